@@ -0,0 +1,180 @@
+/*
+ * Copyright (c) 2014-2015 Nicolas Martyanoff
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <core.h>
+
+#include "../src/json.h"
+
+/* Compare the time needed to load a document from its text representation
+ * with json_parse(), from its compact binary encoding decoded into a value
+ * tree, and from a frozen image opened in place. Trusted images opened in
+ * place are accessed lazily, so the benchmark reads one member of every
+ * record. */
+
+#define BENCH_NB_RECORDS 100000
+#define BENCH_NB_RUNS    5
+
+static struct json_value *bench_document(size_t);
+static int64_t bench_read_frozen(const struct json_frozen_value *);
+static double bench_now(void);
+static void bench_report(const char *, double, double, size_t);
+
+static volatile int64_t bench_sink;
+
+int
+main(int argc, char **argv) {
+    const struct json_frozen *frozen;
+    struct json_frozen *image;
+    struct json_value *value;
+    char *text, *binary;
+    size_t text_len, binary_len, image_len;
+    double start, parse_time, decode_time, open_time, check_time;
+
+    value = bench_document(BENCH_NB_RECORDS);
+
+    text = json_value_format(value, JSON_FORMAT_DEFAULT, &text_len);
+    binary = json_value_encode_binary(value, &binary_len);
+    image = json_freeze(value);
+    if (!text || !binary || !image) {
+        fprintf(stderr, "cannot encode document: %s\n", c_get_error());
+        exit(1);
+    }
+    image_len = json_frozen_size(image);
+
+    json_value_delete(value);
+
+    printf("text: %zu bytes, binary: %zu bytes, frozen: %zu bytes\n\n",
+           text_len, binary_len, image_len);
+
+    parse_time = decode_time = open_time = check_time = 0.0;
+
+    for (int run = 0; run < BENCH_NB_RUNS; run++) {
+        start = bench_now();
+        value = json_parse(text, text_len, JSON_PARSE_DEFAULT);
+        parse_time += bench_now() - start;
+        if (!value) {
+            fprintf(stderr, "cannot parse document: %s\n", c_get_error());
+            exit(1);
+        }
+        json_value_delete(value);
+
+        start = bench_now();
+        value = json_value_decode_binary(binary, binary_len);
+        decode_time += bench_now() - start;
+        if (!value) {
+            fprintf(stderr, "cannot decode document: %s\n", c_get_error());
+            exit(1);
+        }
+        json_value_delete(value);
+
+        start = bench_now();
+        if (!json_frozen_open(image, image_len, JSON_FROZEN_OPEN_DEFAULT)) {
+            fprintf(stderr, "cannot open document: %s\n", c_get_error());
+            exit(1);
+        }
+        check_time += bench_now() - start;
+
+        start = bench_now();
+        frozen = json_frozen_open(image, image_len, JSON_FROZEN_OPEN_TRUSTED);
+        if (!frozen) {
+            fprintf(stderr, "cannot open document: %s\n", c_get_error());
+            exit(1);
+        }
+        bench_sink += bench_read_frozen(json_frozen_root(frozen));
+        open_time += bench_now() - start;
+    }
+
+    printf("%-24s %12s %12s %10s\n", "method", "ms", "MB/s", "speedup");
+    bench_report("json_parse", parse_time, parse_time, text_len);
+    bench_report("decode_binary", decode_time, parse_time, binary_len);
+    bench_report("frozen_open", check_time, parse_time, image_len);
+    bench_report("frozen_open+read", open_time, parse_time, image_len);
+
+    json_frozen_delete(image);
+    c_free(binary);
+    c_free(text);
+    return 0;
+}
+
+static struct json_value *
+bench_document(size_t nb_records) {
+    struct json_value *records;
+
+    records = json_array_new();
+
+    for (size_t i = 0; i < nb_records; i++) {
+        struct json_value *record, *tags;
+
+        record = json_object_new();
+        json_object_add_member(record, "id", json_integer_new((int64_t)i));
+        json_object_add_member(record, "name",
+                               json_string_new_printf("record %zu", i));
+        json_object_add_member(record, "score",
+                               json_real_new((double)i / 7.0));
+        json_object_add_member(record, "enabled", json_boolean_new(i % 2));
+        json_object_add_member(record, "parent", json_null_new());
+
+        tags = json_array_new();
+        json_array_add_element(tags, json_string_new("alpha"));
+        json_array_add_element(tags, json_string_new("beta"));
+        json_object_add_member(record, "tags", tags);
+
+        json_array_add_element(records, record);
+    }
+
+    return records;
+}
+
+static int64_t
+bench_read_frozen(const struct json_frozen_value *records) {
+    size_t nb_records;
+    int64_t sum;
+
+    nb_records = json_frozen_array_nb_elements(records);
+    sum = 0;
+
+    for (size_t i = 0; i < nb_records; i++) {
+        const struct json_frozen_value *record;
+
+        record = json_frozen_array_element(records, i);
+        sum += json_frozen_integer_value(json_frozen_object_member(record,
+                                                                   "id"));
+    }
+
+    return sum;
+}
+
+static double
+bench_now(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+static void
+bench_report(const char *name, double time, double reference, size_t len) {
+    time /= BENCH_NB_RUNS;
+    reference /= BENCH_NB_RUNS;
+
+    printf("%-24s %12.3f %12.1f %9.1fx\n", name, time * 1e3,
+           (double)len / time / 1e6, reference / time);
+}
@@ -0,0 +1,207 @@
+/*
+ * Copyright (c) 2014-2015 Nicolas Martyanoff
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <core.h>
+
+#include "../src/json.h"
+
+/* Compare the size and the encoding and decoding times of JSON text, CBOR
+ * and MessagePack on documents with different shapes. Throughputs are given
+ * in megabytes of encoded data per second, so times are the figures to
+ * compare between formats. */
+
+#define BENCH_NB_RUNS 5
+
+struct bench_format {
+    const char *name;
+
+    char *(*encode)(const struct json_value *, size_t *);
+    struct json_value *(*decode)(const void *, size_t);
+};
+
+static char *bench_encode_text(const struct json_value *, size_t *);
+static struct json_value *bench_decode_text(const void *, size_t);
+
+static const struct bench_format bench_formats[] = {
+    {"json", bench_encode_text, bench_decode_text},
+    {"cbor", json_value_encode_cbor, json_value_decode_cbor},
+    {"msgpack", json_value_encode_msgpack, json_value_decode_msgpack},
+};
+
+static void bench_document(const char *, struct json_value *);
+static struct json_value *bench_records(size_t);
+static struct json_value *bench_numbers(size_t);
+static struct json_value *bench_strings(size_t);
+static double bench_now(void);
+
+int
+main(int argc, char **argv) {
+    printf("%-10s %-8s %10s %10s %10s %12s %12s\n",
+           "document", "format", "size", "encode ms", "decode ms",
+           "encode MB/s", "decode MB/s");
+
+    bench_document("records", bench_records(50000));
+    bench_document("numbers", bench_numbers(1000000));
+    bench_document("strings", bench_strings(200000));
+
+    return 0;
+}
+
+static void
+bench_document(const char *name, struct json_value *value) {
+    size_t nb_formats;
+
+    nb_formats = sizeof(bench_formats) / sizeof(bench_formats[0]);
+
+    for (size_t i = 0; i < nb_formats; i++) {
+        const struct bench_format *format;
+        double start, encode_time, decode_time;
+        size_t len;
+        char *data;
+
+        format = bench_formats + i;
+
+        data = NULL;
+        len = 0;
+
+        encode_time = 0.0;
+        for (int run = 0; run < BENCH_NB_RUNS; run++) {
+            c_free(data);
+
+            start = bench_now();
+            data = format->encode(value, &len);
+            encode_time += bench_now() - start;
+
+            if (!data) {
+                fprintf(stderr, "cannot encode %s document: %s\n",
+                        format->name, c_get_error());
+                exit(1);
+            }
+        }
+
+        decode_time = 0.0;
+        for (int run = 0; run < BENCH_NB_RUNS; run++) {
+            struct json_value *decoded;
+
+            start = bench_now();
+            decoded = format->decode(data, len);
+            decode_time += bench_now() - start;
+
+            if (!decoded) {
+                fprintf(stderr, "cannot decode %s document: %s\n",
+                        format->name, c_get_error());
+                exit(1);
+            }
+
+            json_value_delete(decoded);
+        }
+
+        encode_time /= BENCH_NB_RUNS;
+        decode_time /= BENCH_NB_RUNS;
+
+        printf("%-10s %-8s %10zu %10.2f %10.2f %12.1f %12.1f\n",
+               name, format->name, len, encode_time * 1e3, decode_time * 1e3,
+               (double)len / encode_time / 1e6,
+               (double)len / decode_time / 1e6);
+
+        c_free(data);
+    }
+
+    json_value_delete(value);
+}
+
+static char *
+bench_encode_text(const struct json_value *value, size_t *plen) {
+    return json_value_format((struct json_value *)value, JSON_FORMAT_DEFAULT,
+                             plen);
+}
+
+static struct json_value *
+bench_decode_text(const void *data, size_t len) {
+    return json_parse(data, len, JSON_PARSE_DEFAULT);
+}
+
+static struct json_value *
+bench_records(size_t nb_records) {
+    struct json_value *records;
+
+    records = json_array_new();
+
+    for (size_t i = 0; i < nb_records; i++) {
+        struct json_value *record;
+
+        record = json_object_new();
+        json_object_add_member(record, "id", json_integer_new((int64_t)i));
+        json_object_add_member(record, "name",
+                               json_string_new_printf("record %zu", i));
+        json_object_add_member(record, "score",
+                               json_real_new((double)i / 7.0));
+        json_object_add_member(record, "enabled", json_boolean_new(i % 2));
+        json_object_add_member(record, "parent", json_null_new());
+
+        json_array_add_element(records, record);
+    }
+
+    return records;
+}
+
+static struct json_value *
+bench_numbers(size_t nb_numbers) {
+    struct json_value *numbers;
+
+    numbers = json_array_new();
+
+    for (size_t i = 0; i < nb_numbers; i++) {
+        if (i % 2 == 0) {
+            json_array_add_element(numbers,
+                                   json_integer_new((int64_t)(i * i) - 1000));
+        } else {
+            json_array_add_element(numbers,
+                                   json_real_new((double)i * 0.001));
+        }
+    }
+
+    return numbers;
+}
+
+static struct json_value *
+bench_strings(size_t nb_strings) {
+    struct json_value *strings;
+
+    strings = json_array_new();
+
+    for (size_t i = 0; i < nb_strings; i++) {
+        json_array_add_element(strings,
+                               json_string_new_printf("the quick brown fox"
+                                                      " jumps over the lazy"
+                                                      " dog %zu", i));
+    }
+
+    return strings;
+}
+
+static double
+bench_now(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
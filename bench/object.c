@@ -0,0 +1,171 @@
+/*
+ * Copyright (c) 2014-2015 Nicolas Martyanoff
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <core.h>
+
+#include "../src/json.h"
+
+/* Compare member lookups on objects of various sizes between the current
+ * struct-of-arrays layout and the previous array of members, where each
+ * member held a full string value as its key and lookups compared key
+ * strings one member after the other. */
+
+#define BENCH_NB_LOOKUPS 4000000
+
+struct bench_legacy_member {
+    struct json_value *key;
+    size_t index;
+    struct json_value *value;
+};
+
+struct bench_legacy_object {
+    struct bench_legacy_member *members;
+    size_t nb_members;
+};
+
+static void bench_object(size_t);
+
+static struct json_value *bench_legacy_lookup(struct bench_legacy_object *,
+                                              const char *, size_t);
+static double bench_now(void);
+
+static volatile size_t bench_sink;
+
+int
+main(int argc, char **argv) {
+    static const size_t sizes[] = {8, 64, 1024};
+
+    printf("%-10s %-8s %12s %12s\n",
+           "members", "layout", "ns/lookup", "Mlookups/s");
+
+    for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++)
+        bench_object(sizes[i]);
+
+    return 0;
+}
+
+static void
+bench_object(size_t nb_members) {
+    struct bench_legacy_object legacy;
+    struct json_value *object;
+    char **keys;
+    size_t *key_lens;
+    size_t nb_lookups;
+    double start, soa_time, legacy_time;
+
+    object = json_object_new();
+
+    keys = c_malloc(nb_members * sizeof(char *));
+    key_lens = c_malloc(nb_members * sizeof(size_t));
+
+    legacy.members = c_malloc(nb_members * sizeof(struct bench_legacy_member));
+    legacy.nb_members = nb_members;
+
+    for (size_t i = 0; i < nb_members; i++) {
+        char tmp[32];
+        int len;
+
+        /* Keys share a common prefix, as they usually do in real
+         * documents */
+        len = snprintf(tmp, sizeof(tmp), "member_%zu", i);
+
+        keys[i] = c_strndup(tmp, (size_t)len);
+        key_lens[i] = (size_t)len;
+
+        if (json_object_add_member(object, tmp,
+                                   json_integer_new((int64_t)i)) == -1) {
+            fprintf(stderr, "cannot add member: %s\n", c_get_error());
+            exit(1);
+        }
+
+        legacy.members[i].key = json_string_new2(tmp, (size_t)len);
+        legacy.members[i].index = i;
+        legacy.members[i].value = json_integer_new((int64_t)i);
+    }
+
+    /* Large objects are looked up less often to keep running time
+     * reasonable with the linear legacy layout. */
+    nb_lookups = BENCH_NB_LOOKUPS / (nb_members / 8);
+
+    start = bench_now();
+    for (size_t i = 0; i < nb_lookups; i++) {
+        size_t idx;
+
+        idx = (i * 7919) % nb_members;
+        bench_sink += (size_t)json_object_member2(object, keys[idx],
+                                                  key_lens[idx]);
+    }
+    soa_time = bench_now() - start;
+
+    start = bench_now();
+    for (size_t i = 0; i < nb_lookups; i++) {
+        size_t idx;
+
+        idx = (i * 7919) % nb_members;
+        bench_sink += (size_t)bench_legacy_lookup(&legacy, keys[idx],
+                                                  key_lens[idx]);
+    }
+    legacy_time = bench_now() - start;
+
+    printf("%-10zu %-8s %12.1f %12.2f\n", nb_members, "soa",
+           soa_time * 1e9 / (double)nb_lookups,
+           (double)nb_lookups / soa_time / 1e6);
+    printf("%-10zu %-8s %12.1f %12.2f\n", nb_members, "legacy",
+           legacy_time * 1e9 / (double)nb_lookups,
+           (double)nb_lookups / legacy_time / 1e6);
+
+    for (size_t i = 0; i < nb_members; i++) {
+        json_value_delete(legacy.members[i].key);
+        json_value_delete(legacy.members[i].value);
+        c_free(keys[i]);
+    }
+
+    c_free(legacy.members);
+    c_free(key_lens);
+    c_free(keys);
+
+    json_value_delete(object);
+}
+
+static struct json_value *
+bench_legacy_lookup(struct bench_legacy_object *object,
+                    const char *key, size_t len) {
+    for (size_t i = 0; i < object->nb_members; i++) {
+        struct bench_legacy_member *member;
+
+        member = object->members + i;
+
+        if (json_string_length(member->key) == len
+         && memcmp(json_string_value(member->key), key, len) == 0) {
+            return member->value;
+        }
+    }
+
+    return NULL;
+}
+
+static double
+bench_now(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
@@ -0,0 +1,462 @@
+/*
+ * Copyright (c) 2015 Nicolas Martyanoff
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <errno.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <core.h>
+
+#include "../src/json.h"
+
+/* Measure parsing, projection, formatting, cloning, copying and deletion on
+ * generated corpora of different shapes. Each corpus is processed in its
+ * own process so that peak memory usage is measured for each of them.
+ *
+ * Results are printed as tab separated values, one line per corpus and
+ * operation, so that they can be compared between releases:
+ *
+ *     corpus  operation  bytes  mb_per_s  allocs_per_mb  peak_rss_kb
+ *
+ * Throughputs and allocation counts are relative to the size of the
+ * compact JSON text of the corpus. Allocations are only counted with the
+ * GNU C library; the count is -1 otherwise. */
+
+#define BENCH_NB_RUNS 5
+
+#define BENCH_NB_NUMBERS     500000
+#define BENCH_NB_STRINGS     100000
+#define BENCH_NB_TREES       5000
+#define BENCH_TREE_DEPTH     64
+#define BENCH_NB_WIDE        20
+#define BENCH_NB_WIDE_MEMBERS 5000
+#define BENCH_NB_UNICODE     100000
+
+struct bench_corpus {
+    const char *name;
+    char *(*generate)(size_t *);
+};
+
+static char *bench_generate_numbers(size_t *);
+static char *bench_generate_strings(size_t *);
+static char *bench_generate_nested(size_t *);
+static char *bench_generate_wide(size_t *);
+static char *bench_generate_unicode(size_t *);
+
+static const struct bench_corpus bench_corpora[] = {
+    {"numbers", bench_generate_numbers},
+    {"strings", bench_generate_strings},
+    {"nested",  bench_generate_nested},
+    {"wide",    bench_generate_wide},
+    {"unicode", bench_generate_unicode},
+};
+
+enum bench_operation {
+    BENCH_PARSE,
+    BENCH_PROJECT,
+    BENCH_FORMAT,
+    BENCH_FORMAT_INDENT,
+    BENCH_CLONE_SHARED,
+    BENCH_COPY,
+    BENCH_DELETE,
+};
+
+static const char *bench_operation_names[] = {
+    [BENCH_PARSE]         = "parse",
+    [BENCH_PROJECT]       = "project",
+    [BENCH_FORMAT]        = "format",
+    [BENCH_FORMAT_INDENT] = "format_indent",
+    [BENCH_CLONE_SHARED]  = "clone_shared",
+    [BENCH_COPY]          = "copy",
+    [BENCH_DELETE]        = "delete",
+};
+
+static void bench_corpus(const struct bench_corpus *);
+static void bench_run(const char *, enum bench_operation, const char *,
+                      size_t);
+static char *bench_format(struct json_value *, size_t *);
+static double bench_now(void);
+static long bench_peak_rss(void);
+
+static volatile size_t bench_sink;
+
+#ifdef __GLIBC__
+/* Allocations are counted by wrapping the allocator of the C library, which
+ * is used by both libjson and libcore. */
+void *__libc_malloc(size_t);
+void *__libc_calloc(size_t, size_t);
+void *__libc_realloc(void *, size_t);
+
+static int64_t bench_nb_allocs;
+
+void *
+malloc(size_t sz) {
+    bench_nb_allocs++;
+    return __libc_malloc(sz);
+}
+
+void *
+calloc(size_t nb, size_t sz) {
+    bench_nb_allocs++;
+    return __libc_calloc(nb, sz);
+}
+
+void *
+realloc(void *ptr, size_t sz) {
+    bench_nb_allocs++;
+    return __libc_realloc(ptr, sz);
+}
+#else
+static int64_t bench_nb_allocs = -1;
+#endif
+
+int
+main(int argc, char **argv) {
+    size_t nb_corpora;
+
+    printf("corpus\toperation\tbytes\tmb_per_s\tallocs_per_mb"
+           "\tpeak_rss_kb\n");
+    fflush(stdout);
+
+    nb_corpora = sizeof(bench_corpora) / sizeof(bench_corpora[0]);
+
+    for (size_t i = 0; i < nb_corpora; i++) {
+        pid_t pid;
+        int status;
+
+        pid = fork();
+        if (pid == -1) {
+            fprintf(stderr, "cannot fork: %s\n", strerror(errno));
+            exit(1);
+        }
+
+        if (pid == 0) {
+            bench_corpus(bench_corpora + i);
+            exit(0);
+        }
+
+        if (waitpid(pid, &status, 0) == -1) {
+            fprintf(stderr, "cannot wait for process: %s\n",
+                    strerror(errno));
+            exit(1);
+        }
+
+        if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+            fprintf(stderr, "benchmark failed for corpus %s\n",
+                    bench_corpora[i].name);
+            exit(1);
+        }
+    }
+
+    return 0;
+}
+
+static void
+bench_corpus(const struct bench_corpus *corpus) {
+    char *text;
+    size_t len;
+
+    text = corpus->generate(&len);
+
+    bench_run(corpus->name, BENCH_PARSE, text, len);
+    bench_run(corpus->name, BENCH_PROJECT, text, len);
+    bench_run(corpus->name, BENCH_FORMAT, text, len);
+    bench_run(corpus->name, BENCH_FORMAT_INDENT, text, len);
+    bench_run(corpus->name, BENCH_CLONE_SHARED, text, len);
+    bench_run(corpus->name, BENCH_COPY, text, len);
+    bench_run(corpus->name, BENCH_DELETE, text, len);
+
+    c_free(text);
+}
+
+static void
+bench_run(const char *name, enum bench_operation operation,
+          const char *text, size_t len) {
+    struct json_projection *projection;
+    struct json_value *value;
+    double time, mb;
+    int64_t nb_allocs;
+
+    /* The projected value is in none of the corpora, the whole text is
+     * skipped. */
+    projection = json_projection_new();
+    json_projection_add_pointer(projection, "/none");
+
+    time = 0.0;
+    nb_allocs = 0;
+
+    for (int run = 0; run < BENCH_NB_RUNS; run++) {
+        struct json_value *clone;
+        int64_t allocs_start;
+        double start;
+        char *string;
+        size_t string_len;
+
+        /* Only the operation itself is measured */
+        value = NULL;
+        if (operation != BENCH_PARSE && operation != BENCH_PROJECT) {
+            value = json_parse(text, len, JSON_PARSE_DEFAULT);
+            if (!value) {
+                fprintf(stderr, "cannot parse %s corpus: %s\n",
+                        name, c_get_error());
+                exit(1);
+            }
+        }
+
+        clone = NULL;
+        string = NULL;
+
+        allocs_start = bench_nb_allocs;
+        start = bench_now();
+
+        switch (operation) {
+        case BENCH_PARSE:
+            value = json_parse(text, len, JSON_PARSE_DEFAULT);
+            break;
+
+        case BENCH_PROJECT:
+            if (json_parse_project(text, len, JSON_PARSE_DEFAULT,
+                                   projection, &value) == -1) {
+                fprintf(stderr, "cannot parse %s corpus: %s\n",
+                        name, c_get_error());
+                exit(1);
+            }
+            break;
+
+        case BENCH_FORMAT:
+            string = json_value_format(value, JSON_FORMAT_DEFAULT,
+                                       &string_len);
+            break;
+
+        case BENCH_FORMAT_INDENT:
+            string = json_value_format(value, JSON_FORMAT_INDENT,
+                                       &string_len);
+            break;
+
+        case BENCH_CLONE_SHARED:
+            clone = json_value_clone_shared(value);
+            break;
+
+        case BENCH_COPY:
+            clone = json_value_copy(value);
+            break;
+
+        case BENCH_DELETE:
+            json_value_delete(value);
+            value = NULL;
+            break;
+        }
+
+        time += bench_now() - start;
+        nb_allocs += bench_nb_allocs - allocs_start;
+
+        if (operation == BENCH_PARSE && !value) {
+            fprintf(stderr, "cannot parse %s corpus: %s\n",
+                    name, c_get_error());
+            exit(1);
+        }
+
+        if (string)
+            bench_sink += string_len;
+
+        c_free(string);
+        json_value_delete(clone);
+        json_value_delete(value);
+    }
+
+    json_projection_delete(projection);
+
+    mb = (double)len / 1e6;
+
+    printf("%s\t%s\t%zu\t%.1f\t%.0f\t%ld\n",
+           name, bench_operation_names[operation], len,
+           mb * BENCH_NB_RUNS / time,
+           (bench_nb_allocs < 0)
+               ? -1.0 : (double)nb_allocs / BENCH_NB_RUNS / mb,
+           bench_peak_rss());
+    fflush(stdout);
+}
+
+static char *
+bench_generate_numbers(size_t *plen) {
+    struct json_value *value;
+
+    value = json_array_new();
+
+    for (size_t i = 0; i < BENCH_NB_NUMBERS; i++) {
+        if (i % 2 == 0) {
+            json_array_add_element(value,
+                                   json_integer_new((int64_t)(i * 7919)
+                                                    - 1000000));
+        } else {
+            json_array_add_element(value,
+                                   json_real_new((double)i / 7.0 - 1000.0));
+        }
+    }
+
+    return bench_format(value, plen);
+}
+
+static char *
+bench_generate_strings(size_t *plen) {
+    struct json_value *value;
+
+    value = json_array_new();
+
+    for (size_t i = 0; i < BENCH_NB_STRINGS; i++) {
+        json_array_add_element(value,
+                               json_string_new_printf("string %zu with some"
+                                                      " \"quoted\" text,"
+                                                      " a tab\tand a line"
+                                                      " break\n%.*s",
+                                                      i, (int)(i % 40),
+                                                      "abcdefghijklmnopqrst"
+                                                      "uvwxyz0123456789/\\"
+                                                      "!?"));
+    }
+
+    return bench_format(value, plen);
+}
+
+static char *
+bench_generate_nested(size_t *plen) {
+    struct json_value *value;
+
+    value = json_array_new();
+
+    for (size_t i = 0; i < BENCH_NB_TREES; i++) {
+        struct json_value *tree;
+
+        tree = json_integer_new((int64_t)i);
+
+        for (int depth = 0; depth < BENCH_TREE_DEPTH; depth++) {
+            struct json_value *parent;
+
+            if (depth % 2 == 0) {
+                parent = json_object_new();
+                json_object_add_member(parent, "level",
+                                       json_integer_new(depth));
+                json_object_add_member(parent, "child", tree);
+            } else {
+                parent = json_array_new();
+                json_array_add_element(parent, tree);
+                json_array_add_element(parent, json_boolean_new(true));
+            }
+
+            tree = parent;
+        }
+
+        json_array_add_element(value, tree);
+    }
+
+    return bench_format(value, plen);
+}
+
+static char *
+bench_generate_wide(size_t *plen) {
+    struct json_value *value;
+
+    value = json_array_new();
+
+    for (size_t i = 0; i < BENCH_NB_WIDE; i++) {
+        struct json_value *object;
+
+        object = json_object_new();
+
+        for (size_t j = 0; j < BENCH_NB_WIDE_MEMBERS; j++) {
+            char key[32];
+
+            snprintf(key, sizeof(key), "member_%05zu", j);
+            json_object_add_member(object, key,
+                                   json_integer_new((int64_t)(i + j)));
+        }
+
+        json_array_add_element(value, object);
+    }
+
+    return bench_format(value, plen);
+}
+
+static char *
+bench_generate_unicode(size_t *plen) {
+    static const char *strings[] = {
+        "\"caf\\u00e9 cr\\u00e8me br\\u00fbl\\u00e9e\"",
+        "\"\xe6\x97\xa5\xe6\x9c\xac\xe8\xaa\x9e\xe3\x81\xae\xe3\x83\x86"
+        "\xe3\x82\xad\xe3\x82\xb9\xe3\x83\x88\"",
+        "\"\\ud83d\\ude00 \\ud83c\\udf89 \xf0\x9f\x9a\x80\"",
+        "\"\xd0\xbf\xd1\x80\xd0\xb8\xd0\xb2\xd0\xb5\xd1\x82 \xd0\xbc"
+        "\xd0\xb8\xd1\x80\"",
+    };
+
+    struct c_buffer *buf;
+    char *text;
+
+    /* Strings contain both raw UTF-8 sequences and escape sequences, which
+     * the formatter would not produce. */
+    buf = c_buffer_new();
+
+    c_buffer_add_string(buf, "[");
+    for (size_t i = 0; i < BENCH_NB_UNICODE; i++) {
+        if (i > 0)
+            c_buffer_add_string(buf, ",");
+        c_buffer_add_string(buf, strings[i % 4]);
+    }
+    c_buffer_add_string(buf, "]");
+
+    text = c_buffer_extract_string(buf, plen);
+    c_buffer_delete(buf);
+
+    return text;
+}
+
+static char *
+bench_format(struct json_value *value, size_t *plen) {
+    char *text;
+
+    text = json_value_format(value, JSON_FORMAT_DEFAULT, plen);
+    if (!text) {
+        fprintf(stderr, "cannot format corpus: %s\n", c_get_error());
+        exit(1);
+    }
+
+    json_value_delete(value);
+    return text;
+}
+
+static double
+bench_now(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+static long
+bench_peak_rss(void) {
+    struct rusage usage;
+
+    if (getrusage(RUSAGE_SELF, &usage) == -1)
+        return -1;
+
+    return usage.ru_maxrss;
+}
@@ -0,0 +1,612 @@
+/*
+ * Copyright (c) 2015 Nicolas Martyanoff
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <core.h>
+
+#include "../src/json.h"
+
+/* Measure the time needed to validate API request documents against the
+ * schemas they are checked with in production: a complete order request
+ * schema, a schema which only checks the type of each member, and a wide
+ * schema with hundreds of properties. Generated documents are then checked
+ * against schemas stressing a single feature: recursive references,
+ * regular expressions and large enumerations.
+ *
+ * When the library is built with profile=1, the number of checks of each
+ * keyword and the time they took are printed below each schema. Timing each
+ * check has a cost of its own, so these figures are only meaningful relative
+ * to each other.
+ *
+ * Request bodies are then validated from their text, either by parsing
+ * them and validating the tree, or by validating them while parsing, with
+ * and without building the document.
+ *
+ * A batch of requests stored in a single array is also validated in the
+ * calling thread and with a pool of threads. */
+
+#define BENCH_NB_DOCUMENTS      10000
+#define BENCH_NB_WIDE_DOCUMENTS 1000
+#define BENCH_NB_RUNS           20
+
+#define BENCH_NB_WIDE_PROPERTIES 300
+#define BENCH_NB_WIDE_REQUIRED   100
+
+#define BENCH_TREE_DEPTH  4
+#define BENCH_TREE_FANOUT 3
+
+#define BENCH_NB_ENUM_VALUES 200
+#define BENCH_NB_ENUM_TAGS   20
+
+static const char *bench_order_schema =
+    "{"
+    "  \"type\": \"object\","
+    "  \"required\": [\"id\", \"customer\", \"items\", \"currency\"],"
+    "  \"additionalProperties\": false,"
+    "  \"properties\": {"
+    "    \"id\": {\"type\": \"string\", \"pattern\": \"^[0-9a-f]{8}$\"},"
+    "    \"customer\": {"
+    "      \"type\": \"object\","
+    "      \"required\": [\"name\", \"email\"],"
+    "      \"properties\": {"
+    "        \"name\": {\"type\": \"string\", \"minLength\": 1,"
+    "                   \"maxLength\": 64},"
+    "        \"email\": {\"type\": \"string\", \"maxLength\": 128}"
+    "      }"
+    "    },"
+    "    \"items\": {"
+    "      \"type\": \"array\","
+    "      \"minItems\": 1,"
+    "      \"maxItems\": 100,"
+    "      \"items\": {"
+    "        \"type\": \"object\","
+    "        \"required\": [\"sku\", \"quantity\"],"
+    "        \"properties\": {"
+    "          \"sku\": {\"type\": \"string\"},"
+    "          \"quantity\": {\"type\": \"integer\", \"minimum\": 1},"
+    "          \"price\": {\"type\": \"number\", \"minimum\": 0}"
+    "        }"
+    "      }"
+    "    },"
+    "    \"currency\": {\"enum\": [\"EUR\", \"USD\", \"GBP\"]},"
+    "    \"priority\": {\"type\": \"integer\", \"minimum\": 0,"
+    "                   \"maximum\": 9},"
+    "    \"tags\": {\"type\": \"array\", \"items\": {\"type\": \"string\"}}"
+    "  }"
+    "}";
+
+static const char *bench_type_schema =
+    "{"
+    "  \"type\": \"object\","
+    "  \"properties\": {"
+    "    \"id\": {\"type\": \"string\"},"
+    "    \"customer\": {\"type\": \"object\"},"
+    "    \"items\": {\"type\": \"array\"},"
+    "    \"currency\": {\"type\": \"string\"},"
+    "    \"priority\": {\"type\": \"integer\"},"
+    "    \"tags\": {\"type\": \"array\"}"
+    "  }"
+    "}";
+
+static const char *bench_tree_schema =
+    "{"
+    "  \"definitions\": {"
+    "    \"node\": {"
+    "      \"type\": \"object\","
+    "      \"required\": [\"id\", \"children\"],"
+    "      \"properties\": {"
+    "        \"id\": {\"type\": \"integer\", \"minimum\": 0},"
+    "        \"label\": {\"$ref\": \"#/definitions/label\"},"
+    "        \"children\": {"
+    "          \"type\": \"array\","
+    "          \"items\": {\"$ref\": \"#/definitions/node\"}"
+    "        }"
+    "      }"
+    "    },"
+    "    \"label\": {\"type\": \"string\", \"maxLength\": 32}"
+    "  },"
+    "  \"$ref\": \"#/definitions/node\""
+    "}";
+
+static const char *bench_regex_schema =
+    "{"
+    "  \"type\": \"object\","
+    "  \"properties\": {"
+    "    \"email\": {\"type\": \"string\","
+    "              \"pattern\": \"^[^@ ]+@[^@ ]+\\\\.[a-z]{2,}$\"},"
+    "    \"phone\": {\"type\": \"string\","
+    "              \"pattern\": \"^\\\\+?[0-9 ()-]{7,20}$\"},"
+    "    \"zip\": {\"type\": \"string\","
+    "            \"pattern\": \"^[0-9]{5}(-[0-9]{4})?$\"}"
+    "  },"
+    "  \"patternProperties\": {"
+    "    \"^x-[a-z]+$\": {\"type\": \"string\","
+    "                    \"pattern\": \"^[A-Za-z0-9+/]+=*$\"},"
+    "    \"^[0-9]+$\": {\"type\": \"integer\"}"
+    "  },"
+    "  \"additionalProperties\": false"
+    "}";
+
+static void bench_schema(const char *, const char *, struct json_value **,
+                         size_t);
+static void bench_profile(void);
+static void bench_parse(const char *, const char *, char **, size_t);
+static void bench_parallel(struct json_value **, size_t);
+static struct json_value *bench_request(size_t);
+static char *bench_wide_schema(void);
+static struct json_value *bench_wide_request(size_t);
+static struct json_value *bench_tree_request(size_t, int);
+static struct json_value *bench_regex_request(size_t);
+static char *bench_enum_schema(void);
+static struct json_value *bench_enum_request(size_t);
+static double bench_now(void);
+
+int
+main(int argc, char **argv) {
+    struct json_value **documents;
+    char *wide_schema, *enum_schema;
+    char **texts;
+
+    documents = c_malloc(BENCH_NB_DOCUMENTS * sizeof(struct json_value *));
+    for (size_t i = 0; i < BENCH_NB_DOCUMENTS; i++)
+        documents[i] = bench_request(i);
+
+    bench_parallel(documents, BENCH_NB_DOCUMENTS);
+
+    printf("\n%-10s %14s %14s\n", "schema", "ns/document", "documents/s");
+
+    bench_schema("order", bench_order_schema, documents, BENCH_NB_DOCUMENTS);
+    bench_schema("type", bench_type_schema, documents, BENCH_NB_DOCUMENTS);
+
+    texts = c_malloc(BENCH_NB_DOCUMENTS * sizeof(char *));
+    for (size_t i = 0; i < BENCH_NB_DOCUMENTS; i++) {
+        texts[i] = json_value_format(documents[i], JSON_FORMAT_DEFAULT, NULL);
+        json_value_delete(documents[i]);
+    }
+
+    for (size_t i = 0; i < BENCH_NB_WIDE_DOCUMENTS; i++)
+        documents[i] = bench_wide_request(i);
+
+    wide_schema = bench_wide_schema();
+    bench_schema("wide", wide_schema, documents, BENCH_NB_WIDE_DOCUMENTS);
+    c_free(wide_schema);
+
+    for (size_t i = 0; i < BENCH_NB_WIDE_DOCUMENTS; i++) {
+        json_value_delete(documents[i]);
+        documents[i] = bench_tree_request(i, BENCH_TREE_DEPTH);
+    }
+
+    bench_schema("tree", bench_tree_schema, documents,
+                 BENCH_NB_WIDE_DOCUMENTS);
+
+    for (size_t i = 0; i < BENCH_NB_WIDE_DOCUMENTS; i++)
+        json_value_delete(documents[i]);
+
+    for (size_t i = 0; i < BENCH_NB_DOCUMENTS; i++)
+        documents[i] = bench_regex_request(i);
+
+    bench_schema("regex", bench_regex_schema, documents, BENCH_NB_DOCUMENTS);
+
+    for (size_t i = 0; i < BENCH_NB_DOCUMENTS; i++) {
+        json_value_delete(documents[i]);
+        documents[i] = bench_enum_request(i);
+    }
+
+    enum_schema = bench_enum_schema();
+    bench_schema("enum", enum_schema, documents, BENCH_NB_DOCUMENTS);
+    c_free(enum_schema);
+
+    for (size_t i = 0; i < BENCH_NB_DOCUMENTS; i++)
+        json_value_delete(documents[i]);
+
+    c_free(documents);
+
+    printf("\n%-10s %14s %14s %14s\n", "schema", "parse+check ns",
+           "fused ns", "fused+tree ns");
+
+    bench_parse("order", bench_order_schema, texts, BENCH_NB_DOCUMENTS);
+    bench_parse("type", bench_type_schema, texts, BENCH_NB_DOCUMENTS);
+    bench_parse("invalid", "{\"type\": \"object\","
+                           " \"properties\": {\"id\": {\"type\": \"integer\"}}}",
+                texts, BENCH_NB_DOCUMENTS);
+
+    for (size_t i = 0; i < BENCH_NB_DOCUMENTS; i++)
+        c_free(texts[i]);
+    c_free(texts);
+
+    return 0;
+}
+
+static void
+bench_schema(const char *name, const char *string,
+             struct json_value **documents, size_t nb_documents) {
+    struct json_schema *schema;
+    double start, time;
+
+    schema = json_schema_parse_string(string);
+    if (!schema) {
+        fprintf(stderr, "cannot parse %s schema: %s\n", name, c_get_error());
+        exit(1);
+    }
+
+    json_schema_profile_reset();
+
+    start = bench_now();
+
+    for (int run = 0; run < BENCH_NB_RUNS; run++) {
+        for (size_t i = 0; i < nb_documents; i++) {
+            if (json_schema_validate(schema, documents[i]) == -1) {
+                fprintf(stderr, "invalid document %zu for %s schema: %s\n",
+                        i, name, c_get_error());
+                exit(1);
+            }
+        }
+    }
+
+    time = (bench_now() - start) / BENCH_NB_RUNS / (double)nb_documents;
+
+    printf("%-10s %14.1f %14.0f\n", name, time * 1e9, 1.0 / time);
+
+    bench_profile();
+
+    json_schema_delete(schema);
+}
+
+static void
+bench_profile(void) {
+    struct json_schema_profile_entry entries[32];
+    uint64_t total_time;
+    size_t nb_entries;
+
+    nb_entries = json_schema_profile_entries(entries, 32);
+    if (nb_entries == 0)
+        return;
+
+    total_time = 0;
+    for (size_t i = 0; i < nb_entries; i++)
+        total_time += entries[i].time;
+
+    for (size_t i = 0; i < nb_entries; i++) {
+        const struct json_schema_profile_entry *entry;
+
+        entry = entries + i;
+
+        printf("  %-22s %12"PRIu64" checks %10.1f ns/check %6.1f%%\n",
+               entry->keyword, entry->count,
+               (double)entry->time / (double)entry->count,
+               (double)entry->time * 100.0 / (double)total_time);
+    }
+}
+
+static void
+bench_parse(const char *name, const char *string, char **texts,
+            size_t nb_texts) {
+    struct json_schema *schema;
+    double start, times[3];
+
+    schema = json_schema_parse_string(string);
+    if (!schema) {
+        fprintf(stderr, "cannot parse %s schema: %s\n", name, c_get_error());
+        exit(1);
+    }
+
+    /* The invalid schema rejects the first member of each document, so
+     * results are not checked. */
+    for (int mode = 0; mode < 3; mode++) {
+        start = bench_now();
+
+        for (int run = 0; run < BENCH_NB_RUNS; run++) {
+            for (size_t i = 0; i < nb_texts; i++) {
+                struct json_value *value;
+
+                value = NULL;
+
+                if (mode == 0) {
+                    value = json_parse(texts[i], strlen(texts[i]),
+                                       JSON_PARSE_DEFAULT);
+                    if (value)
+                        json_schema_validate(schema, value);
+                } else {
+                    json_parse_validate(texts[i], strlen(texts[i]),
+                                        JSON_PARSE_DEFAULT, schema,
+                                        (mode == 2) ? &value : NULL);
+                }
+
+                json_value_delete(value);
+            }
+        }
+
+        times[mode] = (bench_now() - start) / BENCH_NB_RUNS
+                    / (double)nb_texts;
+    }
+
+    printf("%-10s %14.1f %14.1f %14.1f\n", name,
+           times[0] * 1e9, times[1] * 1e9, times[2] * 1e9);
+
+    json_schema_delete(schema);
+}
+
+static void
+bench_parallel(struct json_value **documents, size_t nb_documents) {
+    struct json_schema_pool *pool;
+    struct json_schema *schema;
+    struct json_value *batch;
+    double start, times[2];
+    char *string;
+
+    c_asprintf(&string, "{\"type\": \"array\", \"items\": %s}",
+               bench_order_schema);
+    schema = json_schema_parse_string(string);
+    c_free(string);
+    if (!schema) {
+        fprintf(stderr, "cannot parse batch schema: %s\n", c_get_error());
+        exit(1);
+    }
+
+    pool = json_schema_pool_new(0);
+    if (!pool) {
+        fprintf(stderr, "cannot create pool: %s\n", c_get_error());
+        exit(1);
+    }
+
+    batch = json_array_new();
+    for (size_t i = 0; i < nb_documents; i++)
+        json_array_add_element(batch, json_value_clone(documents[i]));
+
+    for (int mode = 0; mode < 2; mode++) {
+        start = bench_now();
+
+        for (int run = 0; run < BENCH_NB_RUNS; run++) {
+            int ret;
+
+            if (mode == 0) {
+                ret = json_schema_validate(schema, batch);
+            } else {
+                ret = json_schema_validate_parallel(schema, batch, pool);
+            }
+
+            if (ret == -1) {
+                fprintf(stderr, "invalid batch: %s\n", c_get_error());
+                exit(1);
+            }
+        }
+
+        times[mode] = (bench_now() - start) / BENCH_NB_RUNS;
+    }
+
+    printf("%-10s %14s %14s\n", "batch", "sequential ms", "parallel ms");
+    printf("%-10s %14.2f %14.2f\n", "order", times[0] * 1e3, times[1] * 1e3);
+
+    json_value_delete(batch);
+    json_schema_pool_delete(pool);
+    json_schema_delete(schema);
+}
+
+static struct json_value *
+bench_request(size_t n) {
+    struct json_value *request, *customer, *items, *tags;
+
+    request = json_object_new();
+
+    json_object_add_member(request, "id",
+                           json_string_new_printf("%08zx", n));
+
+    customer = json_object_new();
+    json_object_add_member(customer, "name",
+                           json_string_new_printf("customer %zu", n));
+    json_object_add_member(customer, "email",
+                           json_string_new_printf("customer-%zu@example.com",
+                                                  n));
+    json_object_add_member(request, "customer", customer);
+
+    items = json_array_new();
+    for (size_t i = 0; i < 1 + n % 5; i++) {
+        struct json_value *item;
+
+        item = json_object_new();
+        json_object_add_member(item, "sku",
+                               json_string_new_printf("SKU-%zu", i));
+        json_object_add_member(item, "quantity",
+                               json_integer_new((int64_t)(1 + i)));
+        json_object_add_member(item, "price",
+                               json_real_new((double)i * 2.5));
+        json_array_add_element(items, item);
+    }
+    json_object_add_member(request, "items", items);
+
+    json_object_add_member(request, "currency", json_string_new("EUR"));
+    json_object_add_member(request, "priority",
+                           json_integer_new((int64_t)(n % 10)));
+
+    tags = json_array_new();
+    json_array_add_element(tags, json_string_new("web"));
+    json_array_add_element(tags, json_string_new("priority"));
+    json_object_add_member(request, "tags", tags);
+
+    return request;
+}
+
+static char *
+bench_wide_schema(void) {
+    struct c_buffer *buf;
+    char *string;
+
+    buf = c_buffer_new();
+
+    c_buffer_add_string(buf, "{\"type\": \"object\", \"properties\": {");
+    for (int i = 0; i < BENCH_NB_WIDE_PROPERTIES; i++) {
+        c_buffer_add_printf(buf, "%s\"field_%03d\": {\"type\": \"%s\"}",
+                            (i > 0) ? ", " : "", i,
+                            (i % 2 == 0) ? "integer" : "string");
+    }
+
+    c_buffer_add_string(buf, "}, \"required\": [");
+    for (int i = 0; i < BENCH_NB_WIDE_REQUIRED; i++) {
+        c_buffer_add_printf(buf, "%s\"field_%03d\"", (i > 0) ? ", " : "",
+                            i * 3);
+    }
+    c_buffer_add_string(buf, "]}");
+
+    string = c_buffer_extract_string(buf, NULL);
+    c_buffer_delete(buf);
+
+    return string;
+}
+
+static struct json_value *
+bench_wide_request(size_t n) {
+    struct json_value *request;
+
+    request = json_object_new();
+
+    for (int i = 0; i < BENCH_NB_WIDE_PROPERTIES; i++) {
+        struct json_value *value;
+        char key[32];
+
+        snprintf(key, sizeof(key), "field_%03d", i);
+
+        if (i % 2 == 0) {
+            value = json_integer_new((int64_t)(n + (size_t)i));
+        } else {
+            value = json_string_new_printf("value %zu", n);
+        }
+
+        json_object_add_member(request, key, value);
+    }
+
+    return request;
+}
+
+static struct json_value *
+bench_tree_request(size_t n, int depth) {
+    struct json_value *node, *children;
+
+    node = json_object_new();
+
+    json_object_add_member(node, "id", json_integer_new((int64_t)n));
+    json_object_add_member(node, "label",
+                           json_string_new_printf("node %zu", n));
+
+    children = json_array_new();
+    if (depth > 0) {
+        for (size_t i = 0; i < BENCH_TREE_FANOUT; i++) {
+            json_array_add_element(children,
+                                   bench_tree_request(n * BENCH_TREE_FANOUT
+                                                      + i, depth - 1));
+        }
+    }
+    json_object_add_member(node, "children", children);
+
+    return node;
+}
+
+static struct json_value *
+bench_regex_request(size_t n) {
+    struct json_value *request;
+
+    request = json_object_new();
+
+    json_object_add_member(request, "email",
+                           json_string_new_printf("user.%zu@example.com", n));
+    json_object_add_member(request, "phone",
+                           json_string_new_printf("+33 (1) %08zu", n));
+    json_object_add_member(request, "zip",
+                           json_string_new_printf("%05zu-%04zu",
+                                                  n % 100000, n % 10000));
+
+    for (int i = 0; i < 10; i++) {
+        char key[32];
+
+        snprintf(key, sizeof(key), "x-header%c", 'a' + i);
+        json_object_add_member(request, key,
+                               json_string_new_printf("dG9rZW4%zu==", n));
+
+        snprintf(key, sizeof(key), "%d", i);
+        json_object_add_member(request, key,
+                               json_integer_new((int64_t)(n + (size_t)i)));
+    }
+
+    return request;
+}
+
+static char *
+bench_enum_schema(void) {
+    struct c_buffer *buf;
+    char *string;
+
+    buf = c_buffer_new();
+
+    c_buffer_add_string(buf, "{\"type\": \"object\", \"properties\": {"
+                        "\"status\": {\"enum\": [\"pending\", \"paid\","
+                        " \"shipped\", \"delivered\", \"cancelled\"]},"
+                        " \"country\": {\"enum\": [");
+    for (int i = 0; i < BENCH_NB_ENUM_VALUES; i++) {
+        c_buffer_add_printf(buf, "%s\"country-%03d\"", (i > 0) ? ", " : "",
+                            i);
+    }
+
+    c_buffer_add_string(buf, "]}, \"tags\": {\"type\": \"array\","
+                        " \"items\": {\"enum\": [");
+    for (int i = 0; i < BENCH_NB_ENUM_VALUES; i++)
+        c_buffer_add_printf(buf, "%s%d", (i > 0) ? ", " : "", i * 7);
+    c_buffer_add_string(buf, "]}}}}");
+
+    string = c_buffer_extract_string(buf, NULL);
+    c_buffer_delete(buf);
+
+    return string;
+}
+
+static struct json_value *
+bench_enum_request(size_t n) {
+    static const char *statuses[] = {
+        "pending", "paid", "shipped", "delivered", "cancelled",
+    };
+
+    struct json_value *request, *tags;
+
+    request = json_object_new();
+
+    json_object_add_member(request, "status",
+                           json_string_new(statuses[n % 5]));
+    json_object_add_member(request, "country",
+                           json_string_new_printf("country-%03zu",
+                                                  n % BENCH_NB_ENUM_VALUES));
+
+    tags = json_array_new();
+    for (size_t i = 0; i < BENCH_NB_ENUM_TAGS; i++) {
+        size_t tag;
+
+        tag = (n + i * 13) % BENCH_NB_ENUM_VALUES;
+        json_array_add_element(tags, json_integer_new((int64_t)(tag * 7)));
+    }
+    json_object_add_member(request, "tags", tags);
+
+    return request;
+}
+
+static double
+bench_now(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
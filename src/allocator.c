@@ -0,0 +1,182 @@
+/*
+ * Copyright (c) 2015 Nicolas Martyanoff
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <stdarg.h>
+#include <stdio.h>
+
+#include "internal.h"
+
+/* Values, strings, keys and the arrays of objects and arrays are allocated
+ * with the allocator selected for the current thread if there is one, or
+ * with the default allocator otherwise. Values and keys record the
+ * allocator they were created with, and their memory is always released
+ * and resized with it. Schemas are shared between threads and outlive the
+ * scope of a thread allocator: they always use the default allocator. */
+
+static void *json_libcore_alloc(void *, size_t);
+static void *json_libcore_realloc(void *, void *, size_t);
+static void json_libcore_free(void *, void *);
+
+static const struct json_allocator json_libcore_allocator = {
+    .alloc = json_libcore_alloc,
+    .realloc = json_libcore_realloc,
+    .free = json_libcore_free,
+    .data = NULL,
+};
+
+static const struct json_allocator *json_default_allocator =
+    &json_libcore_allocator;
+
+static __thread const struct json_allocator *json_thread_allocator;
+
+void
+json_set_allocator(const struct json_allocator *allocator) {
+    json_default_allocator = allocator ? allocator : &json_libcore_allocator;
+}
+
+const struct json_allocator *
+json_use_allocator(const struct json_allocator *allocator) {
+    const struct json_allocator *previous;
+
+    previous = json_thread_allocator;
+    json_thread_allocator = allocator;
+
+    return previous;
+}
+
+const struct json_allocator *
+json_allocator_current(void) {
+    if (json_thread_allocator)
+        return json_thread_allocator;
+
+    return json_default_allocator;
+}
+
+void *
+json_allocator_malloc(const struct json_allocator *allocator, size_t size) {
+    void *ptr;
+
+    ptr = allocator->alloc(allocator->data, size);
+    if (!ptr) {
+        c_set_error("cannot allocate %zu bytes", size);
+        return NULL;
+    }
+
+    return ptr;
+}
+
+void *
+json_allocator_realloc(const struct json_allocator *allocator, void *ptr,
+                       size_t size) {
+    void *nptr;
+
+    nptr = allocator->realloc(allocator->data, ptr, size);
+    if (!nptr) {
+        c_set_error("cannot reallocate %zu bytes", size);
+        return NULL;
+    }
+
+    return nptr;
+}
+
+void
+json_allocator_free(const struct json_allocator *allocator, void *ptr) {
+    if (!ptr)
+        return;
+
+    allocator->free(allocator->data, ptr);
+}
+
+void *
+json_malloc(size_t size) {
+    return json_allocator_malloc(json_allocator_current(), size);
+}
+
+void *
+json_malloc0(size_t size) {
+    void *ptr;
+
+    ptr = json_malloc(size);
+    if (!ptr)
+        return NULL;
+
+    memset(ptr, 0, size);
+    return ptr;
+}
+
+void *
+json_realloc(void *ptr, size_t size) {
+    return json_allocator_realloc(json_allocator_current(), ptr, size);
+}
+
+void
+json_free(void *ptr) {
+    json_allocator_free(json_allocator_current(), ptr);
+}
+
+char *
+json_strndup(const char *string, size_t len) {
+    char *nstring;
+
+    nstring = json_malloc(len + 1);
+    if (!nstring)
+        return NULL;
+
+    memcpy(nstring, string, len);
+    nstring[len] = '\0';
+
+    return nstring;
+}
+
+int
+json_vasprintf(char **pstring, const char *fmt, va_list ap) {
+    char *string;
+    va_list ap2;
+    int len;
+
+    va_copy(ap2, ap);
+    len = vsnprintf(NULL, 0, fmt, ap2);
+    va_end(ap2);
+
+    if (len < 0) {
+        c_set_error("cannot format string: %s", strerror(errno));
+        return -1;
+    }
+
+    string = json_malloc((size_t)len + 1);
+    if (!string)
+        return -1;
+
+    vsnprintf(string, (size_t)len + 1, fmt, ap);
+
+    *pstring = string;
+    return len;
+}
+
+static void *
+json_libcore_alloc(void *data, size_t size) {
+    return c_malloc(size);
+}
+
+static void *
+json_libcore_realloc(void *data, void *ptr, size_t size) {
+    return c_realloc(ptr, size);
+}
+
+static void
+json_libcore_free(void *data, void *ptr) {
+    c_free(ptr);
+}
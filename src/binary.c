@@ -0,0 +1,810 @@
+/*
+ * Copyright (c) 2014-2015 Nicolas Martyanoff
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include "internal.h"
+
+/* The binary encoding is a compact representation of a value, independent
+ * of the byte order of the host:
+ *
+ * header:       the magic number "JSNB", the version (32 bit) and the total
+ *               size in bytes including the header (64 bit), big endian.
+ * string table: the number of strings, then the length and the bytes of
+ *               each string. Keys and string values are stored only once.
+ * value:        the root value.
+ *
+ * Every value starts with a tag byte containing its type in the low 3 bits
+ * and an argument in the upper 5 bits. Arguments greater than 30 follow the
+ * tag as an unsigned LEB128 integer, the argument in the tag being 31:
+ *
+ * null:    no argument.
+ * boolean: the argument is the value.
+ * integer: the argument is the zigzag encoding of the value.
+ * real:    no argument, the tag is followed by the 64 bit IEEE 754 value,
+ *          big endian.
+ * string:  the argument is the index of the string in the table.
+ * array:   the argument is the number of elements, followed by them.
+ * object:  the argument is the number of members, each member being the
+ *          index of its key in the table as a LEB128 integer followed by
+ *          its value.
+ *
+ * Arrays and objects cannot be nested more than JSON_MAX_DEPTH times.
+ * Documents which must be used in place without any decoding are stored as
+ * frozen documents instead (see frozen.c). */
+
+#define JSON_BINARY_MAGIC       "JSNB"
+#define JSON_BINARY_VERSION     1
+#define JSON_BINARY_HEADER_SIZE 16
+
+#define JSON_BINARY_VARINT 31
+
+enum json_binary_type {
+    JSON_BINARY_NULL    = 0,
+    JSON_BINARY_BOOLEAN = 1,
+    JSON_BINARY_INTEGER = 2,
+    JSON_BINARY_REAL    = 3,
+    JSON_BINARY_STRING  = 4,
+    JSON_BINARY_ARRAY   = 5,
+    JSON_BINARY_OBJECT  = 6,
+};
+
+struct json_binary_string {
+    const char *ptr;
+    size_t len;
+    uint32_t hash;
+
+    struct json_key *key; /* only used when decoding */
+};
+
+struct json_binary_encoder {
+    /* Values are encoded before the string table is complete, and copied
+     * after it once every string has been found. */
+    struct c_buffer *values;
+
+    /* Strings in order of first occurrence */
+    struct json_binary_string *strings;
+    size_t nb_strings;
+    size_t strings_size;
+
+    /* Open addressing table of the indexes of strings plus one */
+    size_t *table;
+    size_t table_size;
+};
+
+struct json_binary_decoder {
+    const uint8_t *ptr;
+    size_t len;
+
+    size_t depth;
+
+    struct json_binary_string *strings;
+    size_t nb_strings;
+};
+
+static int json_binary_encode(const struct json_value *, struct c_buffer *);
+static int json_binary_encode_value(struct json_binary_encoder *,
+                                    const struct json_value *, size_t);
+static int json_binary_encoder_string(struct json_binary_encoder *,
+                                      const char *, size_t, uint32_t,
+                                      size_t *);
+static int json_binary_table_resize(struct json_binary_encoder *, size_t);
+static int json_binary_write_head(struct c_buffer *, enum json_binary_type,
+                                  uint64_t);
+static int json_binary_write_varint(struct c_buffer *, uint64_t);
+
+static int json_binary_decode_value(struct json_binary_decoder *,
+                                    struct json_value **);
+static int json_binary_decode_strings(struct json_binary_decoder *);
+static int json_binary_decode_array(struct json_binary_decoder *, uint64_t,
+                                    struct json_value **);
+static int json_binary_decode_object(struct json_binary_decoder *, uint64_t,
+                                     struct json_value **);
+static int json_binary_read_varint(struct json_binary_decoder *, uint64_t *);
+
+char *
+json_value_encode_binary(const struct json_value *value, size_t *plen) {
+    struct c_buffer *buf;
+    char *data;
+
+    buf = c_buffer_new();
+
+    if (json_binary_encode(value, buf) == -1) {
+        c_buffer_delete(buf);
+        return NULL;
+    }
+
+    data = c_buffer_extract_string(buf, plen);
+    c_buffer_delete(buf);
+
+    return data;
+}
+
+int
+json_value_encode_binary_to_buffer(const struct json_value *value,
+                                   struct c_buffer *buf) {
+    return json_binary_encode(value, buf);
+}
+
+struct json_value *
+json_value_decode_binary(const void *data, size_t len) {
+    struct json_binary_decoder decoder;
+    struct json_value *value;
+    const uint8_t *header;
+    uint64_t size;
+    uint32_t version;
+
+    header = data;
+
+    if (len < JSON_BINARY_HEADER_SIZE) {
+        c_set_error("invalid binary document: truncated header");
+        return NULL;
+    }
+
+    if (memcmp(header, JSON_BINARY_MAGIC, 4) != 0) {
+        c_set_error("invalid binary document: invalid magic number");
+        return NULL;
+    }
+
+    version = json_read_be32(header + 4);
+    if (version != JSON_BINARY_VERSION) {
+        c_set_error("invalid binary document: unsupported version %"PRIu32,
+                    version);
+        return NULL;
+    }
+
+    size = json_read_be64(header + 8);
+    if (size > len) {
+        c_set_error("invalid binary document: truncated document");
+        return NULL;
+    } else if (size < JSON_BINARY_HEADER_SIZE) {
+        c_set_error("invalid binary document: invalid document size");
+        return NULL;
+    }
+
+    memset(&decoder, 0, sizeof(struct json_binary_decoder));
+
+    decoder.ptr = header + JSON_BINARY_HEADER_SIZE;
+    decoder.len = (size_t)size - JSON_BINARY_HEADER_SIZE;
+
+    value = NULL;
+
+    if (json_binary_decode_strings(&decoder) == -1
+     || json_binary_decode_value(&decoder, &value) == -1) {
+        c_set_error("invalid binary document: %s", c_get_error());
+        goto error;
+    }
+
+    if (decoder.len > 0) {
+        c_set_error("invalid binary document: trailing data after root "
+                    "value");
+        goto error;
+    }
+
+    for (size_t i = 0; i < decoder.nb_strings; i++)
+        json_key_unref(decoder.strings[i].key);
+    c_free(decoder.strings);
+
+    return value;
+
+error:
+    for (size_t i = 0; i < decoder.nb_strings; i++)
+        json_key_unref(decoder.strings[i].key);
+    c_free(decoder.strings);
+
+    json_value_delete(value);
+    return NULL;
+}
+
+static int
+json_binary_encode(const struct json_value *value, struct c_buffer *buf) {
+    struct json_binary_encoder encoder;
+    uint8_t header[JSON_BINARY_HEADER_SIZE];
+    size_t start;
+    uint64_t size;
+    int ret;
+
+    memset(&encoder, 0, sizeof(struct json_binary_encoder));
+    encoder.values = c_buffer_new();
+
+    ret = -1;
+
+    if (json_binary_encode_value(&encoder, value, 0) == -1)
+        goto end;
+
+    /* The size is only known once the string table is written */
+    start = c_buffer_length(buf);
+
+    memset(header, 0, sizeof(header));
+    memcpy(header, JSON_BINARY_MAGIC, 4);
+    for (int i = 0; i < 4; i++)
+        header[4 + i] = (uint8_t)(JSON_BINARY_VERSION >> (24 - i * 8));
+
+    if (c_buffer_add(buf, header, sizeof(header)) == -1)
+        goto end;
+
+    if (json_binary_write_varint(buf, encoder.nb_strings) == -1)
+        goto end;
+
+    for (size_t i = 0; i < encoder.nb_strings; i++) {
+        const struct json_binary_string *string;
+
+        string = encoder.strings + i;
+
+        if (json_binary_write_varint(buf, string->len) == -1)
+            goto end;
+        if (c_buffer_add(buf, string->ptr, string->len) == -1)
+            goto end;
+    }
+
+    if (c_buffer_add(buf, c_buffer_data(encoder.values),
+                     c_buffer_length(encoder.values)) == -1) {
+        goto end;
+    }
+
+    size = (uint64_t)(c_buffer_length(buf) - start);
+    for (int i = 0; i < 8; i++) {
+        c_buffer_data(buf)[start + 8 + (size_t)i]
+            = (char)(uint8_t)(size >> (56 - i * 8));
+    }
+
+    ret = 0;
+
+end:
+    c_buffer_delete(encoder.values);
+    c_free(encoder.strings);
+    c_free(encoder.table);
+
+    return ret;
+}
+
+static int
+json_binary_encode_value(struct json_binary_encoder *encoder,
+                         const struct json_value *value, size_t depth) {
+    struct c_buffer *buf;
+
+    buf = encoder->values;
+
+    if ((value->type == JSON_OBJECT || value->type == JSON_ARRAY)
+     && depth >= JSON_MAX_DEPTH) {
+        c_set_error("too many nested arrays and objects");
+        return -1;
+    }
+
+    switch (value->type) {
+    case JSON_OBJECT:
+    {
+        const struct json_object *object;
+
+        object = &value->u.object;
+
+        if (json_binary_write_head(buf, JSON_BINARY_OBJECT,
+                                   object->nb_members) == -1) {
+            return -1;
+        }
+
+        for (size_t i = 0; i < object->nb_members; i++) {
+            const struct json_object_key *okey;
+            size_t idx;
+
+            okey = object->keys + i;
+
+            if (json_binary_encoder_string(encoder, okey->key->ptr,
+                                           okey->len, okey->hash,
+                                           &idx) == -1) {
+                return -1;
+            }
+
+            /* Key indexes are not tagged, their type is implied */
+            if (json_binary_write_varint(buf, idx) == -1)
+                return -1;
+
+            if (json_binary_encode_value(encoder, object->values[i],
+                                         depth + 1) == -1) {
+                return -1;
+            }
+        }
+
+        return 0;
+    }
+
+    case JSON_ARRAY:
+        if (json_binary_write_head(buf, JSON_BINARY_ARRAY,
+                                   value->u.array.nb_elements) == -1) {
+            return -1;
+        }
+
+        for (size_t i = 0; i < value->u.array.nb_elements; i++) {
+            if (json_binary_encode_value(encoder, value->u.array.elements[i],
+                                         depth + 1) == -1) {
+                return -1;
+            }
+        }
+
+        return 0;
+
+    case JSON_INTEGER:
+    {
+        uint64_t integer;
+
+        /* Small negative integers must be encoded in a single byte too */
+        integer = (uint64_t)value->u.integer;
+        return json_binary_write_head(buf, JSON_BINARY_INTEGER,
+                                      (integer << 1) ^ (0 - (integer >> 63)));
+    }
+
+    case JSON_REAL:
+    {
+        uint64_t bits;
+
+        memcpy(&bits, &value->u.real, sizeof(uint64_t));
+        return json_write_be64(buf, JSON_BINARY_REAL, bits);
+    }
+
+    case JSON_STRING:
+    {
+        const char *ptr;
+        size_t len, idx;
+
+        ptr = value->u.string.ptr;
+        len = value->u.string.len;
+
+        if (json_binary_encoder_string(encoder, ptr, len,
+                                       json_hash_string(ptr, len),
+                                       &idx) == -1) {
+            return -1;
+        }
+
+        return json_binary_write_head(buf, JSON_BINARY_STRING, idx);
+    }
+
+    case JSON_BOOLEAN:
+        return json_binary_write_head(buf, JSON_BINARY_BOOLEAN,
+                                      value->u.boolean ? 1 : 0);
+
+    case JSON_NULL:
+        return json_binary_write_head(buf, JSON_BINARY_NULL, 0);
+    }
+
+    c_set_error("unknown json value type %d", value->type);
+    return -1;
+}
+
+static int
+json_binary_encoder_string(struct json_binary_encoder *encoder,
+                           const char *ptr, size_t len, uint32_t hash,
+                           size_t *pidx) {
+    struct json_binary_string *string;
+    size_t mask, slot;
+
+    if ((encoder->nb_strings + 1) * 2 > encoder->table_size) {
+        size_t size;
+
+        size = (encoder->table_size == 0) ? 64 : encoder->table_size * 2;
+        if (json_binary_table_resize(encoder, size) == -1)
+            return -1;
+    }
+
+    mask = encoder->table_size - 1;
+
+    for (slot = hash & mask; encoder->table[slot] != 0;
+         slot = (slot + 1) & mask) {
+        string = encoder->strings + encoder->table[slot] - 1;
+
+        if (string->hash == hash && string->len == len
+         && memcmp(string->ptr, ptr, len) == 0) {
+            break;
+        }
+    }
+
+    if (encoder->table[slot] == 0) {
+        if (encoder->nb_strings >= encoder->strings_size) {
+            struct json_binary_string *strings;
+            size_t size;
+
+            size = (encoder->strings_size == 0) ? 32
+                                                : encoder->strings_size * 2;
+
+            strings = c_realloc(encoder->strings,
+                                size * sizeof(struct json_binary_string));
+            if (!strings)
+                return -1;
+
+            encoder->strings = strings;
+            encoder->strings_size = size;
+        }
+
+        string = encoder->strings + encoder->nb_strings++;
+
+        string->ptr = ptr;
+        string->len = len;
+        string->hash = hash;
+        string->key = NULL;
+
+        encoder->table[slot] = encoder->nb_strings;
+    }
+
+    *pidx = encoder->table[slot] - 1;
+    return 0;
+}
+
+static int
+json_binary_table_resize(struct json_binary_encoder *encoder, size_t size) {
+    size_t *table, mask;
+
+    table = c_malloc0(size * sizeof(size_t));
+    if (!table)
+        return -1;
+
+    mask = size - 1;
+
+    for (size_t i = 0; i < encoder->nb_strings; i++) {
+        size_t slot;
+
+        slot = encoder->strings[i].hash & mask;
+        while (table[slot] != 0)
+            slot = (slot + 1) & mask;
+
+        table[slot] = i + 1;
+    }
+
+    c_free(encoder->table);
+
+    encoder->table = table;
+    encoder->table_size = size;
+
+    return 0;
+}
+
+static int
+json_binary_write_head(struct c_buffer *buf, enum json_binary_type type,
+                       uint64_t argument) {
+    uint8_t byte;
+
+    if (argument < JSON_BINARY_VARINT) {
+        byte = (uint8_t)(type | (argument << 3));
+        return c_buffer_add(buf, &byte, 1);
+    }
+
+    byte = (uint8_t)(type | (JSON_BINARY_VARINT << 3));
+    if (c_buffer_add(buf, &byte, 1) == -1)
+        return -1;
+
+    return json_binary_write_varint(buf, argument);
+}
+
+static int
+json_binary_write_varint(struct c_buffer *buf, uint64_t value) {
+    uint8_t data[10];
+    size_t len;
+
+    len = 0;
+
+    do {
+        data[len] = value & 0x7f;
+        value >>= 7;
+
+        if (value > 0)
+            data[len] |= 0x80;
+        len++;
+    } while (value > 0);
+
+    return c_buffer_add(buf, data, len);
+}
+
+static int
+json_binary_decode_value(struct json_binary_decoder *decoder,
+                         struct json_value **pvalue) {
+    struct json_value *value;
+    uint64_t argument;
+    uint8_t tag;
+
+    if (decoder->len == 0) {
+        c_set_error("truncated value");
+        return -1;
+    }
+
+    tag = *decoder->ptr;
+
+    decoder->ptr++;
+    decoder->len--;
+
+    argument = tag >> 3;
+    if (argument == JSON_BINARY_VARINT) {
+        if (json_binary_read_varint(decoder, &argument) == -1)
+            return -1;
+    }
+
+    switch (tag & 0x07) {
+    case JSON_BINARY_NULL:
+        if (argument != 0) {
+            c_set_error("invalid null value");
+            return -1;
+        }
+
+        value = json_null_new();
+        break;
+
+    case JSON_BINARY_BOOLEAN:
+        if (argument > 1) {
+            c_set_error("invalid boolean value");
+            return -1;
+        }
+
+        value = json_boolean_new(argument == 1);
+        break;
+
+    case JSON_BINARY_INTEGER:
+        value = json_integer_new((int64_t)((argument >> 1)
+                                           ^ (0 - (argument & 1))));
+        break;
+
+    case JSON_BINARY_REAL:
+    {
+        uint64_t bits;
+        double real;
+
+        if (argument != 0) {
+            c_set_error("invalid real value");
+            return -1;
+        }
+
+        if (decoder->len < 8) {
+            c_set_error("truncated real");
+            return -1;
+        }
+
+        bits = json_read_be64(decoder->ptr);
+        memcpy(&real, &bits, sizeof(double));
+
+        decoder->ptr += 8;
+        decoder->len -= 8;
+
+        value = json_real_new(real);
+        break;
+    }
+
+    case JSON_BINARY_STRING:
+    {
+        const struct json_binary_string *string;
+
+        if (argument >= decoder->nb_strings) {
+            c_set_error("invalid string index %"PRIu64, argument);
+            return -1;
+        }
+
+        string = decoder->strings + argument;
+        value = json_string_new2(string->ptr, string->len);
+        break;
+    }
+
+    case JSON_BINARY_ARRAY:
+        return json_binary_decode_array(decoder, argument, pvalue);
+
+    case JSON_BINARY_OBJECT:
+        return json_binary_decode_object(decoder, argument, pvalue);
+
+    default:
+        c_set_error("invalid value type %u", tag & 0x07);
+        return -1;
+    }
+
+    if (!value)
+        return -1;
+
+    *pvalue = value;
+    return 0;
+}
+
+static int
+json_binary_decode_strings(struct json_binary_decoder *decoder) {
+    uint64_t nb_strings;
+
+    if (json_binary_read_varint(decoder, &nb_strings) == -1)
+        return -1;
+
+    /* Each string takes at least one byte */
+    if (nb_strings > decoder->len) {
+        c_set_error("truncated string table");
+        return -1;
+    }
+
+    if (nb_strings == 0)
+        return 0;
+
+    decoder->strings = c_malloc0((size_t)nb_strings
+                                 * sizeof(struct json_binary_string));
+    if (!decoder->strings)
+        return -1;
+
+    for (uint64_t i = 0; i < nb_strings; i++) {
+        struct json_binary_string *string;
+        uint64_t len;
+
+        if (json_binary_read_varint(decoder, &len) == -1)
+            return -1;
+
+        if (len > decoder->len) {
+            c_set_error("truncated string table");
+            return -1;
+        }
+
+        string = decoder->strings + decoder->nb_strings++;
+        string->ptr = (const char *)decoder->ptr;
+        string->len = (size_t)len;
+
+        decoder->ptr += len;
+        decoder->len -= (size_t)len;
+    }
+
+    return 0;
+}
+
+static int
+json_binary_decode_array(struct json_binary_decoder *decoder,
+                         uint64_t nb_elements, struct json_value **pvalue) {
+    struct json_value *array;
+
+    if (decoder->depth >= JSON_MAX_DEPTH) {
+        c_set_error("too many nested arrays and objects");
+        return -1;
+    }
+
+    /* Each element takes at least one byte */
+    if (nb_elements > decoder->len) {
+        c_set_error("truncated array");
+        return -1;
+    }
+
+    array = json_array_new();
+    if (!array)
+        return -1;
+
+    if (json_array_reserve(array, (size_t)nb_elements) == -1)
+        goto error;
+
+    decoder->depth++;
+
+    for (uint64_t i = 0; i < nb_elements; i++) {
+        struct json_value *element;
+
+        if (json_binary_decode_value(decoder, &element) == -1) {
+            decoder->depth--;
+            goto error;
+        }
+
+        array->u.array.elements[array->u.array.nb_elements++] = element;
+    }
+
+    decoder->depth--;
+
+    *pvalue = array;
+    return 0;
+
+error:
+    json_value_delete(array);
+    return -1;
+}
+
+static int
+json_binary_decode_object(struct json_binary_decoder *decoder,
+                          uint64_t nb_members, struct json_value **pvalue) {
+    struct json_value *object;
+
+    if (decoder->depth >= JSON_MAX_DEPTH) {
+        c_set_error("too many nested arrays and objects");
+        return -1;
+    }
+
+    /* Each member takes at least two bytes */
+    if (nb_members > decoder->len / 2) {
+        c_set_error("truncated object");
+        return -1;
+    }
+
+    object = json_object_new();
+    if (!object)
+        return -1;
+
+    if (json_object_reserve(object, (size_t)nb_members) == -1)
+        goto error;
+
+    decoder->depth++;
+
+    for (uint64_t i = 0; i < nb_members; i++) {
+        struct json_binary_string *string;
+        struct json_value *value;
+        struct json_key *key;
+        uint64_t idx;
+
+        if (json_binary_read_varint(decoder, &idx) == -1)
+            goto error_depth;
+
+        if (idx >= decoder->nb_strings) {
+            c_set_error("invalid key index %"PRIu64, idx);
+            goto error_depth;
+        }
+
+        /* Keys are created once for the whole document */
+        string = decoder->strings + idx;
+        if (!string->key) {
+            string->key = json_key_new(string->ptr, string->len);
+            if (!string->key)
+                goto error_depth;
+        }
+
+        if (json_binary_decode_value(decoder, &value) == -1)
+            goto error_depth;
+
+        key = json_key_ref(string->key);
+
+        if (json_object_add_member_key(object, key, value) == -1) {
+            json_key_unref(key);
+            json_value_delete(value);
+            goto error_depth;
+        }
+    }
+
+    decoder->depth--;
+
+    *pvalue = object;
+    return 0;
+
+error_depth:
+    decoder->depth--;
+
+error:
+    json_value_delete(object);
+    return -1;
+}
+
+static int
+json_binary_read_varint(struct json_binary_decoder *decoder,
+                        uint64_t *pvalue) {
+    uint64_t value;
+
+    value = 0;
+
+    for (int shift = 0; ; shift += 7) {
+        uint8_t byte;
+
+        if (decoder->len == 0) {
+            c_set_error("truncated integer");
+            return -1;
+        }
+
+        byte = *decoder->ptr;
+
+        if (shift == 63 && byte > 1) {
+            c_set_error("integer too large");
+            return -1;
+        }
+
+        decoder->ptr++;
+        decoder->len--;
+
+        value |= (uint64_t)(byte & 0x7f) << shift;
+
+        if (!(byte & 0x80))
+            break;
+
+        if (shift == 63) {
+            c_set_error("integer too large");
+            return -1;
+        }
+    }
+
+    *pvalue = value;
+    return 0;
+}
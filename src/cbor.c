@@ -0,0 +1,811 @@
+/*
+ * Copyright (c) 2014-2015 Nicolas Martyanoff
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include "internal.h"
+
+/* CBOR (RFC 8949). Objects are encoded as maps with text string keys,
+ * integers as major types 0 and 1 and reals as double precision floats.
+ *
+ * The decoder accepts indefinite length items, all float sizes and ignores
+ * tags. Byte strings, map keys which are not text strings, text strings
+ * which are not valid UTF-8, integers which do not fit in a signed 64 bit
+ * integer and arrays and maps nested more than JSON_MAX_DEPTH times are
+ * rejected. Undefined is decoded as null. */
+
+enum json_cbor_major_type {
+    JSON_CBOR_UINT   = 0,
+    JSON_CBOR_NINT   = 1,
+    JSON_CBOR_BYTES  = 2,
+    JSON_CBOR_TEXT   = 3,
+    JSON_CBOR_ARRAY  = 4,
+    JSON_CBOR_MAP    = 5,
+    JSON_CBOR_TAG    = 6,
+    JSON_CBOR_SIMPLE = 7,
+};
+
+#define JSON_CBOR_FALSE     0xf4
+#define JSON_CBOR_TRUE      0xf5
+#define JSON_CBOR_NULL      0xf6
+#define JSON_CBOR_UNDEFINED 0xf7
+#define JSON_CBOR_FLOAT16   0xf9
+#define JSON_CBOR_FLOAT32   0xfa
+#define JSON_CBOR_FLOAT64   0xfb
+#define JSON_CBOR_BREAK     0xff
+
+#define JSON_CBOR_INDEFINITE 31
+
+struct json_cbor_decoder {
+    const uint8_t *ptr;
+    size_t len;
+
+    size_t depth;
+
+    struct json_key_table keys;
+};
+
+static int json_cbor_encode_value(const struct json_value *,
+                                  struct c_buffer *);
+static int json_cbor_encode_head(struct c_buffer *,
+                                 enum json_cbor_major_type, uint64_t);
+
+static int json_cbor_decode_value(struct json_cbor_decoder *,
+                                  struct json_value **);
+static int json_cbor_decode_head(struct json_cbor_decoder *,
+                                 uint8_t *, uint64_t *);
+static int json_cbor_decode_text(struct json_cbor_decoder *, uint8_t,
+                                 uint64_t, char **, size_t *);
+static int json_cbor_decode_array(struct json_cbor_decoder *, uint8_t,
+                                  uint64_t, struct json_value **);
+static int json_cbor_decode_map(struct json_cbor_decoder *, uint8_t,
+                                uint64_t, struct json_value **);
+static double json_cbor_decode_float16(uint16_t);
+static int json_cbor_check_utf8(const uint8_t *, size_t);
+
+static bool json_cbor_decoder_skip_break(struct json_cbor_decoder *);
+
+char *
+json_value_encode_cbor(const struct json_value *value, size_t *plen) {
+    struct c_buffer *buf;
+    char *data;
+
+    buf = c_buffer_new();
+
+    if (json_cbor_encode_value(value, buf) == -1) {
+        c_buffer_delete(buf);
+        return NULL;
+    }
+
+    data = c_buffer_extract_string(buf, plen);
+    c_buffer_delete(buf);
+
+    return data;
+}
+
+int
+json_value_encode_cbor_to_buffer(const struct json_value *value,
+                                 struct c_buffer *buf) {
+    return json_cbor_encode_value(value, buf);
+}
+
+struct json_value *
+json_value_decode_cbor(const void *data, size_t len) {
+    struct json_cbor_decoder decoder;
+    struct json_value *value;
+
+    memset(&decoder, 0, sizeof(struct json_cbor_decoder));
+
+    decoder.ptr = data;
+    decoder.len = len;
+
+    json_key_table_init(&decoder.keys);
+
+    if (json_cbor_decode_value(&decoder, &value) == -1) {
+        json_key_table_free(&decoder.keys);
+        return NULL;
+    }
+
+    json_key_table_free(&decoder.keys);
+
+    if (decoder.len > 0) {
+        c_set_error("invalid trailing data");
+        json_value_delete(value);
+        return NULL;
+    }
+
+    return value;
+}
+
+int
+json_cbor_read_item_head(const uint8_t *data, size_t len,
+                         struct json_item_head *head) {
+    uint8_t major, info;
+    uint64_t argument;
+
+    memset(head, 0, sizeof(struct json_item_head));
+
+    if (len < 1)
+        return 0;
+
+    major = data[0] >> 5;
+    info = data[0] & 0x1f;
+
+    if (data[0] == JSON_CBOR_BREAK) {
+        head->size = 1;
+        head->is_break = true;
+        return 1;
+    }
+
+    if (info < 24) {
+        head->size = 1;
+        argument = info;
+    } else if (info <= 27) {
+        head->size = 1 + ((size_t)1 << (info - 24));
+        if (len < head->size)
+            return 0;
+
+        switch (info) {
+        case 24: argument = data[1];                break;
+        case 25: argument = json_read_be16(data + 1); break;
+        case 26: argument = json_read_be32(data + 1); break;
+        default: argument = json_read_be64(data + 1); break;
+        }
+    } else if (info == JSON_CBOR_INDEFINITE
+            && (major == JSON_CBOR_BYTES || major == JSON_CBOR_TEXT
+             || major == JSON_CBOR_ARRAY || major == JSON_CBOR_MAP)) {
+        head->size = 1;
+        head->indefinite = true;
+        return 1;
+    } else {
+        c_set_error("invalid additional information %u", info);
+        return -1;
+    }
+
+    switch (major) {
+    case JSON_CBOR_BYTES:
+    case JSON_CBOR_TEXT:
+        head->data_size = argument;
+        break;
+
+    case JSON_CBOR_ARRAY:
+        head->nb_items = argument;
+        break;
+
+    case JSON_CBOR_MAP:
+        if (argument > UINT64_MAX / 2) {
+            c_set_error("map too large");
+            return -1;
+        }
+
+        head->nb_items = argument * 2;
+        break;
+
+    case JSON_CBOR_TAG:
+        head->nb_items = 1;
+        break;
+
+    default:
+        break;
+    }
+
+    return 1;
+}
+
+static int
+json_cbor_encode_value(const struct json_value *value,
+                       struct c_buffer *buf) {
+    switch (value->type) {
+    case JSON_OBJECT:
+    {
+        const struct json_object *object;
+
+        object = &value->u.object;
+
+        if (json_cbor_encode_head(buf, JSON_CBOR_MAP,
+                                  object->nb_members) == -1) {
+            return -1;
+        }
+
+        for (size_t i = 0; i < object->nb_members; i++) {
+            const struct json_key *key;
+
+            key = object->keys[i].key;
+
+            if (json_cbor_encode_head(buf, JSON_CBOR_TEXT, key->len) == -1)
+                return -1;
+            if (c_buffer_add(buf, key->ptr, key->len) == -1)
+                return -1;
+
+            if (json_cbor_encode_value(object->values[i], buf) == -1)
+                return -1;
+        }
+
+        return 0;
+    }
+
+    case JSON_ARRAY:
+        if (json_cbor_encode_head(buf, JSON_CBOR_ARRAY,
+                                  value->u.array.nb_elements) == -1) {
+            return -1;
+        }
+
+        for (size_t i = 0; i < value->u.array.nb_elements; i++) {
+            if (json_cbor_encode_value(value->u.array.elements[i], buf) == -1)
+                return -1;
+        }
+
+        return 0;
+
+    case JSON_INTEGER:
+        if (value->u.integer >= 0) {
+            return json_cbor_encode_head(buf, JSON_CBOR_UINT,
+                                         (uint64_t)value->u.integer);
+        } else {
+            /* -1 - n without overflowing for INT64_MIN */
+            return json_cbor_encode_head(buf, JSON_CBOR_NINT,
+                                         ~(uint64_t)value->u.integer);
+        }
+
+    case JSON_REAL:
+    {
+        uint64_t bits;
+
+        memcpy(&bits, &value->u.real, sizeof(uint64_t));
+        return json_write_be64(buf, JSON_CBOR_FLOAT64, bits);
+    }
+
+    case JSON_STRING:
+        if (json_cbor_encode_head(buf, JSON_CBOR_TEXT,
+                                  value->u.string.len) == -1) {
+            return -1;
+        }
+
+        return c_buffer_add(buf, value->u.string.ptr, value->u.string.len);
+
+    case JSON_BOOLEAN:
+    {
+        uint8_t byte;
+
+        byte = value->u.boolean ? JSON_CBOR_TRUE : JSON_CBOR_FALSE;
+        return c_buffer_add(buf, &byte, 1);
+    }
+
+    case JSON_NULL:
+    {
+        uint8_t byte;
+
+        byte = JSON_CBOR_NULL;
+        return c_buffer_add(buf, &byte, 1);
+    }
+    }
+
+    c_set_error("unknown json value type %d", value->type);
+    return -1;
+}
+
+static int
+json_cbor_encode_head(struct c_buffer *buf, enum json_cbor_major_type major,
+                      uint64_t argument) {
+    uint8_t byte;
+
+    byte = (uint8_t)(major << 5);
+
+    if (argument < 24) {
+        byte |= (uint8_t)argument;
+        return c_buffer_add(buf, &byte, 1);
+    } else if (argument <= UINT8_MAX) {
+        uint8_t data[2];
+
+        data[0] = byte | 24;
+        data[1] = (uint8_t)argument;
+        return c_buffer_add(buf, data, 2);
+    } else if (argument <= UINT16_MAX) {
+        return json_write_be16(buf, byte | 25, (uint16_t)argument);
+    } else if (argument <= UINT32_MAX) {
+        return json_write_be32(buf, byte | 26, (uint32_t)argument);
+    } else {
+        return json_write_be64(buf, byte | 27, argument);
+    }
+}
+
+static int
+json_cbor_decode_value(struct json_cbor_decoder *decoder,
+                       struct json_value **pvalue) {
+    uint8_t major, info;
+    uint64_t argument;
+
+    for (;;) {
+        if (decoder->len == 0) {
+            c_set_error("truncated item");
+            return -1;
+        }
+
+        major = decoder->ptr[0] >> 5;
+        info = decoder->ptr[0] & 0x1f;
+
+        if (major != JSON_CBOR_TAG)
+            break;
+
+        /* Tags only carry semantic information, the content is decoded as
+         * any other item. */
+        if (json_cbor_decode_head(decoder, &info, &argument) == -1)
+            return -1;
+    }
+
+    if (major == JSON_CBOR_SIMPLE) {
+        uint8_t byte;
+
+        byte = decoder->ptr[0];
+
+        switch (byte) {
+        case JSON_CBOR_FALSE:
+        case JSON_CBOR_TRUE:
+            decoder->ptr++;
+            decoder->len--;
+
+            *pvalue = json_boolean_new(byte == JSON_CBOR_TRUE);
+            return 0;
+
+        case JSON_CBOR_NULL:
+        case JSON_CBOR_UNDEFINED:
+            decoder->ptr++;
+            decoder->len--;
+
+            *pvalue = json_null_new();
+            return 0;
+
+        case JSON_CBOR_FLOAT16:
+        case JSON_CBOR_FLOAT32:
+        case JSON_CBOR_FLOAT64:
+        {
+            double real;
+
+            if (json_cbor_decode_head(decoder, &info, &argument) == -1)
+                return -1;
+
+            if (byte == JSON_CBOR_FLOAT16) {
+                real = json_cbor_decode_float16((uint16_t)argument);
+            } else if (byte == JSON_CBOR_FLOAT32) {
+                uint32_t bits;
+                float f;
+
+                bits = (uint32_t)argument;
+                memcpy(&f, &bits, sizeof(float));
+                real = f;
+            } else {
+                memcpy(&real, &argument, sizeof(double));
+            }
+
+            *pvalue = json_real_new(real);
+            return 0;
+        }
+
+        case JSON_CBOR_BREAK:
+            c_set_error("unexpected break marker");
+            return -1;
+
+        default:
+            c_set_error("unsupported simple value 0x%02x", byte);
+            return -1;
+        }
+    }
+
+    if (json_cbor_decode_head(decoder, &info, &argument) == -1)
+        return -1;
+
+    switch (major) {
+    case JSON_CBOR_UINT:
+        if (argument > INT64_MAX) {
+            c_set_error("integer too large");
+            return -1;
+        }
+
+        *pvalue = json_integer_new((int64_t)argument);
+        return 0;
+
+    case JSON_CBOR_NINT:
+        if (argument > INT64_MAX) {
+            c_set_error("integer too small");
+            return -1;
+        }
+
+        *pvalue = json_integer_new(-1 - (int64_t)argument);
+        return 0;
+
+    case JSON_CBOR_TEXT:
+    {
+        char *string;
+        size_t len;
+
+        if (json_cbor_decode_text(decoder, info, argument,
+                                  &string, &len) == -1) {
+            return -1;
+        }
+
+        *pvalue = json_string_new_nocopy2(string, len);
+        return 0;
+    }
+
+    case JSON_CBOR_ARRAY:
+        return json_cbor_decode_array(decoder, info, argument, pvalue);
+
+    case JSON_CBOR_MAP:
+        return json_cbor_decode_map(decoder, info, argument, pvalue);
+
+    case JSON_CBOR_BYTES:
+        c_set_error("byte strings are not supported");
+        return -1;
+    }
+
+    c_set_error("invalid major type %u", major);
+    return -1;
+}
+
+static int
+json_cbor_decode_head(struct json_cbor_decoder *decoder,
+                      uint8_t *pinfo, uint64_t *pargument) {
+    struct json_item_head head;
+    const uint8_t *data;
+    uint8_t info;
+    int ret;
+
+    data = decoder->ptr;
+
+    ret = json_cbor_read_item_head(data, decoder->len, &head);
+    if (ret == -1)
+        return -1;
+    if (ret == 0) {
+        c_set_error("truncated item");
+        return -1;
+    }
+
+    info = data[0] & 0x1f;
+
+    switch (info) {
+    case 24: *pargument = data[1];                break;
+    case 25: *pargument = json_read_be16(data + 1); break;
+    case 26: *pargument = json_read_be32(data + 1); break;
+    case 27: *pargument = json_read_be64(data + 1); break;
+    default: *pargument = info;                   break;
+    }
+
+    *pinfo = info;
+
+    decoder->ptr += head.size;
+    decoder->len -= head.size;
+
+    return 0;
+}
+
+static int
+json_cbor_decode_text(struct json_cbor_decoder *decoder, uint8_t info,
+                      uint64_t argument, char **pstring, size_t *plen) {
+    struct c_buffer *buf;
+
+    if (info != JSON_CBOR_INDEFINITE) {
+        char *string;
+
+        if (argument > decoder->len) {
+            c_set_error("truncated text string");
+            return -1;
+        }
+
+        if (json_cbor_check_utf8(decoder->ptr, (size_t)argument) == -1)
+            return -1;
+
+        string = json_strndup((const char *)decoder->ptr, (size_t)argument);
+        if (!string)
+            return -1;
+
+        decoder->ptr += argument;
+        decoder->len -= (size_t)argument;
+
+        *pstring = string;
+        *plen = (size_t)argument;
+        return 0;
+    }
+
+    /* Indefinite length strings are a sequence of definite length chunks */
+    buf = c_buffer_new();
+
+    for (;;) {
+        if (json_cbor_decoder_skip_break(decoder))
+            break;
+
+        if (decoder->len == 0 || decoder->ptr[0] >> 5 != JSON_CBOR_TEXT) {
+            c_set_error("invalid text string chunk");
+            goto error;
+        }
+
+        if (json_cbor_decode_head(decoder, &info, &argument) == -1)
+            goto error;
+
+        if (info == JSON_CBOR_INDEFINITE) {
+            c_set_error("nested indefinite length text string");
+            goto error;
+        }
+
+        if (argument > decoder->len) {
+            c_set_error("truncated text string");
+            goto error;
+        }
+
+        /* Each chunk is a complete UTF-8 sequence */
+        if (json_cbor_check_utf8(decoder->ptr, (size_t)argument) == -1)
+            goto error;
+
+        if (c_buffer_add(buf, decoder->ptr, (size_t)argument) == -1)
+            goto error;
+
+        decoder->ptr += argument;
+        decoder->len -= (size_t)argument;
+    }
+
+    *pstring = json_strndup(c_buffer_data(buf), c_buffer_length(buf));
+    if (!*pstring)
+        goto error;
+    *plen = c_buffer_length(buf);
+
+    c_buffer_delete(buf);
+    return 0;
+
+error:
+    c_buffer_delete(buf);
+    return -1;
+}
+
+static int
+json_cbor_decode_array(struct json_cbor_decoder *decoder, uint8_t info,
+                       uint64_t argument, struct json_value **pvalue) {
+    struct json_value *value;
+
+    if (decoder->depth >= JSON_MAX_DEPTH) {
+        c_set_error("too many nested arrays and maps");
+        return -1;
+    }
+
+    value = json_array_new();
+    decoder->depth++;
+
+    if (info != JSON_CBOR_INDEFINITE) {
+        /* Each element takes at least one byte */
+        if (argument > decoder->len) {
+            c_set_error("truncated array");
+            goto error;
+        }
+
+        if (json_array_reserve(value, (size_t)argument) == -1)
+            goto error;
+    }
+
+    for (uint64_t i = 0;; i++) {
+        struct json_value *element;
+
+        if (info == JSON_CBOR_INDEFINITE) {
+            if (json_cbor_decoder_skip_break(decoder))
+                break;
+        } else if (i >= argument) {
+            break;
+        }
+
+        if (json_cbor_decode_value(decoder, &element) == -1)
+            goto error;
+
+        if (json_array_add_element(value, element) == -1) {
+            json_value_delete(element);
+            goto error;
+        }
+    }
+
+    decoder->depth--;
+
+    *pvalue = value;
+    return 0;
+
+error:
+    decoder->depth--;
+    json_value_delete(value);
+    return -1;
+}
+
+static int
+json_cbor_decode_map(struct json_cbor_decoder *decoder, uint8_t info,
+                     uint64_t argument, struct json_value **pvalue) {
+    struct json_value *value;
+
+    if (decoder->depth >= JSON_MAX_DEPTH) {
+        c_set_error("too many nested arrays and maps");
+        return -1;
+    }
+
+    value = json_object_new();
+    decoder->depth++;
+
+    if (info != JSON_CBOR_INDEFINITE) {
+        /* Each entry takes at least two bytes */
+        if (argument > decoder->len / 2) {
+            c_set_error("truncated map");
+            goto error;
+        }
+
+        if (json_object_reserve(value, (size_t)argument) == -1)
+            goto error;
+    }
+
+    for (uint64_t i = 0;; i++) {
+        struct json_value *member;
+        struct json_key *key;
+        uint8_t key_info;
+        uint64_t key_argument;
+
+        if (info == JSON_CBOR_INDEFINITE) {
+            if (json_cbor_decoder_skip_break(decoder))
+                break;
+        } else if (i >= argument) {
+            break;
+        }
+
+        if (decoder->len == 0 || decoder->ptr[0] >> 5 != JSON_CBOR_TEXT) {
+            c_set_error("map key is not a text string");
+            goto error;
+        }
+
+        if (json_cbor_decode_head(decoder, &key_info, &key_argument) == -1)
+            goto error;
+
+        if (key_info != JSON_CBOR_INDEFINITE) {
+            if (key_argument > decoder->len) {
+                c_set_error("truncated text string");
+                goto error;
+            }
+
+            if (json_cbor_check_utf8(decoder->ptr,
+                                     (size_t)key_argument) == -1) {
+                goto error;
+            }
+
+            key = json_key_table_intern(&decoder->keys,
+                                        (const char *)decoder->ptr,
+                                        (size_t)key_argument);
+
+            decoder->ptr += key_argument;
+            decoder->len -= (size_t)key_argument;
+        } else {
+            char *string;
+            size_t len;
+
+            if (json_cbor_decode_text(decoder, key_info, key_argument,
+                                      &string, &len) == -1) {
+                goto error;
+            }
+
+            key = json_key_table_intern(&decoder->keys, string, len);
+            json_free(string);
+        }
+
+        if (!key)
+            goto error;
+
+        if (json_cbor_decode_value(decoder, &member) == -1) {
+            json_key_unref(key);
+            goto error;
+        }
+
+        if (json_object_add_member_key(value, key, member) == -1) {
+            json_key_unref(key);
+            json_value_delete(member);
+            goto error;
+        }
+    }
+
+    decoder->depth--;
+
+    *pvalue = value;
+    return 0;
+
+error:
+    decoder->depth--;
+    json_value_delete(value);
+    return -1;
+}
+
+static double
+json_cbor_decode_float16(uint16_t half) {
+    int exponent, mantissa;
+    double real;
+
+    exponent = (half >> 10) & 0x1f;
+    mantissa = half & 0x3ff;
+
+    if (exponent == 0) {
+        real = ldexp(mantissa, -24);
+    } else if (exponent != 31) {
+        real = ldexp(mantissa + 1024, exponent - 25);
+    } else {
+        real = (mantissa == 0) ? INFINITY : NAN;
+    }
+
+    return (half & 0x8000) ? -real : real;
+}
+
+static int
+json_cbor_check_utf8(const uint8_t *data, size_t len) {
+    size_t i;
+
+    i = 0;
+
+    while (i < len) {
+        uint32_t codepoint;
+        size_t nb_bytes;
+
+        if (data[i] < 0x80) {
+            i++;
+            continue;
+        }
+
+        /* Overlong sequences, surrogates and codepoints above U+10FFFF are
+         * invalid (RFC 3629). */
+        if (data[i] >= 0xc2 && data[i] <= 0xdf) {
+            codepoint = data[i] & 0x1f;
+            nb_bytes = 2;
+        } else if (data[i] >= 0xe0 && data[i] <= 0xef) {
+            codepoint = data[i] & 0x0f;
+            nb_bytes = 3;
+        } else if (data[i] >= 0xf0 && data[i] <= 0xf4) {
+            codepoint = data[i] & 0x07;
+            nb_bytes = 4;
+        } else {
+            goto invalid;
+        }
+
+        if (nb_bytes > len - i)
+            goto invalid;
+
+        for (size_t j = 1; j < nb_bytes; j++) {
+            if ((data[i + j] & 0xc0) != 0x80)
+                goto invalid;
+
+            codepoint = (codepoint << 6) | (data[i + j] & 0x3f);
+        }
+
+        if (nb_bytes == 3 && codepoint < 0x800)
+            goto invalid;
+
+        if (codepoint >= 0xd800 && codepoint <= 0xdfff)
+            goto invalid;
+
+        if (nb_bytes == 4 && (codepoint < 0x10000 || codepoint > 0x10ffff))
+            goto invalid;
+
+        i += nb_bytes;
+    }
+
+    return 0;
+
+invalid:
+    c_set_error("invalid utf-8 sequence in text string");
+    return -1;
+}
+
+static bool
+json_cbor_decoder_skip_break(struct json_cbor_decoder *decoder) {
+    if (decoder->len == 0 || decoder->ptr[0] != JSON_CBOR_BREAK)
+        return false;
+
+    decoder->ptr++;
+    decoder->len--;
+
+    return true;
+}
@@ -0,0 +1,308 @@
+/*
+ * Copyright (c) 2014-2015 Nicolas Martyanoff
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include "internal.h"
+
+/* The streaming decoder reads a sequence of CBOR or MessagePack items from
+ * data fed in chunks of any size. It scans item headers as data arrive,
+ * keeping track of the number of items left at each nesting level, so that
+ * each byte is only scanned once. Once a top-level item is complete, it is
+ * decoded in one pass. */
+
+#define JSON_DECODER_INDEFINITE UINT64_MAX
+
+typedef int (*json_item_head_reader)(const uint8_t *, size_t,
+                                     struct json_item_head *);
+
+struct json_decoder {
+    enum json_decoder_format format;
+    json_item_head_reader read_item_head;
+
+    uint8_t *data;
+    size_t len;
+    size_t size;
+
+    size_t start; /* start of the current item */
+    size_t scan;  /* end of the scanned part of the current item */
+
+    /* Number of items left at each nesting level */
+    uint64_t *levels;
+    size_t nb_levels;
+    size_t levels_size;
+};
+
+static int json_decoder_scan(struct json_decoder *);
+static int json_decoder_push_level(struct json_decoder *, uint64_t);
+static bool json_decoder_end_item(struct json_decoder *);
+
+uint16_t
+json_read_be16(const uint8_t *data) {
+    return (uint16_t)((data[0] << 8) | data[1]);
+}
+
+uint32_t
+json_read_be32(const uint8_t *data) {
+    return ((uint32_t)data[0] << 24) | ((uint32_t)data[1] << 16)
+         | ((uint32_t)data[2] << 8) | (uint32_t)data[3];
+}
+
+uint64_t
+json_read_be64(const uint8_t *data) {
+    return ((uint64_t)json_read_be32(data) << 32)
+         | (uint64_t)json_read_be32(data + 4);
+}
+
+int
+json_write_be16(struct c_buffer *buf, uint8_t type, uint16_t value) {
+    uint8_t data[3];
+
+    data[0] = type;
+    data[1] = (uint8_t)(value >> 8);
+    data[2] = (uint8_t)value;
+
+    return c_buffer_add(buf, data, sizeof(data));
+}
+
+int
+json_write_be32(struct c_buffer *buf, uint8_t type, uint32_t value) {
+    uint8_t data[5];
+
+    data[0] = type;
+    for (int i = 0; i < 4; i++)
+        data[1 + i] = (uint8_t)(value >> (24 - i * 8));
+
+    return c_buffer_add(buf, data, sizeof(data));
+}
+
+int
+json_write_be64(struct c_buffer *buf, uint8_t type, uint64_t value) {
+    uint8_t data[9];
+
+    data[0] = type;
+    for (int i = 0; i < 8; i++)
+        data[1 + i] = (uint8_t)(value >> (56 - i * 8));
+
+    return c_buffer_add(buf, data, sizeof(data));
+}
+
+struct json_decoder *
+json_decoder_new(enum json_decoder_format format) {
+    struct json_decoder *decoder;
+
+    decoder = c_malloc0(sizeof(struct json_decoder));
+    if (!decoder)
+        return NULL;
+
+    decoder->format = format;
+
+    switch (format) {
+    case JSON_DECODER_CBOR:
+        decoder->read_item_head = json_cbor_read_item_head;
+        break;
+
+    case JSON_DECODER_MSGPACK:
+        decoder->read_item_head = json_msgpack_read_item_head;
+        break;
+
+    default:
+        c_set_error("unknown decoder format %d", format);
+        c_free(decoder);
+        return NULL;
+    }
+
+    return decoder;
+}
+
+void
+json_decoder_delete(struct json_decoder *decoder) {
+    if (!decoder)
+        return;
+
+    c_free(decoder->data);
+    c_free(decoder->levels);
+
+    c_free0(decoder, sizeof(struct json_decoder));
+}
+
+int
+json_decoder_feed(struct json_decoder *decoder, const void *data,
+                  size_t len) {
+    /* Drop data of items already returned before growing the buffer */
+    if (decoder->start > 0) {
+        memmove(decoder->data, decoder->data + decoder->start,
+                decoder->len - decoder->start);
+
+        decoder->len -= decoder->start;
+        decoder->scan -= decoder->start;
+        decoder->start = 0;
+    }
+
+    if (decoder->len + len > decoder->size) {
+        uint8_t *ndata;
+        size_t size;
+
+        size = (decoder->size == 0) ? BUFSIZ : decoder->size;
+        while (size < decoder->len + len)
+            size *= 2;
+
+        ndata = c_realloc(decoder->data, size);
+        if (!ndata)
+            return -1;
+
+        decoder->data = ndata;
+        decoder->size = size;
+    }
+
+    memcpy(decoder->data + decoder->len, data, len);
+    decoder->len += len;
+
+    return 0;
+}
+
+int
+json_decoder_next(struct json_decoder *decoder, struct json_value **pvalue) {
+    struct json_value *value;
+    const uint8_t *data;
+    size_t len;
+    int ret;
+
+    ret = json_decoder_scan(decoder);
+    if (ret <= 0)
+        return ret;
+
+    data = decoder->data + decoder->start;
+    len = decoder->scan - decoder->start;
+
+    switch (decoder->format) {
+    case JSON_DECODER_CBOR:
+        value = json_value_decode_cbor(data, len);
+        break;
+
+    case JSON_DECODER_MSGPACK:
+        value = json_value_decode_msgpack(data, len);
+        break;
+
+    default:
+        value = NULL;
+        break;
+    }
+
+    if (!value)
+        return -1;
+
+    decoder->start = decoder->scan;
+
+    *pvalue = value;
+    return 1;
+}
+
+static int
+json_decoder_scan(struct json_decoder *decoder) {
+    for (;;) {
+        struct json_item_head head;
+        size_t len;
+        int ret;
+
+        len = decoder->len - decoder->scan;
+
+        ret = decoder->read_item_head(decoder->data + decoder->scan, len,
+                                      &head);
+        if (ret <= 0)
+            return ret;
+
+        if (head.is_break) {
+            if (decoder->nb_levels == 0
+             || decoder->levels[decoder->nb_levels - 1]
+                != JSON_DECODER_INDEFINITE) {
+                c_set_error("unexpected break marker");
+                return -1;
+            }
+
+            decoder->scan += head.size;
+            decoder->nb_levels--;
+
+            if (json_decoder_end_item(decoder))
+                return 1;
+
+            continue;
+        }
+
+        if (head.size > len || head.data_size > len - head.size)
+            return 0;
+
+        decoder->scan += head.size + (size_t)head.data_size;
+
+        if (head.indefinite) {
+            if (json_decoder_push_level(decoder,
+                                        JSON_DECODER_INDEFINITE) == -1) {
+                return -1;
+            }
+        } else if (head.nb_items > 0) {
+            if (json_decoder_push_level(decoder, head.nb_items) == -1)
+                return -1;
+        } else if (json_decoder_end_item(decoder)) {
+            return 1;
+        }
+    }
+}
+
+static int
+json_decoder_push_level(struct json_decoder *decoder, uint64_t nb_items) {
+    /* Reject deep items as soon as their headers are scanned instead of
+     * buffering them until the decoder refuses them. */
+    if (decoder->nb_levels >= JSON_MAX_DEPTH) {
+        c_set_error("too many nested items");
+        return -1;
+    }
+
+    if (decoder->nb_levels >= decoder->levels_size) {
+        uint64_t *levels;
+        size_t size;
+
+        size = (decoder->levels_size == 0) ? 16 : decoder->levels_size * 2;
+
+        levels = c_realloc(decoder->levels, size * sizeof(uint64_t));
+        if (!levels)
+            return -1;
+
+        decoder->levels = levels;
+        decoder->levels_size = size;
+    }
+
+    decoder->levels[decoder->nb_levels++] = nb_items;
+    return 0;
+}
+
+static bool
+json_decoder_end_item(struct json_decoder *decoder) {
+    /* An item is complete, and so are all the containers it completes. We
+     * return true once the top-level item is complete. */
+    while (decoder->nb_levels > 0) {
+        uint64_t *level;
+
+        level = decoder->levels + decoder->nb_levels - 1;
+
+        if (*level == JSON_DECODER_INDEFINITE)
+            return false;
+
+        if (--*level > 0)
+            return false;
+
+        decoder->nb_levels--;
+    }
+
+    return true;
+}
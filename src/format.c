@@ -71,8 +71,6 @@ json_value_format_to_buffer(struct json_value *value, struct c_buffer *buf,
                             uint32_t opts) {
     struct json_format_ctx ctx;
 
-    json_value_sort_objects_by_index(value);
-
     memset(&ctx, 0, sizeof(struct json_format_ctx));
     ctx.opts = opts;
     ctx.indent = 0;
@@ -163,12 +161,11 @@ json_format_object(const struct json_object *object, struct c_buffer *buf,
     }
 
     for (size_t i = 0; i < object->nb_members; i++) {
-        const struct json_object_member *member;
-        const struct json_value *key, *value;
+        const struct json_key *key;
+        const struct json_value *value;
 
-        member = object->members + i;
-        key = member->key;
-        value = member->value;
+        key = object->keys[i].key;
+        value = object->values[i];
 
         if (i > 0) {
             if (c_buffer_add_string(buf, ", ") == -1)
@@ -185,7 +182,7 @@ json_format_object(const struct json_object *object, struct c_buffer *buf,
                 return -1;
         }
 
-        if (json_format_string(key->u.string.ptr, key->u.string.len,
+        if (json_format_string(key->ptr, key->len,
                                buf, ctx, JSON_ANSI_COLOR_YELLOW) == -1) {
             return -1;
         }
@@ -0,0 +1,728 @@
+/*
+ * Copyright (c) 2015 Nicolas Martyanoff
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <pthread.h>
+
+#include "internal.h"
+
+/* Built-in formats are checked in a single pass over the string, without
+ * allocating memory. They follow the RFCs referenced by the JSON schema
+ * specification, with the following restrictions:
+ *
+ * - email: the local part must be a dot-atom; quoted local parts and
+ *   comments are not supported.
+ * - uri: the uri must be absolute; characters are checked but the
+ *   components following the scheme are not parsed.
+ * - regex: the pattern is checked for the syntax of ECMA 262 regular
+ *   expressions; escape sequences are not interpreted.
+ *
+ * Formats registered with json_schema_format_register() are kept for the
+ * lifetime of the process, since compiled schemas refer to them. */
+
+static const struct json_schema_format *
+json_schema_format_find_builtin(const char *);
+static const struct json_schema_format *
+json_schema_format_find_custom(const char *);
+
+static bool json_format_check_date_time(const char *, size_t, void *);
+static bool json_format_check_email(const char *, size_t, void *);
+static bool json_format_check_hostname(const char *, size_t, void *);
+static bool json_format_check_ipv4(const char *, size_t, void *);
+static bool json_format_check_ipv6(const char *, size_t, void *);
+static bool json_format_check_uri(const char *, size_t, void *);
+static bool json_format_check_regex(const char *, size_t, void *);
+
+static bool json_format_read_digits(const char *, size_t, size_t *, size_t,
+                                    unsigned int *);
+static bool json_format_is_digit(char);
+static bool json_format_is_alpha(char);
+static bool json_format_is_hex_digit(char);
+static bool json_format_is_atext(char);
+static bool json_format_is_uri_char(char);
+
+static const struct json_schema_format json_schema_formats[] = {
+    {"date-time", json_format_check_date_time, NULL, NULL},
+    {"email",     json_format_check_email,     NULL, NULL},
+    {"hostname",  json_format_check_hostname,  NULL, NULL},
+    {"ipv4",      json_format_check_ipv4,      NULL, NULL},
+    {"ipv6",      json_format_check_ipv6,      NULL, NULL},
+    {"uri",       json_format_check_uri,       NULL, NULL},
+    {"regex",     json_format_check_regex,     NULL, NULL},
+};
+
+static struct json_schema_format *json_schema_custom_formats;
+static pthread_rwlock_t json_schema_custom_formats_lock =
+    PTHREAD_RWLOCK_INITIALIZER;
+
+const struct json_schema_format *
+json_schema_format_find(const char *name) {
+    const struct json_schema_format *format;
+
+    format = json_schema_format_find_builtin(name);
+    if (format)
+        return format;
+
+    pthread_rwlock_rdlock(&json_schema_custom_formats_lock);
+    format = json_schema_format_find_custom(name);
+    pthread_rwlock_unlock(&json_schema_custom_formats_lock);
+
+    return format;
+}
+
+int
+json_schema_format_register(const char *name,
+                            json_schema_format_function function,
+                            void *data) {
+    struct json_schema_format *format;
+
+    if (json_schema_format_find_builtin(name))
+        goto already_registered;
+
+    format = c_malloc0(sizeof(struct json_schema_format));
+    if (!format)
+        return -1;
+
+    format->name = c_strdup(name);
+    if (!format->name) {
+        c_free(format);
+        return -1;
+    }
+
+    format->function = function;
+    format->data = data;
+
+    pthread_rwlock_wrlock(&json_schema_custom_formats_lock);
+
+    if (json_schema_format_find_custom(name)) {
+        pthread_rwlock_unlock(&json_schema_custom_formats_lock);
+
+        c_free(format->name);
+        c_free(format);
+        goto already_registered;
+    }
+
+    format->next = json_schema_custom_formats;
+    json_schema_custom_formats = format;
+
+    pthread_rwlock_unlock(&json_schema_custom_formats_lock);
+
+    return 0;
+
+already_registered:
+    c_set_error("format '%s' already registered", name);
+    return -1;
+}
+
+bool
+json_schema_format_check(const struct json_schema_format *format,
+                         const char *string, size_t len) {
+    return format->function(string, len, format->data);
+}
+
+static const struct json_schema_format *
+json_schema_format_find_builtin(const char *name) {
+    size_t nb_formats;
+
+    nb_formats = sizeof(json_schema_formats) / sizeof(json_schema_formats[0]);
+    for (size_t i = 0; i < nb_formats; i++) {
+        if (strcmp(name, json_schema_formats[i].name) == 0)
+            return &json_schema_formats[i];
+    }
+
+    return NULL;
+}
+
+static const struct json_schema_format *
+json_schema_format_find_custom(const char *name) {
+    const struct json_schema_format *format;
+
+    for (format = json_schema_custom_formats; format; format = format->next) {
+        if (strcmp(name, format->name) == 0)
+            return format;
+    }
+
+    return NULL;
+}
+
+/* ------------------------------------------------------------------------
+ *  Date and time (RFC 3339)
+ * ------------------------------------------------------------------------ */
+static bool
+json_format_check_date_time(const char *string, size_t len, void *data) {
+    unsigned int year, month, day, hour, minute, second;
+    unsigned int days_in_month, offset_hour, offset_minute;
+    size_t i;
+
+    /* full-date: YYYY-MM-DD */
+    i = 0;
+
+    if (!json_format_read_digits(string, len, &i, 4, &year))
+        return false;
+    if (i >= len || string[i++] != '-')
+        return false;
+    if (!json_format_read_digits(string, len, &i, 2, &month))
+        return false;
+    if (i >= len || string[i++] != '-')
+        return false;
+    if (!json_format_read_digits(string, len, &i, 2, &day))
+        return false;
+
+    if (month < 1 || month > 12)
+        return false;
+
+    if (month == 2) {
+        bool leap;
+
+        leap = (year % 4 == 0) && (year % 100 != 0 || year % 400 == 0);
+        days_in_month = leap ? 29 : 28;
+    } else if (month == 4 || month == 6 || month == 9 || month == 11) {
+        days_in_month = 30;
+    } else {
+        days_in_month = 31;
+    }
+
+    if (day < 1 || day > days_in_month)
+        return false;
+
+    if (i >= len || (string[i] != 'T' && string[i] != 't'))
+        return false;
+    i++;
+
+    /* partial-time: HH:MM:SS[.frac] */
+    if (!json_format_read_digits(string, len, &i, 2, &hour))
+        return false;
+    if (i >= len || string[i++] != ':')
+        return false;
+    if (!json_format_read_digits(string, len, &i, 2, &minute))
+        return false;
+    if (i >= len || string[i++] != ':')
+        return false;
+    if (!json_format_read_digits(string, len, &i, 2, &second))
+        return false;
+
+    /* Leap seconds are accepted */
+    if (hour > 23 || minute > 59 || second > 60)
+        return false;
+
+    if (i < len && string[i] == '.') {
+        size_t start;
+
+        i++;
+
+        start = i;
+        while (i < len && json_format_is_digit(string[i]))
+            i++;
+
+        if (i == start)
+            return false;
+    }
+
+    /* time-offset: Z or +HH:MM/-HH:MM */
+    if (i >= len)
+        return false;
+
+    if (string[i] == 'Z' || string[i] == 'z')
+        return i + 1 == len;
+
+    if (string[i] != '+' && string[i] != '-')
+        return false;
+    i++;
+
+    if (!json_format_read_digits(string, len, &i, 2, &offset_hour))
+        return false;
+    if (i >= len || string[i++] != ':')
+        return false;
+    if (!json_format_read_digits(string, len, &i, 2, &offset_minute))
+        return false;
+
+    if (offset_hour > 23 || offset_minute > 59)
+        return false;
+
+    return i == len;
+}
+
+/* ------------------------------------------------------------------------
+ *  Email address (RFC 5322)
+ * ------------------------------------------------------------------------ */
+static bool
+json_format_check_email(const char *string, size_t len, void *data) {
+    const char *domain;
+    size_t i, domain_len;
+
+    /* dot-atom local part: no leading, trailing or consecutive dots */
+    for (i = 0; i < len && string[i] != '@'; i++) {
+        if (string[i] == '.') {
+            if (i == 0 || string[i - 1] == '.')
+                return false;
+        } else if (!json_format_is_atext(string[i])) {
+            return false;
+        }
+    }
+
+    if (i == 0 || i == len || i > 64 || string[i - 1] == '.')
+        return false;
+
+    domain = string + i + 1;
+    domain_len = len - i - 1;
+
+    /* Domain literals contain an address */
+    if (domain_len > 2 && domain[0] == '[' && domain[domain_len - 1] == ']') {
+        if (domain_len > 7 && memcmp(domain + 1, "IPv6:", 5) == 0)
+            return json_format_check_ipv6(domain + 6, domain_len - 7, NULL);
+
+        return json_format_check_ipv4(domain + 1, domain_len - 2, NULL);
+    }
+
+    return json_format_check_hostname(domain, domain_len, NULL);
+}
+
+/* ------------------------------------------------------------------------
+ *  Host name (RFC 1123)
+ * ------------------------------------------------------------------------ */
+static bool
+json_format_check_hostname(const char *string, size_t len, void *data) {
+    size_t label_len;
+
+    if (len == 0 || len > 253)
+        return false;
+
+    label_len = 0;
+
+    for (size_t i = 0; i < len; i++) {
+        char c;
+
+        c = string[i];
+
+        if (c == '.') {
+            if (label_len == 0 || string[i - 1] == '-')
+                return false;
+
+            label_len = 0;
+        } else if (json_format_is_alpha(c) || json_format_is_digit(c)) {
+            label_len++;
+        } else if (c == '-') {
+            if (label_len == 0)
+                return false;
+
+            label_len++;
+        } else {
+            return false;
+        }
+
+        if (label_len > 63)
+            return false;
+    }
+
+    return label_len > 0 && string[len - 1] != '-';
+}
+
+/* ------------------------------------------------------------------------
+ *  IP addresses (RFC 2673, RFC 4291)
+ * ------------------------------------------------------------------------ */
+static bool
+json_format_check_ipv4(const char *string, size_t len, void *data) {
+    size_t i;
+
+    i = 0;
+
+    for (int n = 0; n < 4; n++) {
+        unsigned int byte;
+        size_t start;
+
+        if (n > 0) {
+            if (i >= len || string[i] != '.')
+                return false;
+            i++;
+        }
+
+        start = i;
+        byte = 0;
+
+        while (i < len && json_format_is_digit(string[i]) && i - start < 3) {
+            byte = byte * 10 + (unsigned int)(string[i] - '0');
+            i++;
+        }
+
+        /* Leading zeros could be read as octal numbers */
+        if (i == start || byte > 255)
+            return false;
+        if (string[start] == '0' && i - start > 1)
+            return false;
+    }
+
+    return i == len;
+}
+
+static bool
+json_format_check_ipv6(const char *string, size_t len, void *data) {
+    size_t i, group_start, nb_groups;
+    bool compressed;
+
+    if (len < 2)
+        return false;
+
+    i = 0;
+    nb_groups = 0;
+    compressed = false;
+
+    if (string[0] == ':') {
+        if (string[1] != ':')
+            return false;
+
+        compressed = true;
+        i = 2;
+
+        if (i == len)
+            return true;
+    }
+
+    for (;;) {
+        group_start = i;
+
+        while (i < len && json_format_is_hex_digit(string[i])
+               && i - group_start < 4) {
+            i++;
+        }
+
+        if (i < len && string[i] == '.') {
+            /* Trailing IPv4 address, counting as two groups */
+            if (!json_format_check_ipv4(string + group_start,
+                                        len - group_start, NULL)) {
+                return false;
+            }
+
+            nb_groups += 2;
+            break;
+        }
+
+        if (i == group_start)
+            return false;
+
+        nb_groups++;
+
+        if (i == len)
+            break;
+
+        if (string[i] != ':')
+            return false;
+        i++;
+
+        if (i < len && string[i] == ':') {
+            if (compressed)
+                return false;
+
+            compressed = true;
+            i++;
+
+            if (i == len)
+                break;
+        } else if (i == len) {
+            return false;
+        }
+
+        if (nb_groups >= 8)
+            return false;
+    }
+
+    if (compressed)
+        return nb_groups <= 7;
+
+    return nb_groups == 8;
+}
+
+/* ------------------------------------------------------------------------
+ *  URI (RFC 3986)
+ * ------------------------------------------------------------------------ */
+static bool
+json_format_check_uri(const char *string, size_t len, void *data) {
+    bool fragment;
+    size_t i;
+
+    /* scheme */
+    if (len == 0 || !json_format_is_alpha(string[0]))
+        return false;
+
+    for (i = 1; i < len && string[i] != ':'; i++) {
+        char c;
+
+        c = string[i];
+
+        if (!json_format_is_alpha(c) && !json_format_is_digit(c)
+         && c != '+' && c != '-' && c != '.') {
+            return false;
+        }
+    }
+
+    if (i == len)
+        return false;
+    i++;
+
+    /* hier-part, query and fragment */
+    fragment = false;
+
+    for (; i < len; i++) {
+        char c;
+
+        c = string[i];
+
+        if (c == '%') {
+            if (i + 2 >= len
+             || !json_format_is_hex_digit(string[i + 1])
+             || !json_format_is_hex_digit(string[i + 2])) {
+                return false;
+            }
+
+            i += 2;
+        } else if (c == '#') {
+            if (fragment)
+                return false;
+
+            fragment = true;
+        } else if (!json_format_is_uri_char(c)) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+/* ------------------------------------------------------------------------
+ *  Regular expression (ECMA 262)
+ * ------------------------------------------------------------------------ */
+static bool
+json_format_check_regex(const char *string, size_t len, void *data) {
+    size_t depth;
+    bool quantifiable, quantified;
+    size_t i;
+
+    depth = 0;
+    quantifiable = false; /* the previous token is an atom */
+    quantified = false;   /* the previous token is a greedy quantifier */
+
+    for (i = 0; i < len; i++) {
+        char c;
+
+        c = string[i];
+
+        switch (c) {
+        case '\\':
+            if (i + 1 == len)
+                return false;
+            i++;
+
+            quantifiable = true;
+            quantified = false;
+            break;
+
+        case '(':
+            depth++;
+
+            if (i + 1 < len && string[i + 1] == '?') {
+                if (i + 2 == len)
+                    return false;
+
+                c = string[i + 2];
+                if (c != ':' && c != '=' && c != '!')
+                    return false;
+
+                i += 2;
+            }
+
+            quantifiable = false;
+            quantified = false;
+            break;
+
+        case ')':
+            if (depth == 0)
+                return false;
+            depth--;
+
+            quantifiable = true;
+            quantified = false;
+            break;
+
+        case '[':
+            i++;
+            if (i < len && string[i] == '^')
+                i++;
+
+            while (i < len && string[i] != ']') {
+                if (string[i] == '\\') {
+                    if (i + 1 == len)
+                        return false;
+                    i++;
+                }
+
+                i++;
+            }
+
+            if (i == len)
+                return false;
+
+            quantifiable = true;
+            quantified = false;
+            break;
+
+        case '*':
+        case '+':
+        case '?':
+            if (c == '?' && quantified) {
+                /* Lazy quantifier */
+                quantified = false;
+                break;
+            }
+
+            if (!quantifiable)
+                return false;
+
+            quantifiable = false;
+            quantified = true;
+            break;
+
+        case '{': {
+            unsigned int min, max;
+            size_t start, end;
+            bool has_max;
+
+            /* A brace which does not start a valid quantifier is a literal
+             * character. */
+            start = i + 1;
+            end = start;
+            min = 0;
+            max = 0;
+            has_max = true;
+
+            while (end < len && json_format_is_digit(string[end]))
+                min = min * 10 + (unsigned int)(string[end++] - '0');
+
+            if (end == start || end - start > 9 || end == len) {
+                quantifiable = true;
+                quantified = false;
+                break;
+            }
+
+            if (string[end] == ',') {
+                size_t max_start;
+
+                max_start = ++end;
+                while (end < len && json_format_is_digit(string[end]))
+                    max = max * 10 + (unsigned int)(string[end++] - '0');
+
+                if (end - max_start > 9) {
+                    quantifiable = true;
+                    quantified = false;
+                    break;
+                }
+
+                has_max = (end > max_start);
+            } else {
+                max = min;
+            }
+
+            if (end == len || string[end] != '}') {
+                quantifiable = true;
+                quantified = false;
+                break;
+            }
+
+            if (!quantifiable || (has_max && max < min))
+                return false;
+
+            i = end;
+
+            quantifiable = false;
+            quantified = true;
+            break;
+        }
+
+        case '|':
+        case '^':
+        case '$':
+            quantifiable = false;
+            quantified = false;
+            break;
+
+        default:
+            quantifiable = true;
+            quantified = false;
+            break;
+        }
+    }
+
+    return depth == 0;
+}
+
+/* ------------------------------------------------------------------------
+ *  Utils
+ * ------------------------------------------------------------------------ */
+static bool
+json_format_read_digits(const char *string, size_t len, size_t *pi,
+                        size_t nb_digits, unsigned int *pvalue) {
+    unsigned int value;
+    size_t i;
+
+    i = *pi;
+    if (len - i < nb_digits)
+        return false;
+
+    value = 0;
+
+    for (size_t n = 0; n < nb_digits; n++) {
+        if (!json_format_is_digit(string[i]))
+            return false;
+
+        value = value * 10 + (unsigned int)(string[i] - '0');
+        i++;
+    }
+
+    *pi = i;
+    *pvalue = value;
+    return true;
+}
+
+static bool
+json_format_is_digit(char c) {
+    return c >= '0' && c <= '9';
+}
+
+static bool
+json_format_is_alpha(char c) {
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z');
+}
+
+static bool
+json_format_is_hex_digit(char c) {
+    return json_format_is_digit(c)
+        || (c >= 'a' && c <= 'f') || (c >= 'A' && c <= 'F');
+}
+
+static bool
+json_format_is_atext(char c) {
+    if (json_format_is_alpha(c) || json_format_is_digit(c))
+        return true;
+
+    return c != '\0' && strchr("!#$%&'*+-/=?^_`{|}~", c) != NULL;
+}
+
+static bool
+json_format_is_uri_char(char c) {
+    /* unreserved, sub-delims and gen-delims except '#' and '%', which are
+     * handled separately */
+    if (json_format_is_alpha(c) || json_format_is_digit(c))
+        return true;
+
+    return c != '\0' && strchr("-._~!$&'()*+,;=:@/?[]", c) != NULL;
+}
@@ -0,0 +1,1140 @@
+/*
+ * Copyright (c) 2014-2015 Nicolas Martyanoff
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "internal.h"
+
+/* A frozen document is a single block made of a header, a tape of 64 bit
+ * words and a string area. Every value starts with a tag word containing its
+ * type in the low 8 bits and a payload in the upper 56 bits:
+ *
+ * null, boolean: the tag only, the payload is the boolean value.
+ * integer, real: the tag followed by the raw 64 bit value.
+ * string:        the tag (payload: length) followed by the offset in bytes of
+ *                the NUL-terminated string data.
+ * array:         the tag (payload: number of elements) followed by the
+ *                offset in words of each element.
+ * object:        the tag (payload: number of members), one entry of three
+ *                words per member in insertion order (key hash and length,
+ *                offset of the key string, offset of the value), then the
+ *                positions of the members sorted by key, packed as 32 bit
+ *                integers.
+ *
+ * All offsets are relative to the tag word of the value containing them, so
+ * the document does not contain any pointer and can be copied anywhere: its
+ * memory can be written to a file, then mapped and used in place without
+ * any decoding. Access is favoured over size; the compact binary encoding
+ * (see binary.c) is meant for storage and transfer.
+ *
+ * Words are stored in host byte order; documents written on a host with a
+ * different byte order are detected by their magic number and rejected.
+ * Arrays and objects cannot be nested more than JSON_MAX_DEPTH times. */
+
+struct json_frozen_string {
+    const char *ptr;
+    size_t len;
+    uint32_t hash;
+    uint64_t offset; /* in the string area */
+};
+
+struct json_frozen_ctx {
+    /* Deduplication table of all strings, keys and values */
+    struct json_frozen_string *strings;
+    size_t nb_strings;
+    size_t strings_table_size;
+    uint64_t strings_size;
+
+    /* Offsets of strings in the string area, in traversal order */
+    uint64_t *offsets;
+    size_t nb_offsets;
+    size_t offsets_size;
+    size_t offsets_cursor;
+
+    uint64_t *tape;
+    char *string_area;
+};
+
+struct json_frozen_sort_entry {
+    uint32_t hash;
+    uint32_t len;
+    const char *key;
+    uint32_t position;
+};
+
+static int json_frozen_measure(struct json_frozen_ctx *,
+                               const struct json_value *, size_t,
+                               uint64_t *);
+static int json_frozen_add_string(struct json_frozen_ctx *,
+                                  const char *, size_t, uint32_t);
+static int json_frozen_strings_resize(struct json_frozen_ctx *, size_t);
+static uint64_t json_frozen_write(struct json_frozen_ctx *,
+                                  const struct json_value *, uint64_t);
+static int json_frozen_sort_entry_cmp(const void *, const void *);
+static void json_frozen_ctx_free(struct json_frozen_ctx *);
+
+static struct json_value *json_frozen_thaw(struct json_key_table *,
+                                           const uint64_t *);
+static int json_frozen_check_value(const struct json_frozen *, uint64_t,
+                                   size_t, uint64_t *);
+static int json_frozen_check_string(const struct json_frozen *, uint64_t,
+                                    uint64_t, uint64_t);
+
+static const uint64_t *json_frozen_value_words(const struct json_frozen_value *);
+static const struct json_frozen_value *
+json_frozen_words_value(const uint64_t *);
+static uint64_t json_frozen_value_payload(const struct json_frozen_value *);
+static const char *json_frozen_value_string(const uint64_t *, uint64_t);
+static uint32_t json_frozen_object_position(const uint64_t *, uint64_t,
+                                            uint64_t);
+static bool json_frozen_object_find(const struct json_frozen_value *,
+                                    const char *, size_t, uint64_t *);
+
+struct json_frozen *
+json_freeze(const struct json_value *value) {
+    struct json_frozen_ctx ctx;
+    struct json_frozen *frozen;
+    uint64_t nb_words, strings_size;
+    size_t size;
+
+    memset(&ctx, 0, sizeof(struct json_frozen_ctx));
+
+    /* First pass: compute the size of the tape and collect strings */
+    nb_words = 0;
+    if (json_frozen_measure(&ctx, value, 0, &nb_words) == -1) {
+        json_frozen_ctx_free(&ctx);
+        return NULL;
+    }
+
+    strings_size = (ctx.strings_size + 7) & ~(uint64_t)7;
+
+    size = sizeof(struct json_frozen) + (size_t)nb_words * sizeof(uint64_t)
+         + (size_t)strings_size;
+
+    frozen = c_malloc0(size);
+    if (!frozen) {
+        json_frozen_ctx_free(&ctx);
+        return NULL;
+    }
+
+    frozen->magic = JSON_FROZEN_MAGIC;
+    frozen->version = JSON_FROZEN_VERSION;
+    frozen->size = size;
+    frozen->nb_words = nb_words;
+    frozen->strings_size = strings_size;
+
+    ctx.tape = frozen->tape;
+    ctx.string_area = (char *)(frozen->tape + nb_words);
+
+    for (size_t i = 0; i < ctx.strings_table_size; i++) {
+        const struct json_frozen_string *string;
+
+        string = ctx.strings + i;
+        if (!string->ptr)
+            continue;
+
+        memcpy(ctx.string_area + string->offset, string->ptr, string->len);
+    }
+
+    /* Second pass: write values */
+    json_frozen_write(&ctx, value, 0);
+
+    json_frozen_ctx_free(&ctx);
+    return frozen;
+}
+
+void
+json_frozen_delete(struct json_frozen *frozen) {
+    c_free(frozen);
+}
+
+struct json_frozen *
+json_frozen_clone(const struct json_frozen *frozen) {
+    struct json_frozen *nfrozen;
+
+    nfrozen = c_malloc((size_t)frozen->size);
+    if (!nfrozen)
+        return NULL;
+
+    memcpy(nfrozen, frozen, (size_t)frozen->size);
+    return nfrozen;
+}
+
+size_t
+json_frozen_size(const struct json_frozen *frozen) {
+    return (size_t)frozen->size;
+}
+
+const struct json_frozen_value *
+json_frozen_root(const struct json_frozen *frozen) {
+    return json_frozen_words_value(frozen->tape);
+}
+
+struct json_value *
+json_frozen_value_thaw(const struct json_frozen_value *fvalue) {
+    struct json_key_table keys;
+    struct json_value *value;
+
+    /* Identical keys share the same string in the string area, interning
+     * them makes the resulting objects share keys as parsed ones do. */
+    json_key_table_init(&keys);
+
+    value = json_frozen_thaw(&keys, json_frozen_value_words(fvalue));
+
+    json_key_table_free(&keys);
+    return value;
+}
+
+const struct json_frozen *
+json_frozen_open(const void *data, size_t len, uint32_t options) {
+    const struct json_frozen *frozen;
+
+    if ((uintptr_t)data % sizeof(uint64_t) != 0) {
+        c_set_error("misaligned data");
+        return NULL;
+    }
+
+    frozen = data;
+
+    if (options & JSON_FROZEN_OPEN_TRUSTED) {
+        if (len < sizeof(struct json_frozen)
+         || frozen->magic != JSON_FROZEN_MAGIC
+         || frozen->version != JSON_FROZEN_VERSION
+         || frozen->size > len) {
+            c_set_error("invalid frozen document");
+            return NULL;
+        }
+    } else {
+        if (json_frozen_check(frozen, len) == -1) {
+            c_set_error("invalid frozen document: %s", c_get_error());
+            return NULL;
+        }
+    }
+
+    return frozen;
+}
+
+const struct json_frozen *
+json_frozen_map_file(const char *path, uint32_t options) {
+    const struct json_frozen *frozen;
+    struct stat st;
+    void *data;
+    int fd;
+
+    fd = open(path, O_RDONLY);
+    if (fd == -1) {
+        c_set_error("cannot open %s: %s", path, strerror(errno));
+        return NULL;
+    }
+
+    if (fstat(fd, &st) == -1) {
+        c_set_error("cannot stat %s: %s", path, strerror(errno));
+        close(fd);
+        return NULL;
+    }
+
+    if ((size_t)st.st_size < sizeof(struct json_frozen)) {
+        c_set_error("invalid frozen document: truncated header");
+        close(fd);
+        return NULL;
+    }
+
+    data = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (data == MAP_FAILED) {
+        c_set_error("cannot map %s: %s", path, strerror(errno));
+        close(fd);
+        return NULL;
+    }
+
+    close(fd);
+
+    frozen = json_frozen_open(data, (size_t)st.st_size, options);
+    if (!frozen) {
+        munmap(data, (size_t)st.st_size);
+        return NULL;
+    }
+
+    if (frozen->size != (uint64_t)st.st_size) {
+        c_set_error("invalid frozen document: trailing data");
+        munmap(data, (size_t)st.st_size);
+        return NULL;
+    }
+
+    return frozen;
+}
+
+void
+json_frozen_unmap(const struct json_frozen *frozen) {
+    if (!frozen)
+        return;
+
+    munmap((void *)frozen, (size_t)frozen->size);
+}
+
+int
+json_frozen_check(const struct json_frozen *frozen, size_t size) {
+    uint64_t end;
+
+    if (size < sizeof(struct json_frozen)) {
+        c_set_error("truncated header");
+        return -1;
+    }
+
+    if (frozen->magic != JSON_FROZEN_MAGIC) {
+        if (frozen->magic == __builtin_bswap32(JSON_FROZEN_MAGIC)) {
+            c_set_error("unsupported byte order");
+        } else {
+            c_set_error("invalid magic number");
+        }
+
+        return -1;
+    }
+
+    if (frozen->version != JSON_FROZEN_VERSION) {
+        c_set_error("unsupported version %"PRIu32, frozen->version);
+        return -1;
+    }
+
+    if (frozen->size > size) {
+        c_set_error("truncated document");
+        return -1;
+    }
+
+    if (frozen->size < sizeof(struct json_frozen)) {
+        c_set_error("invalid document size");
+        return -1;
+    }
+
+    if (frozen->nb_words == 0
+     || frozen->nb_words > (frozen->size - sizeof(struct json_frozen)) / 8
+     || frozen->strings_size != frozen->size - sizeof(struct json_frozen)
+                                - frozen->nb_words * 8) {
+        c_set_error("invalid document size");
+        return -1;
+    }
+
+    if (json_frozen_check_value(frozen, 0, 0, &end) == -1)
+        return -1;
+
+    if (end != frozen->nb_words) {
+        c_set_error("trailing data after root value");
+        return -1;
+    }
+
+    return 0;
+}
+
+enum json_type
+json_frozen_value_type(const struct json_frozen_value *fvalue) {
+    return (enum json_type)(json_frozen_value_words(fvalue)[0] & 0xff);
+}
+
+size_t
+json_frozen_object_nb_members(const struct json_frozen_value *fvalue) {
+    return (size_t)json_frozen_value_payload(fvalue);
+}
+
+bool
+json_frozen_object_has_member(const struct json_frozen_value *fvalue,
+                              const char *key) {
+    return json_frozen_object_has_member2(fvalue, key, strlen(key));
+}
+
+bool
+json_frozen_object_has_member2(const struct json_frozen_value *fvalue,
+                               const char *key, size_t len) {
+    uint64_t idx;
+
+    return json_frozen_object_find(fvalue, key, len, &idx);
+}
+
+const struct json_frozen_value *
+json_frozen_object_member(const struct json_frozen_value *fvalue,
+                          const char *key) {
+    return json_frozen_object_member2(fvalue, key, strlen(key));
+}
+
+const struct json_frozen_value *
+json_frozen_object_member2(const struct json_frozen_value *fvalue,
+                           const char *key, size_t len) {
+    const uint64_t *words, *entry;
+    uint64_t idx;
+
+    if (!json_frozen_object_find(fvalue, key, len, &idx))
+        return NULL;
+
+    words = json_frozen_value_words(fvalue);
+    entry = words + 1 + idx * JSON_FROZEN_OBJECT_ENTRY_SIZE;
+
+    return json_frozen_words_value(words + entry[2]);
+}
+
+const char *
+json_frozen_object_nth_member(const struct json_frozen_value *fvalue,
+                              size_t idx,
+                              const struct json_frozen_value **pvalue) {
+    const uint64_t *words, *entry;
+
+    words = json_frozen_value_words(fvalue);
+    entry = words + 1 + idx * JSON_FROZEN_OBJECT_ENTRY_SIZE;
+
+    if (pvalue)
+        *pvalue = json_frozen_words_value(words + entry[2]);
+    return json_frozen_value_string(words, entry[1]);
+}
+
+size_t
+json_frozen_array_nb_elements(const struct json_frozen_value *fvalue) {
+    return (size_t)json_frozen_value_payload(fvalue);
+}
+
+const struct json_frozen_value *
+json_frozen_array_element(const struct json_frozen_value *fvalue,
+                          size_t idx) {
+    const uint64_t *words;
+
+    if (idx >= json_frozen_value_payload(fvalue)) {
+        c_set_error("invalid index %zu", idx);
+        return NULL;
+    }
+
+    words = json_frozen_value_words(fvalue);
+    return json_frozen_words_value(words + words[1 + idx]);
+}
+
+int64_t
+json_frozen_integer_value(const struct json_frozen_value *fvalue) {
+    int64_t integer;
+
+    memcpy(&integer, json_frozen_value_words(fvalue) + 1, sizeof(int64_t));
+    return integer;
+}
+
+double
+json_frozen_real_value(const struct json_frozen_value *fvalue) {
+    double real;
+
+    memcpy(&real, json_frozen_value_words(fvalue) + 1, sizeof(double));
+    return real;
+}
+
+const char *
+json_frozen_string_value(const struct json_frozen_value *fvalue) {
+    const uint64_t *words;
+
+    words = json_frozen_value_words(fvalue);
+    return json_frozen_value_string(words, words[1]);
+}
+
+size_t
+json_frozen_string_length(const struct json_frozen_value *fvalue) {
+    return (size_t)json_frozen_value_payload(fvalue);
+}
+
+bool
+json_frozen_boolean_value(const struct json_frozen_value *fvalue) {
+    return json_frozen_value_payload(fvalue) != 0;
+}
+
+static int
+json_frozen_measure(struct json_frozen_ctx *ctx,
+                    const struct json_value *value, size_t depth,
+                    uint64_t *pnb_words) {
+    if ((value->type == JSON_OBJECT || value->type == JSON_ARRAY)
+     && depth >= JSON_MAX_DEPTH) {
+        c_set_error("too many nested arrays and objects");
+        return -1;
+    }
+
+    switch (value->type) {
+    case JSON_OBJECT:
+    {
+        const struct json_object *object;
+
+        object = &value->u.object;
+
+        if (object->nb_members > UINT32_MAX) {
+            c_set_error("object too large");
+            return -1;
+        }
+
+        *pnb_words += 1 + object->nb_members * JSON_FROZEN_OBJECT_ENTRY_SIZE
+                    + (object->nb_members + 1) / 2;
+
+        for (size_t i = 0; i < object->nb_members; i++) {
+            const struct json_key *key;
+
+            key = object->keys[i].key;
+
+            if (json_frozen_add_string(ctx, key->ptr, key->len,
+                                       key->hash) == -1) {
+                return -1;
+            }
+
+            if (json_frozen_measure(ctx, object->values[i], depth + 1,
+                                    pnb_words) == -1) {
+                return -1;
+            }
+        }
+
+        break;
+    }
+
+    case JSON_ARRAY:
+        *pnb_words += 1 + value->u.array.nb_elements;
+
+        for (size_t i = 0; i < value->u.array.nb_elements; i++) {
+            if (json_frozen_measure(ctx, value->u.array.elements[i],
+                                    depth + 1, pnb_words) == -1) {
+                return -1;
+            }
+        }
+
+        break;
+
+    case JSON_STRING:
+        *pnb_words += 2;
+
+        if (json_frozen_add_string(ctx, value->u.string.ptr,
+                                   value->u.string.len,
+                                   json_hash_string(value->u.string.ptr,
+                                                    value->u.string.len))
+            == -1) {
+            return -1;
+        }
+
+        break;
+
+    case JSON_INTEGER:
+    case JSON_REAL:
+        *pnb_words += 2;
+        break;
+
+    case JSON_BOOLEAN:
+    case JSON_NULL:
+        *pnb_words += 1;
+        break;
+    }
+
+    return 0;
+}
+
+static int
+json_frozen_add_string(struct json_frozen_ctx *ctx,
+                       const char *ptr, size_t len, uint32_t hash) {
+    struct json_frozen_string *string;
+    size_t mask, idx;
+
+    if (ctx->nb_offsets >= ctx->offsets_size) {
+        uint64_t *offsets;
+        size_t size;
+
+        size = (ctx->offsets_size == 0) ? 64 : ctx->offsets_size * 2;
+
+        offsets = c_realloc(ctx->offsets, size * sizeof(uint64_t));
+        if (!offsets)
+            return -1;
+
+        ctx->offsets = offsets;
+        ctx->offsets_size = size;
+    }
+
+    if ((ctx->nb_strings + 1) * 2 > ctx->strings_table_size) {
+        size_t size;
+
+        size = (ctx->strings_table_size == 0) ? 64
+                                              : ctx->strings_table_size * 2;
+
+        if (json_frozen_strings_resize(ctx, size) == -1)
+            return -1;
+    }
+
+    mask = ctx->strings_table_size - 1;
+
+    for (idx = hash & mask; ctx->strings[idx].ptr; idx = (idx + 1) & mask) {
+        string = ctx->strings + idx;
+
+        if (string->hash == hash && string->len == len
+         && memcmp(string->ptr, ptr, len) == 0) {
+            ctx->offsets[ctx->nb_offsets++] = string->offset;
+            return 0;
+        }
+    }
+
+    string = ctx->strings + idx;
+
+    string->ptr = ptr;
+    string->len = len;
+    string->hash = hash;
+    string->offset = ctx->strings_size;
+
+    ctx->nb_strings++;
+    ctx->strings_size += len + 1;
+
+    ctx->offsets[ctx->nb_offsets++] = string->offset;
+    return 0;
+}
+
+static int
+json_frozen_strings_resize(struct json_frozen_ctx *ctx, size_t size) {
+    struct json_frozen_string *strings;
+    size_t mask;
+
+    strings = c_malloc0(size * sizeof(struct json_frozen_string));
+    if (!strings)
+        return -1;
+
+    mask = size - 1;
+
+    for (size_t i = 0; i < ctx->strings_table_size; i++) {
+        const struct json_frozen_string *string;
+        size_t idx;
+
+        string = ctx->strings + i;
+        if (!string->ptr)
+            continue;
+
+        idx = string->hash & mask;
+        while (strings[idx].ptr)
+            idx = (idx + 1) & mask;
+
+        strings[idx] = *string;
+    }
+
+    c_free(ctx->strings);
+
+    ctx->strings = strings;
+    ctx->strings_table_size = size;
+
+    return 0;
+}
+
+static uint64_t
+json_frozen_write(struct json_frozen_ctx *ctx,
+                  const struct json_value *value, uint64_t pos) {
+    uint64_t *words;
+    uint64_t strings, next;
+
+    words = ctx->tape + pos;
+
+    /* Offset in bytes of the string area relative to the current value */
+    strings = (uint64_t)(ctx->string_area - (const char *)words);
+
+    switch (value->type) {
+    case JSON_OBJECT:
+    {
+        const struct json_object *object;
+        struct json_frozen_sort_entry stack_entries[JSON_OBJECT_INDEX_THRESHOLD];
+        struct json_frozen_sort_entry *entries;
+        uint64_t *index;
+        size_t nb_members;
+
+        object = &value->u.object;
+        nb_members = object->nb_members;
+
+        words[0] = JSON_FROZEN_TAG(JSON_OBJECT, nb_members);
+
+        index = words + 1 + nb_members * JSON_FROZEN_OBJECT_ENTRY_SIZE;
+        next = pos + 1 + nb_members * JSON_FROZEN_OBJECT_ENTRY_SIZE
+             + (nb_members + 1) / 2;
+
+        for (size_t i = 0; i < nb_members; i++) {
+            const struct json_object_key *key;
+            uint64_t *entry;
+
+            key = object->keys + i;
+            entry = words + 1 + i * JSON_FROZEN_OBJECT_ENTRY_SIZE;
+
+            entry[0] = ((uint64_t)key->hash << 32) | key->len;
+            entry[1] = strings + ctx->offsets[ctx->offsets_cursor++];
+            entry[2] = next - pos;
+
+            next = json_frozen_write(ctx, object->values[i], next);
+        }
+
+        /* Sort member positions by key for lookups */
+        if (nb_members <= JSON_OBJECT_INDEX_THRESHOLD) {
+            entries = stack_entries;
+        } else {
+            entries = c_malloc(nb_members
+                               * sizeof(struct json_frozen_sort_entry));
+        }
+
+        for (size_t i = 0; i < nb_members; i++) {
+            entries[i].hash = object->keys[i].hash;
+            entries[i].len = object->keys[i].len;
+            entries[i].key = object->keys[i].key->ptr;
+            entries[i].position = (uint32_t)i;
+        }
+
+        qsort(entries, nb_members, sizeof(struct json_frozen_sort_entry),
+              json_frozen_sort_entry_cmp);
+
+        for (size_t i = 0; i < nb_members; i++) {
+            index[i / 2] |= (uint64_t)entries[i].position << (32 * (i % 2));
+        }
+
+        if (entries != stack_entries)
+            c_free(entries);
+
+        return next;
+    }
+
+    case JSON_ARRAY:
+    {
+        const struct json_array *array;
+
+        array = &value->u.array;
+
+        words[0] = JSON_FROZEN_TAG(JSON_ARRAY, array->nb_elements);
+        next = pos + 1 + array->nb_elements;
+
+        for (size_t i = 0; i < array->nb_elements; i++) {
+            words[1 + i] = next - pos;
+            next = json_frozen_write(ctx, array->elements[i], next);
+        }
+
+        return next;
+    }
+
+    case JSON_INTEGER:
+        words[0] = JSON_FROZEN_TAG(JSON_INTEGER, 0);
+        memcpy(words + 1, &value->u.integer, sizeof(int64_t));
+        return pos + 2;
+
+    case JSON_REAL:
+        words[0] = JSON_FROZEN_TAG(JSON_REAL, 0);
+        memcpy(words + 1, &value->u.real, sizeof(double));
+        return pos + 2;
+
+    case JSON_STRING:
+        words[0] = JSON_FROZEN_TAG(JSON_STRING, value->u.string.len);
+        words[1] = strings + ctx->offsets[ctx->offsets_cursor++];
+        return pos + 2;
+
+    case JSON_BOOLEAN:
+        words[0] = JSON_FROZEN_TAG(JSON_BOOLEAN, value->u.boolean ? 1 : 0);
+        return pos + 1;
+
+    case JSON_NULL:
+        words[0] = JSON_FROZEN_TAG(JSON_NULL, 0);
+        return pos + 1;
+    }
+
+    return pos;
+}
+
+static int
+json_frozen_sort_entry_cmp(const void *arg1, const void *arg2) {
+    const struct json_frozen_sort_entry *entry1, *entry2;
+    int ret;
+
+    entry1 = arg1;
+    entry2 = arg2;
+
+    if (entry1->hash != entry2->hash)
+        return (entry1->hash < entry2->hash) ? -1 : 1;
+
+    if (entry1->len != entry2->len)
+        return (entry1->len < entry2->len) ? -1 : 1;
+
+    ret = memcmp(entry1->key, entry2->key, entry1->len);
+    if (ret != 0)
+        return ret;
+
+    /* Duplicate keys: the first member wins, as for regular objects */
+    if (entry1->position != entry2->position)
+        return (entry1->position < entry2->position) ? -1 : 1;
+
+    return 0;
+}
+
+static void
+json_frozen_ctx_free(struct json_frozen_ctx *ctx) {
+    c_free(ctx->strings);
+    c_free(ctx->offsets);
+
+    memset(ctx, 0, sizeof(struct json_frozen_ctx));
+}
+
+static const uint64_t *
+json_frozen_value_words(const struct json_frozen_value *fvalue) {
+    return (const uint64_t *)fvalue;
+}
+
+static const struct json_frozen_value *
+json_frozen_words_value(const uint64_t *words) {
+    return (const struct json_frozen_value *)words;
+}
+
+static uint64_t
+json_frozen_value_payload(const struct json_frozen_value *fvalue) {
+    return json_frozen_value_words(fvalue)[0] >> 8;
+}
+
+static const char *
+json_frozen_value_string(const uint64_t *words, uint64_t offset) {
+    return (const char *)words + offset;
+}
+
+static uint32_t
+json_frozen_object_position(const uint64_t *words, uint64_t nb_members,
+                            uint64_t i) {
+    const uint64_t *index;
+
+    index = words + 1 + nb_members * JSON_FROZEN_OBJECT_ENTRY_SIZE;
+    return (uint32_t)(index[i / 2] >> (32 * (i % 2)));
+}
+
+static bool
+json_frozen_object_find(const struct json_frozen_value *fvalue,
+                        const char *key, size_t len, uint64_t *pidx) {
+    const uint64_t *words;
+    uint64_t nb_members, low, high;
+    uint32_t hash;
+
+    words = json_frozen_value_words(fvalue);
+    nb_members = json_frozen_value_payload(fvalue);
+
+    if (len > UINT32_MAX)
+        return false;
+
+    hash = json_hash_string(key, len);
+
+    /* Find the first member whose key is not lower than the searched key in
+     * the sorted index. */
+    low = 0;
+    high = nb_members;
+
+    while (low < high) {
+        const uint64_t *entry;
+        uint64_t middle;
+        uint32_t ehash, elen;
+        int cmp;
+
+        middle = low + (high - low) / 2;
+        entry = words + 1
+              + json_frozen_object_position(words, nb_members, middle)
+              * JSON_FROZEN_OBJECT_ENTRY_SIZE;
+
+        ehash = (uint32_t)(entry[0] >> 32);
+        elen = (uint32_t)entry[0];
+
+        if (ehash != hash) {
+            cmp = (ehash < hash) ? -1 : 1;
+        } else if (elen != len) {
+            cmp = (elen < len) ? -1 : 1;
+        } else {
+            cmp = memcmp(json_frozen_value_string(words, entry[1]), key, len);
+        }
+
+        if (cmp < 0) {
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
+    }
+
+    if (low < nb_members) {
+        const uint64_t *entry;
+        uint32_t position;
+
+        position = json_frozen_object_position(words, nb_members, low);
+        entry = words + 1 + position * JSON_FROZEN_OBJECT_ENTRY_SIZE;
+
+        if (entry[0] == (((uint64_t)hash << 32) | len)
+         && memcmp(json_frozen_value_string(words, entry[1]), key,
+                   len) == 0) {
+            *pidx = position;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+static struct json_value *
+json_frozen_thaw(struct json_key_table *keys, const uint64_t *words) {
+    uint64_t payload;
+
+    payload = words[0] >> 8;
+
+    switch ((enum json_type)(words[0] & 0xff)) {
+    case JSON_OBJECT:
+    {
+        struct json_value *value;
+
+        value = json_object_new();
+
+        if (json_object_reserve(value, (size_t)payload) == -1) {
+            json_value_delete(value);
+            return NULL;
+        }
+
+        for (uint64_t i = 0; i < payload; i++) {
+            const uint64_t *entry;
+            struct json_value *member;
+            struct json_key *key;
+
+            entry = words + 1 + i * JSON_FROZEN_OBJECT_ENTRY_SIZE;
+
+            member = json_frozen_thaw(keys, words + entry[2]);
+            if (!member) {
+                json_value_delete(value);
+                return NULL;
+            }
+
+            key = json_key_table_intern2(keys,
+                                         json_frozen_value_string(words,
+                                                                  entry[1]),
+                                         (uint32_t)entry[0],
+                                         (uint32_t)(entry[0] >> 32));
+            if (!key) {
+                json_value_delete(member);
+                json_value_delete(value);
+                return NULL;
+            }
+
+            if (json_object_add_member_key(value, key, member) == -1) {
+                json_key_unref(key);
+                json_value_delete(member);
+                json_value_delete(value);
+                return NULL;
+            }
+        }
+
+        return value;
+    }
+
+    case JSON_ARRAY:
+    {
+        struct json_value *value;
+
+        value = json_array_new();
+
+        if (json_array_reserve(value, (size_t)payload) == -1) {
+            json_value_delete(value);
+            return NULL;
+        }
+
+        for (uint64_t i = 0; i < payload; i++) {
+            struct json_value *element;
+
+            element = json_frozen_thaw(keys, words + words[1 + i]);
+            if (!element) {
+                json_value_delete(value);
+                return NULL;
+            }
+
+            json_array_add_element(value, element);
+        }
+
+        return value;
+    }
+
+    case JSON_INTEGER:
+    {
+        int64_t integer;
+
+        memcpy(&integer, words + 1, sizeof(int64_t));
+        return json_integer_new(integer);
+    }
+
+    case JSON_REAL:
+    {
+        double real;
+
+        memcpy(&real, words + 1, sizeof(double));
+        return json_real_new(real);
+    }
+
+    case JSON_STRING:
+        return json_string_new2(json_frozen_value_string(words, words[1]),
+                                (size_t)payload);
+
+    case JSON_BOOLEAN:
+        return json_boolean_new(payload != 0);
+
+    case JSON_NULL:
+        return json_null_new();
+    }
+
+    c_set_error("unknown json value type %d", (int)(words[0] & 0xff));
+    return NULL;
+}
+
+static int
+json_frozen_check_value(const struct json_frozen *frozen, uint64_t pos,
+                        size_t depth, uint64_t *pend) {
+    const uint64_t *words;
+    uint64_t nb_words, payload, next;
+
+    /* Children must be laid out one after the other right after the header
+     * of their parent, exactly as json_freeze() writes them. This guarantees
+     * that the tape is a tree and that checking it is linear. */
+
+    nb_words = frozen->nb_words;
+    words = frozen->tape + pos;
+
+    if (pos >= nb_words) {
+        c_set_error("value out of bounds at word %"PRIu64, pos);
+        return -1;
+    }
+
+    payload = words[0] >> 8;
+
+    if (((words[0] & 0xff) == JSON_OBJECT || (words[0] & 0xff) == JSON_ARRAY)
+     && depth >= JSON_MAX_DEPTH) {
+        c_set_error("too many nested arrays and objects at word %"PRIu64, pos);
+        return -1;
+    }
+
+    switch ((enum json_type)(words[0] & 0xff)) {
+    case JSON_OBJECT:
+        if (payload > UINT32_MAX
+         || payload > (nb_words - pos - 1) / JSON_FROZEN_OBJECT_ENTRY_SIZE) {
+            c_set_error("invalid object size at word %"PRIu64, pos);
+            return -1;
+        }
+
+        next = pos + 1 + payload * JSON_FROZEN_OBJECT_ENTRY_SIZE
+             + (payload + 1) / 2;
+        if (next > nb_words) {
+            c_set_error("invalid object size at word %"PRIu64, pos);
+            return -1;
+        }
+
+        for (uint64_t i = 0; i < payload; i++) {
+            const uint64_t *entry;
+
+            entry = words + 1 + i * JSON_FROZEN_OBJECT_ENTRY_SIZE;
+
+            if (json_frozen_check_string(frozen, pos, entry[1],
+                                         (uint32_t)entry[0]) == -1) {
+                return -1;
+            }
+
+            if (entry[2] != next - pos) {
+                c_set_error("invalid member offset at word %"PRIu64, pos);
+                return -1;
+            }
+
+            if (json_frozen_check_value(frozen, next, depth + 1,
+                                        &next) == -1) {
+                return -1;
+            }
+        }
+
+        for (uint64_t i = 0; i < payload; i++) {
+            if (json_frozen_object_position(words, payload, i) >= payload) {
+                c_set_error("invalid object index at word %"PRIu64, pos);
+                return -1;
+            }
+        }
+
+        break;
+
+    case JSON_ARRAY:
+        if (payload > nb_words - pos - 1) {
+            c_set_error("invalid array size at word %"PRIu64, pos);
+            return -1;
+        }
+
+        next = pos + 1 + payload;
+
+        for (uint64_t i = 0; i < payload; i++) {
+            if (words[1 + i] != next - pos) {
+                c_set_error("invalid element offset at word %"PRIu64, pos);
+                return -1;
+            }
+
+            if (json_frozen_check_value(frozen, next, depth + 1,
+                                        &next) == -1) {
+                return -1;
+            }
+        }
+
+        break;
+
+    case JSON_STRING:
+        if (pos + 2 > nb_words) {
+            c_set_error("truncated string at word %"PRIu64, pos);
+            return -1;
+        }
+
+        if (json_frozen_check_string(frozen, pos, words[1], payload) == -1)
+            return -1;
+
+        next = pos + 2;
+        break;
+
+    case JSON_INTEGER:
+    case JSON_REAL:
+        if (pos + 2 > nb_words) {
+            c_set_error("truncated number at word %"PRIu64, pos);
+            return -1;
+        }
+
+        next = pos + 2;
+        break;
+
+    case JSON_BOOLEAN:
+    case JSON_NULL:
+        next = pos + 1;
+        break;
+
+    default:
+        c_set_error("invalid value type at word %"PRIu64, pos);
+        return -1;
+    }
+
+    *pend = next;
+    return 0;
+}
+
+static int
+json_frozen_check_string(const struct json_frozen *frozen, uint64_t pos,
+                         uint64_t offset, uint64_t len) {
+    uint64_t start, strings_start;
+
+    /* The offset is relative to the value, convert it to an offset in the
+     * string area. */
+    strings_start = (frozen->nb_words - pos) * sizeof(uint64_t);
+
+    if (offset < strings_start) {
+        c_set_error("invalid string offset at word %"PRIu64, pos);
+        return -1;
+    }
+
+    start = offset - strings_start;
+
+    if (start >= frozen->strings_size
+     || len >= frozen->strings_size - start) {
+        c_set_error("invalid string offset at word %"PRIu64, pos);
+        return -1;
+    }
+
+    if (json_frozen_value_string(frozen->tape + pos, offset)[len] != '\0') {
+        c_set_error("unterminated string at word %"PRIu64, pos);
+        return -1;
+    }
+
+    return 0;
+}
@@ -29,6 +29,10 @@
 
 #include "json.h"
 
+/* Maximum nesting depth of arrays and objects in binary input, so that
+ * checking or decoding untrusted data cannot exhaust the stack. */
+#define JSON_MAX_DEPTH 1024
+
 /* ------------------------------------------------------------------------
  *  Errors
  * ------------------------------------------------------------------------ */
@@ -36,43 +40,119 @@ void json_set_error_invalid_character(char, const char *fmt, ...)
     __attribute__((format(printf, 2, 3)));
 
 /* ------------------------------------------------------------------------
- *  JSON
+ *  Memory allocation
  * ------------------------------------------------------------------------ */
-struct json_object_member {
-    struct json_value *key;
-    struct json_value *value;
-    size_t index;
+const struct json_allocator *json_allocator_current(void);
+
+void *json_allocator_malloc(const struct json_allocator *, size_t);
+void *json_allocator_realloc(const struct json_allocator *, void *, size_t);
+void json_allocator_free(const struct json_allocator *, void *);
+
+/* Use the current allocator */
+void *json_malloc(size_t);
+void *json_malloc0(size_t);
+void *json_realloc(void *, size_t);
+void json_free(void *);
+char *json_strndup(const char *, size_t);
+int json_vasprintf(char **, const char *, va_list);
+
+/* ------------------------------------------------------------------------
+ *  Keys
+ * ------------------------------------------------------------------------ */
+uint32_t json_hash_string(const char *, size_t);
+uint32_t json_hash_integer(uint64_t);
+
+/* Hash table functions for tables keyed by address */
+uint32_t json_hash_pointer(const void *);
+bool json_equal_pointer(const void *, const void *);
+
+/* Object keys are immutable and reference counted so that objects can share
+ * them. Keys created by json_key_new() store their string inline; keys
+ * created by json_key_new_nocopy() take ownership of a string allocated with
+ * the current allocator. */
+struct json_key {
+    unsigned int refcount;
+    uint32_t hash;
+    size_t len;
+    char *ptr;
+
+    /* The allocator the key was created with, used to free it */
+    const struct json_allocator *allocator;
 };
 
-enum json_object_sort_mode {
-    JSON_OBJECT_UNSORTED = 0,
-    JSON_OBJECT_SORTED_BY_INDEX,
-    JSON_OBJECT_SORTED_BY_KEY,
-    JSON_OBJECT_SORTED_BY_KEY_VALUE,
+struct json_key *json_key_new(const char *, size_t);
+struct json_key *json_key_new_nocopy(char *, size_t);
+struct json_key *json_key_ref(struct json_key *);
+void json_key_unref(struct json_key *);
+
+bool json_key_equal(const struct json_key *, const char *, size_t, uint32_t);
+int json_key_cmp(const struct json_key *, const struct json_key *);
+
+/* An interning table makes identical keys share the same json_key. The
+ * parser uses one for each document, so that the thousands of objects of an
+ * array of records share a single copy of each key. */
+struct json_key_table {
+    struct json_key **entries;
+    size_t nb_entries;
+    size_t size;
 };
 
-struct json_object {
-    struct json_object_member *members;
-    size_t nb_members;
-    enum json_object_sort_mode sort_mode;
+void json_key_table_init(struct json_key_table *);
+void json_key_table_free(struct json_key_table *);
+
+struct json_key *json_key_table_intern(struct json_key_table *,
+                                       const char *, size_t);
+struct json_key *json_key_table_intern2(struct json_key_table *,
+                                        const char *, size_t, uint32_t);
+
+/* Take ownership of the string, freeing it if the key is already interned.
+ * The caller keeps it if interning fails. */
+struct json_key *json_key_table_intern_nocopy(struct json_key_table *,
+                                              char *, size_t, uint32_t);
+
+/* ------------------------------------------------------------------------
+ *  JSON
+ * ------------------------------------------------------------------------ */
+/* Object members are stored in insertion order in two parallel arrays. Keys
+ * carry their hash and length inline, so that a lookup only scans the
+ * contiguous key array and never touches values or key strings until it
+ * finds a candidate. */
+struct json_object_key {
+    uint32_t hash;
+    uint32_t len;
+    struct json_key *key;
 };
 
-void json_object_sort_by_index(struct json_object *);
-void json_object_sort_by_key(struct json_object *);
-void json_object_sort_by_key_value(struct json_object *);
+/* Objects with at least this many members get a hash index */
+#define JSON_OBJECT_INDEX_THRESHOLD 16
 
-struct json_object_iterator {
-    struct json_object *object;
-    size_t index;
+struct json_object {
+    struct json_object_key *keys;
+    struct json_value **values;
+    size_t nb_members;
+    size_t size;
+
+    /* Open addressing table of member positions plus one, zero marking a
+     * free slot. */
+    uint32_t *index;
+    size_t index_size;
 };
 
+bool json_object_find(const struct json_object *, const char *, size_t,
+                      uint32_t, size_t *);
+
 struct json_array {
     struct json_value **elements;
     size_t nb_elements;
+    size_t size;
 };
 
 struct json_value {
     enum json_type type;
+    unsigned int refcount; /* values are shared by clones */
+
+    /* The allocator used for the value and the memory it owns */
+    const struct json_allocator *allocator;
 
     union {
         struct json_object object;
@@ -88,8 +168,134 @@ struct json_value {
 };
 
 struct json_value *json_value_new(enum json_type);
+struct json_value *json_value_ref(struct json_value *);
+bool json_value_is_shared(const struct json_value *);
+
+/* Replace a shared container by a copy which can be modified */
+struct json_value *json_value_unshare(struct json_value **);
+
+uint32_t json_value_hash(const struct json_value *);
+
+int json_object_reserve(struct json_value *, size_t);
+int json_object_add_member_key(struct json_value *, struct json_key *,
+                               struct json_value *);
+bool json_object_has_key(const struct json_value *, const struct json_key *);
 
-void json_value_sort_objects_by_index(struct json_value *);
+struct json_object_iterator {
+    struct json_object *object;
+    size_t index;
+
+    /* Returned to the caller as the key of the current member */
+    struct json_value key;
+};
+
+int json_array_reserve(struct json_value *, size_t);
+
+/* ------------------------------------------------------------------------
+ *  JSON pointers
+ * ------------------------------------------------------------------------ */
+/* A compiled pointer stores its reference tokens unescaped, with the hash of
+ * each token and its value as an array index, so that evaluating it against
+ * a document neither allocates nor parses anything. */
+struct json_pointer_token {
+    char *string;
+    size_t len;
+    uint32_t hash;
+
+    size_t index; /* SIZE_MAX if the token is not an array index */
+    bool end;     /* "-", the position after the last element */
+};
+
+struct json_pointer {
+    struct json_pointer_token *tokens;
+    size_t nb_tokens;
+
+    char *strings;
+};
+
+struct json_pointer *json_pointer_compile_fragment(const char *);
+
+void json_pointer_append_token(struct c_buffer *, const char *, size_t);
+
+/* ------------------------------------------------------------------------
+ *  Projections
+ * ------------------------------------------------------------------------ */
+/* The pointers of a projection are merged in a tree of tokens. While
+ * parsing, only the values on the path to a selected value are read; every
+ * other value is skipped without being decoded. */
+struct json_projection_node {
+    char *key;
+    size_t len;
+    size_t index; /* SIZE_MAX if the token is not an array index */
+
+    int target; /* index of the selected value, or -1 */
+
+    struct json_projection_node **children;
+    size_t nb_children;
+};
+
+struct json_projection {
+    struct json_projection_node root;
+    size_t nb_targets;
+};
+
+struct json_projection_node *
+json_projection_node_child(const struct json_projection_node *,
+                           const char *, size_t);
+struct json_projection_node *
+json_projection_node_element(const struct json_projection_node *, size_t);
+
+/* ------------------------------------------------------------------------
+ *  Frozen documents
+ * ------------------------------------------------------------------------ */
+#define JSON_FROZEN_MAGIC   0x5a46534a /* "JSFZ" */
+#define JSON_FROZEN_VERSION 1
+
+#define JSON_FROZEN_OBJECT_ENTRY_SIZE 3
+
+#define JSON_FROZEN_TAG(type_, payload_) \
+    (((uint64_t)(payload_) << 8) | (uint64_t)(type_))
+
+/* The header of a frozen document, followed by the tape and the string area
+ * (see frozen.c). */
+struct json_frozen {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t size; /* total size in bytes, including the header */
+    uint64_t nb_words;
+    uint64_t strings_size;
+
+    uint64_t tape[];
+};
+
+int json_frozen_check(const struct json_frozen *, size_t);
+
+/* ------------------------------------------------------------------------
+ *  CBOR and MessagePack
+ * ------------------------------------------------------------------------ */
+uint16_t json_read_be16(const uint8_t *);
+uint32_t json_read_be32(const uint8_t *);
+uint64_t json_read_be64(const uint8_t *);
+
+int json_write_be16(struct c_buffer *, uint8_t, uint16_t);
+int json_write_be32(struct c_buffer *, uint8_t, uint32_t);
+int json_write_be64(struct c_buffer *, uint8_t, uint64_t);
+
+/* The header of an encoded item, as seen by the streaming decoder which
+ * only has to know the size of items without decoding them. */
+struct json_item_head {
+    size_t size;         /* size of the header itself */
+    uint64_t data_size;  /* size of the data following the header */
+    uint64_t nb_items;   /* number of nested items, two per map entry */
+    bool indefinite;     /* nested items end with a break marker */
+    bool is_break;
+};
+
+/* Return 1 if a header was read, 0 if more data is needed or -1 if the data
+ * are invalid. */
+int json_cbor_read_item_head(const uint8_t *, size_t, struct json_item_head *);
+int json_msgpack_read_item_head(const uint8_t *, size_t,
+                                struct json_item_head *);
 
 /* ------------------------------------------------------------------------
  *  JSON schema
@@ -118,17 +324,17 @@ bool json_schema_simple_type_matches_type(enum json_schema_simple_type,
                                           enum json_type);
 
 /* Format */
-enum json_schema_format {
-    JSON_SCHEMA_FORMAT_DATE_TIME,
-    JSON_SCHEMA_FORMAT_EMAIL,
-    JSON_SCHEMA_FORMAT_HOSTNAME,
-    JSON_SCHEMA_FORMAT_IPV4,
-    JSON_SCHEMA_FORMAT_IPV6,
-    JSON_SCHEMA_FORMAT_URI,
-    JSON_SCHEMA_FORMAT_REGEX,
+struct json_schema_format {
+    char *name;
+    json_schema_format_function function;
+    void *data;
+
+    struct json_schema_format *next; /* registered formats */
 };
 
-int json_schema_format_parse(const char *, enum json_schema_format *);
+const struct json_schema_format *json_schema_format_find(const char *);
+bool json_schema_format_check(const struct json_schema_format *,
+                              const char *, size_t);
 
 /* Generic validator */
 struct json_generic_validator {
@@ -141,15 +347,12 @@ struct json_generic_validator {
     struct c_ptr_vector *one_of; /* struct json_schema * */
     struct json_schema *not;
 
-    enum json_schema_format format;
+    const struct json_schema_format *format;
 };
 
 void json_generic_validator_init(struct json_generic_validator *);
 void json_generic_validator_free(struct json_generic_validator *);
 
-int json_generic_validator_check(struct json_generic_validator *,
-                                 struct json_value *);
-
 /* Numeric validator */
 struct json_numeric_validator {
     struct json_value *multiple_of;
@@ -163,9 +366,6 @@ struct json_numeric_validator {
 void json_numeric_validator_init(struct json_numeric_validator *);
 void json_numeric_validator_free(struct json_numeric_validator *);
 
-int json_numeric_validator_check(struct json_numeric_validator *,
-                                 struct json_value *);
-
 /* String validator */
 struct json_string_validator {
     bool has_min_length;
@@ -174,15 +374,12 @@ struct json_string_validator {
     size_t max_length;
 
     char *pattern;
-    pcre *pattern_re;
+    struct json_schema_re *pattern_re;
 };
 
 void json_string_validator_init(struct json_string_validator *);
 void json_string_validator_free(struct json_string_validator *);
 
-int json_string_validator_check(struct json_string_validator *,
-                                struct json_value *);
-
 /* Array validator */
 struct json_array_validator {
     bool has_min_items;
@@ -205,9 +402,6 @@ struct json_array_validator {
 void json_array_validator_init(struct json_array_validator *);
 void json_array_validator_free(struct json_array_validator *);
 
-int json_array_validator_check(struct json_array_validator *,
-                               struct json_value *);
-
 /* Object validator */
 struct json_object_validator_property {
     char *string;
@@ -217,7 +411,7 @@ struct json_object_validator_property {
 
 struct json_object_validator_pattern {
     char *pattern;
-    pcre *pattern_re;
+    struct json_schema_re *pattern_re;
 
     struct json_schema *schema;
 };
@@ -247,9 +441,6 @@ struct json_object_validator {
 void json_object_validator_init(struct json_object_validator *);
 void json_object_validator_free(struct json_object_validator *);
 
-int json_object_validator_check(struct json_object_validator *,
-                               struct json_value *);
-
 /* Validator */
 struct json_validator {
     struct c_hash_table *definitions; /* name -> schema */
@@ -264,7 +455,335 @@ struct json_validator {
 void json_validator_init(struct json_validator *);
 void json_validator_free(struct json_validator *);
 
-int json_validator_check(struct json_validator *, struct json_value *);
+/* Regex */
+enum json_schema_re_type {
+    JSON_SCHEMA_RE_PCRE,
+    JSON_SCHEMA_RE_LITERAL,
+    JSON_SCHEMA_RE_CLASS,
+};
+
+struct json_schema_re {
+    enum json_schema_re_type type;
+
+    bool anchored_start;
+    bool anchored_end;
+
+    pcre *re;
+    pcre_extra *extra;
+
+    union {
+        struct {
+            char *ptr;
+            size_t len;
+        } literal;
+
+        struct {
+            uint8_t bits[16]; /* ASCII characters */
+            size_t min;
+            size_t max;
+        } class;
+    } u;
+};
+
+struct json_schema_re *json_schema_re_compile(const char *);
+void json_schema_re_delete(struct json_schema_re *);
+int json_schema_re_exec(const struct json_schema_re *, const char *, size_t,
+                        bool *);
+
+/* Program */
+#define JSON_NB_TYPES (JSON_NULL + 1)
+
+#define JSON_SCHEMA_TYPE_MASK(type_) (1u << (type_))
+
+#define JSON_SCHEMA_ALL_TYPES ((1u << JSON_NB_TYPES) - 1)
+
+/* Arrays with more elements are checked for uniqueness with a hash table */
+#define JSON_SCHEMA_UNIQUE_ITEMS_THRESHOLD 8
+
+#define JSON_SCHEMA_NODE_NONE UINT32_MAX
+
+enum json_schema_op {
+    /* Generic */
+    JSON_SCHEMA_OP_ENUM,
+    JSON_SCHEMA_OP_ALL_OF,
+    JSON_SCHEMA_OP_ANY_OF,
+    JSON_SCHEMA_OP_ONE_OF,
+    JSON_SCHEMA_OP_NOT,
+    JSON_SCHEMA_OP_FORMAT,
+
+    /* Numeric */
+    JSON_SCHEMA_OP_MULTIPLE_OF_INTEGER,
+    JSON_SCHEMA_OP_MULTIPLE_OF_REAL,
+    JSON_SCHEMA_OP_MIN_INTEGER,
+    JSON_SCHEMA_OP_MIN_REAL,
+    JSON_SCHEMA_OP_MAX_INTEGER,
+    JSON_SCHEMA_OP_MAX_REAL,
+
+    /* String */
+    JSON_SCHEMA_OP_LENGTH,
+    JSON_SCHEMA_OP_PATTERN,
+
+    /* Array */
+    JSON_SCHEMA_OP_MIN_ITEMS,
+    JSON_SCHEMA_OP_MAX_ITEMS,
+    JSON_SCHEMA_OP_UNIQUE_ITEMS,
+    JSON_SCHEMA_OP_ITEMS,
+    JSON_SCHEMA_OP_TUPLE_ITEMS,
+
+    /* Object */
+    JSON_SCHEMA_OP_MIN_PROPERTIES,
+    JSON_SCHEMA_OP_MAX_PROPERTIES,
+    JSON_SCHEMA_OP_MEMBERS,
+    JSON_SCHEMA_OP_SCHEMA_DEPENDENCY,
+    JSON_SCHEMA_OP_PROPERTY_DEPENDENCY,
+};
+
+struct json_schema_key {
+    const char *ptr;
+    uint32_t len;
+    uint32_t hash;
+};
+
+/* Entries of the member table of an object node, for keys listed in
+ * 'properties' and/or 'required'. */
+struct json_schema_property {
+    struct json_schema_key key;
+    uint32_t node;     /* JSON_SCHEMA_NODE_NONE if not in 'properties' */
+    uint32_t required; /* bit index, JSON_SCHEMA_NODE_NONE if not required */
+};
+
+struct json_schema_pattern {
+    const char *string;
+    const struct json_schema_re *re;
+    uint32_t node;
+};
+
+/* Instructions carry their constants inline. Lists of nodes, values, keys,
+ * properties and patterns are ranges in the tables of the program. */
+struct json_schema_insn {
+    enum json_schema_op op;
+
+    union {
+        struct {
+            uint32_t start;
+            uint32_t count;
+        } range;
+
+        uint32_t node;
+
+        struct {
+            int64_t value;
+            bool exclusive;
+        } integer;
+
+        struct {
+            double value;
+            bool exclusive;
+        } real;
+
+        size_t size;
+
+        struct {
+            size_t min;
+            size_t max;
+        } length;
+
+        const struct json_schema_re *re;
+
+        const struct json_schema_format *format;
+
+        struct {
+            uint32_t start;
+            uint32_t count;
+            uint32_t additional;
+            bool allow_additional;
+        } tuple;
+
+        struct {
+            uint32_t properties;
+            uint32_t nb_properties;
+            uint32_t index;      /* start of the hash index of properties */
+            uint32_t index_size; /* power of two */
+            uint32_t nb_required;
+            uint32_t patterns;
+            uint32_t nb_patterns;
+            uint32_t additional;
+            bool allow_additional;
+        } members;
+
+        struct {
+            struct json_schema_key key;
+            uint32_t node;
+            uint32_t start;
+            uint32_t count;
+        } dependency;
+
+    } u;
+};
+
+/* Branches of anyOf and oneOf instructions, stored at the same position as
+ * the node they refer to in the reference table. They are computed once
+ * all nodes are compiled, since a branch can refer to a node which is still
+ * being compiled, and let validation skip branches which cannot match. */
+struct json_schema_branch {
+    uint32_t types;
+
+    /* Required member whose schema only accepts one value; key.ptr is NULL
+     * if the branch has none. */
+    struct json_schema_key key;
+    const struct json_value *value;
+};
+
+/* The instructions of a node are contiguous: generic instructions first,
+ * then the instructions applying to each JSON type in enum json_type order.
+ * Instructions for types rejected by the type mask are never emitted. */
+struct json_schema_node {
+    uint32_t types; /* mask of accepted enum json_type values */
+    uint32_t insns[JSON_NB_TYPES + 2];
+};
+
+struct json_schema_program {
+    struct json_schema_node *nodes;
+    size_t nb_nodes;
+    size_t nodes_size;
+
+    struct json_schema_insn *insns;
+    size_t nb_insns;
+    size_t insns_size;
+
+    uint32_t *refs; /* node indexes */
+    size_t nb_refs;
+    size_t refs_size;
+
+    struct json_schema_branch *branches; /* nb_refs entries */
+
+    struct json_value **values;
+    size_t nb_values;
+    size_t values_size;
+
+    struct json_schema_key *keys;
+    size_t nb_keys;
+    size_t keys_size;
+
+    struct json_schema_property *properties;
+    size_t nb_properties;
+    size_t properties_size;
+
+    /* Open addressing tables of property positions plus one, zero marking a
+     * free slot, one per object node. */
+    uint32_t *index;
+    size_t nb_index;
+    size_t index_size;
+
+    struct json_schema_pattern *patterns;
+    size_t nb_patterns;
+    size_t patterns_size;
+
+    uint32_t root;
+
+    /* Schema -> node index, only used during compilation */
+    struct c_hash_table *schemas;
+};
+
+void json_schema_program_delete(struct json_schema_program *);
+int json_schema_program_check(const struct json_schema_program *, uint32_t,
+                              const struct json_value *);
+
+/* Thread pool */
+typedef void (*json_schema_pool_function)(void *, size_t);
+
+unsigned int json_schema_pool_nb_threads(const struct json_schema_pool *);
+void json_schema_pool_run(struct json_schema_pool *,
+                          json_schema_pool_function, void *, size_t);
+
+/* Arrays and objects with fewer children, and values of allOf constraints
+ * with fewer children, are checked in the calling thread. */
+#define JSON_SCHEMA_PARALLEL_MIN_ITEMS 256
+
+/* Minimal number of children checked by each task */
+#define JSON_SCHEMA_PARALLEL_MIN_CHUNK 64
+
+/* Profiling */
+struct json_schema_profile_frame {
+    uint64_t start;
+    uint64_t nested_time;
+};
+
+void json_schema_profile_enter(struct json_schema_profile_frame *);
+void json_schema_profile_leave(struct json_schema_profile_frame *,
+                               enum json_schema_op);
+
+/* Validation runs in one of three modes: stop at the first error and
+ * describe it with c_set_error(), collect errors up to a maximum, or only
+ * tell whether the value is valid, without formatting any message. */
+enum json_schema_check_mode {
+    JSON_SCHEMA_CHECK_FIRST_ERROR,
+    JSON_SCHEMA_CHECK_ALL_ERRORS,
+    JSON_SCHEMA_CHECK_VALID,
+};
+
+struct json_schema_check {
+    const struct json_schema_program *program;
+    enum json_schema_check_mode mode;
+
+    /* Large loops are split between the threads of the pool, except when
+     * collecting all errors. */
+    struct json_schema_pool *pool;
+
+    struct json_schema_error *errors;
+    size_t max_errors;
+    size_t nb_errors;
+
+    bool failed; /* error which is not a validation failure */
+};
+
+void json_schema_check_init(struct json_schema_check *,
+                            const struct json_schema_program *,
+                            enum json_schema_check_mode);
+int json_schema_check_node(struct json_schema_check *, uint32_t,
+                           const struct json_value *);
+
+/* Validation of an object or array while it is parsed: members are checked
+ * one at a time against the schema selected for them, and counts and
+ * required members once the container ends. */
+struct json_schema_frame {
+    enum json_type type;
+
+    const struct json_schema_insn *insn; /* members or items, may be NULL */
+
+    size_t nb_children;
+    size_t min_children;
+    size_t max_children;
+
+    uint64_t required_bits[4];
+    uint64_t *required;
+    size_t nb_required_found;
+};
+
+/* The schemas a member or element must match. Members matching both a
+ * property and a pattern have to match two schemas. */
+struct json_schema_child {
+    uint32_t node; /* JSON_SCHEMA_NODE_NONE if not constrained */
+    const char *constraint;
+
+    uint32_t pattern_node;
+};
+
+/* Return 1 if the frame was initialized, 0 if the node must be checked on
+ * the whole value or -1 on error. */
+int json_schema_frame_init(struct json_schema_frame *,
+                           const struct json_schema_program *, uint32_t,
+                           enum json_type);
+void json_schema_frame_free(struct json_schema_frame *);
+
+int json_schema_frame_member(struct json_schema_frame *,
+                             const struct json_schema_program *,
+                             const char *, size_t, uint32_t,
+                             struct json_schema_child *);
+int json_schema_frame_element(struct json_schema_frame *,
+                              const struct json_schema_program *,
+                              struct json_schema_child *);
+int json_schema_frame_end(const struct json_schema_frame *);
 
 /* Schema */
 struct json_schema {
@@ -277,9 +796,57 @@ struct json_schema {
 
     struct json_validator validator;
 
-    /* TODO refcount */
+    /* $ref, resolved when the document is parsed to the schema it points
+     * to, in the same document or in a document of the registry.
+     * References do not own their target: the document does, and may
+     * contain cycles. */
+    char *ref;
+    struct json_schema *ref_target;
+
+    /* Only set on schemas returned by json_schema_parse(); constants of the
+     * program point to the validators of the schema tree. */
+    struct json_schema_program *program;
+
+    /* Root schemas of the other documents referenced by the document, so
+     * that they live as long as references to them. */
+    struct c_ptr_vector *documents;
+
+    /* The JSON object the schema was read from, only set while parsing */
+    const struct json_value *json;
+
+    unsigned int refcount;
 };
 
 struct json_schema *json_schema_new(void);
+void json_schema_add_document(struct json_schema *, struct json_schema *);
+
+char *json_schema_id_normalize(const char *);
+
+/* Documents */
+struct json_schema_document {
+    char *uri;
+
+    struct json_value *json;
+    struct json_schema *schema;
+
+    struct c_hash_table *schemas; /* json value -> schema */
+    struct c_hash_table *ids;     /* id -> json value */
+};
+
+/* json_schema_document_load() takes ownership of the json value on
+ * success. */
+int json_schema_document_parse(struct json_schema_document *, const char *,
+                               const char *, size_t,
+                               struct json_schema_registry *);
+int json_schema_document_load(struct json_schema_document *, const char *,
+                              struct json_value *,
+                              struct json_schema_registry *);
+void json_schema_document_free(struct json_schema_document *);
+
+/* Registry */
+const struct json_schema_document *
+json_schema_registry_find_document(struct json_schema_registry *,
+                                   const struct json_schema_document *,
+                                   const char *);
 
 #endif
@@ -16,11 +16,52 @@
 
 #include "internal.h"
 
+struct json_object_member {
+    const struct json_key *key;
+    struct json_value *value;
+};
+
 static int json_value_cmp(const void *, const void *);
 
-static int json_object_member_cmp_by_index(const void *, const void *);
-static int json_object_member_cmp_by_key(const void *, const void *);
-static int json_object_member_cmp_by_key_value(const void *, const void *);
+static struct json_value *json_object_copy(const struct json_value *);
+static struct json_value *json_array_copy(const struct json_value *);
+static struct json_value *json_object_clone(const struct json_value *);
+static struct json_value *json_array_clone(const struct json_value *);
+static struct json_value *json_value_share(struct json_value *);
+
+static bool json_object_equal(const struct json_object *,
+                              const struct json_object *);
+static int json_object_member_cmp(const void *, const void *);
+
+struct json_object_removal {
+    const char *key;
+    size_t len;
+    uint32_t hash;
+};
+
+struct json_object_removals {
+    const struct json_object_removal *removals;
+    size_t nb_removals;
+};
+
+struct json_object_filter {
+    json_object_filter_function function;
+    void *data;
+};
+
+typedef bool (*json_object_keep_function)(const struct json_object_key *,
+                                          struct json_value *, void *);
+
+static bool json_object_removal_keep(const struct json_object_key *,
+                                     struct json_value *, void *);
+static bool json_object_filter_keep(const struct json_object_key *,
+                                    struct json_value *, void *);
+static size_t json_object_compact(struct json_object *, size_t,
+                                  json_object_keep_function, void *);
+
+static int json_object_grow(struct json_value *, size_t);
+static int json_object_index_build(struct json_value *, size_t);
+static void json_object_index_insert(struct json_object *, size_t);
 
 const char *
 json_type_to_string(enum json_type type) {
@@ -43,38 +84,71 @@ json_type_to_string(enum json_type type) {
 
 struct json_value *
 json_value_new(enum json_type type) {
+    const struct json_allocator *allocator;
     struct json_value *value;
 
-    value = c_malloc(sizeof(struct json_value));
+    allocator = json_allocator_current();
+
+    value = json_allocator_malloc(allocator, sizeof(struct json_value));
+    if (!value)
+        return NULL;
+
     memset(value, 0, sizeof(struct json_value));
 
     value->type = type;
+    value->refcount = 1;
+    value->allocator = allocator;
 
     return value;
 }
 
+struct json_value *
+json_value_ref(struct json_value *value) {
+    __atomic_add_fetch(&value->refcount, 1, __ATOMIC_RELAXED);
+    return value;
+}
+
+bool
+json_value_is_shared(const struct json_value *value) {
+    return __atomic_load_n(&value->refcount, __ATOMIC_ACQUIRE) > 1;
+}
+
 void
 json_value_delete(struct json_value *value) {
+    const struct json_allocator *allocator;
+
     if (!value)
         return;
 
+    /* A value which is not shared does not need an atomic operation */
+    if (json_value_is_shared(value)
+     && __atomic_sub_fetch(&value->refcount, 1, __ATOMIC_ACQ_REL) > 0) {
+        return;
+    }
+
+    /* The memory of a value is released with the allocator which created
+     * it, whatever the allocator currently selected. */
+    allocator = value->allocator;
+
     switch (value->type) {
     case JSON_OBJECT:
         for (size_t i = 0; i < value->u.object.nb_members; i++) {
-            json_value_delete(value->u.object.members[i].key);
-            json_value_delete(value->u.object.members[i].value);
+            json_key_unref(value->u.object.keys[i].key);
+            json_value_delete(value->u.object.values[i]);
         }
-        c_free(value->u.object.members);
+        json_allocator_free(allocator, value->u.object.keys);
+        json_allocator_free(allocator, value->u.object.values);
+        json_allocator_free(allocator, value->u.object.index);
         break;
 
     case JSON_ARRAY:
         for (size_t i = 0; i < value->u.array.nb_elements; i++)
             json_value_delete(value->u.array.elements[i]);
-        c_free(value->u.array.elements);
+        json_allocator_free(allocator, value->u.array.elements);
         break;
 
     case JSON_STRING:
-        c_free(value->u.string.ptr);
+        json_allocator_free(allocator, value->u.string.ptr);
         break;
 
     default:
@@ -82,118 +156,304 @@ json_value_delete(struct json_value *value) {
     }
 
     memset(value, 0, sizeof(struct json_value));
-    c_free(value);
+    json_allocator_free(allocator, value);
 }
 
 struct json_value *
 json_value_clone(const struct json_value *value) {
+    return json_value_copy(value);
+}
+
+struct json_value *
+json_value_clone_shared(const struct json_value *value) {
+    /* A clone only shares values created with the current allocator, so
+     * that it never refers to memory of an allocator it may outlive. */
+    if (value->allocator != json_allocator_current())
+        return json_value_copy(value);
+
     switch (value->type) {
     case JSON_OBJECT:
-    {
-        struct json_value *nvalue;
+        return json_object_clone(value);
 
-        nvalue = json_object_new();
+    case JSON_ARRAY:
+        return json_array_clone(value);
 
-        for (size_t i = 0; i < value->u.object.nb_members; i++) {
-            struct json_object_member *member;
-            struct json_value *val;
-            const char *key;
-            size_t len;
+    default:
+        /* Scalars are immutable */
+        return json_value_ref((struct json_value *)value);
+    }
+}
+
+struct json_value *
+json_value_copy(const struct json_value *value) {
+    switch (value->type) {
+    case JSON_OBJECT:
+        return json_object_copy(value);
 
-            member = value->u.object.members + i;
+    case JSON_ARRAY:
+        return json_array_copy(value);
 
-            key = member->key->u.string.ptr;
-            len = member->key->u.string.len;
+    case JSON_INTEGER:
+        return json_integer_new(value->u.integer);
 
-            val = json_value_clone(member->value);
-            if (!val) {
-                json_value_delete(nvalue);
-                return NULL;
-            }
+    case JSON_REAL:
+        return json_real_new(value->u.real);
 
-            if (json_object_add_member2(nvalue, key, len, val) == -1) {
-                json_value_delete(val);
-                json_value_delete(nvalue);
-                return NULL;
+    case JSON_STRING:
+        return json_string_new2(value->u.string.ptr, value->u.string.len);
+
+    case JSON_BOOLEAN:
+        return json_boolean_new(value->u.boolean);
+
+    case JSON_NULL:
+        return json_null_new();
+    }
+
+    c_set_error("unknown json value type %d", value->type);
+    return NULL;
+}
+
+static struct json_value *
+json_object_copy(const struct json_value *value) {
+    const struct json_object *object;
+    const struct json_allocator *allocator;
+    struct json_object *nobject;
+    struct json_value *nvalue;
+
+    /* Arrays are allocated with their final size and the index is copied
+     * as is, so that members are copied in a single linear pass. */
+    object = &value->u.object;
+
+    nvalue = json_object_new();
+    if (!nvalue)
+        return NULL;
+
+    nobject = &nvalue->u.object;
+
+    if (json_object_reserve(nvalue, object->nb_members) == -1)
+        goto error;
+
+    if (object->index) {
+        nobject->index = json_malloc(object->index_size * sizeof(uint32_t));
+        if (!nobject->index)
+            goto error;
+
+        memcpy(nobject->index, object->index,
+               object->index_size * sizeof(uint32_t));
+        nobject->index_size = object->index_size;
+    }
+
+    allocator = json_allocator_current();
+
+    for (size_t i = 0; i < object->nb_members; i++) {
+        struct json_key *key;
+        struct json_value *member;
+
+        member = json_value_copy(object->values[i]);
+        if (!member)
+            goto error;
+
+        /* Keys are immutable, the copy can share them unless it is created
+         * with another allocator. */
+        key = object->keys[i].key;
+        if (key->allocator == allocator) {
+            key = json_key_ref(key);
+        } else {
+            key = json_key_new(key->ptr, key->len);
+            if (!key) {
+                json_value_delete(member);
+                goto error;
             }
         }
 
-        return nvalue;
+        nobject->keys[i] = object->keys[i];
+        nobject->keys[i].key = key;
+        nobject->values[i] = member;
+
+        nobject->nb_members++;
     }
 
-    case JSON_ARRAY:
-    {
-        struct json_value *nvalue;
+    return nvalue;
 
-        nvalue = json_array_new();
+error:
+    json_value_delete(nvalue);
+    return NULL;
+}
 
-        for (size_t i = 0; i < value->u.array.nb_elements; i++) {
-            struct json_value *element;
+static struct json_value *
+json_array_copy(const struct json_value *value) {
+    const struct json_array *array;
+    struct json_array *narray;
+    struct json_value *nvalue;
 
-            element = json_value_clone(value->u.array.elements[i]);
-            if (!element) {
-                json_value_delete(nvalue);
-                return NULL;
-            }
+    array = &value->u.array;
+
+    nvalue = json_array_new();
+    if (!nvalue)
+        return NULL;
+
+    narray = &nvalue->u.array;
+
+    if (json_array_reserve(nvalue, array->nb_elements) == -1) {
+        json_value_delete(nvalue);
+        return NULL;
+    }
+
+    for (size_t i = 0; i < array->nb_elements; i++) {
+        struct json_value *element;
+
+        element = json_value_copy(array->elements[i]);
+        if (!element) {
+            json_value_delete(nvalue);
+            return NULL;
+        }
 
-            if (json_array_add_element(nvalue, element) == -1) {
-                json_value_delete(element);
+        narray->elements[narray->nb_elements++] = element;
+    }
+
+    return nvalue;
+}
+
+static struct json_value *
+json_object_clone(const struct json_value *value) {
+    const struct json_object *object;
+    struct json_object *nobject;
+    struct json_value *nvalue;
+
+    /* Members are shared with the original object */
+    object = &value->u.object;
+
+    nvalue = json_object_new();
+    if (!nvalue)
+        return NULL;
+
+    nobject = &nvalue->u.object;
+
+    if (json_object_reserve(nvalue, object->nb_members) == -1) {
+        json_value_delete(nvalue);
+        return NULL;
+    }
+
+    if (object->index) {
+        nobject->index = json_malloc(object->index_size * sizeof(uint32_t));
+        if (!nobject->index) {
+            json_value_delete(nvalue);
+            return NULL;
+        }
+
+        memcpy(nobject->index, object->index,
+               object->index_size * sizeof(uint32_t));
+        nobject->index_size = object->index_size;
+    }
+
+    for (size_t i = 0; i < object->nb_members; i++) {
+        struct json_key *key;
+        struct json_value *member;
+
+        member = json_value_share(object->values[i]);
+        if (!member) {
+            json_value_delete(nvalue);
+            return NULL;
+        }
+
+        key = object->keys[i].key;
+        if (key->allocator == nvalue->allocator) {
+            key = json_key_ref(key);
+        } else {
+            key = json_key_new(key->ptr, key->len);
+            if (!key) {
+                json_value_delete(member);
                 json_value_delete(nvalue);
                 return NULL;
             }
         }
 
-        return nvalue;
+        nobject->keys[i] = object->keys[i];
+        nobject->keys[i].key = key;
+        nobject->values[i] = member;
+
+        nobject->nb_members++;
     }
 
-    case JSON_INTEGER:
-        return json_integer_new(value->u.integer);
+    return nvalue;
+}
 
-    case JSON_REAL:
-        return json_real_new(value->u.real);
+static struct json_value *
+json_array_clone(const struct json_value *value) {
+    const struct json_array *array;
+    struct json_array *narray;
+    struct json_value *nvalue;
 
-    case JSON_STRING:
-        return json_string_new2(value->u.string.ptr, value->u.string.len);
+    /* Elements are shared with the original array */
+    array = &value->u.array;
 
-    case JSON_BOOLEAN:
-        return json_boolean_new(value->u.boolean);
+    nvalue = json_array_new();
+    if (!nvalue)
+        return NULL;
 
-    case JSON_NULL:
-        return json_null_new();
+    narray = &nvalue->u.array;
+
+    if (json_array_reserve(nvalue, array->nb_elements) == -1) {
+        json_value_delete(nvalue);
+        return NULL;
     }
 
-    c_set_error("unknown json value type %d", value->type);
-    return NULL;
+    for (size_t i = 0; i < array->nb_elements; i++) {
+        struct json_value *element;
+
+        element = json_value_share(array->elements[i]);
+        if (!element) {
+            json_value_delete(nvalue);
+            return NULL;
+        }
+
+        narray->elements[narray->nb_elements++] = element;
+    }
+
+    return nvalue;
+}
+
+static struct json_value *
+json_value_share(struct json_value *value) {
+    if (value->allocator != json_allocator_current())
+        return json_value_copy(value);
+
+    return json_value_ref(value);
+}
+
+struct json_value *
+json_value_unshare(struct json_value **pvalue) {
+    struct json_value *value, *copy;
+
+    /* Scalars are immutable, only containers have to be copied */
+    value = *pvalue;
+    if (!json_value_is_shared(value)
+     || (value->type != JSON_OBJECT && value->type != JSON_ARRAY)) {
+        return value;
+    }
+
+    copy = json_value_clone_shared(value);
+    if (!copy)
+        return NULL;
+
+    json_value_delete(value);
+    *pvalue = copy;
+
+    return copy;
 }
 
 bool
 json_value_equal(struct json_value *val1, struct json_value *val2) {
-    struct json_object_member *members1, *members2;
-    size_t nb_members;
+    /* Clones share values */
+    if (val1 == val2)
+        return true;
 
     if (val1->type != val2->type)
         return false;
 
     switch (val1->type) {
     case JSON_OBJECT:
-        if (val1->u.object.nb_members != val2->u.object.nb_members)
-            return false;
-
-        json_object_sort_by_key_value(&val1->u.object);
-        json_object_sort_by_key_value(&val2->u.object);
-
-        nb_members = val1->u.object.nb_members;
-        members1 = val1->u.object.members;
-        members2 = val2->u.object.members;
-
-        for (size_t i = 0; i < nb_members; i++) {
-            if (!json_value_equal(members1[i].key, members2[i].key)
-             || !json_value_equal(members1[i].value, members2[i].value)) {
-                return false;
-            }
-        }
-
-        return true;
+        return json_object_equal(&val1->u.object, &val2->u.object);
 
     case JSON_ARRAY:
         if (val1->u.array.nb_elements != val2->u.array.nb_elements)
@@ -229,14 +489,60 @@ json_value_equal(struct json_value *val1, struct json_value *val2) {
     }
 }
 
-void
-json_value_sort_objects_by_index(struct json_value *value) {
-    if (value->type == JSON_OBJECT) {
-        json_object_sort_by_index(&value->u.object);
+uint32_t
+json_value_hash(const struct json_value *value) {
+    uint64_t bits;
+    uint32_t hash;
+    double real;
+
+    /* Equal values have the same hash. Members are combined with an
+     * addition so that the hash of an object does not depend on the order
+     * of its members. */
+    switch (value->type) {
+    case JSON_OBJECT:
+        hash = 0x9e3779b9u;
 
-        for (size_t i = 0; i < value->u.object.nb_members; i++)
-            json_value_sort_objects_by_index(value->u.object.members[i].value);
+        for (size_t i = 0; i < value->u.object.nb_members; i++) {
+            uint32_t member_hash;
+
+            member_hash = json_value_hash(value->u.object.values[i]);
+            hash += json_hash_integer(value->u.object.keys[i].hash
+                                      ^ member_hash);
+        }
+
+        return hash;
+
+    case JSON_ARRAY:
+        hash = 0x7f4a7c15u;
+
+        for (size_t i = 0; i < value->u.array.nb_elements; i++) {
+            hash = hash * 31u
+                 + json_value_hash(value->u.array.elements[i]);
+        }
+
+        return hash;
+
+    case JSON_INTEGER:
+        return json_hash_integer((uint64_t)value->u.integer);
+
+    case JSON_REAL:
+        /* 0.0 and -0.0 are equal */
+        real = (value->u.real == 0.0) ? 0.0 : value->u.real;
+
+        memcpy(&bits, &real, sizeof(bits));
+        return json_hash_integer(bits) ^ 0x5bd1e995u;
+
+    case JSON_STRING:
+        return json_hash_string(value->u.string.ptr, value->u.string.len);
+
+    case JSON_BOOLEAN:
+        return value->u.boolean ? 0x3c6ef372u : 0xa54ff53au;
+
+    case JSON_NULL:
+        return 0x510e527fu;
     }
+
+    return 0;
 }
 
 enum json_type
@@ -316,74 +622,184 @@ struct json_value *
 json_object_member2(const struct json_value *value,
                     const char *key, size_t len) {
     const struct json_object *object;
+    size_t idx;
 
     object = &value->u.object;
 
-    for (size_t i = 0; i < object->nb_members; i++) {
-        struct json_object_member *member;
+    if (!json_object_find(object, key, len, json_hash_string(key, len), &idx))
+        return NULL;
 
-        member = object->members + i;
+    return object->values[idx];
+}
 
-        if (member->key->u.string.len != len)
-            continue;
+struct json_value *
+json_object_member_mutable(struct json_value *value, const char *key) {
+    return json_object_member_mutable2(value, key, strlen(key));
+}
 
-        if (memcmp(member->key->u.string.ptr, key, len) == 0)
-            return member->value;
+struct json_value *
+json_object_member_mutable2(struct json_value *value,
+                            const char *key, size_t len) {
+    struct json_object *object;
+    size_t idx;
+
+    if (json_value_is_shared(value)) {
+        c_set_error("cannot modify a shared value");
+        return NULL;
     }
 
-    return NULL;
+    object = &value->u.object;
+
+    if (!json_object_find(object, key, len, json_hash_string(key, len), &idx))
+        return NULL;
+
+    return json_value_unshare(object->values + idx);
 }
 
 const char *
 json_object_nth_member(const struct json_value *value, size_t idx,
                        struct json_value **pvalue) {
     const struct json_object *object;
-    const struct json_object_member *member;
 
     object = &value->u.object;
-    member = object->members + idx;
 
     if (pvalue)
-        *pvalue = member->value;
-    return member->key->u.string.ptr;
+        *pvalue = object->values[idx];
+    return object->keys[idx].key->ptr;
+}
+
+bool
+json_object_find(const struct json_object *object, const char *key,
+                 size_t len, uint32_t hash, size_t *pidx) {
+    const struct json_object_key *keys;
+
+    keys = object->keys;
+
+    if (object->index) {
+        size_t mask, slot;
+
+        mask = object->index_size - 1;
+
+        for (slot = hash & mask; object->index[slot] != 0;
+             slot = (slot + 1) & mask) {
+            size_t idx;
+
+            idx = object->index[slot] - 1;
+
+            if (keys[idx].hash == hash && keys[idx].len == len
+             && memcmp(keys[idx].key->ptr, key, len) == 0) {
+                *pidx = idx;
+                return true;
+            }
+        }
+
+        return false;
+    }
+
+    for (size_t i = 0; i < object->nb_members; i++) {
+        if (keys[i].hash == hash && keys[i].len == len
+         && memcmp(keys[i].key->ptr, key, len) == 0) {
+            *pidx = i;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+bool
+json_object_has_key(const struct json_value *value,
+                    const struct json_key *key) {
+    const struct json_object *object;
+    size_t idx;
+
+    object = &value->u.object;
+
+    return json_object_find(object, key->ptr, key->len, key->hash, &idx);
 }
 
 int
-json_object_add_member2(struct json_value *object_value, const char *key,
-                        size_t len, struct json_value *value) {
+json_object_reserve(struct json_value *value, size_t size) {
     struct json_object *object;
-    struct json_value *key_json;
-    struct json_object_member *members;
-    struct json_object_member *member;
-    size_t nb_members;
 
-    key_json = json_string_new2(key, len);
-    if (!key_json)
-        return -1;
+    object = &value->u.object;
+
+    if (size <= object->size)
+        return 0;
+
+    return json_object_grow(value, size);
+}
+
+int
+json_object_add_member_key(struct json_value *object_value,
+                           struct json_key *key, struct json_value *value) {
+    struct json_object *object;
+    struct json_object_key *okey;
+    size_t idx;
 
     object = &object_value->u.object;
 
-    if (object->nb_members == 0) {
-        nb_members = 1;
-        members = c_malloc(sizeof(struct json_object_member));
-    } else {
-        nb_members = object->nb_members + 1;
-        members = c_realloc(object->members,
-                            nb_members * sizeof(struct json_object_member));
+    if (json_value_is_shared(object_value)) {
+        c_set_error("cannot modify a shared value");
+        return -1;
     }
 
-    if (!members) {
-        json_value_delete(key_json);
+    if (key->len > UINT32_MAX) {
+        c_set_error("key too long");
         return -1;
     }
 
-    object->members = members;
-    object->nb_members = nb_members;
+    if (object->nb_members >= object->size) {
+        size_t size;
+
+        size = (object->size == 0) ? 4 : object->size * 2;
+        if (json_object_grow(object_value, size) == -1)
+            return -1;
+    }
+
+    idx = object->nb_members++;
+
+    okey = object->keys + idx;
+    okey->hash = key->hash;
+    okey->len = (uint32_t)key->len;
+    okey->key = key;
+
+    object->values[idx] = value;
+
+    if (object->index) {
+        if (object->nb_members * 2 > object->index_size) {
+            if (json_object_index_build(object_value,
+                                        object->index_size * 2) == -1) {
+                object->nb_members--;
+                return -1;
+            }
+        } else {
+            json_object_index_insert(object, idx);
+        }
+    } else if (object->nb_members >= JSON_OBJECT_INDEX_THRESHOLD) {
+        if (json_object_index_build(object_value,
+                                    JSON_OBJECT_INDEX_THRESHOLD * 4) == -1) {
+            object->nb_members--;
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+int
+json_object_add_member2(struct json_value *object_value, const char *key,
+                        size_t len, struct json_value *value) {
+    struct json_key *nkey;
+
+    nkey = json_key_new(key, len);
+    if (!nkey)
+        return -1;
 
-    member = &object->members[object->nb_members - 1];
-    member->key = key_json;
-    member->value = value;
-    member->index = nb_members - 1;
+    if (json_object_add_member_key(object_value, nkey, value) == -1) {
+        json_key_unref(nkey);
+        return -1;
+    }
 
     return 0;
 }
@@ -394,35 +810,49 @@ json_object_add_member(struct json_value *object, const char *key,
     return json_object_add_member2(object, key, strlen(key), value);
 }
 
+int
+json_object_add_member_nocopy2(struct json_value *object_value, char *key,
+                               size_t len, struct json_value *value) {
+    struct json_key *nkey;
+
+    nkey = json_key_new_nocopy(key, len);
+    if (!nkey)
+        return -1;
+
+    if (json_object_add_member_key(object_value, nkey, value) == -1) {
+        /* The caller keeps the string on error */
+        nkey->ptr = NULL;
+        json_key_unref(nkey);
+        return -1;
+    }
+
+    return 0;
+}
+
+int
+json_object_add_member_nocopy(struct json_value *object, char *key,
+                              struct json_value *value) {
+    return json_object_add_member_nocopy2(object, key, strlen(key), value);
+}
+
 int
 json_object_set_member2(struct json_value *value, const char *key, size_t len,
                         struct json_value *val) {
     struct json_object *object;
-    struct json_object_member *member;
-    bool found;
+    size_t idx;
 
     object = &value->u.object;
 
-    member = NULL;
-    found = false;
-
-    for (size_t i = 0; i < object->nb_members; i++) {
-        member = object->members + i;
-
-        if (member->key->u.string.len != len)
-            continue;
-
-        if (memcmp(member->key->u.string.ptr, key, len) == 0) {
-            found = true;
-            break;
-        }
+    if (json_value_is_shared(value)) {
+        c_set_error("cannot modify a shared value");
+        return -1;
     }
 
-    if (!found)
+    if (!json_object_find(object, key, len, json_hash_string(key, len), &idx))
         return json_object_add_member2(value, key, len, val);
 
-    json_value_delete(member->value);
-    member->value = val;
+    json_value_delete(object->values[idx]);
+    object->values[idx] = val;
     return 1;
 }
 
@@ -432,76 +862,212 @@ json_object_set_member(struct json_value *value, const char *key,
     return json_object_set_member2(value, key, strlen(key), val);
 }
 
-void
+int
 json_object_remove_member2(struct json_value *object_value,
                            const char *key, size_t sz) {
+    struct json_object_removal removal;
+    struct json_object_removals ctx;
     struct json_object *object;
+    size_t idx;
+
+    if (json_value_is_shared(object_value)) {
+        c_set_error("cannot modify a shared value");
+        return -1;
+    }
 
     object = &object_value->u.object;
 
-    for (size_t i = 0; i < object->nb_members; i++) {
-        struct json_object_member *member;
-        size_t removed_index;
+    removal.key = key;
+    removal.len = sz;
+    removal.hash = json_hash_string(key, sz);
 
-        member = object->members + i;
+    /* With an index, removing an absent key does not scan the members */
+    if (!json_object_find(object, key, sz, removal.hash, &idx))
+        return 0;
 
-        if (member->key->u.string.len != sz)
-            continue;
-        if (memcmp(member->key->u.string.ptr, key, sz) != 0)
-            continue;
+    ctx.removals = &removal;
+    ctx.nb_removals = 1;
 
-        removed_index = member->index;
+    json_object_compact(object, idx, json_object_removal_keep, &ctx);
+    return 0;
+}
 
-        json_value_delete(member->key);
-        json_value_delete(member->value);
+int
+json_object_remove_member(struct json_value *object, const char *key) {
+    return json_object_remove_member2(object, key, strlen(key));
+}
 
-        if (i == object->nb_members - 1) {
-            member->key = NULL;
-            member->value = NULL;
-        } else {
-            size_t member_sz;
+size_t
+json_object_remove_members(struct json_value *object_value,
+                           const char * const *keys, size_t nb_keys) {
+    struct json_object_removal stack_removals[32], *removals;
+    struct json_object_removals ctx;
+    struct json_object *object;
+    size_t nb_removals, first, nb_removed;
 
-            member_sz = sizeof(struct json_object_member);
-            memmove(object->members + i, object->members + i + 1,
-                    (object->nb_members - i - 1) * member_sz);
+    if (json_value_is_shared(object_value)) {
+        c_set_error("cannot modify a shared value");
+        return (size_t)-1;
+    }
+
+    object = &object_value->u.object;
+
+    removals = stack_removals;
+    if (nb_keys > sizeof(stack_removals) / sizeof(stack_removals[0]))
+        removals = c_malloc(nb_keys * sizeof(struct json_object_removal));
+
+    /* Only keep the keys present in the object, and remember where the
+     * first member to remove is. */
+    nb_removals = 0;
+    first = object->nb_members;
+
+    for (size_t i = 0; i < nb_keys; i++) {
+        struct json_object_removal *removal;
+        size_t idx;
+
+        removal = removals + nb_removals;
+
+        removal->key = keys[i];
+        removal->len = strlen(keys[i]);
+        removal->hash = json_hash_string(removal->key, removal->len);
+
+        if (!json_object_find(object, removal->key, removal->len,
+                              removal->hash, &idx)) {
+            continue;
         }
 
-        object->nb_members--;
-        object->sort_mode = JSON_OBJECT_UNSORTED;
+        if (idx < first)
+            first = idx;
 
-        /* Renumber to avoid holes in the index sequence */
-        if (i == object->nb_members) {
-            for (size_t j = 0; j < object->nb_members; j++) {
-                struct json_object_member *member2;
+        nb_removals++;
+    }
 
-                member2 = object->members + j;
+    nb_removed = 0;
 
-                if (member2->index > removed_index)
-                    member2->index--;
-            }
+    if (nb_removals > 0) {
+        ctx.removals = removals;
+        ctx.nb_removals = nb_removals;
+
+        nb_removed = json_object_compact(object, first,
+                                         json_object_removal_keep, &ctx);
+    }
+
+    if (removals != stack_removals)
+        c_free(removals);
+
+    return nb_removed;
+}
+
+size_t
+json_object_filter(struct json_value *object_value,
+                   json_object_filter_function function, void *data) {
+    struct json_object_filter filter;
+
+    if (json_value_is_shared(object_value)) {
+        c_set_error("cannot modify a shared value");
+        return (size_t)-1;
+    }
+
+    filter.function = function;
+    filter.data = data;
+
+    return json_object_compact(&object_value->u.object, 0,
+                               json_object_filter_keep, &filter);
+}
+
+static bool
+json_object_removal_keep(const struct json_object_key *okey,
+                         struct json_value *value, void *data) {
+    struct json_object_removals *ctx;
+
+    ctx = data;
+
+    for (size_t i = 0; i < ctx->nb_removals; i++) {
+        const struct json_object_removal *removal;
+
+        removal = ctx->removals + i;
+
+        if (okey->hash == removal->hash && okey->len == removal->len
+         && memcmp(okey->key->ptr, removal->key, removal->len) == 0) {
+            return false;
         }
     }
+
+    return true;
 }
 
-void
-json_object_remove_member(struct json_value *object, const char *key) {
-    json_object_remove_member2(object, key, strlen(key));
+static bool
+json_object_filter_keep(const struct json_object_key *okey,
+                        struct json_value *value, void *data) {
+    struct json_object_filter *filter;
+
+    filter = data;
+    return filter->function(okey->key->ptr, value, filter->data);
 }
 
-void
+static size_t
+json_object_compact(struct json_object *object, size_t start,
+                    json_object_keep_function keep, void *data) {
+    size_t nb_members, nb_removed;
+
+    /* Members are removed in a single pass which preserves the order of
+     * the remaining ones, whatever the number of members removed. */
+    nb_members = start;
+
+    for (size_t i = start; i < object->nb_members; i++) {
+        if (keep(object->keys + i, object->values[i], data)) {
+            object->keys[nb_members] = object->keys[i];
+            object->values[nb_members] = object->values[i];
+            nb_members++;
+            continue;
+        }
+
+        json_key_unref(object->keys[i].key);
+        json_value_delete(object->values[i]);
+    }
+
+    nb_removed = object->nb_members - nb_members;
+    if (nb_removed == 0)
+        return 0;
+
+    object->nb_members = nb_members;
+
+    /* Positions changed; the index keeps its size and is refilled from
+     * the hashes stored with the keys. */
+    if (object->index) {
+        memset(object->index, 0, object->index_size * sizeof(uint32_t));
+
+        for (size_t i = 0; i < object->nb_members; i++)
+            json_object_index_insert(object, i);
+    }
+
+    return nb_removed;
+}
+
+int
 json_object_merge(struct json_value *obj1, const struct json_value *obj2) {
     assert(obj1->type == JSON_OBJECT);
     assert(obj2->type == JSON_OBJECT);
 
     for (size_t i = 0; i < json_object_nb_members(obj2); i++) {
         const char *key;
-        struct json_value *value2;
+        struct json_value *value2, *clone;
 
         key = json_object_nth_member(obj2, i, &value2);
+        if (!value2)
+            continue;
 
-        if (value2)
-            json_object_set_member(obj1, key, json_value_clone(value2));
+        clone = json_value_clone(value2);
+        if (!clone)
+            return -1;
+
+        if (json_object_set_member(obj1, key, clone) == -1) {
+            json_value_delete(clone);
+            return -1;
+        }
     }
+
+    return 0;
 }
 
 struct json_object_iterator *
@@ -532,58 +1098,142 @@ int
 json_object_iterator_get_next(struct json_object_iterator *it,
                               struct json_value **pkey,
                               struct json_value **pvalue) {
-    struct json_object_member *member;
+    struct json_key *key;
 
     if (it->index >= it->object->nb_members)
         return 0;
 
-    member = it->object->members + it->index;
+    key = it->object->keys[it->index].key;
+
+    if (pkey) {
+        it->key.type = JSON_STRING;
+        it->key.u.string.ptr = key->ptr;
+        it->key.u.string.len = key->len;
 
-    if (pkey)
-        *pkey = member->key;
+        *pkey = &it->key;
+    }
     if (pvalue)
-        *pvalue = member->value;
+        *pvalue = it->object->values[it->index];
 
     it->index++;
     return 1;
 }
 
-void
-json_object_sort_by_index(struct json_object *object) {
-    if (object->sort_mode == JSON_OBJECT_SORTED_BY_INDEX)
-        return;
+static bool
+json_object_equal(const struct json_object *object1,
+                  const struct json_object *object2) {
+    struct json_object_member stack_members[2 * JSON_OBJECT_INDEX_THRESHOLD];
+    struct json_object_member *members1, *members2;
+    size_t nb_members;
+    bool equal;
 
-    qsort(object->members, object->nb_members,
-          sizeof(struct json_object_member),
-          json_object_member_cmp_by_index);
+    if (object1->nb_members != object2->nb_members)
+        return false;
 
-    object->sort_mode = JSON_OBJECT_SORTED_BY_INDEX;
-}
+    nb_members = object1->nb_members;
 
-void
-json_object_sort_by_key(struct json_object *object) {
-    if (object->sort_mode == JSON_OBJECT_SORTED_BY_KEY
-     || object->sort_mode == JSON_OBJECT_SORTED_BY_KEY_VALUE) {
-        return;
+    /* Members are compared in key/value order on temporary arrays, objects
+     * themselves are never reordered. */
+    if (nb_members <= JSON_OBJECT_INDEX_THRESHOLD) {
+        members1 = stack_members;
+    } else {
+        members1 = c_malloc(2 * nb_members * sizeof(struct json_object_member));
+        if (!members1)
+            return false;
+    }
+
+    members2 = members1 + nb_members;
+
+    for (size_t i = 0; i < nb_members; i++) {
+        members1[i].key = object1->keys[i].key;
+        members1[i].value = object1->values[i];
+
+        members2[i].key = object2->keys[i].key;
+        members2[i].value = object2->values[i];
+    }
+
+    qsort(members1, nb_members, sizeof(struct json_object_member),
+          json_object_member_cmp);
+    qsort(members2, nb_members, sizeof(struct json_object_member),
+          json_object_member_cmp);
+
+    equal = true;
+
+    for (size_t i = 0; i < nb_members; i++) {
+        if (json_key_cmp(members1[i].key, members2[i].key) != 0
+         || !json_value_equal(members1[i].value, members2[i].value)) {
+            equal = false;
+            break;
+        }
     }
 
-    qsort(object->members, object->nb_members,
-          sizeof(struct json_object_member),
-          json_object_member_cmp_by_key);
+    if (members1 != stack_members)
+        c_free(members1);
 
-    object->sort_mode = JSON_OBJECT_SORTED_BY_KEY;
+    return equal;
 }
 
-void
-json_object_sort_by_key_value(struct json_object *object) {
-    if (object->sort_mode == JSON_OBJECT_SORTED_BY_KEY_VALUE)
-        return;
+static int
+json_object_grow(struct json_value *value, size_t size) {
+    struct json_object *object;
+    struct json_object_key *keys;
+    struct json_value **values;
 
-    qsort(object->members, object->nb_members,
-          sizeof(struct json_object_member),
-          json_object_member_cmp_by_key_value);
+    object = &value->u.object;
 
-    object->sort_mode = JSON_OBJECT_SORTED_BY_KEY_VALUE;
+    keys = json_allocator_realloc(value->allocator, object->keys,
+                                  size * sizeof(struct json_object_key));
+    if (!keys)
+        return -1;
+    object->keys = keys;
+
+    values = json_allocator_realloc(value->allocator, object->values,
+                                    size * sizeof(struct json_value *));
+    if (!values)
+        return -1;
+    object->values = values;
+
+    object->size = size;
+    return 0;
+}
+
+static int
+json_object_index_build(struct json_value *value, size_t size) {
+    struct json_object *object;
+    uint32_t *index;
+
+    object = &value->u.object;
+
+    index = json_allocator_malloc(value->allocator, size * sizeof(uint32_t));
+    if (!index)
+        return -1;
+
+    memset(index, 0, size * sizeof(uint32_t));
+
+    json_allocator_free(value->allocator, object->index);
+
+    object->index = index;
+    object->index_size = size;
+
+    for (size_t i = 0; i < object->nb_members; i++)
+        json_object_index_insert(object, i);
+
+    return 0;
+}
+
+static void
+json_object_index_insert(struct json_object *object, size_t idx) {
+    size_t mask, slot;
+
+    mask = object->index_size - 1;
+
+    /* Members with the same key end up further along the probe sequence
+     * than the first one, so lookups keep returning the first member. */
+    slot = object->keys[idx].hash & mask;
+    while (object->index[slot] != 0)
+        slot = (slot + 1) & mask;
+
+    object->index[slot] = (uint32_t)(idx + 1);
 }
 
 struct json_value *
@@ -606,35 +1256,68 @@ json_array_element(const struct json_value *value, size_t idx) {
     return value->u.array.elements[idx];
 }
 
+struct json_value *
+json_array_element_mutable(struct json_value *value, size_t idx) {
+    if (json_value_is_shared(value)) {
+        c_set_error("cannot modify a shared value");
+        return NULL;
+    }
+
+    if (idx >= value->u.array.nb_elements) {
+        c_set_error("invalid index %zu", idx);
+        return NULL;
+    }
+
+    return json_value_unshare(value->u.array.elements + idx);
+}
+
 int
 json_array_add_element(struct json_value *value, struct json_value *element) {
     struct json_array *array;
-    struct json_value **elements;
-    size_t nb_elements;
 
     if (value->type != JSON_ARRAY) {
         c_set_error("value is not an array");
         return -1;
     }
 
+    if (json_value_is_shared(value)) {
+        c_set_error("cannot modify a shared value");
+        return -1;
+    }
+
     array = &value->u.array;
 
-    if (array->nb_elements == 0) {
-        nb_elements = 1;
-        elements = c_malloc(sizeof(struct json_value *));
-    } else {
-        nb_elements = array->nb_elements + 1;
-        elements = c_realloc(array->elements,
-                                nb_elements * sizeof(struct json_value *));
+    /* Appending n elements only reallocates O(log n) times */
+    if (array->nb_elements >= array->size) {
+        size_t size;
+
+        size = (array->size == 0) ? 4 : array->size * 2;
+        if (json_array_reserve(value, size) == -1)
+            return -1;
     }
 
+    array->elements[array->nb_elements++] = element;
+    return 0;
+}
+
+int
+json_array_reserve(struct json_value *value, size_t size) {
+    struct json_array *array;
+    struct json_value **elements;
+
+    array = &value->u.array;
+
+    if (size <= array->size)
+        return 0;
+
+    elements = json_allocator_realloc(value->allocator, array->elements,
+                                      size * sizeof(struct json_value *));
     if (!elements)
         return -1;
 
     array->elements = elements;
-    array->nb_elements = nb_elements;
+    array->size = size;
 
-    array->elements[array->nb_elements - 1] = element;
     return 0;
 }
 
@@ -684,7 +1367,7 @@ json_string_new(const char *string) {
     length = strlen(string);
     value->u.string.len = length;
 
-    value->u.string.ptr = c_strndup(string, length);
+    value->u.string.ptr = json_strndup(string, length);
     if (!value->u.string.ptr) {
         json_value_delete(value);
         return NULL;
@@ -703,7 +1386,7 @@ json_string_new2(const char *string, size_t length) {
 
     value->u.string.len = length;
 
-    value->u.string.ptr = c_strndup(string, length);
+    value->u.string.ptr = json_strndup(string, length);
     if (!value->u.string.ptr) {
         json_value_delete(value);
         return NULL;
@@ -736,7 +1419,7 @@ json_string_new_vprintf(const char *fmt, va_list ap) {
     char *string;
     int size;
 
-    size = c_vasprintf(&string, fmt, ap);
+    size = json_vasprintf(&string, fmt, ap);
     if (size == -1)
         return NULL;
 
@@ -882,40 +1565,14 @@ json_value_cmp(const void *arg1, const void *arg2) {
 }
 
 static int
-json_object_member_cmp_by_index(const void *arg1, const void *arg2) {
-    const struct json_object_member *member1, *member2;
-
-    member1 = arg1;
-    member2 = arg2;
-
-    if (member1->index < member2->index) {
-        return -1;
-    } else if (member1->index > member2->index) {
-        return 1;
-    }
-
-    return 0;
-}
-
-static int
-json_object_member_cmp_by_key(const void *arg1, const void *arg2) {
-    const struct json_object_member *member1, *member2;
-
-    member1 = arg1;
-    member2 = arg2;
-
-    return strcmp(member1->key->u.string.ptr, member2->key->u.string.ptr);
-}
-
-static int
-json_object_member_cmp_by_key_value(const void *arg1, const void *arg2) {
+json_object_member_cmp(const void *arg1, const void *arg2) {
     const struct json_object_member *member1, *member2;
     int ret;
 
     member1 = arg1;
     member2 = arg2;
 
-    ret = strcmp(member1->key->u.string.ptr, member2->key->u.string.ptr);
+    ret = json_key_cmp(member1->key, member2->key);
     if (ret != 0)
         return ret;
 
@@ -23,6 +23,29 @@
 
 #include <core.h>
 
+/* Memory allocation */
+struct json_allocator {
+    void *(*alloc)(void *data, size_t size);
+    void *(*realloc)(void *data, void *ptr, size_t size);
+    void (*free)(void *data, void *ptr);
+
+    void *data;
+};
+
+/* Set the allocator used by default for values, strings and keys; NULL
+ * restores the libcore allocator. The allocator is referenced, not copied,
+ * and must remain valid as long as values created with it exist. */
+void json_set_allocator(const struct json_allocator *);
+
+/* Select the allocator used by the current thread instead of the default
+ * one, and return the previous selection. The allocator is referenced, not
+ * copied. Values and keys record the allocator they were created with:
+ * they are resized and freed with it whatever the allocator selected at
+ * the time. Strings passed to json_string_new_nocopy() must have been
+ * allocated with the current allocator. Cloning a value created with
+ * another allocator than the current one makes a deep copy. */
+const struct json_allocator *json_use_allocator(const struct json_allocator *);
+
 /* JSON */
 enum json_type {
     JSON_OBJECT,
@@ -51,7 +74,18 @@ struct json_value *json_parse_fd(int, uint32_t);
 struct json_value *json_parse_file(const char *, uint32_t);
 
 void json_value_delete(struct json_value *);
+
+/* Return a deep copy which shares nothing with the original value but the
+ * keys of objects. */
 struct json_value *json_value_clone(const struct json_value *);
+struct json_value *json_value_copy(const struct json_value *);
+
+/* Return a copy-on-write clone which shares its members with the original
+ * value. Shared containers are only copied when reached with
+ * json_object_member_mutable(), json_array_element_mutable() or
+ * json_pointer_set(); values obtained with json_object_member() or
+ * json_array_element() must not be modified in either document. */
+struct json_value *json_value_clone_shared(const struct json_value *);
 bool json_value_equal(struct json_value *, struct json_value *);
 
 enum json_type json_value_type(const struct json_value *);
@@ -77,6 +111,33 @@ int json_value_format_to_buffer(struct json_value *, struct c_buffer *,
                                 uint32_t);
 char *json_value_format(struct json_value *, uint32_t, size_t *);
 
+/* The binary encoding is compact, versioned and independent of the byte
+ * order, with a table of unique strings; it is decoded into a value tree. */
+char *json_value_encode_binary(const struct json_value *, size_t *);
+int json_value_encode_binary_to_buffer(const struct json_value *,
+                                       struct c_buffer *);
+struct json_value *json_value_decode_binary(const void *, size_t);
+
+char *json_value_encode_cbor(const struct json_value *, size_t *);
+int json_value_encode_cbor_to_buffer(const struct json_value *,
+                                     struct c_buffer *);
+struct json_value *json_value_decode_cbor(const void *, size_t);
+
+char *json_value_encode_msgpack(const struct json_value *, size_t *);
+int json_value_encode_msgpack_to_buffer(const struct json_value *,
+                                        struct c_buffer *);
+struct json_value *json_value_decode_msgpack(const void *, size_t);
+
+enum json_decoder_format {
+    JSON_DECODER_CBOR,
+    JSON_DECODER_MSGPACK,
+};
+
+struct json_decoder *json_decoder_new(enum json_decoder_format);
+void json_decoder_delete(struct json_decoder *);
+int json_decoder_feed(struct json_decoder *, const void *, size_t);
+int json_decoder_next(struct json_decoder *, struct json_value **);
+
 struct json_value *json_object_new(void);
 size_t json_object_nb_members(const struct json_value *);
 bool json_object_has_member(const struct json_value *, const char *);
@@ -84,19 +145,48 @@ bool json_object_has_member2(const struct json_value *, const char *, size_t);
 struct json_value *json_object_member(const struct json_value *, const char *);
 struct json_value *json_object_member2(const struct json_value *,
                                        const char *, size_t);
+struct json_value *json_object_member_mutable(struct json_value *,
+                                             const char *);
+struct json_value *json_object_member_mutable2(struct json_value *,
+                                              const char *, size_t);
 const char *json_object_nth_member(const struct json_value *, size_t,
                                    struct json_value **);
 int json_object_add_member2(struct json_value *, const char *, size_t,
                             struct json_value *);
 int json_object_add_member(struct json_value *, const char *,
                            struct json_value *);
+
+/* The object takes ownership of the key, which must have been allocated with
+ * the current allocator (c_malloc() by default). */
+int json_object_add_member_nocopy2(struct json_value *, char *, size_t,
+                                   struct json_value *);
+int json_object_add_member_nocopy(struct json_value *, char *,
+                                  struct json_value *);
+
 int json_object_set_member2(struct json_value *, const char *, size_t,
                             struct json_value *);
 int json_object_set_member(struct json_value *, const char *,
                            struct json_value *);
-void json_object_remove_member2(struct json_value *, const char *, size_t);
-void json_object_remove_member(struct json_value *, const char *);
-void json_object_merge(struct json_value *, const struct json_value *);
+int json_object_remove_member2(struct json_value *, const char *, size_t);
+int json_object_remove_member(struct json_value *, const char *);
+
+/* Remove all the members whose key is in a list in a single pass, and
+ * return the number of members removed, or (size_t)-1 if the object is
+ * shared. */
+size_t json_object_remove_members(struct json_value *, const char * const *,
+                                  size_t);
+
+/* Remove all the members for which the function returns false, and return
+ * the number of members removed, or (size_t)-1 if the object is shared. */
+typedef bool (*json_object_filter_function)(const char *, struct json_value *,
+                                            void *);
+
+size_t json_object_filter(struct json_value *, json_object_filter_function,
+                          void *);
+
+/* Set all the members of the second object in the first one. On failure,
+ * the members merged before the error are kept. */
+int json_object_merge(struct json_value *, const struct json_value *);
 
 struct json_object_iterator *json_object_iterate(struct json_value *);
 void json_object_iterator_delete(struct json_object_iterator *);
@@ -106,6 +196,7 @@ int json_object_iterator_get_next(struct json_object_iterator *,
 struct json_value *json_array_new(void);
 size_t json_array_nb_elements(const struct json_value *);
 struct json_value *json_array_element(const struct json_value *, size_t);
+struct json_value *json_array_element_mutable(struct json_value *, size_t);
 int json_array_add_element(struct json_value *, struct json_value *);
 
 struct json_value *json_integer_new(int64_t);
@@ -130,13 +221,207 @@ bool json_boolean_value(const struct json_value *);
 
 struct json_value *json_null_new(void);
 
+/* JSON pointers (RFC 6901) */
+struct json_pointer;
+
+struct json_pointer *json_pointer_compile(const char *);
+void json_pointer_delete(struct json_pointer *);
+size_t json_pointer_nb_tokens(const struct json_pointer *);
+
+/* Evaluating a compiled pointer does not allocate memory. Setting a value
+ * replaces or adds the last member or element designated by the pointer,
+ * "-" designating the end of an array, and copies the shared containers on
+ * the path. The document takes ownership of the value on success; on
+ * failure, the value still belongs to the caller. */
+struct json_value *json_pointer_get(const struct json_pointer *,
+                                    const struct json_value *);
+int json_pointer_set(const struct json_pointer *, struct json_value *,
+                     struct json_value *);
+
+/* Projections */
+struct json_projection;
+
+struct json_projection *json_projection_new(void);
+void json_projection_delete(struct json_projection *);
+size_t json_projection_nb_targets(const struct json_projection *);
+
+/* Add a value to select with a json pointer or with a json path made of
+ * member names and array indexes, such as "$.a['b'][0]". Return the index
+ * of the value in the array filled by json_parse_project(). */
+int json_projection_add_pointer(struct json_projection *, const char *);
+int json_projection_add_path(struct json_projection *, const char *);
+
+/* Parse a document and only create the selected values; values which are
+ * not found are set to NULL. Selected values are the ones json_parse() then
+ * json_pointer_get() would return, the first member winning for duplicate
+ * keys. Values which are neither selected nor on the path to a selected
+ * value are skipped without being decoded: their structure, literals and
+ * numbers are checked, but their strings are only scanned for their end,
+ * and their escape sequences and duplicate keys are not checked. Parsing
+ * stops once every selected value has been read, the rest of the document
+ * is not checked. */
+int json_parse_project(const char *, size_t, uint32_t,
+                       const struct json_projection *, struct json_value **);
+
+/* Frozen documents. The json_frozen_size() bytes of a frozen document can be
+ * stored, then opened or mapped and used in place without any decoding. The
+ * format uses the byte order of the host; opening a document written on a
+ * host with a different byte order fails. */
+struct json_frozen;
+struct json_frozen_value;
+
+struct json_frozen *json_freeze(const struct json_value *);
+void json_frozen_delete(struct json_frozen *);
+struct json_frozen *json_frozen_clone(const struct json_frozen *);
+size_t json_frozen_size(const struct json_frozen *);
+const struct json_frozen_value *json_frozen_root(const struct json_frozen *);
+
+struct json_value *json_frozen_value_thaw(const struct json_frozen_value *);
+
+enum json_frozen_open_option {
+    JSON_FROZEN_OPEN_DEFAULT = 0,
+
+    /* Only check the header and access the tape without validating it
+     * first. Only use with data produced by json_freeze(). */
+    JSON_FROZEN_OPEN_TRUSTED = (1 << 0),
+};
+
+const struct json_frozen *json_frozen_open(const void *, size_t, uint32_t);
+const struct json_frozen *json_frozen_map_file(const char *, uint32_t);
+void json_frozen_unmap(const struct json_frozen *);
+
+enum json_type json_frozen_value_type(const struct json_frozen_value *);
+
+size_t json_frozen_object_nb_members(const struct json_frozen_value *);
+bool json_frozen_object_has_member(const struct json_frozen_value *,
+                                   const char *);
+bool json_frozen_object_has_member2(const struct json_frozen_value *,
+                                    const char *, size_t);
+const struct json_frozen_value *
+json_frozen_object_member(const struct json_frozen_value *, const char *);
+const struct json_frozen_value *
+json_frozen_object_member2(const struct json_frozen_value *,
+                           const char *, size_t);
+const char *json_frozen_object_nth_member(const struct json_frozen_value *,
+                                          size_t,
+                                          const struct json_frozen_value **);
+
+size_t json_frozen_array_nb_elements(const struct json_frozen_value *);
+const struct json_frozen_value *
+json_frozen_array_element(const struct json_frozen_value *, size_t);
+
+int64_t json_frozen_integer_value(const struct json_frozen_value *);
+double json_frozen_real_value(const struct json_frozen_value *);
+const char *json_frozen_string_value(const struct json_frozen_value *);
+size_t json_frozen_string_length(const struct json_frozen_value *);
+bool json_frozen_boolean_value(const struct json_frozen_value *);
+
 /* JSON schema */
 struct json_schema *json_schema_parse(const char *, size_t);
 struct json_schema *json_schema_parse_string(const char *);
 struct json_schema *json_schema_parse_fd(int);
 struct json_schema *json_schema_parse_file(const char *);
+struct json_schema *json_schema_ref(struct json_schema *);
 void json_schema_delete(struct json_schema *);
 
+int json_schema_compile(struct json_schema *);
+
 int json_schema_validate(struct json_schema *, struct json_value *);
 
+enum json_schema_error_code {
+    JSON_SCHEMA_ERROR_TYPE,
+    JSON_SCHEMA_ERROR_ENUM,
+    JSON_SCHEMA_ERROR_ANY_OF,
+    JSON_SCHEMA_ERROR_ONE_OF,
+    JSON_SCHEMA_ERROR_NOT,
+    JSON_SCHEMA_ERROR_FORMAT,
+    JSON_SCHEMA_ERROR_MULTIPLE_OF,
+    JSON_SCHEMA_ERROR_MINIMUM,
+    JSON_SCHEMA_ERROR_MAXIMUM,
+    JSON_SCHEMA_ERROR_MIN_LENGTH,
+    JSON_SCHEMA_ERROR_MAX_LENGTH,
+    JSON_SCHEMA_ERROR_PATTERN,
+    JSON_SCHEMA_ERROR_MIN_ITEMS,
+    JSON_SCHEMA_ERROR_MAX_ITEMS,
+    JSON_SCHEMA_ERROR_UNIQUE_ITEMS,
+    JSON_SCHEMA_ERROR_ADDITIONAL_ITEMS,
+    JSON_SCHEMA_ERROR_MIN_PROPERTIES,
+    JSON_SCHEMA_ERROR_MAX_PROPERTIES,
+    JSON_SCHEMA_ERROR_REQUIRED,
+    JSON_SCHEMA_ERROR_ADDITIONAL_PROPERTIES,
+    JSON_SCHEMA_ERROR_DEPENDENCIES,
+};
+
+struct json_schema_error {
+    enum json_schema_error_code code;
+
+    char *pointer;     /* JSON pointer to the value in the document */
+    char *schema_path; /* JSON pointer to the keyword in the schema */
+};
+
+/* Collect up to the given number of errors. Return 0 if the value is
+ * valid, or -1 if it is not or if validation failed; in the later case, no
+ * error is returned and the error is set with c_set_error(). */
+int json_schema_validate_all(struct json_schema *, const struct json_value *,
+                             struct json_schema_error *, size_t, size_t *);
+void json_schema_errors_free(struct json_schema_error *, size_t);
+
+bool json_schema_is_valid(struct json_schema *, const struct json_value *);
+
+int json_parse_validate(const char *, size_t, uint32_t, struct json_schema *,
+                        struct json_value **);
+
+/* Validate a value using the threads of a pool for large arrays and
+ * objects. The first error reported is the same as with
+ * json_schema_validate(). A pool can be used by several threads at the same
+ * time; zero threads means one thread per processor. The threads of the
+ * pool allocate memory with the allocator selected by the calling thread
+ * (see json_use_allocator()). */
+struct json_schema_pool *json_schema_pool_new(unsigned int);
+void json_schema_pool_delete(struct json_schema_pool *);
+
+int json_schema_validate_parallel(struct json_schema *, struct json_value *,
+                                  struct json_schema_pool *);
+
+/* Formats must be registered before parsing schemas using them; they cannot
+ * be unregistered. The function is called with a string and its length and
+ * returns true if the string matches the format. */
+typedef bool (*json_schema_format_function)(const char *, size_t, void *);
+
+int json_schema_format_register(const char *, json_schema_format_function,
+                                void *);
+
+/* JSON schema profiling: when the library is built with profile=1, return
+ * the number of times each keyword was checked and the time spent checking
+ * it in nanoseconds, excluding nested values. Otherwise no entry is
+ * returned. */
+struct json_schema_profile_entry {
+    const char *keyword;
+    uint64_t count;
+    uint64_t time;
+};
+
+size_t json_schema_profile_entries(struct json_schema_profile_entry *,
+                                   size_t);
+void json_schema_profile_reset(void);
+
+/* JSON schema registry */
+typedef char *(*json_schema_loader)(const char *, size_t *, void *);
+
+struct json_schema_registry *json_schema_registry_new(void);
+void json_schema_registry_delete(struct json_schema_registry *);
+
+void json_schema_registry_set_loader(struct json_schema_registry *,
+                                     json_schema_loader, void *);
+
+/* Return 1 if the schema was loaded, 0 if it is already loaded with the
+ * same content, or -1 on error. */
+int json_schema_registry_add(struct json_schema_registry *, const char *,
+                             const char *, size_t);
+int json_schema_registry_add_file(struct json_schema_registry *,
+                                  const char *);
+
+struct json_schema *json_schema_registry_get(struct json_schema_registry *,
+                                             const char *);
+
 #endif
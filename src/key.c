@@ -0,0 +1,282 @@
+/*
+ * Copyright (c) 2014-2015 Nicolas Martyanoff
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include "internal.h"
+
+#define JSON_KEY_TABLE_INITIAL_SIZE 64
+
+static struct json_key **json_key_table_find(struct json_key_table *,
+                                            const char *, size_t, uint32_t);
+static int json_key_table_resize(struct json_key_table *, size_t);
+
+uint32_t
+json_hash_string(const char *string, size_t len) {
+    uint32_t hash;
+
+    /* FNV-1a */
+    hash = 2166136261u;
+
+    for (size_t i = 0; i < len; i++) {
+        hash ^= (unsigned char)string[i];
+        hash *= 16777619u;
+    }
+
+    return hash;
+}
+
+uint32_t
+json_hash_integer(uint64_t value) {
+    /* splitmix64 finalizer */
+    value = (value ^ (value >> 30)) * 0xbf58476d1ce4e5b9ull;
+    value = (value ^ (value >> 27)) * 0x94d049bb133111ebull;
+    value ^= value >> 31;
+
+    return (uint32_t)(value ^ (value >> 32));
+}
+
+uint32_t
+json_hash_pointer(const void *ptr) {
+    uint64_t value;
+
+    /* The low bits of allocated addresses are always zero */
+    value = (uint64_t)(uintptr_t)ptr >> 4;
+    return (uint32_t)(value ^ (value >> 32));
+}
+
+bool
+json_equal_pointer(const void *ptr1, const void *ptr2) {
+    return ptr1 == ptr2;
+}
+
+struct json_key *
+json_key_new(const char *string, size_t len) {
+    struct json_key *key;
+
+    /* The string is stored right after the structure so that a key only
+     * costs one allocation. */
+    key = json_malloc(sizeof(struct json_key) + len + 1);
+    if (!key)
+        return NULL;
+
+    key->allocator = json_allocator_current();
+    key->refcount = 1;
+    key->hash = json_hash_string(string, len);
+    key->len = len;
+    key->ptr = (char *)(key + 1);
+
+    memcpy(key->ptr, string, len);
+    key->ptr[len] = '\0';
+
+    return key;
+}
+
+struct json_key *
+json_key_new_nocopy(char *string, size_t len) {
+    struct json_key *key;
+
+    key = json_malloc(sizeof(struct json_key));
+    if (!key)
+        return NULL;
+
+    key->allocator = json_allocator_current();
+    key->refcount = 1;
+    key->hash = json_hash_string(string, len);
+    key->len = len;
+    key->ptr = string;
+
+    return key;
+}
+
+struct json_key *
+json_key_ref(struct json_key *key) {
+    __atomic_add_fetch(&key->refcount, 1, __ATOMIC_RELAXED);
+    return key;
+}
+
+void
+json_key_unref(struct json_key *key) {
+    if (!key)
+        return;
+
+    if (__atomic_sub_fetch(&key->refcount, 1, __ATOMIC_ACQ_REL) > 0)
+        return;
+
+    if (key->ptr && key->ptr != (char *)(key + 1))
+        key->allocator->free(key->allocator->data, key->ptr);
+
+    key->allocator->free(key->allocator->data, key);
+}
+
+bool
+json_key_equal(const struct json_key *key, const char *string, size_t len,
+               uint32_t hash) {
+    return key->hash == hash && key->len == len
+        && memcmp(key->ptr, string, len) == 0;
+}
+
+int
+json_key_cmp(const struct json_key *key1, const struct json_key *key2) {
+    size_t len;
+    int ret;
+
+    if (key1 == key2)
+        return 0;
+
+    len = (key1->len < key2->len) ? key1->len : key2->len;
+
+    ret = memcmp(key1->ptr, key2->ptr, len);
+    if (ret != 0)
+        return ret;
+
+    if (key1->len < key2->len) {
+        return -1;
+    } else if (key1->len > key2->len) {
+        return 1;
+    }
+
+    return 0;
+}
+
+void
+json_key_table_init(struct json_key_table *table) {
+    memset(table, 0, sizeof(struct json_key_table));
+}
+
+void
+json_key_table_free(struct json_key_table *table) {
+    if (!table)
+        return;
+
+    for (size_t i = 0; i < table->size; i++)
+        json_key_unref(table->entries[i]);
+
+    json_free(table->entries);
+
+    memset(table, 0, sizeof(struct json_key_table));
+}
+
+struct json_key *
+json_key_table_intern(struct json_key_table *table,
+                      const char *string, size_t len) {
+    return json_key_table_intern2(table, string, len,
+                                  json_hash_string(string, len));
+}
+
+struct json_key *
+json_key_table_intern2(struct json_key_table *table,
+                       const char *string, size_t len, uint32_t hash) {
+    struct json_key **slot;
+
+    slot = json_key_table_find(table, string, len, hash);
+    if (!slot)
+        return NULL;
+
+    if (!*slot) {
+        *slot = json_key_new(string, len);
+        if (!*slot)
+            return NULL;
+
+        table->nb_entries++;
+    }
+
+    return json_key_ref(*slot);
+}
+
+struct json_key *
+json_key_table_intern_nocopy(struct json_key_table *table,
+                             char *string, size_t len, uint32_t hash) {
+    struct json_key **slot;
+
+    slot = json_key_table_find(table, string, len, hash);
+    if (!slot)
+        return NULL;
+
+    if (*slot) {
+        json_free(string);
+    } else {
+        *slot = json_key_new_nocopy(string, len);
+        if (!*slot)
+            return NULL;
+
+        table->nb_entries++;
+    }
+
+    return json_key_ref(*slot);
+}
+
+static struct json_key **
+json_key_table_find(struct json_key_table *table,
+                    const char *string, size_t len, uint32_t hash) {
+    size_t mask, idx;
+
+    /* Keep the load factor under 1/2 so that probe sequences stay short */
+    if ((table->nb_entries + 1) * 2 > table->size) {
+        size_t size;
+
+        size = (table->size == 0) ? JSON_KEY_TABLE_INITIAL_SIZE
+                                  : table->size * 2;
+
+        if (json_key_table_resize(table, size) == -1)
+            return NULL;
+    }
+
+    mask = table->size - 1;
+    idx = hash & mask;
+
+    for (;;) {
+        struct json_key *key;
+
+        key = table->entries[idx];
+        if (!key || json_key_equal(key, string, len, hash))
+            return table->entries + idx;
+
+        idx = (idx + 1) & mask;
+    }
+}
+
+static int
+json_key_table_resize(struct json_key_table *table, size_t size) {
+    struct json_key **entries;
+    size_t mask;
+
+    entries = json_malloc0(size * sizeof(struct json_key *));
+    if (!entries)
+        return -1;
+
+    mask = size - 1;
+
+    for (size_t i = 0; i < table->size; i++) {
+        struct json_key *key;
+        size_t idx;
+
+        key = table->entries[i];
+        if (!key)
+            continue;
+
+        idx = key->hash & mask;
+        while (entries[idx])
+            idx = (idx + 1) & mask;
+
+        entries[idx] = key;
+    }
+
+    json_free(table->entries);
+
+    table->entries = entries;
+    table->size = size;
+
+    return 0;
+}
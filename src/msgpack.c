@@ -0,0 +1,713 @@
+/*
+ * Copyright (c) 2014-2015 Nicolas Martyanoff
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include "internal.h"
+
+/* MessagePack. Integers use the smallest representation, reals are encoded
+ * as 64 bit floats. The decoder rejects binary data, extension types, map
+ * keys which are not strings, unsigned integers larger than INT64_MAX and
+ * arrays and maps nested more than JSON_MAX_DEPTH times. */
+
+#define JSON_MSGPACK_NIL      0xc0
+#define JSON_MSGPACK_FALSE    0xc2
+#define JSON_MSGPACK_TRUE     0xc3
+#define JSON_MSGPACK_BIN8     0xc4
+#define JSON_MSGPACK_BIN16    0xc5
+#define JSON_MSGPACK_BIN32    0xc6
+#define JSON_MSGPACK_EXT8     0xc7
+#define JSON_MSGPACK_EXT16    0xc8
+#define JSON_MSGPACK_EXT32    0xc9
+#define JSON_MSGPACK_FLOAT32  0xca
+#define JSON_MSGPACK_FLOAT64  0xcb
+#define JSON_MSGPACK_UINT8    0xcc
+#define JSON_MSGPACK_UINT16   0xcd
+#define JSON_MSGPACK_UINT32   0xce
+#define JSON_MSGPACK_UINT64   0xcf
+#define JSON_MSGPACK_INT8     0xd0
+#define JSON_MSGPACK_INT16    0xd1
+#define JSON_MSGPACK_INT32    0xd2
+#define JSON_MSGPACK_INT64    0xd3
+#define JSON_MSGPACK_FIXEXT1  0xd4
+#define JSON_MSGPACK_FIXEXT16 0xd8
+#define JSON_MSGPACK_STR8     0xd9
+#define JSON_MSGPACK_STR16    0xda
+#define JSON_MSGPACK_STR32    0xdb
+#define JSON_MSGPACK_ARRAY16  0xdc
+#define JSON_MSGPACK_ARRAY32  0xdd
+#define JSON_MSGPACK_MAP16    0xde
+#define JSON_MSGPACK_MAP32    0xdf
+
+struct json_msgpack_decoder {
+    const uint8_t *ptr;
+    size_t len;
+
+    size_t depth;
+
+    struct json_key_table keys;
+};
+
+static int json_msgpack_encode_value(const struct json_value *,
+                                     struct c_buffer *);
+static int json_msgpack_encode_integer(struct c_buffer *, int64_t);
+static int json_msgpack_encode_string(struct c_buffer *,
+                                      const char *, size_t);
+static int json_msgpack_encode_container(struct c_buffer *, uint8_t,
+                                         uint8_t, uint8_t, size_t);
+
+static int json_msgpack_decode_value(struct json_msgpack_decoder *,
+                                     struct json_value **);
+static int json_msgpack_decode_array(struct json_msgpack_decoder *,
+                                     uint64_t, struct json_value **);
+static int json_msgpack_decode_map(struct json_msgpack_decoder *,
+                                   uint64_t, struct json_value **);
+
+char *
+json_value_encode_msgpack(const struct json_value *value, size_t *plen) {
+    struct c_buffer *buf;
+    char *data;
+
+    buf = c_buffer_new();
+
+    if (json_msgpack_encode_value(value, buf) == -1) {
+        c_buffer_delete(buf);
+        return NULL;
+    }
+
+    data = c_buffer_extract_string(buf, plen);
+    c_buffer_delete(buf);
+
+    return data;
+}
+
+int
+json_value_encode_msgpack_to_buffer(const struct json_value *value,
+                                    struct c_buffer *buf) {
+    return json_msgpack_encode_value(value, buf);
+}
+
+struct json_value *
+json_value_decode_msgpack(const void *data, size_t len) {
+    struct json_msgpack_decoder decoder;
+    struct json_value *value;
+
+    memset(&decoder, 0, sizeof(struct json_msgpack_decoder));
+
+    decoder.ptr = data;
+    decoder.len = len;
+
+    json_key_table_init(&decoder.keys);
+
+    if (json_msgpack_decode_value(&decoder, &value) == -1) {
+        json_key_table_free(&decoder.keys);
+        return NULL;
+    }
+
+    json_key_table_free(&decoder.keys);
+
+    if (decoder.len > 0) {
+        c_set_error("invalid trailing data");
+        json_value_delete(value);
+        return NULL;
+    }
+
+    return value;
+}
+
+int
+json_msgpack_read_item_head(const uint8_t *data, size_t len,
+                            struct json_item_head *head) {
+    uint8_t byte;
+
+    memset(head, 0, sizeof(struct json_item_head));
+
+    if (len < 1)
+        return 0;
+
+    byte = data[0];
+    head->size = 1;
+
+    if (byte <= 0x7f || byte >= 0xe0) {
+        /* Positive and negative fixint */
+        return 1;
+    } else if (byte <= 0x8f) {
+        head->nb_items = (uint64_t)(byte & 0x0f) * 2;
+        return 1;
+    } else if (byte <= 0x9f) {
+        head->nb_items = byte & 0x0f;
+        return 1;
+    } else if (byte <= 0xbf) {
+        head->data_size = byte & 0x1f;
+        return 1;
+    }
+
+    switch (byte) {
+    case JSON_MSGPACK_NIL:
+    case JSON_MSGPACK_FALSE:
+    case JSON_MSGPACK_TRUE:
+        return 1;
+
+    case JSON_MSGPACK_UINT8:
+    case JSON_MSGPACK_INT8:
+        head->data_size = 1;
+        return 1;
+
+    case JSON_MSGPACK_UINT16:
+    case JSON_MSGPACK_INT16:
+        head->data_size = 2;
+        return 1;
+
+    case JSON_MSGPACK_UINT32:
+    case JSON_MSGPACK_INT32:
+    case JSON_MSGPACK_FLOAT32:
+        head->data_size = 4;
+        return 1;
+
+    case JSON_MSGPACK_UINT64:
+    case JSON_MSGPACK_INT64:
+    case JSON_MSGPACK_FLOAT64:
+        head->data_size = 8;
+        return 1;
+
+    case JSON_MSGPACK_STR8:
+    case JSON_MSGPACK_BIN8:
+        head->size = 2;
+        if (len < head->size)
+            return 0;
+
+        head->data_size = data[1];
+        return 1;
+
+    case JSON_MSGPACK_STR16:
+    case JSON_MSGPACK_BIN16:
+        head->size = 3;
+        if (len < head->size)
+            return 0;
+
+        head->data_size = json_read_be16(data + 1);
+        return 1;
+
+    case JSON_MSGPACK_STR32:
+    case JSON_MSGPACK_BIN32:
+        head->size = 5;
+        if (len < head->size)
+            return 0;
+
+        head->data_size = json_read_be32(data + 1);
+        return 1;
+
+    case JSON_MSGPACK_ARRAY16:
+    case JSON_MSGPACK_MAP16:
+        head->size = 3;
+        if (len < head->size)
+            return 0;
+
+        head->nb_items = json_read_be16(data + 1);
+        if (byte == JSON_MSGPACK_MAP16)
+            head->nb_items *= 2;
+        return 1;
+
+    case JSON_MSGPACK_ARRAY32:
+    case JSON_MSGPACK_MAP32:
+        head->size = 5;
+        if (len < head->size)
+            return 0;
+
+        head->nb_items = json_read_be32(data + 1);
+        if (byte == JSON_MSGPACK_MAP32)
+            head->nb_items *= 2;
+        return 1;
+
+    case JSON_MSGPACK_EXT8:
+    case JSON_MSGPACK_EXT16:
+    case JSON_MSGPACK_EXT32:
+    {
+        size_t size;
+
+        size = (size_t)1 << (byte - JSON_MSGPACK_EXT8);
+
+        /* Size, type, then data */
+        head->size = 1 + size + 1;
+        if (len < head->size)
+            return 0;
+
+        if (byte == JSON_MSGPACK_EXT8) {
+            head->data_size = data[1];
+        } else if (byte == JSON_MSGPACK_EXT16) {
+            head->data_size = json_read_be16(data + 1);
+        } else {
+            head->data_size = json_read_be32(data + 1);
+        }
+
+        return 1;
+    }
+
+    default:
+        if (byte >= JSON_MSGPACK_FIXEXT1 && byte <= JSON_MSGPACK_FIXEXT16) {
+            /* Type, then 1, 2, 4, 8 or 16 bytes of data */
+            head->size = 2;
+            if (len < head->size)
+                return 0;
+
+            head->data_size = (uint64_t)1 << (byte - JSON_MSGPACK_FIXEXT1);
+            return 1;
+        }
+
+        c_set_error("invalid type 0x%02x", byte);
+        return -1;
+    }
+}
+
+static int
+json_msgpack_encode_value(const struct json_value *value,
+                          struct c_buffer *buf) {
+    switch (value->type) {
+    case JSON_OBJECT:
+    {
+        const struct json_object *object;
+
+        object = &value->u.object;
+
+        if (json_msgpack_encode_container(buf, 0x80, JSON_MSGPACK_MAP16,
+                                          JSON_MSGPACK_MAP32,
+                                          object->nb_members) == -1) {
+            return -1;
+        }
+
+        for (size_t i = 0; i < object->nb_members; i++) {
+            const struct json_key *key;
+
+            key = object->keys[i].key;
+
+            if (json_msgpack_encode_string(buf, key->ptr, key->len) == -1)
+                return -1;
+
+            if (json_msgpack_encode_value(object->values[i], buf) == -1)
+                return -1;
+        }
+
+        return 0;
+    }
+
+    case JSON_ARRAY:
+        if (json_msgpack_encode_container(buf, 0x90, JSON_MSGPACK_ARRAY16,
+                                          JSON_MSGPACK_ARRAY32,
+                                          value->u.array.nb_elements) == -1) {
+            return -1;
+        }
+
+        for (size_t i = 0; i < value->u.array.nb_elements; i++) {
+            if (json_msgpack_encode_value(value->u.array.elements[i],
+                                          buf) == -1) {
+                return -1;
+            }
+        }
+
+        return 0;
+
+    case JSON_INTEGER:
+        return json_msgpack_encode_integer(buf, value->u.integer);
+
+    case JSON_REAL:
+    {
+        uint64_t bits;
+
+        memcpy(&bits, &value->u.real, sizeof(uint64_t));
+        return json_write_be64(buf, JSON_MSGPACK_FLOAT64, bits);
+    }
+
+    case JSON_STRING:
+        return json_msgpack_encode_string(buf, value->u.string.ptr,
+                                          value->u.string.len);
+
+    case JSON_BOOLEAN:
+    {
+        uint8_t byte;
+
+        byte = value->u.boolean ? JSON_MSGPACK_TRUE : JSON_MSGPACK_FALSE;
+        return c_buffer_add(buf, &byte, 1);
+    }
+
+    case JSON_NULL:
+    {
+        uint8_t byte;
+
+        byte = JSON_MSGPACK_NIL;
+        return c_buffer_add(buf, &byte, 1);
+    }
+    }
+
+    c_set_error("unknown json value type %d", value->type);
+    return -1;
+}
+
+static int
+json_msgpack_encode_integer(struct c_buffer *buf, int64_t integer) {
+    uint8_t data[2];
+
+    if (integer >= 0) {
+        if (integer <= 0x7f) {
+            data[0] = (uint8_t)integer;
+            return c_buffer_add(buf, data, 1);
+        } else if (integer <= UINT8_MAX) {
+            data[0] = JSON_MSGPACK_UINT8;
+            data[1] = (uint8_t)integer;
+            return c_buffer_add(buf, data, 2);
+        } else if (integer <= UINT16_MAX) {
+            return json_write_be16(buf, JSON_MSGPACK_UINT16,
+                                   (uint16_t)integer);
+        } else if (integer <= UINT32_MAX) {
+            return json_write_be32(buf, JSON_MSGPACK_UINT32,
+                                   (uint32_t)integer);
+        } else {
+            return json_write_be64(buf, JSON_MSGPACK_UINT64,
+                                   (uint64_t)integer);
+        }
+    } else {
+        if (integer >= -32) {
+            data[0] = (uint8_t)(int8_t)integer;
+            return c_buffer_add(buf, data, 1);
+        } else if (integer >= INT8_MIN) {
+            data[0] = JSON_MSGPACK_INT8;
+            data[1] = (uint8_t)(int8_t)integer;
+            return c_buffer_add(buf, data, 2);
+        } else if (integer >= INT16_MIN) {
+            return json_write_be16(buf, JSON_MSGPACK_INT16,
+                                   (uint16_t)(int16_t)integer);
+        } else if (integer >= INT32_MIN) {
+            return json_write_be32(buf, JSON_MSGPACK_INT32,
+                                   (uint32_t)(int32_t)integer);
+        } else {
+            return json_write_be64(buf, JSON_MSGPACK_INT64,
+                                   (uint64_t)integer);
+        }
+    }
+}
+
+static int
+json_msgpack_encode_string(struct c_buffer *buf,
+                           const char *string, size_t len) {
+    int ret;
+
+    if (len <= 31) {
+        uint8_t byte;
+
+        byte = (uint8_t)(0xa0 | len);
+        ret = c_buffer_add(buf, &byte, 1);
+    } else if (len <= UINT8_MAX) {
+        uint8_t data[2];
+
+        data[0] = JSON_MSGPACK_STR8;
+        data[1] = (uint8_t)len;
+        ret = c_buffer_add(buf, data, 2);
+    } else if (len <= UINT16_MAX) {
+        ret = json_write_be16(buf, JSON_MSGPACK_STR16, (uint16_t)len);
+    } else if (len <= UINT32_MAX) {
+        ret = json_write_be32(buf, JSON_MSGPACK_STR32, (uint32_t)len);
+    } else {
+        c_set_error("string too long");
+        return -1;
+    }
+
+    if (ret == -1)
+        return -1;
+
+    return c_buffer_add(buf, string, len);
+}
+
+static int
+json_msgpack_encode_container(struct c_buffer *buf, uint8_t fix_type,
+                              uint8_t type16, uint8_t type32, size_t n) {
+    if (n <= 15) {
+        uint8_t byte;
+
+        byte = (uint8_t)(fix_type | n);
+        return c_buffer_add(buf, &byte, 1);
+    } else if (n <= UINT16_MAX) {
+        return json_write_be16(buf, type16, (uint16_t)n);
+    } else if (n <= UINT32_MAX) {
+        return json_write_be32(buf, type32, (uint32_t)n);
+    }
+
+    c_set_error("container too large");
+    return -1;
+}
+
+static int
+json_msgpack_decode_value(struct json_msgpack_decoder *decoder,
+                          struct json_value **pvalue) {
+    struct json_item_head head;
+    const uint8_t *data;
+    uint8_t byte;
+    int ret;
+
+    ret = json_msgpack_read_item_head(decoder->ptr, decoder->len, &head);
+    if (ret == -1)
+        return -1;
+
+    if (ret == 0 || head.data_size > decoder->len - head.size) {
+        c_set_error("truncated item");
+        return -1;
+    }
+
+    byte = decoder->ptr[0];
+    data = decoder->ptr + head.size;
+
+    decoder->ptr += head.size;
+    decoder->len -= head.size;
+
+    if (byte <= 0x7f) {
+        *pvalue = json_integer_new(byte);
+        return 0;
+    } else if (byte >= 0xe0) {
+        *pvalue = json_integer_new((int8_t)byte);
+        return 0;
+    } else if (byte <= 0x8f) {
+        return json_msgpack_decode_map(decoder, head.nb_items / 2, pvalue);
+    } else if (byte <= 0x9f) {
+        return json_msgpack_decode_array(decoder, head.nb_items, pvalue);
+    }
+
+    switch (byte) {
+    case JSON_MSGPACK_NIL:
+        *pvalue = json_null_new();
+        break;
+
+    case JSON_MSGPACK_FALSE:
+    case JSON_MSGPACK_TRUE:
+        *pvalue = json_boolean_new(byte == JSON_MSGPACK_TRUE);
+        break;
+
+    case JSON_MSGPACK_UINT8:
+        *pvalue = json_integer_new(data[0]);
+        break;
+
+    case JSON_MSGPACK_UINT16:
+        *pvalue = json_integer_new(json_read_be16(data));
+        break;
+
+    case JSON_MSGPACK_UINT32:
+        *pvalue = json_integer_new(json_read_be32(data));
+        break;
+
+    case JSON_MSGPACK_UINT64:
+    {
+        uint64_t integer;
+
+        integer = json_read_be64(data);
+        if (integer > INT64_MAX) {
+            c_set_error("integer too large");
+            return -1;
+        }
+
+        *pvalue = json_integer_new((int64_t)integer);
+        break;
+    }
+
+    case JSON_MSGPACK_INT8:
+        *pvalue = json_integer_new((int8_t)data[0]);
+        break;
+
+    case JSON_MSGPACK_INT16:
+        *pvalue = json_integer_new((int16_t)json_read_be16(data));
+        break;
+
+    case JSON_MSGPACK_INT32:
+        *pvalue = json_integer_new((int32_t)json_read_be32(data));
+        break;
+
+    case JSON_MSGPACK_INT64:
+        *pvalue = json_integer_new((int64_t)json_read_be64(data));
+        break;
+
+    case JSON_MSGPACK_FLOAT32:
+    {
+        uint32_t bits;
+        float real;
+
+        bits = json_read_be32(data);
+        memcpy(&real, &bits, sizeof(float));
+
+        *pvalue = json_real_new(real);
+        break;
+    }
+
+    case JSON_MSGPACK_FLOAT64:
+    {
+        uint64_t bits;
+        double real;
+
+        bits = json_read_be64(data);
+        memcpy(&real, &bits, sizeof(double));
+
+        *pvalue = json_real_new(real);
+        break;
+    }
+
+    case JSON_MSGPACK_ARRAY16:
+    case JSON_MSGPACK_ARRAY32:
+        return json_msgpack_decode_array(decoder, head.nb_items, pvalue);
+
+    case JSON_MSGPACK_MAP16:
+    case JSON_MSGPACK_MAP32:
+        return json_msgpack_decode_map(decoder, head.nb_items / 2, pvalue);
+
+    case JSON_MSGPACK_BIN8:
+    case JSON_MSGPACK_BIN16:
+    case JSON_MSGPACK_BIN32:
+        c_set_error("binary data are not supported");
+        return -1;
+
+    default:
+        if ((byte >= 0xa0 && byte <= 0xbf)
+         || byte == JSON_MSGPACK_STR8 || byte == JSON_MSGPACK_STR16
+         || byte == JSON_MSGPACK_STR32) {
+            *pvalue = json_string_new2((const char *)data,
+                                       (size_t)head.data_size);
+            break;
+        }
+
+        c_set_error("extension types are not supported");
+        return -1;
+    }
+
+    decoder->ptr += head.data_size;
+    decoder->len -= (size_t)head.data_size;
+
+    return 0;
+}
+
+static int
+json_msgpack_decode_array(struct json_msgpack_decoder *decoder,
+                          uint64_t nb_elements, struct json_value **pvalue) {
+    struct json_value *value;
+
+    /* Each element takes at least one byte */
+    if (nb_elements > decoder->len) {
+        c_set_error("truncated array");
+        return -1;
+    }
+
+    if (decoder->depth >= JSON_MAX_DEPTH) {
+        c_set_error("too many nested arrays and maps");
+        return -1;
+    }
+
+    value = json_array_new();
+    decoder->depth++;
+
+    if (json_array_reserve(value, (size_t)nb_elements) == -1)
+        goto error;
+
+    for (uint64_t i = 0; i < nb_elements; i++) {
+        struct json_value *element;
+
+        if (json_msgpack_decode_value(decoder, &element) == -1)
+            goto error;
+
+        json_array_add_element(value, element);
+    }
+
+    decoder->depth--;
+
+    *pvalue = value;
+    return 0;
+
+error:
+    decoder->depth--;
+    json_value_delete(value);
+    return -1;
+}
+
+static int
+json_msgpack_decode_map(struct json_msgpack_decoder *decoder,
+                        uint64_t nb_members, struct json_value **pvalue) {
+    struct json_value *value;
+
+    /* Each member takes at least two bytes */
+    if (nb_members > decoder->len / 2) {
+        c_set_error("truncated map");
+        return -1;
+    }
+
+    if (decoder->depth >= JSON_MAX_DEPTH) {
+        c_set_error("too many nested arrays and maps");
+        return -1;
+    }
+
+    value = json_object_new();
+    decoder->depth++;
+
+    if (json_object_reserve(value, (size_t)nb_members) == -1)
+        goto error;
+
+    for (uint64_t i = 0; i < nb_members; i++) {
+        struct json_item_head head;
+        struct json_value *member;
+        struct json_key *key;
+        uint8_t byte;
+        int ret;
+
+        if (decoder->len == 0) {
+            c_set_error("truncated map");
+            goto error;
+        }
+
+        byte = decoder->ptr[0];
+
+        if (!((byte >= 0xa0 && byte <= 0xbf)
+           || byte == JSON_MSGPACK_STR8 || byte == JSON_MSGPACK_STR16
+           || byte == JSON_MSGPACK_STR32)) {
+            c_set_error("map key is not a string");
+            goto error;
+        }
+
+        ret = json_msgpack_read_item_head(decoder->ptr, decoder->len, &head);
+        if (ret == 0 || head.data_size > decoder->len - head.size) {
+            c_set_error("truncated string");
+            goto error;
+        }
+
+        key = json_key_table_intern(&decoder->keys,
+                                    (const char *)decoder->ptr + head.size,
+                                    (size_t)head.data_size);
+        if (!key)
+            goto error;
+
+        decoder->ptr += head.size + head.data_size;
+        decoder->len -= head.size + (size_t)head.data_size;
+
+        if (json_msgpack_decode_value(decoder, &member) == -1) {
+            json_key_unref(key);
+            goto error;
+        }
+
+        if (json_object_add_member_key(value, key, member) == -1) {
+            json_key_unref(key);
+            json_value_delete(member);
+            goto error;
+        }
+    }
+
+    decoder->depth--;
+
+    *pvalue = value;
+    return 0;
+
+error:
+    decoder->depth--;
+    json_value_delete(value);
+    return -1;
+}
@@ -19,22 +19,64 @@
 
 #include "internal.h"
 
+/* Strings shorter than this which do not end up in a document are decoded
+ * on the stack. */
+#define JSON_PARSER_BUFSZ 256
+
 struct json_parser {
     const char *ptr;
     size_t len;
 
     uint32_t options;
+
+    struct json_key_table keys;
+
+    /* Only set when validating while parsing */
+    const struct json_schema_program *program;
+    bool invalid; /* the current error is a validation error */
+
+    /* Only set when parsing a projection */
+    struct json_value **values;
+    size_t nb_pending; /* number of selected values not found yet */
 };
 
+static void json_parser_init(struct json_parser *, const char *, size_t,
+                             uint32_t);
 static void json_parser_skip(struct json_parser *, size_t);
 static void json_parser_skip_ws(struct json_parser *);
-
-static int json_parse_value(struct json_parser *, struct json_value **);
-static int json_parse_value_object(struct json_parser *, struct json_value **);
-static int json_parse_value_array(struct json_parser *, struct json_value **);
-static int json_parse_value_number(struct json_parser *, struct json_value **);
-static int json_parse_value_string(struct json_parser *, struct json_value **);
-static int json_parse_value_literal(struct json_parser *, struct json_value **);
+static int json_parser_skip_value(struct json_parser *);
+static int json_parser_skip_string(struct json_parser *);
+
+static int json_parse_value(struct json_parser *, uint32_t,
+                            struct json_value **);
+static int json_parse_value_whole(struct json_parser *, uint32_t,
+                                  struct json_value **);
+static int json_parse_value_child(struct json_parser *,
+                                  const struct json_schema_child *,
+                                  const char *, size_t, struct json_value **);
+static int json_parse_value_object(struct json_parser *,
+                                   struct json_schema_frame *,
+                                   struct json_value **);
+static int json_parse_value_array(struct json_parser *,
+                                  struct json_schema_frame *,
+                                  struct json_value **);
+static int json_parse_value_number(struct json_parser *, struct json_value *);
+static int json_parse_value_string(struct json_parser *, char *, size_t,
+                                   struct json_value *);
+static int json_parse_value_literal(struct json_parser *, struct json_value *);
+
+static int json_project_value(struct json_parser *,
+                              const struct json_projection_node *);
+static int json_project_object(struct json_parser *,
+                               const struct json_projection_node *);
+static int json_project_array(struct json_parser *,
+                              const struct json_projection_node *);
+static int json_project_select(struct json_parser *,
+                               const struct json_projection_node *,
+                               const struct json_value *);
+
+static char *json_parse_string_token(struct json_parser *, char *, size_t,
+                                     size_t *);
 
 static bool json_is_ws(char);
 static bool json_is_boundary(char);
@@ -43,8 +85,8 @@ static bool json_is_number_char(char);
 static bool json_is_integer_char(char);
 static bool json_is_real_char(char);
 
-static char *json_decode_string(const struct json_parser *,
-                                const char *, size_t, size_t *);
+static int json_decode_string(const struct json_parser *,
+                              const char *, size_t, char *, size_t *);
 static int json_decode_utf8_character(const char *, uint32_t *);
 static int json_decode_utf16_surrogate_pair(const char *, uint32_t *);
 static int json_write_codepoint_as_utf8(uint32_t, char *, size_t *);
@@ -55,18 +97,67 @@ json_parse(const char *buf, size_t sz, uint32_t options) {
     struct json_parser parser;
     struct json_value *value;
 
-    memset(&parser, 0, sizeof(struct json_parser));
-
-    parser.ptr = buf;
-    parser.len = sz;
-    parser.options = options;
+    json_parser_init(&parser, buf, sz, options);
 
-    if (json_parse_value(&parser, &value) == -1)
+    if (json_parse_value(&parser, JSON_SCHEMA_NODE_NONE, &value) == -1) {
+        json_key_table_free(&parser.keys);
         return NULL;
+    }
 
+    json_key_table_free(&parser.keys);
     return value;
 }
 
+int
+json_parse_validate(const char *buf, size_t sz, uint32_t options,
+                    struct json_schema *schema, struct json_value **pvalue) {
+    struct json_parser parser;
+    int ret;
+
+    if (json_schema_compile(schema) == -1)
+        return -1;
+
+    json_parser_init(&parser, buf, sz, options);
+    parser.program = schema->program;
+
+    ret = json_parse_value(&parser, schema->program->root, pvalue);
+
+    json_key_table_free(&parser.keys);
+    return (ret == -1) ? -1 : 0;
+}
+
+int
+json_parse_project(const char *buf, size_t sz, uint32_t options,
+                   const struct json_projection *projection,
+                   struct json_value **values) {
+    struct json_parser parser;
+    int ret;
+
+    for (size_t i = 0; i < projection->nb_targets; i++)
+        values[i] = NULL;
+
+    json_parser_init(&parser, buf, sz, options);
+    parser.values = values;
+    parser.nb_pending = projection->nb_targets;
+
+    ret = 1;
+    if (parser.nb_pending > 0)
+        ret = json_project_value(&parser, &projection->root);
+
+    json_key_table_free(&parser.keys);
+
+    if (ret == -1) {
+        for (size_t i = 0; i < projection->nb_targets; i++) {
+            json_value_delete(values[i]);
+            values[i] = NULL;
+        }
+
+        return -1;
+    }
+
+    return 0;
+}
+
 struct json_value *
 json_parse_string(const char *string, uint32_t options) {
     return json_parse(string, strlen(string), options);
@@ -122,6 +213,18 @@ json_parse_file(const char *path, uint32_t options) {
     return value;
 }
 
+static void
+json_parser_init(struct json_parser *parser, const char *buf, size_t sz,
+                 uint32_t options) {
+    memset(parser, 0, sizeof(struct json_parser));
+
+    parser->ptr = buf;
+    parser->len = sz;
+    parser->options = options;
+
+    json_key_table_init(&parser->keys);
+}
+
 static void
 json_parser_skip(struct json_parser *parser, size_t n) {
     if (n > parser->len)
@@ -140,34 +243,342 @@ json_parser_skip_ws(struct json_parser *parser) {
 }
 
 static int
-json_parse_value(struct json_parser *parser, struct json_value **pvalue) {
+json_parser_skip_value(struct json_parser *parser) {
+    enum {
+        JSON_SKIP_VALUE,
+        JSON_SKIP_VALUE_OR_END,
+        JSON_SKIP_KEY,
+        JSON_SKIP_KEY_OR_END,
+        JSON_SKIP_COLON,
+        JSON_SKIP_COMMA_OR_END,
+    } expected;
+
+    uint64_t objects[JSON_MAX_DEPTH / 64]; /* one bit per open container */
+    struct json_value scalar;
+    size_t depth;
+    bool object;
+    char c;
+
+    /* Values which are not selected are checked for the structure of the
+     * document and for the syntax of literals and numbers, but they are not
+     * decoded and strings are only scanned for their end. The type of each
+     * open container is kept in a bit stack bounded by the depth limit. */
+    expected = JSON_SKIP_VALUE;
+    depth = 0;
+    object = false;
+
+    for (;;) {
+        json_parser_skip_ws(parser);
+        if (parser->len == 0) {
+            c_set_error("truncated value");
+            return -1;
+        }
+
+        c = *parser->ptr;
+
+        if ((expected == JSON_SKIP_VALUE_OR_END && c == ']')
+         || (expected == JSON_SKIP_KEY_OR_END && c == '}')
+         || (expected == JSON_SKIP_COMMA_OR_END
+          && c == (object ? '}' : ']'))) {
+            json_parser_skip(parser, 1);
+
+            depth--;
+            if (depth > 0)
+                object = (objects[(depth - 1) / 64] >> ((depth - 1) % 64)) & 1;
+        } else if (expected == JSON_SKIP_COMMA_OR_END && c == ',') {
+            json_parser_skip(parser, 1);
+            expected = object ? JSON_SKIP_KEY : JSON_SKIP_VALUE;
+            continue;
+        } else if (expected == JSON_SKIP_COLON && c == ':') {
+            json_parser_skip(parser, 1);
+            expected = JSON_SKIP_VALUE;
+            continue;
+        } else if ((expected == JSON_SKIP_KEY
+                 || expected == JSON_SKIP_KEY_OR_END) && c == '"') {
+            if (json_parser_skip_string(parser) == -1)
+                return -1;
+
+            expected = JSON_SKIP_COLON;
+            continue;
+        } else if (expected != JSON_SKIP_VALUE
+                && expected != JSON_SKIP_VALUE_OR_END) {
+            json_set_error_invalid_character(c, " ");
+            return -1;
+        } else if (c == '{' || c == '[') {
+            if (depth >= JSON_MAX_DEPTH) {
+                c_set_error("too many nested arrays and objects");
+                return -1;
+            }
+
+            json_parser_skip(parser, 1);
+
+            object = (c == '{');
+            if (object) {
+                objects[depth / 64] |= (uint64_t)1 << (depth % 64);
+            } else {
+                objects[depth / 64] &= ~((uint64_t)1 << (depth % 64));
+            }
+
+            depth++;
+
+            expected = object ? JSON_SKIP_KEY_OR_END : JSON_SKIP_VALUE_OR_END;
+            continue;
+        } else if (c == '"') {
+            if (json_parser_skip_string(parser) == -1)
+                return -1;
+        } else if (c == 't' || c == 'f' || c == 'n') {
+            if (json_parse_value_literal(parser, &scalar) == -1)
+                return -1;
+        } else if (json_is_number_first_char(c)) {
+            if (json_parse_value_number(parser, &scalar) == -1)
+                return -1;
+        } else {
+            json_set_error_invalid_character(c, " ");
+            return -1;
+        }
+
+        /* A complete value has been skipped */
+        if (depth == 0)
+            return 1;
+
+        expected = JSON_SKIP_COMMA_OR_END;
+    }
+}
+
+static int
+json_parser_skip_string(struct json_parser *parser) {
+    const char *ptr, *end;
+
+    ptr = parser->ptr + 1; /* '"' */
+    end = parser->ptr + parser->len;
+
+    /* A quote ends the string if it is preceded by an even number of
+     * backslashes. memchr() is vectorized by the C library, which makes
+     * this much faster than decoding the string. */
+    for (;;) {
+        const char *quote, *bs;
+
+        quote = memchr(ptr, '"', (size_t)(end - ptr));
+        if (!quote) {
+            c_set_error("truncated string");
+            return -1;
+        }
+
+        bs = quote;
+        while (bs > ptr && bs[-1] == '\\')
+            bs--;
+
+        ptr = quote + 1;
+
+        if ((quote - bs) % 2 == 0)
+            break;
+    }
+
+    json_parser_skip(parser, (size_t)(ptr - parser->ptr));
+    return 1;
+}
+
+static int
+json_parse_value(struct json_parser *parser, uint32_t node,
+                 struct json_value **pvalue) {
+    struct json_schema_frame frame;
+    struct json_value scalar, *value;
+    char buf[JSON_PARSER_BUFSZ];
+    enum json_type type;
+    int ret;
+
     json_parser_skip_ws(parser);
 
     if (*parser->ptr == '{') {
-        return json_parse_value_object(parser, pvalue);
+        type = JSON_OBJECT;
     } else if (*parser->ptr == '[') {
-        return json_parse_value_array(parser, pvalue);
+        type = JSON_ARRAY;
     } else if (*parser->ptr == '"') {
-        return json_parse_value_string(parser, pvalue);
-    } else if (*parser->ptr == 't' || *parser->ptr == 'f'
-            || *parser->ptr == 'n') {
-        return json_parse_value_literal(parser, pvalue);
+        type = JSON_STRING;
+    } else if (*parser->ptr == 't' || *parser->ptr == 'f') {
+        type = JSON_BOOLEAN;
+    } else if (*parser->ptr == 'n') {
+        type = JSON_NULL;
     } else if (json_is_number_first_char(*parser->ptr)) {
-        return json_parse_value_number(parser, pvalue);
+        type = JSON_INTEGER; /* or JSON_REAL */
     } else {
         json_set_error_invalid_character(*parser->ptr, " ");
         return -1;
     }
+
+    /* Reject values of the wrong type before reading them */
+    if (node != JSON_SCHEMA_NODE_NONE) {
+        uint32_t types;
+
+        types = JSON_SCHEMA_TYPE_MASK(type);
+        if (type == JSON_INTEGER)
+            types |= JSON_SCHEMA_TYPE_MASK(JSON_REAL);
+
+        if (!(parser->program->nodes[node].types & types)) {
+            c_set_error("value does not match 'type' constraint");
+            parser->invalid = true;
+            return -1;
+        }
+    }
+
+    if (type == JSON_OBJECT || type == JSON_ARRAY) {
+        struct json_schema_frame *pframe;
+
+        pframe = NULL;
+
+        if (node != JSON_SCHEMA_NODE_NONE) {
+            ret = json_schema_frame_init(&frame, parser->program, node, type);
+            if (ret == -1)
+                return -1;
+            if (ret == 0)
+                return json_parse_value_whole(parser, node, pvalue);
+
+            pframe = &frame;
+        }
+
+        if (type == JSON_OBJECT) {
+            ret = json_parse_value_object(parser, pframe, pvalue);
+        } else {
+            ret = json_parse_value_array(parser, pframe, pvalue);
+        }
+
+        if (pframe)
+            json_schema_frame_free(pframe);
+
+        return ret;
+    }
+
+    /* Scalars are read on the stack, and only copied to the heap if they
+     * are part of the document. */
+    if (type == JSON_STRING) {
+        ret = json_parse_value_string(parser, pvalue ? NULL : buf,
+                                      sizeof(buf), &scalar);
+    } else if (type == JSON_INTEGER) {
+        ret = json_parse_value_number(parser, &scalar);
+    } else {
+        ret = json_parse_value_literal(parser, &scalar);
+    }
+
+    if (ret == -1)
+        return -1;
+
+    if (node != JSON_SCHEMA_NODE_NONE
+     && json_schema_program_check(parser->program, node, &scalar) == -1) {
+        parser->invalid = true;
+        ret = -1;
+    } else if (pvalue) {
+        value = json_value_new(scalar.type);
+        if (value) {
+            value->u = scalar.u;
+
+            *pvalue = value;
+            return 1;
+        }
+
+        ret = -1;
+    }
+
+    if (scalar.type == JSON_STRING && scalar.u.string.ptr != buf)
+        json_free(scalar.u.string.ptr);
+
+    return ret;
+}
+
+static int
+json_parse_value_whole(struct json_parser *parser, uint32_t node,
+                       struct json_value **pvalue) {
+    struct json_value *value;
+
+    if (json_parse_value(parser, JSON_SCHEMA_NODE_NONE, &value) == -1)
+        return -1;
+
+    if (json_schema_program_check(parser->program, node, value) == -1) {
+        parser->invalid = true;
+        json_value_delete(value);
+        return -1;
+    }
+
+    if (pvalue) {
+        *pvalue = value;
+    } else {
+        json_value_delete(value);
+    }
+
+    return 1;
+}
+
+static int
+json_parse_value_child(struct json_parser *parser,
+                       const struct json_schema_child *child,
+                       const char *container, size_t index,
+                       struct json_value **pvalue) {
+    struct json_value *value;
+    const char *constraint;
+
+    constraint = child->constraint;
+
+    if (child->pattern_node == JSON_SCHEMA_NODE_NONE) {
+        if (json_parse_value(parser, child->node, pvalue) == -1)
+            goto error;
+
+        return 1;
+    }
+
+    /* The value is needed to check it against the second schema */
+    if (json_parse_value(parser, child->node, &value) == -1)
+        goto error;
+
+    if (json_schema_program_check(parser->program, child->pattern_node,
+                                  value) == -1) {
+        parser->invalid = true;
+        json_value_delete(value);
+        constraint = "patternProperties";
+        goto error;
+    }
+
+    if (pvalue) {
+        *pvalue = value;
+    } else {
+        json_value_delete(value);
+    }
+
+    return 1;
+
+error:
+    if (parser->invalid && constraint) {
+        c_set_error("%s %zu does not match '%s' constraint: %s",
+                    container, index, constraint, c_get_error());
+    }
+
+    return -1;
 }
 
 static int
 json_parse_value_object(struct json_parser *parser,
+                        struct json_schema_frame *frame,
                         struct json_value **pvalue) {
-    struct json_value *object_value;
+    struct json_value *object_value, *value, **pmember;
+    struct json_key_table seen_keys;
+    char buf[JSON_PARSER_BUFSZ];
+    size_t nb_members;
+    bool check_keys;
+
+    /* Members are only kept if the object is part of the document */
+    object_value = NULL;
+    if (pvalue) {
+        object_value = json_object_new();
+        if (!object_value)
+            return -1;
+    }
 
-    object_value = json_object_new();
-    if (!object_value)
-        return -1;
+    /* Otherwise duplicate keys are found with a table of the keys of the
+     * object, without reading member values. */
+    check_keys = !object_value
+              && (parser->options & JSON_PARSE_REJECT_DUPLICATE_KEYS);
+    json_key_table_init(&seen_keys);
+
+    pmember = object_value ? &value : NULL;
+    nb_members = 0;
 
     json_parser_skip(parser, 1); /* '{' */
     if (parser->len == 0) {
@@ -176,14 +587,17 @@ json_parse_value_object(struct json_parser *parser,
     }
 
     while (parser->len > 0) {
-        struct json_value *key;
-        struct json_value *value;
+        struct json_schema_child child;
+        struct json_key *key;
+        char *string;
+        size_t len;
+        uint32_t hash;
         int ret;
 
         json_parser_skip_ws(parser);
 
         if (*parser->ptr == '}') {
-            if (object_value->u.object.nb_members > 0) {
+            if (nb_members > 0) {
                 c_set_error("truncated object");
                 goto error;
             }
@@ -191,12 +605,74 @@ json_parse_value_object(struct json_parser *parser,
             break;
         }
 
-        ret = json_parse_value(parser, &key);
-        if (ret == -1)
+        if (*parser->ptr != '"') {
+            c_set_error("key in object member is not a string");
             goto error;
+        }
 
-        if (json_value_type(key) != JSON_STRING) {
-            c_set_error("key in object member is not a string");
+        string = json_parse_string_token(parser, buf, sizeof(buf), &len);
+        if (!string)
+            goto error;
+
+        hash = 0;
+        if (object_value || frame || check_keys)
+            hash = json_hash_string(string, len);
+
+        if (check_keys) {
+            size_t nb_keys;
+
+            nb_keys = seen_keys.nb_entries;
+
+            key = json_key_table_intern2(&seen_keys, string, len, hash);
+            if (!key || seen_keys.nb_entries == nb_keys) {
+                if (key)
+                    c_set_error("duplicate object key");
+                if (string != buf)
+                    json_free(string);
+                json_key_unref(key);
+                goto error;
+            }
+
+            json_key_unref(key);
+        }
+
+        key = NULL;
+        if (object_value) {
+            /* Keys too long for the stack buffer are decoded in a heap
+             * string that the key can take instead of copying it. */
+            if (string != buf) {
+                key = json_key_table_intern_nocopy(&parser->keys,
+                                                   string, len, hash);
+            } else {
+                key = json_key_table_intern2(&parser->keys, string, len, hash);
+            }
+
+            if (!key) {
+                if (string != buf)
+                    json_free(string);
+                goto error;
+            }
+
+            string = key->ptr;
+        }
+
+        if (frame) {
+            ret = json_schema_frame_member(frame, parser->program,
+                                           string, len, hash, &child);
+        } else {
+            child.node = JSON_SCHEMA_NODE_NONE;
+            child.constraint = NULL;
+            child.pattern_node = JSON_SCHEMA_NODE_NONE;
+
+            ret = 0;
+        }
+
+        if (string != buf && !key)
+            json_free(string);
+
+        if (ret == -1) {
+            parser->invalid = true;
+            json_key_unref(key);
             goto error;
         }
 
@@ -204,44 +680,44 @@ json_parse_value_object(struct json_parser *parser,
 
         if (*parser->ptr != ':') {
             json_set_error_invalid_character(*parser->ptr, " in object");
-            json_value_delete(key);
+            json_key_unref(key);
             goto error;
         }
 
         json_parser_skip(parser, 1); /* ':' */
         json_parser_skip_ws(parser);
         if (parser->len == 0) {
-            json_value_delete(key);
+            json_key_unref(key);
             c_set_error("truncated object");
             goto error;
         }
 
-        ret = json_parse_value(parser, &value);
+        ret = json_parse_value_child(parser, &child, "object member",
+                                     nb_members, pmember);
         if (ret == -1) {
-            json_value_delete(key);
+            json_key_unref(key);
             goto error;
         }
 
-        if (parser->options & JSON_PARSE_REJECT_DUPLICATE_KEYS) {
-            if (json_object_has_member2(object_value,
-                                        key->u.string.ptr,
-                                        key->u.string.len)) {
-                c_set_error("duplicate object key");
-                json_value_delete(key);
+        nb_members++;
+
+        if (object_value) {
+            if (parser->options & JSON_PARSE_REJECT_DUPLICATE_KEYS) {
+                if (json_object_has_key(object_value, key)) {
+                    c_set_error("duplicate object key");
+                    json_key_unref(key);
+                    json_value_delete(value);
+                    goto error;
+                }
+            }
+
+            if (json_object_add_member_key(object_value, key, value) == -1) {
+                json_key_unref(key);
                 json_value_delete(value);
                 goto error;
             }
         }
 
-        if (json_object_add_member2(object_value, key->u.string.ptr,
-                                    key->u.string.len, value) == -1) {
-            json_value_delete(key);
-            json_value_delete(value);
-            goto error;
-        }
-
-        json_value_delete(key);
-
         json_parser_skip_ws(parser);
         if (parser->len == 0) {
             c_set_error("truncated object");
@@ -265,21 +741,40 @@ json_parse_value_object(struct json_parser *parser,
 
     json_parser_skip(parser, 1); /* '}' */
 
-    *pvalue = object_value;
+    if (frame && json_schema_frame_end(frame) == -1) {
+        parser->invalid = true;
+        goto error;
+    }
+
+    json_key_table_free(&seen_keys);
+
+    if (pvalue)
+        *pvalue = object_value;
+
     return 1;
 
 error:
+    json_key_table_free(&seen_keys);
     json_value_delete(object_value);
     return -1;
 }
 
 static int
-json_parse_value_array(struct json_parser *parser, struct json_value **pvalue) {
-    struct json_value *value;
+json_parse_value_array(struct json_parser *parser,
+                       struct json_schema_frame *frame,
+                       struct json_value **pvalue) {
+    struct json_value *value, *element, **pelement;
+    size_t nb_elements;
+
+    value = NULL;
+    if (pvalue) {
+        value = json_array_new();
+        if (!value)
+            return -1;
+    }
 
-    value = json_array_new();
-    if (!value)
-        return -1;
+    pelement = value ? &element : NULL;
+    nb_elements = 0;
 
     json_parser_skip(parser, 1); /* '[' */
     if (parser->len == 0) {
@@ -288,13 +783,13 @@ json_parse_value_array(struct json_parser *parser, struct json_value **pvalue) {
     }
 
     while (parser->len > 0) {
-        struct json_value *element;
+        struct json_schema_child child;
         int ret;
 
         json_parser_skip_ws(parser);
 
         if (*parser->ptr == ']') {
-            if (value->u.array.nb_elements > 0) {
+            if (nb_elements > 0) {
                 c_set_error("truncated array");
                 goto error;
             }
@@ -302,11 +797,26 @@ json_parse_value_array(struct json_parser *parser, struct json_value **pvalue) {
             break;
         }
 
-        ret = json_parse_value(parser, &element);
+        if (frame) {
+            if (json_schema_frame_element(frame, parser->program,
+                                          &child) == -1) {
+                parser->invalid = true;
+                goto error;
+            }
+        } else {
+            child.node = JSON_SCHEMA_NODE_NONE;
+            child.constraint = NULL;
+            child.pattern_node = JSON_SCHEMA_NODE_NONE;
+        }
+
+        ret = json_parse_value_child(parser, &child, "array element",
+                                     nb_elements, pelement);
         if (ret == -1)
             goto error;
 
-        if (json_array_add_element(value, element) == -1) {
+        nb_elements++;
+
+        if (value && json_array_add_element(value, element) == -1) {
             json_value_delete(element);
             goto error;
         }
@@ -334,7 +844,14 @@ json_parse_value_array(struct json_parser *parser, struct json_value **pvalue) {
 
     json_parser_skip(parser, 1); /* ']' */
 
-    *pvalue = value;
+    if (frame && json_schema_frame_end(frame) == -1) {
+        parser->invalid = true;
+        goto error;
+    }
+
+    if (pvalue)
+        *pvalue = value;
+
     return 1;
 
 error:
@@ -344,8 +861,7 @@ error:
 
 static int
 json_parse_value_number(struct json_parser *parser,
-                        struct json_value **pvalue) {
-    struct json_value *value;
+                        struct json_value *value) {
     const char *ptr, *start;
     size_t len, toklen;
     enum json_type type;
@@ -396,9 +912,8 @@ json_parse_value_number(struct json_parser *parser,
         if (c_parse_i64(tmp, &i64, NULL) == -1)
             return -1;
 
-        value = json_integer_new(i64);
-        if (!value)
-            return -1;
+        value->type = JSON_INTEGER;
+        value->u.integer = i64;
     } else if (type == JSON_REAL) {
         char tmp[64];
         double real;
@@ -430,30 +945,43 @@ json_parse_value_number(struct json_parser *parser,
             return -1;
         }
 
-        value = json_real_new(real);
-        if (!value)
-            return -1;
+        value->type = JSON_REAL;
+        value->u.real = real;
     } else {
         /* Should never happen */
         c_set_error("unknown number type %d", type);
         return -1;
     }
 
-    *pvalue = value;
     return 1;
 }
 
 static int
-json_parse_value_string(struct json_parser *parser,
-                        struct json_value **pvalue) {
-    struct json_value *value;
-    const char *start;
-    size_t toklen;
+json_parse_value_string(struct json_parser *parser, char *buf, size_t bufsz,
+                        struct json_value *value) {
+    char *string;
+    size_t len;
 
-    value = json_value_new(JSON_STRING);
-    if (!value)
+    string = json_parse_string_token(parser, buf, bufsz, &len);
+    if (!string)
         return -1;
 
+    value->type = JSON_STRING;
+    value->u.string.ptr = string;
+    value->u.string.len = len;
+
+    return 1;
+}
+
+/* Decode the string token at the current position, in the buffer of the
+ * caller if there is one large enough, or in a newly allocated string. */
+static char *
+json_parse_string_token(struct json_parser *parser, char *buf, size_t bufsz,
+                        size_t *plen) {
+    const char *start;
+    size_t toklen;
+    char *string;
+
     json_parser_skip(parser, 1); /* '"' */
     start = parser->ptr;
 
@@ -461,8 +989,7 @@ json_parse_value_string(struct json_parser *parser,
         if (*parser->ptr == '\\') {
             if (parser->len < 2) {
                 c_set_error("truncated escape sequence");
-                json_value_delete(value);
-                return -1;
+                return NULL;
             }
 
             json_parser_skip(parser, 2);
@@ -476,50 +1003,52 @@ json_parse_value_string(struct json_parser *parser,
 
     if (*parser->ptr != '"') {
         c_set_error("truncated string");
-        json_value_delete(value);
-        return -1;
+        return NULL;
     }
 
     toklen = (size_t)(parser->ptr - start);
 
-    value->u.string.ptr = json_decode_string(parser, start, toklen,
-                                             &value->u.string.len);
-    if (!value->u.string.ptr) {
-        json_value_delete(value);
-        return -1;
+    /* A decoded string has a length smaller or equal to the length of an
+     * encoded string. */
+    if (buf && toklen < bufsz) {
+        string = buf;
+    } else {
+        string = json_malloc(toklen + 1);
+        if (!string)
+            return NULL;
+    }
+
+    if (json_decode_string(parser, start, toklen, string, plen) == -1) {
+        if (string != buf)
+            json_free(string);
+        return NULL;
     }
 
     json_parser_skip(parser, 1); /* '"' */
 
-    *pvalue = value;
-    return 1;
+    return string;
 }
 
 static int
 json_parse_value_literal(struct json_parser *parser,
-                         struct json_value **pvalue) {
-    struct json_value *value;
+                         struct json_value *value) {
     size_t length;
 
     if (*parser->ptr == 't' && parser->len >= 4
      && memcmp(parser->ptr, "true", 4) == 0) {
-        value = json_boolean_new(true);
-        if (!value)
-            return -1;
+        value->type = JSON_BOOLEAN;
+        value->u.boolean = true;
 
         length = 4;
     } else if (*parser->ptr == 'f' && parser->len >= 5
      && memcmp(parser->ptr, "false", 5) == 0) {
-        value = json_boolean_new(false);
-        if (!value)
-            return -1;
+        value->type = JSON_BOOLEAN;
+        value->u.boolean = false;
 
         length = 5;
     } else if (*parser->ptr == 'n' && parser->len >= 4
      && memcmp(parser->ptr, "null", 4) == 0) {
-        value = json_null_new();
-        if (!value)
-            return -1;
+        value->type = JSON_NULL;
 
         length = 4;
     } else {
@@ -530,10 +1059,279 @@ json_parse_value_literal(struct json_parser *parser,
     parser->ptr += length;
     parser->len -= length;
 
-    *pvalue = value;
     return 1;
 }
 
+static int
+json_project_value(struct json_parser *parser,
+                   const struct json_projection_node *node) {
+    struct json_value *value;
+
+    json_parser_skip_ws(parser);
+    if (parser->len == 0) {
+        c_set_error("truncated value");
+        return -1;
+    }
+
+    if (node->target >= 0) {
+        /* If a key is duplicated, the first member is selected */
+        if (parser->values[node->target])
+            return json_parser_skip_value(parser);
+
+        if (json_parse_value(parser, JSON_SCHEMA_NODE_NONE, &value) == -1)
+            return -1;
+
+        parser->values[node->target] = value;
+        parser->nb_pending--;
+
+        if (json_project_select(parser, node, value) == -1)
+            return -1;
+
+        return (parser->nb_pending > 0) ? 1 : 0;
+    }
+
+    if (*parser->ptr == '{' && node->nb_children > 0) {
+        return json_project_object(parser, node);
+    } else if (*parser->ptr == '[' && node->nb_children > 0) {
+        return json_project_array(parser, node);
+    }
+
+    return json_parser_skip_value(parser);
+}
+
+static int
+json_project_object(struct json_parser *parser,
+                    const struct json_projection_node *node) {
+    struct json_key_table seen_keys;
+    char buf[JSON_PARSER_BUFSZ];
+    size_t nb_members;
+    bool check_keys;
+    int ret;
+
+    /* As with json_object_member(), only the first member with a given key
+     * is followed; with JSON_PARSE_REJECT_DUPLICATE_KEYS, all keys of the
+     * object are recorded so that the document is rejected as it would be
+     * by json_parse(). */
+    check_keys = (parser->options & JSON_PARSE_REJECT_DUPLICATE_KEYS) != 0;
+    json_key_table_init(&seen_keys);
+
+    nb_members = 0;
+
+    json_parser_skip(parser, 1); /* '{' */
+
+    for (;;) {
+        const struct json_projection_node *child;
+        char *string;
+        size_t len, nb_keys;
+
+        json_parser_skip_ws(parser);
+        if (parser->len == 0) {
+            c_set_error("truncated object");
+            goto error;
+        }
+
+        if (*parser->ptr == '}') {
+            if (nb_members > 0) {
+                c_set_error("truncated object");
+                goto error;
+            }
+
+            break;
+        }
+
+        if (*parser->ptr != '"') {
+            c_set_error("key in object member is not a string");
+            goto error;
+        }
+
+        string = json_parse_string_token(parser, buf, sizeof(buf), &len);
+        if (!string)
+            goto error;
+
+        child = json_projection_node_child(node, string, len);
+
+        if (child || check_keys) {
+            struct json_key *key;
+
+            nb_keys = seen_keys.nb_entries;
+
+            key = json_key_table_intern(&seen_keys, string, len);
+            if (!key) {
+                if (string != buf)
+                    json_free(string);
+                goto error;
+            }
+
+            json_key_unref(key);
+
+            if (seen_keys.nb_entries == nb_keys) {
+                if (check_keys) {
+                    c_set_error("duplicate object key");
+                    if (string != buf)
+                        json_free(string);
+                    goto error;
+                }
+
+                child = NULL;
+            }
+        }
+
+        if (string != buf)
+            json_free(string);
+
+        json_parser_skip_ws(parser);
+        if (parser->len == 0) {
+            c_set_error("truncated object");
+            goto error;
+        }
+
+        if (*parser->ptr != ':') {
+            json_set_error_invalid_character(*parser->ptr, " in object");
+            goto error;
+        }
+
+        json_parser_skip(parser, 1); /* ':' */
+
+        if (child) {
+            ret = json_project_value(parser, child);
+        } else {
+            ret = json_parser_skip_value(parser);
+        }
+
+        if (ret <= 0) {
+            json_key_table_free(&seen_keys);
+            return ret;
+        }
+
+        nb_members++;
+
+        json_parser_skip_ws(parser);
+        if (parser->len == 0) {
+            c_set_error("truncated object");
+            goto error;
+        }
+
+        if (*parser->ptr == ',') {
+            json_parser_skip(parser, 1);
+        } else if (*parser->ptr == '}') {
+            break;
+        } else {
+            json_set_error_invalid_character(*parser->ptr, " in object");
+            goto error;
+        }
+    }
+
+    json_parser_skip(parser, 1); /* '}' */
+
+    json_key_table_free(&seen_keys);
+    return 1;
+
+error:
+    json_key_table_free(&seen_keys);
+    return -1;
+}
+
+static int
+json_project_array(struct json_parser *parser,
+                   const struct json_projection_node *node) {
+    size_t nb_elements;
+
+    nb_elements = 0;
+
+    json_parser_skip(parser, 1); /* '[' */
+
+    for (;;) {
+        const struct json_projection_node *child;
+        int ret;
+
+        json_parser_skip_ws(parser);
+        if (parser->len == 0) {
+            c_set_error("truncated array");
+            return -1;
+        }
+
+        if (*parser->ptr == ']') {
+            if (nb_elements > 0) {
+                c_set_error("truncated array");
+                return -1;
+            }
+
+            break;
+        }
+
+        child = json_projection_node_element(node, nb_elements);
+        if (child) {
+            ret = json_project_value(parser, child);
+        } else {
+            ret = json_parser_skip_value(parser);
+        }
+
+        if (ret <= 0)
+            return ret;
+
+        nb_elements++;
+
+        json_parser_skip_ws(parser);
+        if (parser->len == 0) {
+            c_set_error("truncated array");
+            return -1;
+        }
+
+        if (*parser->ptr == ',') {
+            json_parser_skip(parser, 1);
+        } else if (*parser->ptr == ']') {
+            break;
+        } else {
+            json_set_error_invalid_character(*parser->ptr, " in array");
+            return -1;
+        }
+    }
+
+    json_parser_skip(parser, 1); /* ']' */
+    return 1;
+}
+
+static int
+json_project_select(struct json_parser *parser,
+                    const struct json_projection_node *node,
+                    const struct json_value *value) {
+    /* Values selected inside a selected value are copies of its members
+     * and elements, so that each selected value can be modified. */
+    for (size_t i = 0; i < node->nb_children; i++) {
+        const struct json_projection_node *child;
+        const struct json_value *member;
+
+        child = node->children[i];
+
+        member = NULL;
+        if (value->type == JSON_OBJECT) {
+            member = json_object_member2(value, child->key, child->len);
+        } else if (value->type == JSON_ARRAY
+                && child->index < value->u.array.nb_elements) {
+            member = value->u.array.elements[child->index];
+        }
+
+        if (!member)
+            continue;
+
+        if (child->target >= 0 && !parser->values[child->target]) {
+            struct json_value *copy;
+
+            copy = json_value_clone(member);
+            if (!copy)
+                return -1;
+
+            parser->values[child->target] = copy;
+            parser->nb_pending--;
+        }
+
+        if (json_project_select(parser, child, member) == -1)
+            return -1;
+    }
+
+    return 0;
+}
+
 static bool
 json_is_ws(char c) {
     return c == ' ' || c == '\t' || c == '\r' || c == '\n';
@@ -567,18 +1365,12 @@ json_is_real_char(char c) {
         || c == 'e' || c == 'E';
 }
 
-static char *
+static int
 json_decode_string(const struct json_parser *parser,
-                   const char *buf, size_t sz, size_t *plen) {
+                   const char *buf, size_t sz, char *string, size_t *plen) {
     const char *iptr;
-    char *string, *optr;
-    size_t ilen = sz;
-
-    /* A decoded string has a length smaller or equal to the length of an
-     * encoded string. */
-    string = c_malloc(sz + 1);
-    if (!string)
-        return NULL;
+    char *optr;
+    size_t ilen;
 
     iptr = buf;
     ilen = sz;
@@ -588,7 +1380,7 @@ json_decode_string(const struct json_parser *parser,
         if (*iptr == '\\') {
             if (ilen < 2) {
                 c_set_error("truncated escaped character");
-                goto error;
+                return -1;
             }
 
             iptr++;
@@ -626,16 +1418,16 @@ json_decode_string(const struct json_parser *parser,
 
                 if (ilen < 4) {
                     c_set_error("truncated escaped unicode character");
-                    goto error;
+                    return -1;
                 }
 
                 if (json_decode_utf8_character(iptr, &codepoint) == -1)
-                    goto error;
+                    return -1;
 
                 if (parser->options & JSON_PARSE_REJECT_NULL_CHARACTERS) {
                     if (codepoint == 0) {
                         c_set_error("invalid null character");
-                        goto error;
+                        return -1;
                     }
                 }
 
@@ -644,17 +1436,17 @@ json_decode_string(const struct json_parser *parser,
                     if (ilen < 10 || iptr[4] != '\\'
                      || (iptr[5] != 'u' && iptr[5] != 'U')) {
                         c_set_error("truncated escaped surrogate pair");
-                        goto error;
+                        return -1;
                     }
 
                     if (json_decode_utf16_surrogate_pair(iptr,
                                                          &codepoint) == -1) {
-                        goto error;
+                        return -1;
                     }
 
                     if (json_write_codepoint_as_utf8(codepoint, optr,
                                                      &nb_written) == -1) {
-                        goto error;
+                        return -1;
                     }
 
                     iptr += 10;
@@ -663,7 +1455,7 @@ json_decode_string(const struct json_parser *parser,
                 } else {
                     if (json_write_codepoint_as_utf8(codepoint, optr,
                                                      &nb_written) == -1) {
-                        goto error;
+                        return -1;
                     }
 
                     iptr += 4;
@@ -673,10 +1465,10 @@ json_decode_string(const struct json_parser *parser,
             } else if (*iptr == '\0'
                     && parser->options & JSON_PARSE_REJECT_NULL_CHARACTERS) {
                 c_set_error("invalid null character");
-                goto error;
+                return -1;
             } else {
                 c_set_error("invalid escape sequence");
-                goto error;
+                return -1;
             }
         } else {
             *optr++ = *iptr++;
@@ -687,11 +1479,7 @@ json_decode_string(const struct json_parser *parser,
     *optr = '\0';
     *plen = (size_t)(optr - string);
 
-    return string;
-
-error:
-    c_free(string);
-    return NULL;
+    return 0;
 }
 
 static int
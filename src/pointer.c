@@ -0,0 +1,323 @@
+/*
+ * Copyright (c) 2015 Nicolas Martyanoff
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include "internal.h"
+
+static struct json_pointer *json_pointer_compile2(const char *, bool);
+static int json_pointer_read_token(const char **, char *, size_t *, bool);
+static void json_pointer_token_init(struct json_pointer_token *);
+static const struct json_value *
+json_pointer_evaluate(const struct json_pointer_token *,
+                      const struct json_value *);
+
+struct json_pointer *
+json_pointer_compile(const char *string) {
+    return json_pointer_compile2(string, false);
+}
+
+struct json_pointer *
+json_pointer_compile_fragment(const char *string) {
+    return json_pointer_compile2(string, true);
+}
+
+void
+json_pointer_delete(struct json_pointer *pointer) {
+    if (!pointer)
+        return;
+
+    c_free(pointer->tokens);
+    c_free(pointer->strings);
+
+    c_free0(pointer, sizeof(struct json_pointer));
+}
+
+size_t
+json_pointer_nb_tokens(const struct json_pointer *pointer) {
+    return pointer->nb_tokens;
+}
+
+struct json_value *
+json_pointer_get(const struct json_pointer *pointer,
+                 const struct json_value *value) {
+    for (size_t i = 0; i < pointer->nb_tokens; i++) {
+        value = json_pointer_evaluate(pointer->tokens + i, value);
+        if (!value) {
+            c_set_error("no value at token %zu of json pointer", i);
+            return NULL;
+        }
+    }
+
+    return (struct json_value *)value;
+}
+
+int
+json_pointer_set(const struct json_pointer *pointer,
+                 struct json_value *document, struct json_value *value) {
+    const struct json_pointer_token *token;
+    struct json_value *parent, **pslot;
+
+    if (pointer->nb_tokens == 0) {
+        c_set_error("cannot replace the root value");
+        return -1;
+    }
+
+    if (json_value_is_shared(document)) {
+        c_set_error("cannot modify a shared value");
+        return -1;
+    }
+
+    /* Shared containers on the path are copied, the original document of a
+     * copy-on-write clone is never modified. */
+    parent = document;
+
+    for (size_t i = 0; i < pointer->nb_tokens - 1; i++) {
+        token = pointer->tokens + i;
+
+        if (!json_pointer_evaluate(token, parent)) {
+            c_set_error("no value at token %zu of json pointer", i);
+            return -1;
+        }
+
+        if (parent->type == JSON_OBJECT) {
+            struct json_object *object;
+            size_t idx;
+
+            object = &parent->u.object;
+
+            json_object_find(object, token->string, token->len, token->hash,
+                             &idx);
+            pslot = object->values + idx;
+        } else {
+            pslot = parent->u.array.elements + token->index;
+        }
+
+        parent = json_value_unshare(pslot);
+        if (!parent)
+            return -1;
+    }
+
+    token = pointer->tokens + pointer->nb_tokens - 1;
+
+    if (parent->type == JSON_OBJECT) {
+        if (json_object_set_member2(parent, token->string, token->len,
+                                    value) == -1) {
+            return -1;
+        }
+
+        return 0;
+    } else if (parent->type == JSON_ARRAY) {
+        struct json_array *array;
+
+        array = &parent->u.array;
+
+        if (token->end || token->index == array->nb_elements)
+            return json_array_add_element(parent, value);
+
+        if (token->index == SIZE_MAX) {
+            c_set_error("invalid array index '%s'", token->string);
+            return -1;
+        }
+
+        if (token->index > array->nb_elements) {
+            c_set_error("invalid array index %zu", token->index);
+            return -1;
+        }
+
+        if (json_value_is_shared(parent)) {
+            c_set_error("cannot modify a shared value");
+            return -1;
+        }
+
+        json_value_delete(array->elements[token->index]);
+        array->elements[token->index] = value;
+        return 0;
+    }
+
+    c_set_error("cannot set a member of a %s value",
+                json_type_to_string(parent->type));
+    return -1;
+}
+
+void
+json_pointer_append_token(struct c_buffer *buf, const char *string,
+                          size_t len) {
+    c_buffer_add(buf, "/", 1);
+
+    for (size_t i = 0; i < len; i++) {
+        if (string[i] == '~') {
+            c_buffer_add(buf, "~0", 2);
+        } else if (string[i] == '/') {
+            c_buffer_add(buf, "~1", 2);
+        } else {
+            c_buffer_add(buf, string + i, 1);
+        }
+    }
+}
+
+static struct json_pointer *
+json_pointer_compile2(const char *string, bool fragment) {
+    struct json_pointer *pointer;
+    const char *ptr;
+    char *strings;
+    size_t nb_tokens;
+
+    if (*string != '\0' && *string != '/') {
+        c_set_error("json pointer does not start with '/'");
+        return NULL;
+    }
+
+    nb_tokens = 0;
+    for (ptr = string; *ptr != '\0'; ptr++) {
+        if (*ptr == '/')
+            nb_tokens++;
+    }
+
+    pointer = c_malloc0(sizeof(struct json_pointer));
+
+    /* Unescaped tokens are never longer than escaped ones, a single buffer
+     * the size of the pointer holds all of them. */
+    pointer->strings = c_malloc(strlen(string) + 1);
+    pointer->tokens = c_malloc0((nb_tokens > 0 ? nb_tokens : 1)
+                                * sizeof(struct json_pointer_token));
+
+    strings = pointer->strings;
+    ptr = string;
+
+    while (*ptr == '/') {
+        struct json_pointer_token *token;
+
+        token = pointer->tokens + pointer->nb_tokens++;
+        token->string = strings;
+
+        ptr++;
+        if (json_pointer_read_token(&ptr, strings, &token->len,
+                                    fragment) == -1) {
+            json_pointer_delete(pointer);
+            return NULL;
+        }
+
+        strings += token->len + 1;
+
+        json_pointer_token_init(token);
+    }
+
+    return pointer;
+}
+
+static int
+json_pointer_read_token(const char **pptr, char *token, size_t *plen,
+                        bool fragment) {
+    const char *ptr;
+    size_t len;
+
+    ptr = *pptr;
+    len = 0;
+
+    while (*ptr != '\0' && *ptr != '/') {
+        if (*ptr == '~') {
+            if (ptr[1] == '0') {
+                token[len++] = '~';
+            } else if (ptr[1] == '1') {
+                token[len++] = '/';
+            } else {
+                c_set_error("invalid escape sequence in json pointer");
+                return -1;
+            }
+
+            ptr += 2;
+        } else if (*ptr == '%' && fragment) {
+            /* Pointers in URI fragments are percent-encoded */
+            char hex[3];
+
+            if (!isxdigit((unsigned char)ptr[1])
+             || !isxdigit((unsigned char)ptr[2])) {
+                c_set_error("invalid percent encoding in json pointer");
+                return -1;
+            }
+
+            hex[0] = ptr[1];
+            hex[1] = ptr[2];
+            hex[2] = '\0';
+
+            token[len++] = (char)strtoul(hex, NULL, 16);
+            ptr += 3;
+        } else {
+            token[len++] = *ptr++;
+        }
+    }
+
+    token[len] = '\0';
+
+    *pptr = ptr;
+    *plen = len;
+    return 0;
+}
+
+static void
+json_pointer_token_init(struct json_pointer_token *token) {
+    size_t index;
+
+    token->hash = json_hash_string(token->string, token->len);
+
+    token->index = SIZE_MAX;
+    token->end = (token->len == 1 && token->string[0] == '-');
+
+    /* Array indexes have no leading zero */
+    if (token->len == 0 || (token->len > 1 && token->string[0] == '0'))
+        return;
+
+    index = 0;
+
+    for (size_t i = 0; i < token->len; i++) {
+        size_t digit;
+
+        if (token->string[i] < '0' || token->string[i] > '9')
+            return;
+
+        digit = (size_t)(token->string[i] - '0');
+        if (index > (SIZE_MAX - digit) / 10)
+            return;
+
+        index = index * 10 + digit;
+    }
+
+    token->index = index;
+}
+
+static const struct json_value *
+json_pointer_evaluate(const struct json_pointer_token *token,
+                      const struct json_value *value) {
+    if (value->type == JSON_OBJECT) {
+        const struct json_object *object;
+        size_t idx;
+
+        object = &value->u.object;
+
+        if (!json_object_find(object, token->string, token->len, token->hash,
+                              &idx)) {
+            return NULL;
+        }
+
+        return object->values[idx];
+    } else if (value->type == JSON_ARRAY) {
+        if (token->index >= value->u.array.nb_elements)
+            return NULL;
+
+        return value->u.array.elements[token->index];
+    }
+
+    return NULL;
+}
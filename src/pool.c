@@ -0,0 +1,252 @@
+/*
+ * Copyright (c) 2015 Nicolas Martyanoff
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <pthread.h>
+#include <unistd.h>
+
+#include "internal.h"
+
+/* A job is a set of tasks identified by their index. The thread running a
+ * job executes its tasks alongside the workers, and only waits for the
+ * tasks other threads are still executing.
+ *
+ * Tasks can run jobs themselves: nested jobs are added to the list of
+ * pending jobs, and since each thread running a job makes progress on it,
+ * waiting never depends on a thread blocked on another job. */
+
+struct json_schema_pool_job {
+    json_schema_pool_function function;
+    void *data;
+
+    /* Tasks run with the allocator of the thread which started the job */
+    const struct json_allocator *allocator;
+
+    size_t nb_tasks;
+    size_t next_task;
+    size_t nb_done;
+
+    struct json_schema_pool_job *prev;
+    struct json_schema_pool_job *next;
+};
+
+struct json_schema_pool {
+    pthread_t *threads;
+    unsigned int nb_threads;
+
+    pthread_mutex_t mutex;
+    pthread_cond_t work_cond; /* a job was added or the pool is stopping */
+    pthread_cond_t done_cond; /* a job is complete */
+
+    struct json_schema_pool_job *jobs; /* jobs with tasks left to start */
+    bool stopping;
+};
+
+static void *json_schema_pool_main(void *);
+static void json_schema_pool_execute(struct json_schema_pool *,
+                                     struct json_schema_pool_job *);
+static void json_schema_pool_remove_job(struct json_schema_pool *,
+                                        struct json_schema_pool_job *);
+
+struct json_schema_pool *
+json_schema_pool_new(unsigned int nb_threads) {
+    struct json_schema_pool *pool;
+    int ret;
+
+    if (nb_threads == 0) {
+        long nb_cpus;
+
+        nb_cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        nb_threads = (nb_cpus > 0) ? (unsigned int)nb_cpus : 1;
+    }
+
+    pool = c_malloc0(sizeof(struct json_schema_pool));
+    if (!pool)
+        return NULL;
+
+    ret = pthread_mutex_init(&pool->mutex, NULL);
+    if (ret != 0) {
+        c_set_error("cannot initialize mutex: %s", strerror(ret));
+        goto error_mutex;
+    }
+
+    ret = pthread_cond_init(&pool->work_cond, NULL);
+    if (ret != 0) {
+        c_set_error("cannot initialize condition variable: %s",
+                    strerror(ret));
+        goto error_work_cond;
+    }
+
+    ret = pthread_cond_init(&pool->done_cond, NULL);
+    if (ret != 0) {
+        c_set_error("cannot initialize condition variable: %s",
+                    strerror(ret));
+        goto error_done_cond;
+    }
+
+    /* From here on, json_schema_pool_delete() releases everything */
+    pool->threads = c_malloc0(nb_threads * sizeof(pthread_t));
+    if (!pool->threads) {
+        json_schema_pool_delete(pool);
+        return NULL;
+    }
+
+    for (unsigned int i = 0; i < nb_threads; i++) {
+        ret = pthread_create(&pool->threads[i], NULL,
+                             json_schema_pool_main, pool);
+        if (ret != 0) {
+            c_set_error("cannot create thread: %s", strerror(ret));
+            json_schema_pool_delete(pool);
+            return NULL;
+        }
+
+        pool->nb_threads++;
+    }
+
+    return pool;
+
+error_done_cond:
+    pthread_cond_destroy(&pool->work_cond);
+error_work_cond:
+    pthread_mutex_destroy(&pool->mutex);
+error_mutex:
+    c_free0(pool, sizeof(struct json_schema_pool));
+    return NULL;
+}
+
+void
+json_schema_pool_delete(struct json_schema_pool *pool) {
+    if (!pool)
+        return;
+
+    pthread_mutex_lock(&pool->mutex);
+    pool->stopping = true;
+    pthread_cond_broadcast(&pool->work_cond);
+    pthread_mutex_unlock(&pool->mutex);
+
+    for (unsigned int i = 0; i < pool->nb_threads; i++)
+        pthread_join(pool->threads[i], NULL);
+
+    c_free(pool->threads);
+
+    pthread_cond_destroy(&pool->done_cond);
+    pthread_cond_destroy(&pool->work_cond);
+    pthread_mutex_destroy(&pool->mutex);
+
+    c_free0(pool, sizeof(struct json_schema_pool));
+}
+
+unsigned int
+json_schema_pool_nb_threads(const struct json_schema_pool *pool) {
+    return pool->nb_threads;
+}
+
+void
+json_schema_pool_run(struct json_schema_pool *pool,
+                     json_schema_pool_function function, void *data,
+                     size_t nb_tasks) {
+    struct json_schema_pool_job job;
+
+    if (nb_tasks == 0)
+        return;
+
+    memset(&job, 0, sizeof(struct json_schema_pool_job));
+
+    job.function = function;
+    job.data = data;
+    job.allocator = json_allocator_current();
+    job.nb_tasks = nb_tasks;
+
+    pthread_mutex_lock(&pool->mutex);
+
+    /* The most recent job is executed first, so that nested jobs complete
+     * and unblock the tasks waiting for them. */
+    job.next = pool->jobs;
+    if (pool->jobs)
+        pool->jobs->prev = &job;
+    pool->jobs = &job;
+
+    pthread_cond_broadcast(&pool->work_cond);
+
+    while (job.next_task < job.nb_tasks)
+        json_schema_pool_execute(pool, &job);
+
+    while (job.nb_done < job.nb_tasks)
+        pthread_cond_wait(&pool->done_cond, &pool->mutex);
+
+    pthread_mutex_unlock(&pool->mutex);
+}
+
+static void *
+json_schema_pool_main(void *arg) {
+    struct json_schema_pool *pool;
+
+    pool = arg;
+
+    pthread_mutex_lock(&pool->mutex);
+
+    for (;;) {
+        while (!pool->jobs && !pool->stopping)
+            pthread_cond_wait(&pool->work_cond, &pool->mutex);
+
+        if (pool->stopping)
+            break;
+
+        json_schema_pool_execute(pool, pool->jobs);
+    }
+
+    pthread_mutex_unlock(&pool->mutex);
+    return NULL;
+}
+
+static void
+json_schema_pool_execute(struct json_schema_pool *pool,
+                         struct json_schema_pool_job *job) {
+    const struct json_allocator *allocator;
+    size_t task;
+
+    /* Called with the mutex locked */
+    task = job->next_task++;
+    if (job->next_task == job->nb_tasks)
+        json_schema_pool_remove_job(pool, job);
+
+    pthread_mutex_unlock(&pool->mutex);
+
+    allocator = json_use_allocator(job->allocator);
+    job->function(job->data, task);
+    json_use_allocator(allocator);
+
+    pthread_mutex_lock(&pool->mutex);
+
+    job->nb_done++;
+    if (job->nb_done == job->nb_tasks)
+        pthread_cond_broadcast(&pool->done_cond);
+}
+
+static void
+json_schema_pool_remove_job(struct json_schema_pool *pool,
+                            struct json_schema_pool_job *job) {
+    if (job->prev) {
+        job->prev->next = job->next;
+    } else {
+        pool->jobs = job->next;
+    }
+
+    if (job->next)
+        job->next->prev = job->prev;
+
+    job->prev = NULL;
+    job->next = NULL;
+}
@@ -0,0 +1,159 @@
+/*
+ * Copyright (c) 2015 Nicolas Martyanoff
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <time.h>
+
+#include "internal.h"
+
+/* When the library is built with profile=1, each instruction executed
+ * during validation is counted and timed. The time of an instruction does
+ * not include the time spent checking nested values, which is accounted to
+ * the instructions of the nested schemas. Counters are shared between
+ * threads. */
+
+#ifdef JSON_SCHEMA_PROFILE
+#define JSON_SCHEMA_NB_OPS (JSON_SCHEMA_OP_PROPERTY_DEPENDENCY + 1)
+
+static const char *json_schema_op_keywords[JSON_SCHEMA_NB_OPS] = {
+    [JSON_SCHEMA_OP_ENUM]                = "enum",
+    [JSON_SCHEMA_OP_ALL_OF]              = "allOf",
+    [JSON_SCHEMA_OP_ANY_OF]              = "anyOf",
+    [JSON_SCHEMA_OP_ONE_OF]              = "oneOf",
+    [JSON_SCHEMA_OP_NOT]                 = "not",
+    [JSON_SCHEMA_OP_FORMAT]              = "format",
+
+    [JSON_SCHEMA_OP_MULTIPLE_OF_INTEGER] = "multipleOf",
+    [JSON_SCHEMA_OP_MULTIPLE_OF_REAL]    = "multipleOf",
+    [JSON_SCHEMA_OP_MIN_INTEGER]         = "minimum",
+    [JSON_SCHEMA_OP_MIN_REAL]            = "minimum",
+    [JSON_SCHEMA_OP_MAX_INTEGER]         = "maximum",
+    [JSON_SCHEMA_OP_MAX_REAL]            = "maximum",
+
+    [JSON_SCHEMA_OP_LENGTH]              = "minLength/maxLength",
+    [JSON_SCHEMA_OP_PATTERN]             = "pattern",
+
+    [JSON_SCHEMA_OP_MIN_ITEMS]           = "minItems",
+    [JSON_SCHEMA_OP_MAX_ITEMS]           = "maxItems",
+    [JSON_SCHEMA_OP_UNIQUE_ITEMS]        = "uniqueItems",
+    [JSON_SCHEMA_OP_ITEMS]               = "items",
+    [JSON_SCHEMA_OP_TUPLE_ITEMS]         = "items",
+
+    [JSON_SCHEMA_OP_MIN_PROPERTIES]      = "minProperties",
+    [JSON_SCHEMA_OP_MAX_PROPERTIES]      = "maxProperties",
+    [JSON_SCHEMA_OP_MEMBERS]             = "properties",
+    [JSON_SCHEMA_OP_SCHEMA_DEPENDENCY]   = "dependencies",
+    [JSON_SCHEMA_OP_PROPERTY_DEPENDENCY] = "dependencies",
+};
+
+static uint64_t json_schema_profile_counts[JSON_SCHEMA_NB_OPS];
+static uint64_t json_schema_profile_times[JSON_SCHEMA_NB_OPS];
+
+/* Time spent in the instructions nested in the current one */
+static __thread uint64_t json_schema_profile_nested_time;
+
+static uint64_t json_schema_profile_now(void);
+
+void
+json_schema_profile_enter(struct json_schema_profile_frame *frame) {
+    frame->nested_time = json_schema_profile_nested_time;
+    json_schema_profile_nested_time = 0;
+
+    frame->start = json_schema_profile_now();
+}
+
+void
+json_schema_profile_leave(struct json_schema_profile_frame *frame,
+                          enum json_schema_op op) {
+    uint64_t time;
+
+    time = json_schema_profile_now() - frame->start;
+
+    __atomic_add_fetch(&json_schema_profile_counts[op], 1,
+                       __ATOMIC_RELAXED);
+    __atomic_add_fetch(&json_schema_profile_times[op],
+                       time - json_schema_profile_nested_time,
+                       __ATOMIC_RELAXED);
+
+    json_schema_profile_nested_time = frame->nested_time + time;
+}
+
+static uint64_t
+json_schema_profile_now(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + (uint64_t)ts.tv_nsec;
+}
+#endif
+
+size_t
+json_schema_profile_entries(struct json_schema_profile_entry *entries,
+                            size_t max_entries) {
+    size_t nb_entries;
+
+    nb_entries = 0;
+
+#ifdef JSON_SCHEMA_PROFILE
+    /* Instructions implementing the same keyword are merged */
+    for (size_t op = 0; op < JSON_SCHEMA_NB_OPS; op++) {
+        struct json_schema_profile_entry *entry;
+        uint64_t count, time;
+
+        count = __atomic_load_n(&json_schema_profile_counts[op],
+                                __ATOMIC_RELAXED);
+        time = __atomic_load_n(&json_schema_profile_times[op],
+                               __ATOMIC_RELAXED);
+        if (count == 0)
+            continue;
+
+        entry = NULL;
+        for (size_t i = 0; i < nb_entries; i++) {
+            if (strcmp(entries[i].keyword, json_schema_op_keywords[op]) == 0) {
+                entry = entries + i;
+                break;
+            }
+        }
+
+        if (!entry) {
+            if (nb_entries >= max_entries)
+                break;
+
+            entry = entries + nb_entries++;
+
+            entry->keyword = json_schema_op_keywords[op];
+            entry->count = 0;
+            entry->time = 0;
+        }
+
+        entry->count += count;
+        entry->time += time;
+    }
+#endif
+
+    return nb_entries;
+}
+
+void
+json_schema_profile_reset(void) {
+#ifdef JSON_SCHEMA_PROFILE
+    for (size_t op = 0; op < JSON_SCHEMA_NB_OPS; op++) {
+        __atomic_store_n(&json_schema_profile_counts[op], 0,
+                         __ATOMIC_RELAXED);
+        __atomic_store_n(&json_schema_profile_times[op], 0,
+                         __ATOMIC_RELAXED);
+    }
+#endif
+}
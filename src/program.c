@@ -0,0 +1,2810 @@
+/*
+ * Copyright (c) 2015 Nicolas Martyanoff
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include "internal.h"
+
+/* A schema is compiled to a program made of one node per schema of the
+ * tree. Each node contains a mask of accepted types and a contiguous list of
+ * instructions, grouped by the JSON type they apply to, so that validating a
+ * value only runs the checks which can apply to it, without looking at any
+ * validator field which is not set. */
+
+/* Compilation */
+static int json_schema_program_compile(struct json_schema_program *,
+                                       const struct json_schema *,
+                                       uint32_t *);
+static int json_schema_program_compile_list(struct json_schema_program *,
+                                            const struct c_ptr_vector *,
+                                            uint32_t *);
+static int json_schema_program_compile_generic(struct json_schema_program *,
+                                               const struct json_validator *,
+                                               struct c_buffer *);
+static int json_schema_program_compile_numeric(struct json_schema_program *,
+                                               const struct json_validator *,
+                                               struct c_buffer *);
+static int json_schema_program_compile_string(struct json_schema_program *,
+                                              const struct json_validator *,
+                                              struct c_buffer *);
+static int json_schema_program_compile_array(struct json_schema_program *,
+                                             const struct json_validator *,
+                                             struct c_buffer *);
+static int json_schema_program_compile_object(struct json_schema_program *,
+                                              const struct json_validator *,
+                                              struct c_buffer *);
+static int json_schema_program_compile_members(struct json_schema_program *,
+                                               const struct json_object_validator *,
+                                               struct json_schema_insn *);
+
+static uint32_t json_schema_program_types(const struct json_generic_validator *);
+static void json_schema_key_init(struct json_schema_key *, const char *);
+
+static void *json_schema_program_grow(void *, size_t *, size_t, size_t);
+static int json_schema_program_add_node(struct json_schema_program *,
+                                        const struct json_schema_node *,
+                                        uint32_t *);
+static int json_schema_program_add_insns(struct json_schema_program *,
+                                         const struct c_buffer *);
+static int json_schema_program_add_refs(struct json_schema_program *,
+                                        const uint32_t *, size_t);
+static int json_schema_program_add_value(struct json_schema_program *,
+                                         struct json_value *);
+static int json_schema_program_add_key(struct json_schema_program *,
+                                       const char *);
+static int json_schema_program_add_property(struct json_schema_program *,
+                                            const char *, uint32_t);
+static int json_schema_program_add_pattern(struct json_schema_program *,
+                                           const char *,
+                                           const struct json_schema_re *,
+                                           uint32_t);
+static int json_schema_program_index_properties(struct json_schema_program *,
+                                                struct json_schema_insn *);
+static int json_schema_program_index_branches(struct json_schema_program *);
+static void json_schema_branch_init(struct json_schema_branch *,
+                                    const struct json_schema_program *,
+                                    uint32_t);
+static int json_schema_program_emit(struct c_buffer *,
+                                    const struct json_schema_insn *);
+
+/* Execution */
+static int json_schema_check_branch(struct json_schema_check *,
+                                    const struct json_schema_insn *, uint32_t,
+                                    const struct json_value *);
+static int json_schema_check_speculative(struct json_schema_check *,
+                                         uint32_t, const struct json_value *);
+static int json_schema_check_error(struct json_schema_check *,
+                                   enum json_schema_error_code,
+                                   const char *, const char *, ...)
+    __attribute__((format(printf, 4, 5)));
+static bool json_schema_check_continue(const struct json_schema_check *);
+static int json_schema_check_fail(struct json_schema_check *);
+static void json_schema_check_prefix(struct json_schema_check *, size_t,
+                                     const char *, size_t, const char *,
+                                     const char *, size_t);
+
+typedef int (*json_schema_check_function)(struct json_schema_check *,
+                                          const struct json_schema_insn *,
+                                          const struct json_value *, size_t);
+
+static bool json_schema_check_is_parallel(const struct json_schema_check *,
+                                          size_t);
+static int json_schema_check_parallel(struct json_schema_check *,
+                                      const struct json_schema_insn *,
+                                      const struct json_value *, size_t,
+                                      size_t, json_schema_check_function);
+static void json_schema_check_parallel_task(void *, size_t);
+
+static int json_schema_program_exec(struct json_schema_check *,
+                                    const struct json_schema_insn *,
+                                    const struct json_value *);
+static int json_schema_program_exec_insn(struct json_schema_check *,
+                                         const struct json_schema_insn *,
+                                         const struct json_value *);
+static int json_schema_program_check_all_of(struct json_schema_check *,
+                                            const struct json_schema_insn *,
+                                            const struct json_value *,
+                                            size_t);
+static int json_schema_program_check_item(struct json_schema_check *,
+                                          const struct json_schema_insn *,
+                                          const struct json_value *, size_t);
+static int json_schema_program_check_members(struct json_schema_check *,
+                                             const struct json_schema_insn *,
+                                             const struct json_value *);
+static int json_schema_program_check_member(struct json_schema_check *,
+                                            const struct json_schema_insn *,
+                                            const struct json_value *,
+                                            size_t);
+static int
+json_schema_program_check_member_property(struct json_schema_check *,
+                                          const struct json_schema_insn *,
+                                          const struct json_value *, size_t,
+                                          const struct json_schema_property *);
+static int json_schema_program_check_tuple(struct json_schema_check *,
+                                           const struct json_schema_insn *,
+                                           const struct json_value *);
+static const struct json_schema_property *
+json_schema_program_find_property(const struct json_schema_program *,
+                                  const struct json_schema_insn *,
+                                  const char *, size_t, uint32_t);
+static void json_schema_program_mark_required(uint64_t *, size_t *,
+                                              const struct json_schema_property *);
+
+static bool
+json_schema_value_is_multiple_of_integer(const struct json_value *, int64_t);
+static bool
+json_schema_value_is_multiple_of_real(const struct json_value *, double);
+static int json_schema_value_has_unique_elements(const struct json_value *,
+                                                 bool *);
+
+static bool
+json_schema_value_lt_integer(const struct json_value *, int64_t, bool);
+static bool
+json_schema_value_gt_integer(const struct json_value *, int64_t, bool);
+static bool
+json_schema_value_lt_real(const struct json_value *, double, bool);
+static bool
+json_schema_value_gt_real(const struct json_value *, double, bool);
+
+/* ------------------------------------------------------------------------
+ *  Compilation
+ * ------------------------------------------------------------------------ */
+int
+json_schema_compile(struct json_schema *schema) {
+    struct json_schema_program *program;
+    uint32_t root;
+
+    if (schema->program)
+        return 0;
+
+    program = c_malloc0(sizeof(struct json_schema_program));
+    if (!program)
+        return -1;
+
+    program->schemas = c_hash_table_new(json_hash_pointer,
+                                        json_equal_pointer);
+
+    if (json_schema_program_compile(program, schema, &root) == -1) {
+        json_schema_program_delete(program);
+        return -1;
+    }
+
+    c_hash_table_delete(program->schemas);
+    program->schemas = NULL;
+
+    if (json_schema_program_index_branches(program) == -1) {
+        json_schema_program_delete(program);
+        return -1;
+    }
+
+    program->root = root;
+
+    schema->program = program;
+    return 0;
+}
+
+void
+json_schema_program_delete(struct json_schema_program *program) {
+    if (!program)
+        return;
+
+    c_free(program->nodes);
+    c_free(program->insns);
+    c_free(program->refs);
+    c_free(program->branches);
+    c_free(program->values);
+    c_free(program->keys);
+    c_free(program->properties);
+    c_free(program->index);
+    c_free(program->patterns);
+
+    if (program->schemas)
+        c_hash_table_delete(program->schemas);
+
+    c_free0(program, sizeof(struct json_schema_program));
+}
+
+static int
+json_schema_program_compile(struct json_schema_program *program,
+                            const struct json_schema *schema,
+                            uint32_t *pnode) {
+    const struct json_validator *validator;
+    struct json_schema_node node;
+    struct c_buffer *insns;
+    uint32_t offsets[JSON_NB_TYPES + 2];
+    uint32_t index;
+    size_t base;
+    void *ptr;
+
+    /* A reference is compiled as the schema it points to, and each schema
+     * is compiled once: shared sub-schemas use the same node, and recursive
+     * schemas refer to the node of their ancestor. The node is reserved
+     * before sub-schemas are compiled for this reason. */
+    if (schema->ref_target)
+        schema = schema->ref_target;
+
+    if (c_hash_table_get(program->schemas, schema, &ptr) == 1) {
+        *pnode = (uint32_t)(uintptr_t)ptr;
+        return 0;
+    }
+
+    memset(&node, 0, sizeof(struct json_schema_node));
+    if (json_schema_program_add_node(program, &node, &index) == -1)
+        return -1;
+
+    c_hash_table_insert(program->schemas, (void *)schema,
+                        (void *)(uintptr_t)index);
+
+    validator = &schema->validator;
+
+    /* Sub-schemas are compiled as they are found and add their own nodes
+     * and instructions to the program, so the instructions of this node are
+     * collected apart and only added once complete. */
+    insns = c_buffer_new();
+
+#define JSON_NB_INSNS(buf_) \
+    ((uint32_t)(c_buffer_length(buf_) / sizeof(struct json_schema_insn)))
+
+    node.types = json_schema_program_types(&validator->generic);
+
+    offsets[0] = 0;
+
+    if (json_schema_program_compile_generic(program, validator, insns) == -1)
+        goto error;
+
+    for (int type = 0; type < JSON_NB_TYPES; type++) {
+        int ret;
+
+        offsets[type + 1] = JSON_NB_INSNS(insns);
+
+        if (!(node.types & JSON_SCHEMA_TYPE_MASK(type)))
+            continue;
+
+        switch ((enum json_type)type) {
+        case JSON_OBJECT:
+            ret = json_schema_program_compile_object(program, validator,
+                                                     insns);
+            break;
+
+        case JSON_ARRAY:
+            ret = json_schema_program_compile_array(program, validator,
+                                                    insns);
+            break;
+
+        case JSON_INTEGER:
+        case JSON_REAL:
+            ret = json_schema_program_compile_numeric(program, validator,
+                                                      insns);
+            break;
+
+        case JSON_STRING:
+            ret = json_schema_program_compile_string(program, validator,
+                                                     insns);
+            break;
+
+        default:
+            ret = 0;
+            break;
+        }
+
+        if (ret == -1)
+            goto error;
+    }
+
+    offsets[JSON_NB_TYPES + 1] = JSON_NB_INSNS(insns);
+
+#undef JSON_NB_INSNS
+
+    base = program->nb_insns;
+    if (base + offsets[JSON_NB_TYPES + 1] > UINT32_MAX) {
+        c_set_error("schema program too large");
+        goto error;
+    }
+
+    if (json_schema_program_add_insns(program, insns) == -1)
+        goto error;
+
+    for (size_t i = 0; i < JSON_NB_TYPES + 2; i++)
+        node.insns[i] = (uint32_t)base + offsets[i];
+
+    program->nodes[index] = node;
+    *pnode = index;
+
+    c_buffer_delete(insns);
+    return 0;
+
+error:
+    c_buffer_delete(insns);
+    return -1;
+}
+
+static int
+json_schema_program_compile_list(struct json_schema_program *program,
+                                 const struct c_ptr_vector *schemas,
+                                 uint32_t *pstart) {
+    uint32_t *nodes;
+    size_t nb_schemas;
+
+    /* Nested lists are added to the reference table while sub-schemas are
+     * compiled, so nodes are only added once they are all known. */
+    nb_schemas = c_ptr_vector_length(schemas);
+
+    nodes = c_malloc((nb_schemas > 0 ? nb_schemas : 1) * sizeof(uint32_t));
+    if (!nodes)
+        return -1;
+
+    for (size_t i = 0; i < nb_schemas; i++) {
+        if (json_schema_program_compile(program,
+                                        c_ptr_vector_entry(schemas, i),
+                                        &nodes[i]) == -1) {
+            c_free(nodes);
+            return -1;
+        }
+    }
+
+    *pstart = (uint32_t)program->nb_refs;
+
+    if (json_schema_program_add_refs(program, nodes, nb_schemas) == -1) {
+        c_free(nodes);
+        return -1;
+    }
+
+    c_free(nodes);
+    return 0;
+}
+
+static int
+json_schema_program_compile_generic(struct json_schema_program *program,
+                                    const struct json_validator *validator,
+                                    struct c_buffer *insns) {
+    const struct json_generic_validator *generic;
+    struct json_schema_insn insn;
+
+    struct {
+        const struct c_ptr_vector *schemas;
+        enum json_schema_op op;
+    } lists[] = {
+        {validator->generic.all_of, JSON_SCHEMA_OP_ALL_OF},
+        {validator->generic.any_of, JSON_SCHEMA_OP_ANY_OF},
+        {validator->generic.one_of, JSON_SCHEMA_OP_ONE_OF},
+    };
+    size_t nb_lists = sizeof(lists) / sizeof(lists[0]);
+
+    generic = &validator->generic;
+    memset(&insn, 0, sizeof(struct json_schema_insn));
+
+    /* enum */
+    if (generic->enumeration) {
+        insn.op = JSON_SCHEMA_OP_ENUM;
+        insn.u.range.start = (uint32_t)program->nb_values;
+        insn.u.range.count =
+            (uint32_t)c_ptr_vector_length(generic->enumeration);
+
+        for (size_t i = 0; i < insn.u.range.count; i++) {
+            struct json_value *value;
+
+            value = c_ptr_vector_entry(generic->enumeration, i);
+            if (json_schema_program_add_value(program, value) == -1)
+                return -1;
+        }
+
+        if (json_schema_program_emit(insns, &insn) == -1)
+            return -1;
+    }
+
+    /* allOf/anyOf/oneOf */
+    for (size_t i = 0; i < nb_lists; i++) {
+        if (!lists[i].schemas)
+            continue;
+
+        insn.op = lists[i].op;
+        insn.u.range.count = (uint32_t)c_ptr_vector_length(lists[i].schemas);
+
+        if (json_schema_program_compile_list(program, lists[i].schemas,
+                                             &insn.u.range.start) == -1) {
+            return -1;
+        }
+
+        if (json_schema_program_emit(insns, &insn) == -1)
+            return -1;
+    }
+
+    /* not */
+    if (generic->not) {
+        insn.op = JSON_SCHEMA_OP_NOT;
+
+        if (json_schema_program_compile(program, generic->not,
+                                        &insn.u.node) == -1) {
+            return -1;
+        }
+
+        if (json_schema_program_emit(insns, &insn) == -1)
+            return -1;
+    }
+
+    /* format */
+    if (generic->format) {
+        insn.op = JSON_SCHEMA_OP_FORMAT;
+        insn.u.format = generic->format;
+
+        if (json_schema_program_emit(insns, &insn) == -1)
+            return -1;
+    }
+
+    return 0;
+}
+
+static int
+json_schema_program_compile_numeric(struct json_schema_program *program,
+                                    const struct json_validator *validator,
+                                    struct c_buffer *insns) {
+    const struct json_numeric_validator *numeric;
+    struct json_schema_insn insn;
+
+    numeric = &validator->numeric;
+    memset(&insn, 0, sizeof(struct json_schema_insn));
+
+    /* multipleOf */
+    if (numeric->multiple_of) {
+        if (numeric->multiple_of->type == JSON_INTEGER) {
+            insn.op = JSON_SCHEMA_OP_MULTIPLE_OF_INTEGER;
+            insn.u.integer.value = numeric->multiple_of->u.integer;
+        } else {
+            insn.op = JSON_SCHEMA_OP_MULTIPLE_OF_REAL;
+            insn.u.real.value = numeric->multiple_of->u.real;
+        }
+
+        if (json_schema_program_emit(insns, &insn) == -1)
+            return -1;
+    }
+
+    /* minimum/exclusiveMinimum */
+    if (numeric->min) {
+        if (numeric->min->type == JSON_INTEGER) {
+            insn.op = JSON_SCHEMA_OP_MIN_INTEGER;
+            insn.u.integer.value = numeric->min->u.integer;
+            insn.u.integer.exclusive = numeric->exclusive_min;
+        } else {
+            insn.op = JSON_SCHEMA_OP_MIN_REAL;
+            insn.u.real.value = numeric->min->u.real;
+            insn.u.real.exclusive = numeric->exclusive_min;
+        }
+
+        if (json_schema_program_emit(insns, &insn) == -1)
+            return -1;
+    }
+
+    /* maximum/exclusiveMaximum */
+    if (numeric->max) {
+        if (numeric->max->type == JSON_INTEGER) {
+            insn.op = JSON_SCHEMA_OP_MAX_INTEGER;
+            insn.u.integer.value = numeric->max->u.integer;
+            insn.u.integer.exclusive = numeric->exclusive_max;
+        } else {
+            insn.op = JSON_SCHEMA_OP_MAX_REAL;
+            insn.u.real.value = numeric->max->u.real;
+            insn.u.real.exclusive = numeric->exclusive_max;
+        }
+
+        if (json_schema_program_emit(insns, &insn) == -1)
+            return -1;
+    }
+
+    return 0;
+}
+
+static int
+json_schema_program_compile_string(struct json_schema_program *program,
+                                   const struct json_validator *validator,
+                                   struct c_buffer *insns) {
+    const struct json_string_validator *string;
+    struct json_schema_insn insn;
+
+    string = &validator->string;
+    memset(&insn, 0, sizeof(struct json_schema_insn));
+
+    /* minLength/maxLength */
+    if (string->has_min_length || string->has_max_length) {
+        insn.op = JSON_SCHEMA_OP_LENGTH;
+        insn.u.length.min = string->has_min_length ? string->min_length : 0;
+        insn.u.length.max = string->has_max_length ? string->max_length
+                                                   : SIZE_MAX;
+
+        if (json_schema_program_emit(insns, &insn) == -1)
+            return -1;
+    }
+
+    /* pattern */
+    if (string->pattern) {
+        insn.op = JSON_SCHEMA_OP_PATTERN;
+        insn.u.re = string->pattern_re;
+
+        if (json_schema_program_emit(insns, &insn) == -1)
+            return -1;
+    }
+
+    return 0;
+}
+
+static int
+json_schema_program_compile_array(struct json_schema_program *program,
+                                  const struct json_validator *validator,
+                                  struct c_buffer *insns) {
+    const struct json_array_validator *array;
+    struct json_schema_insn insn;
+
+    array = &validator->array;
+    memset(&insn, 0, sizeof(struct json_schema_insn));
+
+    /* minItems */
+    if (array->has_min_items) {
+        insn.op = JSON_SCHEMA_OP_MIN_ITEMS;
+        insn.u.size = array->min_items;
+
+        if (json_schema_program_emit(insns, &insn) == -1)
+            return -1;
+    }
+
+    /* maxItems */
+    if (array->has_max_items) {
+        insn.op = JSON_SCHEMA_OP_MAX_ITEMS;
+        insn.u.size = array->max_items;
+
+        if (json_schema_program_emit(insns, &insn) == -1)
+            return -1;
+    }
+
+    /* uniqueItems */
+    if (array->unique_items) {
+        insn.op = JSON_SCHEMA_OP_UNIQUE_ITEMS;
+
+        if (json_schema_program_emit(insns, &insn) == -1)
+            return -1;
+    }
+
+    /* items/additionalItems */
+    if (array->items && array->items_is_array) {
+        insn.op = JSON_SCHEMA_OP_TUPLE_ITEMS;
+        insn.u.tuple.count = (uint32_t)c_ptr_vector_length(array->items);
+
+        if (json_schema_program_compile_list(program, array->items,
+                                             &insn.u.tuple.start) == -1) {
+            return -1;
+        }
+
+        insn.u.tuple.additional = JSON_SCHEMA_NODE_NONE;
+        insn.u.tuple.allow_additional = true;
+
+        if (array->additional_items_is_schema) {
+            if (json_schema_program_compile(program,
+                                            array->additional_items.schema,
+                                            &insn.u.tuple.additional) == -1) {
+                return -1;
+            }
+        } else {
+            insn.u.tuple.allow_additional = array->additional_items.boolean;
+        }
+
+        if (json_schema_program_emit(insns, &insn) == -1)
+            return -1;
+    } else if (array->items) {
+        insn.op = JSON_SCHEMA_OP_ITEMS;
+
+        if (json_schema_program_compile(program,
+                                        c_ptr_vector_entry(array->items, 0),
+                                        &insn.u.node) == -1) {
+            return -1;
+        }
+
+        if (json_schema_program_emit(insns, &insn) == -1)
+            return -1;
+    }
+
+    return 0;
+}
+
+static int
+json_schema_program_compile_object(struct json_schema_program *program,
+                                   const struct json_validator *validator,
+                                   struct c_buffer *insns) {
+    const struct json_object_validator *object;
+    struct json_schema_insn insn;
+
+    object = &validator->object;
+    memset(&insn, 0, sizeof(struct json_schema_insn));
+
+    /* minProperties */
+    if (object->has_min_properties) {
+        insn.op = JSON_SCHEMA_OP_MIN_PROPERTIES;
+        insn.u.size = object->min_properties;
+
+        if (json_schema_program_emit(insns, &insn) == -1)
+            return -1;
+    }
+
+    /* maxProperties */
+    if (object->has_max_properties) {
+        insn.op = JSON_SCHEMA_OP_MAX_PROPERTIES;
+        insn.u.size = object->max_properties;
+
+        if (json_schema_program_emit(insns, &insn) == -1)
+            return -1;
+    }
+
+    /* required/properties/additionalProperties/patternProperties */
+    if (object->required || object->properties || object->pattern_properties
+     || object->additional_properties_is_schema
+     || !object->additional_properties.boolean) {
+        insn.op = JSON_SCHEMA_OP_MEMBERS;
+
+        if (json_schema_program_compile_members(program, object,
+                                                &insn) == -1) {
+            return -1;
+        }
+
+        if (json_schema_program_emit(insns, &insn) == -1)
+            return -1;
+    }
+
+    /* dependencies */
+    if (object->schema_dependencies) {
+        struct c_hash_table_iterator *it;
+        struct json_schema *schema;
+        const char *key;
+        int ret;
+
+        ret = 0;
+
+        it = c_hash_table_iterate(object->schema_dependencies);
+        while (c_hash_table_iterator_next(it, (void **)&key,
+                                          (void **)&schema) == 1) {
+            insn.op = JSON_SCHEMA_OP_SCHEMA_DEPENDENCY;
+            json_schema_key_init(&insn.u.dependency.key, key);
+
+            ret = json_schema_program_compile(program, schema,
+                                              &insn.u.dependency.node);
+            if (ret == -1)
+                break;
+
+            ret = json_schema_program_emit(insns, &insn);
+            if (ret == -1)
+                break;
+        }
+        c_hash_table_iterator_delete(it);
+
+        if (ret == -1)
+            return -1;
+    }
+
+    if (object->property_dependencies) {
+        struct c_hash_table_iterator *it;
+        struct c_ptr_vector *properties;
+        const char *key;
+        int ret;
+
+        ret = 0;
+
+        it = c_hash_table_iterate(object->property_dependencies);
+        while (c_hash_table_iterator_next(it, (void **)&key,
+                                          (void **)&properties) == 1) {
+            insn.op = JSON_SCHEMA_OP_PROPERTY_DEPENDENCY;
+            json_schema_key_init(&insn.u.dependency.key, key);
+            insn.u.dependency.start = (uint32_t)program->nb_keys;
+            insn.u.dependency.count =
+                (uint32_t)c_ptr_vector_length(properties);
+
+            for (size_t i = 0; i < insn.u.dependency.count; i++) {
+                ret = json_schema_program_add_key(program,
+                                                  c_ptr_vector_entry(properties,
+                                                                     i));
+                if (ret == -1)
+                    break;
+            }
+
+            if (ret == 0)
+                ret = json_schema_program_emit(insns, &insn);
+            if (ret == -1)
+                break;
+        }
+        c_hash_table_iterator_delete(it);
+
+        if (ret == -1)
+            return -1;
+    }
+
+    return 0;
+}
+
+static int
+json_schema_program_compile_members(struct json_schema_program *program,
+                                    const struct json_object_validator *object,
+                                    struct json_schema_insn *insn) {
+    size_t nb_properties, nb_required, nb_patterns;
+    uint32_t *nodes;
+    size_t nb_nodes;
+
+    /* Compile all sub-schemas first so that the properties and patterns of
+     * this object are contiguous in their tables. */
+    nb_properties = object->properties
+                  ? c_vector_length(object->properties) : 0;
+    nb_patterns = object->pattern_properties
+                ? c_vector_length(object->pattern_properties) : 0;
+
+    nb_nodes = nb_properties + nb_patterns;
+    nodes = c_malloc((nb_nodes > 0 ? nb_nodes : 1) * sizeof(uint32_t));
+    if (!nodes)
+        return -1;
+
+    for (size_t i = 0; i < nb_properties; i++) {
+        struct json_object_validator_property *property;
+
+        property = c_vector_entry(object->properties, i);
+        if (json_schema_program_compile(program, property->schema,
+                                        &nodes[i]) == -1) {
+            goto error;
+        }
+    }
+
+    for (size_t i = 0; i < nb_patterns; i++) {
+        struct json_object_validator_pattern *pattern;
+
+        pattern = c_vector_entry(object->pattern_properties, i);
+        if (json_schema_program_compile(program, pattern->schema,
+                                        &nodes[nb_properties + i]) == -1) {
+            goto error;
+        }
+    }
+
+    insn->u.members.additional = JSON_SCHEMA_NODE_NONE;
+    insn->u.members.allow_additional = true;
+
+    if (object->additional_properties_is_schema) {
+        if (json_schema_program_compile(program,
+                                        object->additional_properties.schema,
+                                        &insn->u.members.additional) == -1) {
+            goto error;
+        }
+    } else {
+        insn->u.members.allow_additional = object->additional_properties.boolean;
+    }
+
+    /* Required keys share the entry of the property with the same name if
+     * there is one, and are numbered for the bitmap used during validation */
+    insn->u.members.properties = (uint32_t)program->nb_properties;
+
+    for (size_t i = 0; i < nb_properties; i++) {
+        struct json_object_validator_property *property;
+
+        property = c_vector_entry(object->properties, i);
+        if (json_schema_program_add_property(program, property->string,
+                                             nodes[i]) == -1) {
+            goto error;
+        }
+    }
+
+    nb_required = object->required ? c_ptr_vector_length(object->required) : 0;
+
+    for (size_t i = 0; i < nb_required; i++) {
+        struct json_schema_property *property;
+        struct json_schema_key key;
+
+        json_schema_key_init(&key, c_ptr_vector_entry(object->required, i));
+
+        property = NULL;
+        for (size_t j = 0; j < nb_properties; j++) {
+            struct json_schema_property *candidate;
+
+            candidate = program->properties + insn->u.members.properties + j;
+            if (candidate->key.hash == key.hash
+             && candidate->key.len == key.len
+             && memcmp(candidate->key.ptr, key.ptr, key.len) == 0) {
+                property = candidate;
+                break;
+            }
+        }
+
+        if (!property) {
+            if (json_schema_program_add_property(program, key.ptr,
+                                                 JSON_SCHEMA_NODE_NONE) == -1) {
+                goto error;
+            }
+
+            property = program->properties + program->nb_properties - 1;
+        }
+
+        property->required = (uint32_t)i;
+    }
+
+    insn->u.members.nb_properties =
+        (uint32_t)program->nb_properties - insn->u.members.properties;
+    insn->u.members.nb_required = (uint32_t)nb_required;
+
+    if (json_schema_program_index_properties(program, insn) == -1)
+        goto error;
+
+    insn->u.members.patterns = (uint32_t)program->nb_patterns;
+    insn->u.members.nb_patterns = (uint32_t)nb_patterns;
+
+    for (size_t i = 0; i < nb_patterns; i++) {
+        struct json_object_validator_pattern *pattern;
+
+        pattern = c_vector_entry(object->pattern_properties, i);
+        if (json_schema_program_add_pattern(program, pattern->pattern,
+                                            pattern->pattern_re,
+                                            nodes[nb_properties + i]) == -1) {
+            goto error;
+        }
+    }
+
+    c_free(nodes);
+    return 0;
+
+error:
+    c_free(nodes);
+    return -1;
+}
+
+static uint32_t
+json_schema_program_types(const struct json_generic_validator *generic) {
+    uint32_t types;
+
+    if (!generic->types)
+        return JSON_SCHEMA_ALL_TYPES;
+
+    types = 0;
+
+    for (size_t i = 0; i < c_vector_length(generic->types); i++) {
+        enum json_schema_simple_type *stype;
+
+        stype = c_vector_entry(generic->types, i);
+
+        for (int type = 0; type < JSON_NB_TYPES; type++) {
+            if (json_schema_simple_type_matches_type(*stype,
+                                                     (enum json_type)type)) {
+                types |= JSON_SCHEMA_TYPE_MASK(type);
+            }
+        }
+    }
+
+    return types;
+}
+
+static void
+json_schema_key_init(struct json_schema_key *key, const char *string) {
+    size_t len;
+
+    len = strlen(string);
+
+    key->ptr = string;
+    key->len = (uint32_t)len;
+    key->hash = json_hash_string(string, len);
+}
+
+static void *
+json_schema_program_grow(void *array, size_t *psize, size_t nb,
+                         size_t element_size) {
+    size_t size;
+
+    size = (*psize == 0) ? 8 : *psize;
+    while (size < nb)
+        size *= 2;
+
+    array = c_realloc(array, size * element_size);
+    if (!array)
+        return NULL;
+
+    *psize = size;
+    return array;
+}
+
+static int
+json_schema_program_add_node(struct json_schema_program *program,
+                             const struct json_schema_node *node,
+                             uint32_t *pindex) {
+    if (program->nb_nodes >= program->nodes_size) {
+        struct json_schema_node *nodes;
+
+        nodes = json_schema_program_grow(program->nodes, &program->nodes_size,
+                                         program->nb_nodes + 1,
+                                         sizeof(struct json_schema_node));
+        if (!nodes)
+            return -1;
+
+        program->nodes = nodes;
+    }
+
+    *pindex = (uint32_t)program->nb_nodes;
+    program->nodes[program->nb_nodes++] = *node;
+    return 0;
+}
+
+static int
+json_schema_program_add_insns(struct json_schema_program *program,
+                              const struct c_buffer *buf) {
+    size_t nb_insns;
+
+    nb_insns = c_buffer_length(buf) / sizeof(struct json_schema_insn);
+    if (nb_insns == 0)
+        return 0;
+
+    if (program->nb_insns + nb_insns > program->insns_size) {
+        struct json_schema_insn *insns;
+
+        insns = json_schema_program_grow(program->insns, &program->insns_size,
+                                         program->nb_insns + nb_insns,
+                                         sizeof(struct json_schema_insn));
+        if (!insns)
+            return -1;
+
+        program->insns = insns;
+    }
+
+    memcpy(program->insns + program->nb_insns, c_buffer_data(buf),
+           nb_insns * sizeof(struct json_schema_insn));
+    program->nb_insns += nb_insns;
+
+    return 0;
+}
+
+static int
+json_schema_program_add_refs(struct json_schema_program *program,
+                             const uint32_t *nodes, size_t nb_nodes) {
+    if (nb_nodes == 0)
+        return 0;
+
+    if (program->nb_refs + nb_nodes > program->refs_size) {
+        uint32_t *refs;
+
+        refs = json_schema_program_grow(program->refs, &program->refs_size,
+                                        program->nb_refs + nb_nodes,
+                                        sizeof(uint32_t));
+        if (!refs)
+            return -1;
+
+        program->refs = refs;
+    }
+
+    memcpy(program->refs + program->nb_refs, nodes,
+           nb_nodes * sizeof(uint32_t));
+    program->nb_refs += nb_nodes;
+
+    return 0;
+}
+
+static int
+json_schema_program_add_value(struct json_schema_program *program,
+                              struct json_value *value) {
+    if (program->nb_values >= program->values_size) {
+        struct json_value **values;
+
+        values = json_schema_program_grow(program->values,
+                                          &program->values_size,
+                                          program->nb_values + 1,
+                                          sizeof(struct json_value *));
+        if (!values)
+            return -1;
+
+        program->values = values;
+    }
+
+    program->values[program->nb_values++] = value;
+    return 0;
+}
+
+static int
+json_schema_program_add_key(struct json_schema_program *program,
+                            const char *string) {
+    if (program->nb_keys >= program->keys_size) {
+        struct json_schema_key *keys;
+
+        keys = json_schema_program_grow(program->keys, &program->keys_size,
+                                        program->nb_keys + 1,
+                                        sizeof(struct json_schema_key));
+        if (!keys)
+            return -1;
+
+        program->keys = keys;
+    }
+
+    json_schema_key_init(&program->keys[program->nb_keys++], string);
+    return 0;
+}
+
+static int
+json_schema_program_add_property(struct json_schema_program *program,
+                                 const char *string, uint32_t node) {
+    struct json_schema_property *property;
+
+    if (program->nb_properties >= program->properties_size) {
+        struct json_schema_property *properties;
+
+        properties = json_schema_program_grow(program->properties,
+                                              &program->properties_size,
+                                              program->nb_properties + 1,
+                                              sizeof(struct json_schema_property));
+        if (!properties)
+            return -1;
+
+        program->properties = properties;
+    }
+
+    property = &program->properties[program->nb_properties++];
+
+    json_schema_key_init(&property->key, string);
+    property->node = node;
+    property->required = JSON_SCHEMA_NODE_NONE;
+
+    return 0;
+}
+
+static int
+json_schema_program_add_pattern(struct json_schema_program *program,
+                                const char *string,
+                                const struct json_schema_re *re,
+                                uint32_t node) {
+    struct json_schema_pattern *pattern;
+
+    if (program->nb_patterns >= program->patterns_size) {
+        struct json_schema_pattern *patterns;
+
+        patterns = json_schema_program_grow(program->patterns,
+                                            &program->patterns_size,
+                                            program->nb_patterns + 1,
+                                            sizeof(struct json_schema_pattern));
+        if (!patterns)
+            return -1;
+
+        program->patterns = patterns;
+    }
+
+    pattern = &program->patterns[program->nb_patterns++];
+
+    pattern->string = string;
+    pattern->re = re;
+    pattern->node = node;
+
+    return 0;
+}
+
+static int
+json_schema_program_index_properties(struct json_schema_program *program,
+                                     struct json_schema_insn *insn) {
+    const struct json_schema_property *properties;
+    uint32_t *index;
+    size_t size, mask;
+
+    insn->u.members.index = (uint32_t)program->nb_index;
+    insn->u.members.index_size = 0;
+
+    if (insn->u.members.nb_properties == 0)
+        return 0;
+
+    /* Keep the load factor under 50% */
+    size = 1;
+    while (size < (size_t)insn->u.members.nb_properties * 2)
+        size *= 2;
+
+    if (program->nb_index + size > program->index_size) {
+        index = json_schema_program_grow(program->index, &program->index_size,
+                                         program->nb_index + size,
+                                         sizeof(uint32_t));
+        if (!index)
+            return -1;
+
+        program->index = index;
+    }
+
+    index = program->index + program->nb_index;
+    memset(index, 0, size * sizeof(uint32_t));
+
+    properties = program->properties + insn->u.members.properties;
+    mask = size - 1;
+
+    for (uint32_t i = 0; i < insn->u.members.nb_properties; i++) {
+        size_t slot;
+
+        slot = properties[i].key.hash & mask;
+        while (index[slot] != 0)
+            slot = (slot + 1) & mask;
+
+        index[slot] = i + 1;
+    }
+
+    program->nb_index += size;
+
+    insn->u.members.index_size = (uint32_t)size;
+    return 0;
+}
+
+static int
+json_schema_program_index_branches(struct json_schema_program *program) {
+    if (program->nb_refs == 0)
+        return 0;
+
+    program->branches = c_malloc0(program->nb_refs
+                                  * sizeof(struct json_schema_branch));
+    if (!program->branches)
+        return -1;
+
+    for (size_t i = 0; i < program->nb_insns; i++) {
+        const struct json_schema_insn *insn;
+
+        insn = program->insns + i;
+        if (insn->op != JSON_SCHEMA_OP_ANY_OF
+         && insn->op != JSON_SCHEMA_OP_ONE_OF) {
+            continue;
+        }
+
+        for (uint32_t j = 0; j < insn->u.range.count; j++) {
+            uint32_t ref;
+
+            ref = insn->u.range.start + j;
+            json_schema_branch_init(program->branches + ref, program,
+                                    program->refs[ref]);
+        }
+    }
+
+    return 0;
+}
+
+static void
+json_schema_branch_init(struct json_schema_branch *branch,
+                        const struct json_schema_program *program,
+                        uint32_t index) {
+    const struct json_schema_node *node;
+
+    node = program->nodes + index;
+
+    branch->types = node->types;
+
+    /* Look for a required member whose schema is an enumeration of a
+     * single value, as found in tagged unions: objects without this exact
+     * member cannot match the branch. */
+    for (uint32_t i = node->insns[JSON_OBJECT + 1];
+         i < node->insns[JSON_OBJECT + 2]; i++) {
+        const struct json_schema_property *properties;
+        const struct json_schema_insn *insn;
+
+        insn = program->insns + i;
+        if (insn->op != JSON_SCHEMA_OP_MEMBERS)
+            continue;
+
+        properties = program->properties + insn->u.members.properties;
+
+        for (uint32_t j = 0; j < insn->u.members.nb_properties; j++) {
+            const struct json_schema_property *property;
+            const struct json_schema_node *pnode;
+
+            property = properties + j;
+            if (property->required == JSON_SCHEMA_NODE_NONE
+             || property->node == JSON_SCHEMA_NODE_NONE) {
+                continue;
+            }
+
+            pnode = program->nodes + property->node;
+
+            for (uint32_t k = pnode->insns[0]; k < pnode->insns[1]; k++) {
+                const struct json_schema_insn *pinsn;
+
+                pinsn = program->insns + k;
+                if (pinsn->op == JSON_SCHEMA_OP_ENUM
+                 && pinsn->u.range.count == 1) {
+                    branch->key = property->key;
+                    branch->value = program->values[pinsn->u.range.start];
+                    return;
+                }
+            }
+        }
+    }
+}
+
+static int
+json_schema_program_emit(struct c_buffer *buf,
+                         const struct json_schema_insn *insn) {
+    return c_buffer_add(buf, insn, sizeof(struct json_schema_insn));
+}
+
+/* ------------------------------------------------------------------------
+ *  Execution
+ * ------------------------------------------------------------------------ */
+int
+json_schema_program_check(const struct json_schema_program *program,
+                          uint32_t index, const struct json_value *value) {
+    struct json_schema_check check;
+
+    json_schema_check_init(&check, program, JSON_SCHEMA_CHECK_FIRST_ERROR);
+    return json_schema_check_node(&check, index, value);
+}
+
+void
+json_schema_check_init(struct json_schema_check *check,
+                       const struct json_schema_program *program,
+                       enum json_schema_check_mode mode) {
+    memset(check, 0, sizeof(struct json_schema_check));
+
+    check->program = program;
+    check->mode = mode;
+}
+
+int
+json_schema_check_node(struct json_schema_check *check, uint32_t index,
+                       const struct json_value *value) {
+    const struct json_schema_program *program;
+    const struct json_schema_node *node;
+    const struct json_schema_insn *insns;
+    uint32_t start, end;
+    int ret;
+
+    program = check->program;
+
+    node = program->nodes + index;
+    insns = program->insns;
+
+    if (!(node->types & JSON_SCHEMA_TYPE_MASK(value->type))) {
+        return json_schema_check_error(check, JSON_SCHEMA_ERROR_TYPE, "type",
+                                       "value does not match 'type' "
+                                       "constraint");
+    }
+
+    /* When collecting all errors, the remaining instructions of a node are
+     * still run after a failure, until the error budget is exhausted. */
+    ret = 0;
+
+    for (uint32_t i = node->insns[0]; i < node->insns[1]; i++) {
+        if (json_schema_program_exec(check, insns + i, value) == -1) {
+            ret = -1;
+            if (!json_schema_check_continue(check))
+                return -1;
+        }
+    }
+
+    start = node->insns[value->type + 1];
+    end = node->insns[value->type + 2];
+
+    for (uint32_t i = start; i < end; i++) {
+        if (json_schema_program_exec(check, insns + i, value) == -1) {
+            ret = -1;
+            if (!json_schema_check_continue(check))
+                return -1;
+        }
+    }
+
+    return ret;
+}
+
+static int
+json_schema_check_branch(struct json_schema_check *check,
+                         const struct json_schema_insn *insn, uint32_t i,
+                         const struct json_value *value) {
+    const struct json_schema_program *program;
+    const struct json_schema_branch *branch;
+    uint32_t ref;
+
+    program = check->program;
+
+    ref = insn->u.range.start + i;
+    branch = program->branches + ref;
+
+    /* Branches which cannot match are skipped without being run */
+    if (!(branch->types & JSON_SCHEMA_TYPE_MASK(value->type)))
+        return -1;
+
+    if (branch->key.ptr && value->type == JSON_OBJECT) {
+        const struct json_schema_key *key;
+        size_t idx;
+
+        key = &branch->key;
+
+        if (!json_object_find(&value->u.object, key->ptr, key->len,
+                              key->hash, &idx)) {
+            return -1;
+        }
+
+        if (!json_value_equal(value->u.object.values[idx],
+                              (struct json_value *)branch->value)) {
+            return -1;
+        }
+    }
+
+    return json_schema_check_speculative(check, program->refs[ref], value);
+}
+
+static int
+json_schema_check_speculative(struct json_schema_check *check,
+                              uint32_t index, const struct json_value *value) {
+    enum json_schema_check_mode mode;
+    int ret;
+
+    /* Failures in the branches of anyOf, oneOf and not do not make the
+     * value invalid by themselves: they are neither recorded nor
+     * formatted. */
+    mode = check->mode;
+    check->mode = JSON_SCHEMA_CHECK_VALID;
+
+    ret = json_schema_check_node(check, index, value);
+
+    check->mode = mode;
+    return ret;
+}
+
+static int
+json_schema_check_error(struct json_schema_check *check,
+                        enum json_schema_error_code code,
+                        const char *keyword, const char *fmt, ...) {
+    struct json_schema_error *error;
+    va_list ap;
+
+    switch (check->mode) {
+    case JSON_SCHEMA_CHECK_FIRST_ERROR: {
+        char *message;
+
+        va_start(ap, fmt);
+        if (c_vasprintf(&message, fmt, ap) == -1) {
+            va_end(ap);
+            return -1;
+        }
+        va_end(ap);
+
+        c_set_error("%s", message);
+        c_free(message);
+        break;
+    }
+
+    case JSON_SCHEMA_CHECK_VALID:
+        break;
+
+    case JSON_SCHEMA_CHECK_ALL_ERRORS:
+        if (check->nb_errors >= check->max_errors)
+            break;
+
+        error = check->errors + check->nb_errors++;
+
+        error->code = code;
+        error->pointer = c_strdup("");
+        c_asprintf(&error->schema_path, "/%s", keyword);
+        break;
+    }
+
+    return -1;
+}
+
+static bool
+json_schema_check_continue(const struct json_schema_check *check) {
+    return check->mode == JSON_SCHEMA_CHECK_ALL_ERRORS
+        && !check->failed && check->nb_errors < check->max_errors;
+}
+
+static int
+json_schema_check_fail(struct json_schema_check *check) {
+    /* Errors which are not validation failures, e.g. a regular expression
+     * which cannot be executed, stop validation in all modes. */
+    check->failed = true;
+    return -1;
+}
+
+static void
+json_schema_check_prefix(struct json_schema_check *check, size_t start,
+                         const char *segment, size_t segment_len,
+                         const char *keyword,
+                         const char *name, size_t name_len) {
+    struct c_buffer *pointer, *schema_path;
+
+    /* Paths are built from the innermost failure outwards: each level
+     * prepends its segments to the errors recorded below it. */
+    if (check->mode != JSON_SCHEMA_CHECK_ALL_ERRORS
+     || start == check->nb_errors) {
+        return;
+    }
+
+    pointer = c_buffer_new();
+    schema_path = c_buffer_new();
+
+    if (segment)
+        json_pointer_append_token(pointer, segment, segment_len);
+
+    if (keyword)
+        c_buffer_add_printf(schema_path, "/%s", keyword);
+    if (name)
+        json_pointer_append_token(schema_path, name, name_len);
+
+    for (size_t i = start; i < check->nb_errors; i++) {
+        struct json_schema_error *error;
+        char *string;
+
+        error = check->errors + i;
+
+        c_asprintf(&string, "%.*s%s",
+                   (int)c_buffer_length(pointer), c_buffer_data(pointer),
+                   error->pointer);
+        c_free(error->pointer);
+        error->pointer = string;
+
+        c_asprintf(&string, "%.*s%s",
+                   (int)c_buffer_length(schema_path),
+                   c_buffer_data(schema_path), error->schema_path);
+        c_free(error->schema_path);
+        error->schema_path = string;
+    }
+
+    c_buffer_delete(pointer);
+    c_buffer_delete(schema_path);
+}
+
+/* Children of a large value are checked in chunks by the threads of the
+ * pool, each with its own check. Each chunk stops at its first failure, or
+ * as soon as a failure is known before its next child, so that the first
+ * failing child is always found and reported as if children were checked
+ * in order. */
+struct json_schema_parallel_chunk {
+    size_t failure; /* index of the first failing child, or SIZE_MAX */
+    char *message;
+    bool failed;
+};
+
+struct json_schema_parallel {
+    const struct json_schema_check *check;
+    const struct json_schema_insn *insn;
+    const struct json_value *value;
+    json_schema_check_function function;
+
+    size_t nb_children;
+    size_t chunk_size;
+
+    size_t first_failure; /* updated atomically */
+
+    struct json_schema_parallel_chunk *chunks;
+};
+
+static bool
+json_schema_check_is_parallel(const struct json_schema_check *check,
+                              size_t nb_children) {
+    return check->pool && check->mode != JSON_SCHEMA_CHECK_ALL_ERRORS
+        && nb_children >= JSON_SCHEMA_PARALLEL_MIN_ITEMS;
+}
+
+static int
+json_schema_check_parallel(struct json_schema_check *check,
+                           const struct json_schema_insn *insn,
+                           const struct json_value *value,
+                           size_t nb_children, size_t min_chunk_size,
+                           json_schema_check_function function) {
+    struct json_schema_parallel parallel;
+    size_t nb_chunks;
+    int ret;
+
+    memset(&parallel, 0, sizeof(struct json_schema_parallel));
+
+    parallel.check = check;
+    parallel.insn = insn;
+    parallel.value = value;
+    parallel.function = function;
+    parallel.nb_children = nb_children;
+    parallel.first_failure = SIZE_MAX;
+
+    /* A few chunks per thread balance the load when children have
+     * different sizes. */
+    parallel.chunk_size = nb_children
+                        / (json_schema_pool_nb_threads(check->pool) * 4);
+    if (parallel.chunk_size < min_chunk_size)
+        parallel.chunk_size = min_chunk_size;
+
+    nb_chunks = (nb_children + parallel.chunk_size - 1) / parallel.chunk_size;
+
+    parallel.chunks = c_malloc0(nb_chunks
+                                * sizeof(struct json_schema_parallel_chunk));
+    if (!parallel.chunks)
+        return json_schema_check_fail(check);
+
+    json_schema_pool_run(check->pool, json_schema_check_parallel_task,
+                         &parallel, nb_chunks);
+
+    ret = 0;
+
+    for (size_t i = 0; i < nb_chunks; i++) {
+        struct json_schema_parallel_chunk *chunk;
+
+        chunk = parallel.chunks + i;
+
+        if (ret == 0 && chunk->failure != SIZE_MAX) {
+            if (chunk->failed)
+                check->failed = true;
+
+            if (chunk->message)
+                c_set_error("%s", chunk->message);
+
+            ret = -1;
+        }
+
+        c_free(chunk->message);
+    }
+
+    c_free(parallel.chunks);
+    return ret;
+}
+
+static void
+json_schema_check_parallel_task(void *arg, size_t index) {
+    struct json_schema_parallel *parallel;
+    struct json_schema_parallel_chunk *chunk;
+    struct json_schema_check check;
+    size_t start, end;
+
+    parallel = arg;
+    chunk = parallel->chunks + index;
+
+    chunk->failure = SIZE_MAX;
+
+    start = index * parallel->chunk_size;
+    end = start + parallel->chunk_size;
+    if (end > parallel->nb_children)
+        end = parallel->nb_children;
+
+    json_schema_check_init(&check, parallel->check->program,
+                           parallel->check->mode);
+    check.pool = parallel->check->pool;
+
+    for (size_t i = start; i < end; i++) {
+        size_t first_failure;
+
+        first_failure = __atomic_load_n(&parallel->first_failure,
+                                        __ATOMIC_RELAXED);
+        if (first_failure < i)
+            break;
+
+        if (parallel->function(&check, parallel->insn, parallel->value,
+                               i) == 0) {
+            continue;
+        }
+
+        chunk->failure = i;
+        chunk->failed = check.failed;
+
+        if (check.mode == JSON_SCHEMA_CHECK_FIRST_ERROR || check.failed)
+            chunk->message = c_strdup(c_get_error());
+
+        while (i < first_failure) {
+            if (__atomic_compare_exchange_n(&parallel->first_failure,
+                                            &first_failure, i, false,
+                                            __ATOMIC_RELAXED,
+                                            __ATOMIC_RELAXED)) {
+                break;
+            }
+        }
+
+        break;
+    }
+}
+
+static int
+json_schema_program_exec(struct json_schema_check *check,
+                         const struct json_schema_insn *insn,
+                         const struct json_value *value) {
+#ifdef JSON_SCHEMA_PROFILE
+    struct json_schema_profile_frame frame;
+    int ret;
+
+    json_schema_profile_enter(&frame);
+    ret = json_schema_program_exec_insn(check, insn, value);
+    json_schema_profile_leave(&frame, insn->op);
+
+    return ret;
+#else
+    return json_schema_program_exec_insn(check, insn, value);
+#endif
+}
+
+static int
+json_schema_program_exec_insn(struct json_schema_check *check,
+                              const struct json_schema_insn *insn,
+                              const struct json_value *value) {
+    const struct json_schema_program *program;
+    bool is_valid;
+    size_t start;
+    int ret;
+
+    program = check->program;
+
+    switch (insn->op) {
+    /* Generic */
+    case JSON_SCHEMA_OP_ENUM:
+        for (uint32_t i = 0; i < insn->u.range.count; i++) {
+            struct json_value *evalue;
+
+            evalue = program->values[insn->u.range.start + i];
+            if (json_value_equal(evalue, (struct json_value *)value))
+                return 0;
+        }
+
+        return json_schema_check_error(check, JSON_SCHEMA_ERROR_ENUM, "enum",
+                                       "value does not match 'enum' "
+                                       "constraint");
+
+    case JSON_SCHEMA_OP_ALL_OF: {
+        size_t nb_children;
+
+        /* Branches are only worth checking in parallel on large values */
+        nb_children = 0;
+        if (value->type == JSON_ARRAY) {
+            nb_children = value->u.array.nb_elements;
+        } else if (value->type == JSON_OBJECT) {
+            nb_children = value->u.object.nb_members;
+        }
+
+        if (insn->u.range.count > 1
+         && json_schema_check_is_parallel(check, nb_children)) {
+            return json_schema_check_parallel(check, insn, value,
+                                              insn->u.range.count, 1,
+                                              json_schema_program_check_all_of);
+        }
+
+        ret = 0;
+
+        for (uint32_t i = 0; i < insn->u.range.count; i++) {
+            if (json_schema_program_check_all_of(check, insn, value, i) == 0)
+                continue;
+
+            ret = -1;
+            if (!json_schema_check_continue(check))
+                break;
+        }
+
+        return ret;
+    }
+
+    case JSON_SCHEMA_OP_ANY_OF:
+        for (uint32_t i = 0; i < insn->u.range.count; i++) {
+            if (json_schema_check_branch(check, insn, i, value) == 0)
+                return 0;
+            if (check->failed)
+                return -1;
+        }
+
+        return json_schema_check_error(check, JSON_SCHEMA_ERROR_ANY_OF,
+                                       "anyOf", "value does not match "
+                                       "'anyOf' constraint");
+
+    case JSON_SCHEMA_OP_ONE_OF: {
+        size_t nb_matches;
+
+        nb_matches = 0;
+
+        /* There is no need to look further than a second match */
+        for (uint32_t i = 0; i < insn->u.range.count; i++) {
+            if (json_schema_check_branch(check, insn, i, value) == 0) {
+                if (++nb_matches > 1)
+                    break;
+            }
+
+            if (check->failed)
+                return -1;
+        }
+
+        if (nb_matches != 1) {
+            return json_schema_check_error(check, JSON_SCHEMA_ERROR_ONE_OF,
+                                           "oneOf", "value does not match "
+                                           "'oneOf' constraint");
+        }
+
+        return 0;
+    }
+
+    case JSON_SCHEMA_OP_NOT:
+        if (json_schema_check_speculative(check, insn->u.node, value) == 0) {
+            return json_schema_check_error(check, JSON_SCHEMA_ERROR_NOT,
+                                           "not", "value does not match "
+                                           "'not' constraint");
+        }
+
+        if (check->failed)
+            return -1;
+
+        return 0;
+
+    case JSON_SCHEMA_OP_FORMAT:
+        if (value->type != JSON_STRING)
+            return 0;
+
+        if (!json_schema_format_check(insn->u.format, value->u.string.ptr,
+                                      value->u.string.len)) {
+            return json_schema_check_error(check, JSON_SCHEMA_ERROR_FORMAT,
+                                           "format", "string does not match "
+                                           "format '%s'",
+                                           insn->u.format->name);
+        }
+
+        return 0;
+
+    /* Numeric */
+    case JSON_SCHEMA_OP_MULTIPLE_OF_INTEGER:
+    case JSON_SCHEMA_OP_MULTIPLE_OF_REAL:
+        if (insn->op == JSON_SCHEMA_OP_MULTIPLE_OF_INTEGER) {
+            is_valid = json_schema_value_is_multiple_of_integer(value,
+                                                                insn->u.integer.value);
+        } else {
+            is_valid = json_schema_value_is_multiple_of_real(value,
+                                                             insn->u.real.value);
+        }
+
+        if (!is_valid) {
+            return json_schema_check_error(check,
+                                           JSON_SCHEMA_ERROR_MULTIPLE_OF,
+                                           "multipleOf",
+                                           "value does not match "
+                                           "'multipleOf' constraint");
+        }
+
+        return 0;
+
+    case JSON_SCHEMA_OP_MIN_INTEGER:
+    case JSON_SCHEMA_OP_MIN_REAL:
+        if (insn->op == JSON_SCHEMA_OP_MIN_INTEGER) {
+            is_valid = json_schema_value_gt_integer(value,
+                                                    insn->u.integer.value,
+                                                    insn->u.integer.exclusive);
+        } else {
+            is_valid = json_schema_value_gt_real(value, insn->u.real.value,
+                                                 insn->u.real.exclusive);
+        }
+
+        if (!is_valid) {
+            return json_schema_check_error(check, JSON_SCHEMA_ERROR_MINIMUM,
+                                           "minimum", "number too small");
+        }
+
+        return 0;
+
+    case JSON_SCHEMA_OP_MAX_INTEGER:
+    case JSON_SCHEMA_OP_MAX_REAL:
+        if (insn->op == JSON_SCHEMA_OP_MAX_INTEGER) {
+            is_valid = json_schema_value_lt_integer(value,
+                                                    insn->u.integer.value,
+                                                    insn->u.integer.exclusive);
+        } else {
+            is_valid = json_schema_value_lt_real(value, insn->u.real.value,
+                                                 insn->u.real.exclusive);
+        }
+
+        if (!is_valid) {
+            return json_schema_check_error(check, JSON_SCHEMA_ERROR_MAXIMUM,
+                                           "maximum", "number too large");
+        }
+
+        return 0;
+
+    /* String */
+    case JSON_SCHEMA_OP_LENGTH: {
+        size_t length;
+
+        /* FIXME c_utf8_nb_codepoints() stops at the first U+0000 character.
+         * Add a function that counts using a pointer and size. */
+        if (c_utf8_nb_codepoints(value->u.string.ptr, &length) == -1) {
+            c_set_error("invalid string: %s", c_get_error());
+            return json_schema_check_fail(check);
+        }
+
+        if (length < insn->u.length.min) {
+            return json_schema_check_error(check,
+                                           JSON_SCHEMA_ERROR_MIN_LENGTH,
+                                           "minLength", "string too short");
+        }
+
+        if (length > insn->u.length.max) {
+            return json_schema_check_error(check,
+                                           JSON_SCHEMA_ERROR_MAX_LENGTH,
+                                           "maxLength", "string too long");
+        }
+
+        return 0;
+    }
+
+    case JSON_SCHEMA_OP_PATTERN: {
+        bool match;
+
+        if (json_schema_re_exec(insn->u.re,
+                                value->u.string.ptr, value->u.string.len,
+                                &match) == -1) {
+            return json_schema_check_fail(check);
+        }
+
+        if (!match) {
+            return json_schema_check_error(check, JSON_SCHEMA_ERROR_PATTERN,
+                                           "pattern",
+                                           "string does not match pattern");
+        }
+
+        return 0;
+    }
+
+    /* Array */
+    case JSON_SCHEMA_OP_MIN_ITEMS:
+        if (value->u.array.nb_elements < insn->u.size) {
+            return json_schema_check_error(check, JSON_SCHEMA_ERROR_MIN_ITEMS,
+                                           "minItems",
+                                           "array contains too few elements");
+        }
+
+        return 0;
+
+    case JSON_SCHEMA_OP_MAX_ITEMS:
+        if (value->u.array.nb_elements > insn->u.size) {
+            return json_schema_check_error(check, JSON_SCHEMA_ERROR_MAX_ITEMS,
+                                           "maxItems",
+                                           "array contains too many "
+                                           "elements");
+        }
+
+        return 0;
+
+    case JSON_SCHEMA_OP_UNIQUE_ITEMS: {
+        bool unique;
+
+        if (json_schema_value_has_unique_elements(value, &unique) == -1)
+            return json_schema_check_fail(check);
+
+        if (!unique) {
+            return json_schema_check_error(check,
+                                           JSON_SCHEMA_ERROR_UNIQUE_ITEMS,
+                                           "uniqueItems",
+                                           "array elements are not unique");
+        }
+
+        return 0;
+    }
+
+    case JSON_SCHEMA_OP_ITEMS:
+        if (json_schema_check_is_parallel(check,
+                                          value->u.array.nb_elements)) {
+            return json_schema_check_parallel(check, insn, value,
+                                              value->u.array.nb_elements,
+                                              JSON_SCHEMA_PARALLEL_MIN_CHUNK,
+                                              json_schema_program_check_item);
+        }
+
+        ret = 0;
+
+        for (size_t i = 0; i < value->u.array.nb_elements; i++) {
+            if (json_schema_program_check_item(check, insn, value, i) == 0)
+                continue;
+
+            ret = -1;
+            if (!json_schema_check_continue(check))
+                break;
+        }
+
+        return ret;
+
+    case JSON_SCHEMA_OP_TUPLE_ITEMS:
+        return json_schema_program_check_tuple(check, insn, value);
+
+    /* Object */
+    case JSON_SCHEMA_OP_MIN_PROPERTIES:
+        if (value->u.object.nb_members < insn->u.size) {
+            return json_schema_check_error(check,
+                                           JSON_SCHEMA_ERROR_MIN_PROPERTIES,
+                                           "minProperties",
+                                           "object contains too few members");
+        }
+
+        return 0;
+
+    case JSON_SCHEMA_OP_MAX_PROPERTIES:
+        if (value->u.object.nb_members > insn->u.size) {
+            return json_schema_check_error(check,
+                                           JSON_SCHEMA_ERROR_MAX_PROPERTIES,
+                                           "maxProperties",
+                                           "object contains too many "
+                                           "members");
+        }
+
+        return 0;
+
+    case JSON_SCHEMA_OP_MEMBERS:
+        return json_schema_program_check_members(check, insn, value);
+
+    case JSON_SCHEMA_OP_SCHEMA_DEPENDENCY: {
+        const struct json_schema_key *key;
+        size_t idx;
+
+        key = &insn->u.dependency.key;
+
+        if (!json_object_find(&value->u.object, key->ptr, key->len,
+                              key->hash, &idx)) {
+            return 0;
+        }
+
+        start = check->nb_errors;
+
+        if (json_schema_check_node(check, insn->u.dependency.node,
+                                   value) == 0) {
+            return 0;
+        }
+
+        if (check->mode == JSON_SCHEMA_CHECK_FIRST_ERROR) {
+            c_set_error("object contains member '%s' but does not match "
+                        "the associated schema dependency", key->ptr);
+            return -1;
+        }
+
+        json_schema_check_prefix(check, start, NULL, 0,
+                                 "dependencies", key->ptr, key->len);
+        return -1;
+    }
+
+    case JSON_SCHEMA_OP_PROPERTY_DEPENDENCY: {
+        const struct json_schema_key *key, *keys;
+        size_t idx;
+
+        key = &insn->u.dependency.key;
+
+        if (!json_object_find(&value->u.object, key->ptr, key->len,
+                              key->hash, &idx)) {
+            return 0;
+        }
+
+        keys = program->keys + insn->u.dependency.start;
+
+        for (uint32_t i = 0; i < insn->u.dependency.count; i++) {
+            if (json_object_find(&value->u.object, keys[i].ptr, keys[i].len,
+                                 keys[i].hash, &idx)) {
+                continue;
+            }
+
+            start = check->nb_errors;
+
+            json_schema_check_error(check, JSON_SCHEMA_ERROR_DEPENDENCIES,
+                                    "dependencies",
+                                    "object has member '%s' but does not "
+                                    "have member '%s'",
+                                    key->ptr, keys[i].ptr);
+
+            if (check->nb_errors > start) {
+                struct json_schema_error *error;
+
+                error = check->errors + start;
+
+                c_free(error->schema_path);
+                c_asprintf(&error->schema_path, "/%u", i);
+
+                json_schema_check_prefix(check, start, NULL, 0,
+                                         "dependencies", key->ptr, key->len);
+            }
+
+            return -1;
+        }
+
+        return 0;
+    }
+    }
+
+    return 0;
+}
+
+static int
+json_schema_program_check_tuple(struct json_schema_check *check,
+                                const struct json_schema_insn *insn,
+                                const struct json_value *value) {
+    const struct json_schema_program *program;
+    const uint32_t *refs;
+    size_t nb_schemas;
+    int ret;
+
+    program = check->program;
+
+    refs = program->refs + insn->u.tuple.start;
+    nb_schemas = insn->u.tuple.count;
+
+    ret = 0;
+
+    for (size_t i = 0; i < value->u.array.nb_elements; i++) {
+        char index[32];
+        size_t start;
+        uint32_t node;
+
+        snprintf(index, sizeof(index), "%zu", i);
+
+        start = check->nb_errors;
+
+        if (i < nb_schemas) {
+            node = refs[i];
+        } else if (insn->u.tuple.additional != JSON_SCHEMA_NODE_NONE) {
+            node = insn->u.tuple.additional;
+        } else if (!insn->u.tuple.allow_additional) {
+            json_schema_check_error(check, JSON_SCHEMA_ERROR_ADDITIONAL_ITEMS,
+                                    "additionalItems",
+                                    "array contains additional items");
+            json_schema_check_prefix(check, start, index, strlen(index),
+                                     NULL, NULL, 0);
+            return -1;
+        } else {
+            break;
+        }
+
+        if (json_schema_check_node(check, node,
+                                   value->u.array.elements[i]) == 0) {
+            continue;
+        }
+
+        if (check->mode == JSON_SCHEMA_CHECK_FIRST_ERROR) {
+            c_set_error("array element %zu does not match "
+                        "'%s' constraint: %s", i,
+                        (i < nb_schemas) ? "items" : "additionalItems",
+                        c_get_error());
+            return -1;
+        }
+
+        if (i < nb_schemas) {
+            json_schema_check_prefix(check, start, index, strlen(index),
+                                     "items", index, strlen(index));
+        } else {
+            json_schema_check_prefix(check, start, index, strlen(index),
+                                     "additionalItems", NULL, 0);
+        }
+
+        ret = -1;
+        if (!json_schema_check_continue(check))
+            break;
+    }
+
+    return ret;
+}
+
+static int
+json_schema_program_check_members(struct json_schema_check *check,
+                                  const struct json_schema_insn *insn,
+                                  const struct json_value *value) {
+    const struct json_schema_program *program;
+    const struct json_object *object;
+    uint64_t required_bits[4], *required;
+    size_t nb_required_words, nb_required_found;
+    bool parallel;
+    int ret;
+
+    program = check->program;
+    object = &value->u.object;
+
+    /* Members are checked by the threads of the pool before the required
+     * members are looked for, so that the first error is the same as when
+     * checking them one at a time. */
+    parallel = json_schema_check_is_parallel(check, object->nb_members);
+    if (parallel) {
+        if (json_schema_check_parallel(check, insn, value, object->nb_members,
+                                       JSON_SCHEMA_PARALLEL_MIN_CHUNK,
+                                       json_schema_program_check_member) == -1) {
+            return -1;
+        }
+    }
+
+    /* Required members found are recorded in a bitmap, so that 'required'
+     * is checked during the same pass over the members as 'properties', and
+     * duplicate keys are only counted once. */
+    nb_required_words = (insn->u.members.nb_required + 63) / 64;
+    if (nb_required_words <= 4) {
+        required = required_bits;
+    } else {
+        required = c_malloc(nb_required_words * sizeof(uint64_t));
+        if (!required)
+            return json_schema_check_fail(check);
+    }
+
+    memset(required, 0, nb_required_words * sizeof(uint64_t));
+    nb_required_found = 0;
+
+    ret = 0;
+
+    for (size_t i = 0; i < object->nb_members; i++) {
+        const struct json_schema_property *property;
+        const struct json_object_key *key;
+
+        key = object->keys + i;
+
+        property = json_schema_program_find_property(program, insn,
+                                                     key->key->ptr, key->len,
+                                                     key->hash);
+        if (property) {
+            json_schema_program_mark_required(required, &nb_required_found,
+                                              property);
+        }
+
+        if (parallel)
+            continue;
+
+        if (json_schema_program_check_member_property(check, insn, value, i,
+                                                      property) == 0) {
+            continue;
+        }
+
+        ret = -1;
+        if (!json_schema_check_continue(check))
+            goto end;
+    }
+
+    if (nb_required_found < insn->u.members.nb_required) {
+        const struct json_schema_property *properties;
+
+        ret = -1;
+
+        if (check->mode != JSON_SCHEMA_CHECK_ALL_ERRORS) {
+            json_schema_check_error(check, JSON_SCHEMA_ERROR_REQUIRED,
+                                    "required", "object does not contain "
+                                    "required members");
+            goto end;
+        }
+
+        /* Each missing member is reported with the position of its name in
+         * the 'required' array. */
+        properties = program->properties + insn->u.members.properties;
+
+        for (uint32_t i = 0; i < insn->u.members.nb_properties; i++) {
+            const struct json_schema_property *property;
+            size_t start;
+            uint32_t bit;
+
+            property = properties + i;
+            bit = property->required;
+
+            if (bit == JSON_SCHEMA_NODE_NONE
+             || (required[bit / 64] & ((uint64_t)1 << (bit % 64)))) {
+                continue;
+            }
+
+            if (check->nb_errors >= check->max_errors)
+                break;
+
+            start = check->nb_errors;
+
+            json_schema_check_error(check, JSON_SCHEMA_ERROR_REQUIRED,
+                                    "required", "object does not contain "
+                                    "required members");
+
+            c_free(check->errors[start].schema_path);
+            c_asprintf(&check->errors[start].schema_path, "/required/%u",
+                       bit);
+        }
+    }
+
+end:
+    if (required != required_bits)
+        c_free(required);
+
+    return ret;
+}
+
+static int
+json_schema_program_check_member(struct json_schema_check *check,
+                                 const struct json_schema_insn *insn,
+                                 const struct json_value *value, size_t i) {
+    const struct json_schema_property *property;
+    const struct json_object_key *key;
+
+    key = value->u.object.keys + i;
+
+    property = json_schema_program_find_property(check->program, insn,
+                                                 key->key->ptr, key->len,
+                                                 key->hash);
+
+    return json_schema_program_check_member_property(check, insn, value, i,
+                                                     property);
+}
+
+static int
+json_schema_program_check_member_property(struct json_schema_check *check,
+                                          const struct json_schema_insn *insn,
+                                          const struct json_value *value,
+                                          size_t i,
+                                          const struct json_schema_property *property) {
+    const struct json_schema_pattern *patterns;
+    const struct json_object_key *key;
+    struct json_value *mvalue;
+    bool matched;
+    size_t start;
+    int ret;
+
+    patterns = check->program->patterns + insn->u.members.patterns;
+
+    key = value->u.object.keys + i;
+    mvalue = value->u.object.values[i];
+
+    matched = false;
+    ret = 0;
+
+    /* properties */
+    if (property && property->node != JSON_SCHEMA_NODE_NONE) {
+        matched = true;
+        start = check->nb_errors;
+
+        if (json_schema_check_node(check, property->node, mvalue) == -1) {
+            if (check->mode == JSON_SCHEMA_CHECK_FIRST_ERROR) {
+                c_set_error("object member %zu does not match "
+                            "'properties' constraint: %s",
+                            i, c_get_error());
+                return -1;
+            }
+
+            json_schema_check_prefix(check, start, key->key->ptr, key->len,
+                                     "properties", key->key->ptr, key->len);
+            ret = -1;
+            if (!json_schema_check_continue(check))
+                return -1;
+        }
+    }
+
+    /* patternProperties */
+    for (uint32_t j = 0; j < insn->u.members.nb_patterns; j++) {
+        bool match;
+
+        if (json_schema_re_exec(patterns[j].re, key->key->ptr, key->len,
+                                &match) == -1) {
+            return json_schema_check_fail(check);
+        }
+
+        if (!match)
+            continue;
+
+        matched = true;
+        start = check->nb_errors;
+
+        if (json_schema_check_node(check, patterns[j].node, mvalue) == -1) {
+            if (check->mode == JSON_SCHEMA_CHECK_FIRST_ERROR) {
+                c_set_error("object member %zu does not match "
+                            "'patternProperties' constraint: %s",
+                            i, c_get_error());
+                return -1;
+            }
+
+            json_schema_check_prefix(check, start, key->key->ptr, key->len,
+                                     "patternProperties", patterns[j].string,
+                                     strlen(patterns[j].string));
+            ret = -1;
+        }
+
+        break;
+    }
+
+    if (matched)
+        return ret;
+
+    /* additionalProperties */
+    start = check->nb_errors;
+
+    if (insn->u.members.additional != JSON_SCHEMA_NODE_NONE) {
+        if (json_schema_check_node(check, insn->u.members.additional,
+                                   mvalue) == 0) {
+            return 0;
+        }
+
+        if (check->mode == JSON_SCHEMA_CHECK_FIRST_ERROR) {
+            c_set_error("object member %zu does not match "
+                        "'additionalProperties' constraint: %s",
+                        i, c_get_error());
+            return -1;
+        }
+
+        json_schema_check_prefix(check, start, key->key->ptr, key->len,
+                                 "additionalProperties", NULL, 0);
+        return -1;
+    } else if (!insn->u.members.allow_additional) {
+        json_schema_check_error(check,
+                                JSON_SCHEMA_ERROR_ADDITIONAL_PROPERTIES,
+                                "additionalProperties",
+                                "object contains additional members");
+        json_schema_check_prefix(check, start, key->key->ptr, key->len,
+                                 NULL, NULL, 0);
+        return -1;
+    }
+
+    return 0;
+}
+
+static int
+json_schema_program_check_all_of(struct json_schema_check *check,
+                                 const struct json_schema_insn *insn,
+                                 const struct json_value *value, size_t i) {
+    const uint32_t *refs;
+    char index[32];
+    size_t start;
+
+    refs = check->program->refs + insn->u.range.start;
+    start = check->nb_errors;
+
+    if (json_schema_check_node(check, refs[i], value) == 0)
+        return 0;
+
+    if (check->mode == JSON_SCHEMA_CHECK_FIRST_ERROR) {
+        c_set_error("value does not match 'allOf' constraint");
+        return -1;
+    }
+
+    snprintf(index, sizeof(index), "%zu", i);
+    json_schema_check_prefix(check, start, NULL, 0,
+                             "allOf", index, strlen(index));
+    return -1;
+}
+
+static int
+json_schema_program_check_item(struct json_schema_check *check,
+                               const struct json_schema_insn *insn,
+                               const struct json_value *value, size_t i) {
+    char index[32];
+    size_t start;
+
+    start = check->nb_errors;
+
+    if (json_schema_check_node(check, insn->u.node,
+                               value->u.array.elements[i]) == 0) {
+        return 0;
+    }
+
+    if (check->mode == JSON_SCHEMA_CHECK_FIRST_ERROR) {
+        c_set_error("array element %zu does not match 'items' "
+                    "constraint: %s", i, c_get_error());
+        return -1;
+    }
+
+    snprintf(index, sizeof(index), "%zu", i);
+    json_schema_check_prefix(check, start, index, strlen(index),
+                             "items", NULL, 0);
+    return -1;
+}
+
+static const struct json_schema_property *
+json_schema_program_find_property(const struct json_schema_program *program,
+                                  const struct json_schema_insn *insn,
+                                  const char *key, size_t len, uint32_t hash) {
+    const struct json_schema_property *properties;
+    const uint32_t *index;
+    size_t mask;
+
+    if (insn->u.members.index_size == 0)
+        return NULL;
+
+    properties = program->properties + insn->u.members.properties;
+    index = program->index + insn->u.members.index;
+    mask = insn->u.members.index_size - 1;
+
+    for (size_t slot = hash & mask; index[slot] != 0;
+         slot = (slot + 1) & mask) {
+        const struct json_schema_property *property;
+
+        property = properties + index[slot] - 1;
+
+        if (property->key.hash == hash && property->key.len == len
+         && memcmp(property->key.ptr, key, len) == 0) {
+            return property;
+        }
+    }
+
+    return NULL;
+}
+
+static void
+json_schema_program_mark_required(uint64_t *required,
+                                  size_t *p_nb_required_found,
+                                  const struct json_schema_property *property) {
+    uint64_t *word, bit;
+
+    if (property->required == JSON_SCHEMA_NODE_NONE)
+        return;
+
+    word = required + property->required / 64;
+    bit = (uint64_t)1 << (property->required % 64);
+
+    if (!(*word & bit)) {
+        *word |= bit;
+        (*p_nb_required_found)++;
+    }
+}
+
+/* ------------------------------------------------------------------------
+ *  Streaming
+ * ------------------------------------------------------------------------ */
+int
+json_schema_frame_init(struct json_schema_frame *frame,
+                       const struct json_schema_program *program,
+                       uint32_t index, enum json_type type) {
+    const struct json_schema_node *node;
+    size_t nb_required_words;
+
+    node = program->nodes + index;
+
+    memset(frame, 0, sizeof(struct json_schema_frame));
+
+    frame->type = type;
+    frame->max_children = SIZE_MAX;
+    frame->required = frame->required_bits;
+
+    /* Generic constraints and constraints on the content of the container
+     * as a whole need the complete value. */
+    if (node->insns[0] != node->insns[1])
+        return 0;
+
+    for (uint32_t i = node->insns[type + 1]; i < node->insns[type + 2]; i++) {
+        const struct json_schema_insn *insn;
+
+        insn = program->insns + i;
+
+        switch (insn->op) {
+        case JSON_SCHEMA_OP_MIN_ITEMS:
+        case JSON_SCHEMA_OP_MIN_PROPERTIES:
+            frame->min_children = insn->u.size;
+            break;
+
+        case JSON_SCHEMA_OP_MAX_ITEMS:
+        case JSON_SCHEMA_OP_MAX_PROPERTIES:
+            frame->max_children = insn->u.size;
+            break;
+
+        case JSON_SCHEMA_OP_ITEMS:
+        case JSON_SCHEMA_OP_TUPLE_ITEMS:
+        case JSON_SCHEMA_OP_MEMBERS:
+            frame->insn = insn;
+            break;
+
+        default:
+            return 0;
+        }
+    }
+
+    if (frame->insn && frame->insn->op == JSON_SCHEMA_OP_MEMBERS) {
+        nb_required_words = (frame->insn->u.members.nb_required + 63) / 64;
+        if (nb_required_words > 4) {
+            frame->required = c_malloc(nb_required_words * sizeof(uint64_t));
+            if (!frame->required)
+                return -1;
+        }
+
+        memset(frame->required, 0, nb_required_words * sizeof(uint64_t));
+    }
+
+    return 1;
+}
+
+void
+json_schema_frame_free(struct json_schema_frame *frame) {
+    if (frame->required != frame->required_bits)
+        c_free(frame->required);
+}
+
+int
+json_schema_frame_member(struct json_schema_frame *frame,
+                         const struct json_schema_program *program,
+                         const char *key, size_t len, uint32_t hash,
+                         struct json_schema_child *child) {
+    const struct json_schema_insn *insn;
+    const struct json_schema_property *property;
+    const struct json_schema_pattern *patterns;
+
+    child->node = JSON_SCHEMA_NODE_NONE;
+    child->constraint = NULL;
+    child->pattern_node = JSON_SCHEMA_NODE_NONE;
+
+    if (++frame->nb_children > frame->max_children) {
+        c_set_error("object contains too many members");
+        return -1;
+    }
+
+    insn = frame->insn;
+    if (!insn)
+        return 0;
+
+    /* required/properties */
+    property = json_schema_program_find_property(program, insn,
+                                                 key, len, hash);
+    if (property) {
+        json_schema_program_mark_required(frame->required,
+                                          &frame->nb_required_found,
+                                          property);
+
+        if (property->node != JSON_SCHEMA_NODE_NONE) {
+            child->node = property->node;
+            child->constraint = "properties";
+        }
+    }
+
+    /* patternProperties */
+    patterns = program->patterns + insn->u.members.patterns;
+
+    for (uint32_t i = 0; i < insn->u.members.nb_patterns; i++) {
+        bool match;
+
+        if (json_schema_re_exec(patterns[i].re, key, len, &match) == -1)
+            return -1;
+
+        if (!match)
+            continue;
+
+        if (child->node == JSON_SCHEMA_NODE_NONE) {
+            child->node = patterns[i].node;
+            child->constraint = "patternProperties";
+        } else {
+            child->pattern_node = patterns[i].node;
+        }
+
+        break;
+    }
+
+    if (child->node != JSON_SCHEMA_NODE_NONE)
+        return 0;
+
+    /* additionalProperties */
+    if (insn->u.members.additional != JSON_SCHEMA_NODE_NONE) {
+        child->node = insn->u.members.additional;
+        child->constraint = "additionalProperties";
+    } else if (!insn->u.members.allow_additional) {
+        c_set_error("object contains additional members");
+        return -1;
+    }
+
+    return 0;
+}
+
+int
+json_schema_frame_element(struct json_schema_frame *frame,
+                          const struct json_schema_program *program,
+                          struct json_schema_child *child) {
+    const struct json_schema_insn *insn;
+    size_t i;
+
+    child->node = JSON_SCHEMA_NODE_NONE;
+    child->constraint = NULL;
+    child->pattern_node = JSON_SCHEMA_NODE_NONE;
+
+    i = frame->nb_children++;
+    if (frame->nb_children > frame->max_children) {
+        c_set_error("array contains too many elements");
+        return -1;
+    }
+
+    insn = frame->insn;
+    if (!insn)
+        return 0;
+
+    if (insn->op == JSON_SCHEMA_OP_ITEMS) {
+        child->node = insn->u.node;
+        child->constraint = "items";
+    } else if (i < insn->u.tuple.count) {
+        child->node = program->refs[insn->u.tuple.start + i];
+        child->constraint = "items";
+    } else if (insn->u.tuple.additional != JSON_SCHEMA_NODE_NONE) {
+        child->node = insn->u.tuple.additional;
+        child->constraint = "additionalItems";
+    } else if (!insn->u.tuple.allow_additional) {
+        c_set_error("array contains additional items");
+        return -1;
+    }
+
+    return 0;
+}
+
+int
+json_schema_frame_end(const struct json_schema_frame *frame) {
+    if (frame->nb_children < frame->min_children) {
+        if (frame->type == JSON_OBJECT) {
+            c_set_error("object contains too few members");
+        } else {
+            c_set_error("array contains too few elements");
+        }
+
+        return -1;
+    }
+
+    if (frame->insn && frame->insn->op == JSON_SCHEMA_OP_MEMBERS
+     && frame->nb_required_found < frame->insn->u.members.nb_required) {
+        c_set_error("object does not contain required members");
+        return -1;
+    }
+
+    return 0;
+}
+
+static bool
+json_schema_value_is_multiple_of_integer(const struct json_value *value,
+                                         int64_t integer) {
+    assert(value->type == JSON_INTEGER || value->type == JSON_REAL);
+
+    if (value->type == JSON_INTEGER) {
+        return ((value->u.integer % integer) == 0);
+    } else if (value->type == JSON_REAL) {
+        if (value->u.real > (double)INT64_MAX
+         || value->u.real < (double)INT64_MIN
+         || trunc(value->u.real) != value->u.real) {
+            return false;
+        }
+
+        return (((int64_t)value->u.real % integer) == 0);
+    }
+
+    return false;
+}
+
+static bool
+json_schema_value_is_multiple_of_real(const struct json_value *value,
+                                      double real) {
+    assert(value->type == JSON_INTEGER || value->type == JSON_REAL);
+
+
+    if (value->type == JSON_INTEGER) {
+        double ratio;
+
+        /* FIXME */
+        ratio = (double)value->u.integer / real;
+        return (trunc(ratio) == ratio);
+    } else if (value->type == JSON_REAL) {
+        double ratio;
+
+        ratio = value->u.real / real;
+        return (trunc(ratio) == ratio);
+    }
+
+    return false;
+}
+
+static int
+json_schema_value_has_unique_elements(const struct json_value *value,
+                                      bool *punique) {
+    struct json_value **elements;
+    uint32_t *hashes;
+    size_t *slots;
+    size_t nb_elements, nb_slots;
+
+    elements = value->u.array.elements;
+    nb_elements = value->u.array.nb_elements;
+
+    *punique = true;
+
+    if (nb_elements <= JSON_SCHEMA_UNIQUE_ITEMS_THRESHOLD) {
+        for (size_t i = 0; i < nb_elements; i++) {
+            for (size_t j = i + 1; j < nb_elements; j++) {
+                if (json_value_equal(elements[i], elements[j])) {
+                    *punique = false;
+                    return 0;
+                }
+            }
+        }
+
+        return 0;
+    }
+
+    /* Elements are inserted in an open addressing table of element
+     * positions plus one; values are only compared when their hashes are
+     * equal. */
+    nb_slots = 1;
+    while (nb_slots < nb_elements * 2)
+        nb_slots *= 2;
+
+    slots = c_malloc0(nb_slots * sizeof(size_t));
+    if (!slots)
+        return -1;
+
+    hashes = c_malloc(nb_elements * sizeof(uint32_t));
+    if (!hashes) {
+        c_free(slots);
+        return -1;
+    }
+
+    for (size_t i = 0; *punique && i < nb_elements; i++) {
+        size_t slot;
+
+        hashes[i] = json_value_hash(elements[i]);
+
+        slot = hashes[i] & (nb_slots - 1);
+        while (slots[slot] > 0) {
+            size_t j;
+
+            j = slots[slot] - 1;
+            if (hashes[j] == hashes[i]
+             && json_value_equal(elements[j], elements[i])) {
+                *punique = false;
+                break;
+            }
+
+            slot = (slot + 1) & (nb_slots - 1);
+        }
+
+        slots[slot] = i + 1;
+    }
+
+    c_free(hashes);
+    c_free(slots);
+    return 0;
+}
+
+static bool
+json_schema_value_lt_integer(const struct json_value *value, int64_t integer,
+                             bool exclusive) {
+    assert(value->type == JSON_INTEGER || value->type == JSON_REAL);
+
+    if (value->type == JSON_INTEGER) {
+        if (exclusive) {
+            return value->u.integer < integer;
+        } else {
+            return value->u.integer <= integer;
+        }
+    } else if (value->type == JSON_REAL) {
+        /* FIXME */
+        if (exclusive) {
+            return (int64_t)value->u.real < integer;
+        } else {
+            return (int64_t)value->u.real <= integer;
+        }
+    }
+
+    return false;
+}
+
+static bool
+json_schema_value_gt_integer(const struct json_value *value, int64_t integer,
+                             bool exclusive) {
+    assert(value->type == JSON_INTEGER || value->type == JSON_REAL);
+
+    if (value->type == JSON_INTEGER) {
+        if (exclusive) {
+            return value->u.integer > integer;
+        } else {
+            return value->u.integer >= integer;
+        }
+    } else if (value->type == JSON_REAL) {
+        if (exclusive) {
+            /* FIXME */
+            return (int64_t)value->u.real > integer;
+        } else {
+            return (int64_t)value->u.real >= integer;
+        }
+    }
+
+    return false;
+}
+
+static bool
+json_schema_value_lt_real(const struct json_value *value, double real,
+                          bool exclusive) {
+    assert(value->type == JSON_INTEGER || value->type == JSON_REAL);
+
+    if (value->type == JSON_INTEGER) {
+        if (exclusive) {
+            return (double)value->u.integer < real;
+        } else {
+            return (double)value->u.integer <= real;
+        }
+    } else if (value->type == JSON_REAL) {
+        if (exclusive) {
+            return value->u.real < real;
+        } else {
+            return value->u.real <= real;
+        }
+    }
+
+    return false;
+}
+
+static bool
+json_schema_value_gt_real(const struct json_value *value, double real,
+                          bool exclusive) {
+    assert(value->type == JSON_INTEGER || value->type == JSON_REAL);
+
+    if (value->type == JSON_INTEGER) {
+        if (exclusive) {
+            return (double)value->u.integer > real;
+        } else {
+            return (double)value->u.integer >= real;
+        }
+    } else if (value->type == JSON_REAL) {
+        if (exclusive) {
+            return value->u.real > real;
+        } else {
+            return value->u.real >= real;
+        }
+    }
+
+    return false;
+}
@@ -0,0 +1,271 @@
+/*
+ * Copyright (c) 2015 Nicolas Martyanoff
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+
+#include "internal.h"
+
+static void json_projection_node_free(struct json_projection_node *);
+static struct json_projection_node *
+json_projection_node_add_child(struct json_projection_node *,
+                               const struct json_pointer_token *);
+static int json_projection_read_path_token(const char **, struct c_buffer *);
+
+struct json_projection *
+json_projection_new(void) {
+    struct json_projection *projection;
+
+    projection = c_malloc0(sizeof(struct json_projection));
+
+    projection->root.index = SIZE_MAX;
+    projection->root.target = -1;
+
+    return projection;
+}
+
+void
+json_projection_delete(struct json_projection *projection) {
+    if (!projection)
+        return;
+
+    json_projection_node_free(&projection->root);
+
+    c_free0(projection, sizeof(struct json_projection));
+}
+
+size_t
+json_projection_nb_targets(const struct json_projection *projection) {
+    return projection->nb_targets;
+}
+
+int
+json_projection_add_pointer(struct json_projection *projection,
+                            const char *string) {
+    struct json_projection_node *node;
+    struct json_pointer *pointer;
+
+    pointer = json_pointer_compile(string);
+    if (!pointer)
+        return -1;
+
+    node = &projection->root;
+
+    for (size_t i = 0; i < pointer->nb_tokens; i++) {
+        const struct json_pointer_token *token;
+        struct json_projection_node *child;
+
+        token = pointer->tokens + i;
+
+        if (token->end) {
+            c_set_error("json pointer designates the end of an array");
+            json_pointer_delete(pointer);
+            return -1;
+        }
+
+        child = json_projection_node_child(node, token->string, token->len);
+        if (!child)
+            child = json_projection_node_add_child(node, token);
+
+        node = child;
+    }
+
+    json_pointer_delete(pointer);
+
+    if (node->target == -1) {
+        if (projection->nb_targets >= INT_MAX) {
+            c_set_error("too many values in projection");
+            return -1;
+        }
+
+        node->target = (int)projection->nb_targets++;
+    }
+
+    return node->target;
+}
+
+int
+json_projection_add_path(struct json_projection *projection,
+                         const char *path) {
+    struct c_buffer *buf;
+    const char *ptr;
+    int target;
+
+    /* Simple paths made of member names and array indexes are translated
+     * to json pointers: "$.a['b'][0]" is "/a/b/0". */
+    if (*path != '$') {
+        c_set_error("json path does not start with '$'");
+        return -1;
+    }
+
+    buf = c_buffer_new();
+
+    ptr = path + 1;
+    while (*ptr != '\0') {
+        if (json_projection_read_path_token(&ptr, buf) == -1) {
+            c_buffer_delete(buf);
+            return -1;
+        }
+    }
+
+    c_buffer_add(buf, "", 1);
+
+    target = json_projection_add_pointer(projection, c_buffer_data(buf));
+
+    c_buffer_delete(buf);
+    return target;
+}
+
+struct json_projection_node *
+json_projection_node_child(const struct json_projection_node *node,
+                           const char *key, size_t len) {
+    for (size_t i = 0; i < node->nb_children; i++) {
+        struct json_projection_node *child;
+
+        child = node->children[i];
+        if (child->len == len && memcmp(child->key, key, len) == 0)
+            return child;
+    }
+
+    return NULL;
+}
+
+struct json_projection_node *
+json_projection_node_element(const struct json_projection_node *node,
+                             size_t index) {
+    for (size_t i = 0; i < node->nb_children; i++) {
+        if (node->children[i]->index == index)
+            return node->children[i];
+    }
+
+    return NULL;
+}
+
+static void
+json_projection_node_free(struct json_projection_node *node) {
+    for (size_t i = 0; i < node->nb_children; i++) {
+        struct json_projection_node *child;
+
+        child = node->children[i];
+
+        json_projection_node_free(child);
+        c_free0(child, sizeof(struct json_projection_node));
+    }
+
+    c_free(node->children);
+    c_free(node->key);
+}
+
+static struct json_projection_node *
+json_projection_node_add_child(struct json_projection_node *node,
+                               const struct json_pointer_token *token) {
+    struct json_projection_node *child;
+    size_t nb_children;
+
+    child = c_malloc0(sizeof(struct json_projection_node));
+
+    child->key = c_malloc(token->len + 1);
+    memcpy(child->key, token->string, token->len);
+    child->key[token->len] = '\0';
+    child->len = token->len;
+
+    child->index = token->index;
+    child->target = -1;
+
+    nb_children = node->nb_children + 1;
+    node->children = c_realloc(node->children, nb_children
+                               * sizeof(struct json_projection_node *));
+    node->children[node->nb_children++] = child;
+
+    return child;
+}
+
+static int
+json_projection_read_path_token(const char **pptr, struct c_buffer *buf) {
+    const char *ptr, *start;
+    size_t len;
+
+    ptr = *pptr;
+
+    if (*ptr == '.') {
+        ptr++;
+
+        start = ptr;
+        while (*ptr != '\0' && *ptr != '.' && *ptr != '[')
+            ptr++;
+
+        len = (size_t)(ptr - start);
+        if (len == 0 || (len == 1 && *start == '*')) {
+            c_set_error("invalid member name in json path");
+            return -1;
+        }
+
+        json_pointer_append_token(buf, start, len);
+    } else if (*ptr == '[' && (ptr[1] == '\'' || ptr[1] == '"')) {
+        char quote, *name;
+
+        quote = ptr[1];
+        ptr += 2;
+
+        /* Quoted names are unescaped in a temporary string */
+        name = c_malloc(strlen(ptr) + 1);
+        len = 0;
+
+        while (*ptr != quote) {
+            if (*ptr == '\\' && ptr[1] != '\0')
+                ptr++;
+
+            if (*ptr == '\0') {
+                c_set_error("truncated member name in json path");
+                c_free(name);
+                return -1;
+            }
+
+            name[len++] = *ptr++;
+        }
+
+        if (ptr[1] != ']') {
+            c_set_error("invalid member name in json path");
+            c_free(name);
+            return -1;
+        }
+
+        ptr += 2;
+
+        json_pointer_append_token(buf, name, len);
+        c_free(name);
+    } else if (*ptr == '[') {
+        ptr++;
+
+        start = ptr;
+        while (*ptr >= '0' && *ptr <= '9')
+            ptr++;
+
+        len = (size_t)(ptr - start);
+        if (len == 0 || *ptr != ']') {
+            c_set_error("invalid array index in json path");
+            return -1;
+        }
+
+        ptr++;
+
+        json_pointer_append_token(buf, start, len);
+    } else {
+        c_set_error("invalid character '%c' in json path", *ptr);
+        return -1;
+    }
+
+    *pptr = ptr;
+    return 0;
+}
@@ -0,0 +1,455 @@
+/*
+ * Copyright (c) 2015 Nicolas Martyanoff
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include "internal.h"
+
+/* Most patterns found in schemas are either literal strings, possibly
+ * anchored, or a single anchored character class such as "^[0-9a-f]{8}$".
+ * These are matched directly; other patterns are compiled by PCRE and
+ * studied with the JIT compiler when it is available.
+ *
+ * The built-in matcher follows PCRE semantics: '$' also matches before a
+ * newline ending the string. Character classes only contain ASCII
+ * characters, so that counting bytes is the same as counting characters in
+ * matching strings. */
+
+static bool json_schema_re_parse_simple(struct json_schema_re *,
+                                        const char *);
+static bool json_schema_re_parse_literal(struct json_schema_re *,
+                                         const char *, size_t);
+static bool json_schema_re_parse_class(struct json_schema_re *,
+                                       const char *, size_t);
+static bool json_schema_re_parse_quantifier(struct json_schema_re *,
+                                            const char *, size_t);
+static bool json_schema_re_parse_escape(char, uint8_t *);
+
+static void json_schema_re_class_add(uint8_t *, unsigned char,
+                                     unsigned char);
+static bool json_schema_re_class_has(const uint8_t *, unsigned char);
+static bool json_schema_re_is_meta(char);
+static bool json_schema_re_is_escapable(char);
+
+static bool json_schema_re_match_literal(const struct json_schema_re *,
+                                         const char *, size_t);
+static bool json_schema_re_match_class(const struct json_schema_re *,
+                                       const char *, size_t);
+
+struct json_schema_re *
+json_schema_re_compile(const char *pattern) {
+    struct json_schema_re *re;
+    const char *error;
+    int flags, error_offset;
+
+    re = c_malloc0(sizeof(struct json_schema_re));
+    if (!re)
+        return NULL;
+
+    if (json_schema_re_parse_simple(re, pattern))
+        return re;
+
+    memset(re, 0, sizeof(struct json_schema_re));
+    re->type = JSON_SCHEMA_RE_PCRE;
+
+    flags = PCRE_UTF8 | PCRE_JAVASCRIPT_COMPAT;
+
+    re->re = pcre_compile(pattern, flags, &error, &error_offset, NULL);
+    if (!re->re) {
+        c_set_error("cannot compile regex: %s", error);
+        c_free(re);
+        return NULL;
+    }
+
+    /* pcre_study() returns NULL without error if there is nothing to
+     * optimize, and falls back to the interpreter if JIT compilation is not
+     * supported. */
+    re->extra = pcre_study(re->re, PCRE_STUDY_JIT_COMPILE, &error);
+    if (!re->extra && error) {
+        c_set_error("cannot study regex: %s", error);
+        json_schema_re_delete(re);
+        return NULL;
+    }
+
+    return re;
+}
+
+void
+json_schema_re_delete(struct json_schema_re *re) {
+    if (!re)
+        return;
+
+    if (re->type == JSON_SCHEMA_RE_PCRE) {
+        if (re->extra)
+            pcre_free_study(re->extra);
+        pcre_free(re->re);
+    } else if (re->type == JSON_SCHEMA_RE_LITERAL) {
+        c_free(re->u.literal.ptr);
+    }
+
+    c_free0(re, sizeof(struct json_schema_re));
+}
+
+int
+json_schema_re_exec(const struct json_schema_re *re,
+                    const char *string, size_t length, bool *pmatch) {
+    int ret, offset, flags;
+
+    switch (re->type) {
+    case JSON_SCHEMA_RE_LITERAL:
+        *pmatch = json_schema_re_match_literal(re, string, length);
+        return 0;
+
+    case JSON_SCHEMA_RE_CLASS:
+        *pmatch = json_schema_re_match_class(re, string, length);
+        return 0;
+
+    case JSON_SCHEMA_RE_PCRE:
+        break;
+    }
+
+    if (length > INT_MAX) {
+        c_set_error("string too long");
+        return -1;
+    }
+
+    offset = 0;
+    flags = 0;
+
+    ret = pcre_exec(re->re, re->extra, string, (int)length, offset, flags,
+                    NULL, 0);
+    if (ret < 0) {
+        if (ret == PCRE_ERROR_NOMATCH) {
+            *pmatch = false;
+            return 0;
+        } else {
+            c_set_error("cannot execute regex: %d", ret);
+            return -1;
+        }
+    }
+
+    *pmatch = true;
+    return 0;
+}
+
+static bool
+json_schema_re_parse_simple(struct json_schema_re *re, const char *pattern) {
+    const char *ptr;
+    size_t len;
+
+    ptr = pattern;
+    len = strlen(pattern);
+
+    if (len > 0 && ptr[0] == '^') {
+        re->anchored_start = true;
+        ptr++;
+        len--;
+    }
+
+    if (len > 0 && ptr[len - 1] == '$'
+     && (len < 2 || ptr[len - 2] != '\\')) {
+        re->anchored_end = true;
+        len--;
+    }
+
+    if (json_schema_re_parse_literal(re, ptr, len))
+        return true;
+
+    if (re->anchored_start && re->anchored_end
+     && json_schema_re_parse_class(re, ptr, len)) {
+        return true;
+    }
+
+    return false;
+}
+
+static bool
+json_schema_re_parse_literal(struct json_schema_re *re,
+                             const char *ptr, size_t len) {
+    char *literal;
+    size_t literal_len;
+
+    literal = c_malloc(len + 1);
+    if (!literal)
+        return false;
+
+    literal_len = 0;
+
+    for (size_t i = 0; i < len; i++) {
+        if (ptr[i] == '\\') {
+            if (i + 1 >= len || !json_schema_re_is_escapable(ptr[i + 1]))
+                goto not_literal;
+
+            literal[literal_len++] = ptr[++i];
+        } else if (json_schema_re_is_meta(ptr[i])) {
+            goto not_literal;
+        } else {
+            literal[literal_len++] = ptr[i];
+        }
+    }
+
+    literal[literal_len] = '\0';
+
+    re->type = JSON_SCHEMA_RE_LITERAL;
+    re->u.literal.ptr = literal;
+    re->u.literal.len = literal_len;
+
+    return true;
+
+not_literal:
+    c_free(literal);
+    return false;
+}
+
+static bool
+json_schema_re_parse_class(struct json_schema_re *re,
+                           const char *ptr, size_t len) {
+    uint8_t *class;
+    size_t i;
+
+    class = re->u.class.bits;
+    memset(class, 0, sizeof(re->u.class.bits));
+
+    if (len >= 2 && ptr[0] == '\\') {
+        /* \d or \w */
+        if (!json_schema_re_parse_escape(ptr[1], class))
+            return false;
+
+        i = 2;
+    } else if (len >= 1 && ptr[0] == '[') {
+        i = 1;
+
+        /* Negated classes match non-ASCII characters */
+        if (i < len && ptr[i] == '^')
+            return false;
+
+        while (i < len && ptr[i] != ']') {
+            unsigned char c, last;
+
+            if (ptr[i] == '\\') {
+                if (i + 1 >= len)
+                    return false;
+
+                if (json_schema_re_parse_escape(ptr[i + 1], class)) {
+                    i += 2;
+                    continue;
+                }
+
+                if (!json_schema_re_is_escapable(ptr[i + 1]))
+                    return false;
+
+                c = (unsigned char)ptr[i + 1];
+                i += 2;
+            } else if (ptr[i] == '[') {
+                return false;
+            } else {
+                c = (unsigned char)ptr[i];
+                i++;
+            }
+
+            if (c >= 0x80)
+                return false;
+
+            last = c;
+
+            if (i + 1 < len && ptr[i] == '-' && ptr[i + 1] != ']') {
+                last = (unsigned char)ptr[i + 1];
+                if (last == '\\' || last == '[' || last >= 0x80 || last < c)
+                    return false;
+
+                i += 2;
+            }
+
+            json_schema_re_class_add(class, c, last);
+        }
+
+        if (i >= len)
+            return false;
+
+        i++; /* ']' */
+    } else {
+        return false;
+    }
+
+    if (!json_schema_re_parse_quantifier(re, ptr + i, len - i))
+        return false;
+
+    re->type = JSON_SCHEMA_RE_CLASS;
+    return true;
+}
+
+static bool
+json_schema_re_parse_quantifier(struct json_schema_re *re,
+                                const char *ptr, size_t len) {
+    size_t min, max;
+    char *end;
+
+    if (len == 0) {
+        min = 1;
+        max = 1;
+    } else if (len == 1 && ptr[0] == '+') {
+        min = 1;
+        max = SIZE_MAX;
+    } else if (len == 1 && ptr[0] == '*') {
+        min = 0;
+        max = SIZE_MAX;
+    } else if (len == 1 && ptr[0] == '?') {
+        min = 0;
+        max = 1;
+    } else if (ptr[0] == '{' && ptr[len - 1] == '}') {
+        /* {n}, {n,} or {n,m} */
+        if (!isdigit((unsigned char)ptr[1]))
+            return false;
+
+        errno = 0;
+        min = (size_t)strtoul(ptr + 1, &end, 10);
+        if (errno)
+            return false;
+
+        if (*end == '}') {
+            max = min;
+        } else if (*end == ',' && end[1] == '}') {
+            max = SIZE_MAX;
+            end++;
+        } else if (*end == ',' && isdigit((unsigned char)end[1])) {
+            max = (size_t)strtoul(end + 1, &end, 10);
+            if (errno || max < min)
+                return false;
+        } else {
+            return false;
+        }
+
+        if (end != ptr + len - 1)
+            return false;
+    } else {
+        return false;
+    }
+
+    re->u.class.min = min;
+    re->u.class.max = max;
+
+    return true;
+}
+
+static bool
+json_schema_re_parse_escape(char c, uint8_t *class) {
+    if (c == 'd') {
+        json_schema_re_class_add(class, '0', '9');
+    } else if (c == 'w') {
+        json_schema_re_class_add(class, 'a', 'z');
+        json_schema_re_class_add(class, 'A', 'Z');
+        json_schema_re_class_add(class, '0', '9');
+        json_schema_re_class_add(class, '_', '_');
+    } else {
+        return false;
+    }
+
+    return true;
+}
+
+static void
+json_schema_re_class_add(uint8_t *class, unsigned char first,
+                         unsigned char last) {
+    for (unsigned int c = first; c <= last; c++)
+        class[c / 8] |= (uint8_t)(1u << (c % 8));
+}
+
+static bool
+json_schema_re_class_has(const uint8_t *class, unsigned char c) {
+    if (c >= 0x80)
+        return false;
+
+    return (class[c / 8] & (1u << (c % 8))) != 0;
+}
+
+static bool
+json_schema_re_is_meta(char c) {
+    return c != '\0' && strchr("\\^$.|?*+()[]{}", c) != NULL;
+}
+
+static bool
+json_schema_re_is_escapable(char c) {
+    /* Escaped punctuation characters are always literal */
+    return c > 0 && ispunct((unsigned char)c);
+}
+
+static bool
+json_schema_re_match_literal(const struct json_schema_re *re,
+                             const char *string, size_t length) {
+    const char *literal;
+    size_t len;
+
+    literal = re->u.literal.ptr;
+    len = re->u.literal.len;
+
+    if (re->anchored_end) {
+        /* '$' also matches before a final newline */
+        if (length > 0 && string[length - 1] == '\n') {
+            if (re->anchored_start) {
+                if (length - 1 == len && memcmp(string, literal, len) == 0)
+                    return true;
+            } else if (length - 1 >= len
+                    && memcmp(string + length - 1 - len, literal, len) == 0) {
+                return true;
+            }
+        }
+
+        if (re->anchored_start)
+            return length == len && memcmp(string, literal, len) == 0;
+
+        return length >= len
+            && memcmp(string + length - len, literal, len) == 0;
+    }
+
+    if (re->anchored_start)
+        return length >= len && memcmp(string, literal, len) == 0;
+
+    if (len == 0)
+        return true;
+
+    for (size_t i = 0; i + len <= length; i++) {
+        if (string[i] == literal[0] && memcmp(string + i, literal, len) == 0)
+            return true;
+    }
+
+    return false;
+}
+
+static bool
+json_schema_re_match_class(const struct json_schema_re *re,
+                           const char *string, size_t length) {
+    size_t i;
+
+    for (i = 0; i < length; i++) {
+        if (!json_schema_re_class_has(re->u.class.bits,
+                                      (unsigned char)string[i])) {
+            break;
+        }
+    }
+
+    /* '$' also matches before a final newline */
+    if (i + 1 == length && string[i] == '\n')
+        length--;
+
+    if (i < length)
+        return false;
+
+    if (length >= re->u.class.min && length <= re->u.class.max)
+        return true;
+
+    /* The class matched the final newline, but a shorter match followed by
+     * the newline is valid too. */
+    return length > 0 && string[length - 1] == '\n'
+        && length - 1 >= re->u.class.min && length - 1 <= re->u.class.max;
+}
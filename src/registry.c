@@ -0,0 +1,504 @@
+/*
+ * Copyright (c) 2015 Nicolas Martyanoff
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <fcntl.h>
+#include <pthread.h>
+#include <unistd.h>
+
+#include "internal.h"
+
+/* The registry holds compiled schemas by uri. Documents are only parsed
+ * and compiled again when their content changes; documents referencing a
+ * document which changed are then resolved again from their JSON value.
+ *
+ * Schemas returned by json_schema_registry_get() are references: they stay
+ * valid when the registry loads a new version of the document, and can be
+ * used from any thread. */
+
+struct json_schema_registry_entry {
+    char *uri;
+    uint64_t hash; /* content the document was read from */
+
+    struct json_schema_document document;
+};
+
+/* Documents being loaded, innermost first */
+struct json_schema_registry_load {
+    const char *uri;
+    struct json_schema_registry_load *parent;
+};
+
+struct json_schema_registry {
+    struct c_hash_table *entries; /* uri -> entry */
+
+    json_schema_loader loader;
+    void *loader_data;
+
+    struct json_schema_registry_load *loading;
+
+    pthread_rwlock_t lock;
+};
+
+static struct json_schema_registry_entry *
+json_schema_registry_lookup(struct json_schema_registry *, const char *);
+static int json_schema_registry_load(struct json_schema_registry *,
+                                     const char *, const char *, size_t);
+static int
+json_schema_registry_replace(struct json_schema_registry *,
+                             struct json_schema_registry_entry *,
+                             struct json_schema_document *);
+static char *json_schema_registry_read(struct json_schema_registry *,
+                                       const char *, size_t *);
+static char *json_schema_registry_read_file(const char *, size_t *);
+static char *json_schema_registry_resolve_uri(const char *, const char *);
+static uint64_t json_schema_registry_hash(const char *, size_t);
+
+static void
+json_schema_registry_entry_delete(struct json_schema_registry_entry *);
+
+struct json_schema_registry *
+json_schema_registry_new(void) {
+    struct json_schema_registry *registry;
+
+    registry = c_malloc0(sizeof(struct json_schema_registry));
+
+    registry->entries = c_hash_table_new(c_hash_string, c_equal_string);
+
+    pthread_rwlock_init(&registry->lock, NULL);
+
+    return registry;
+}
+
+void
+json_schema_registry_delete(struct json_schema_registry *registry) {
+    struct json_schema_registry_entry *entry;
+    struct c_hash_table_iterator *it;
+    char *uri;
+
+    if (!registry)
+        return;
+
+    it = c_hash_table_iterate(registry->entries);
+    while (c_hash_table_iterator_next(it, (void **)&uri,
+                                      (void **)&entry) == 1) {
+        json_schema_registry_entry_delete(entry);
+    }
+    c_hash_table_iterator_delete(it);
+
+    c_hash_table_delete(registry->entries);
+
+    pthread_rwlock_destroy(&registry->lock);
+
+    c_free0(registry, sizeof(struct json_schema_registry));
+}
+
+void
+json_schema_registry_set_loader(struct json_schema_registry *registry,
+                                json_schema_loader loader, void *data) {
+    pthread_rwlock_wrlock(&registry->lock);
+
+    registry->loader = loader;
+    registry->loader_data = data;
+
+    pthread_rwlock_unlock(&registry->lock);
+}
+
+int
+json_schema_registry_add(struct json_schema_registry *registry,
+                         const char *uri, const char *data, size_t sz) {
+    char *key;
+    int ret;
+
+    key = json_schema_id_normalize(uri);
+
+    pthread_rwlock_wrlock(&registry->lock);
+    ret = json_schema_registry_load(registry, key, data, sz);
+    pthread_rwlock_unlock(&registry->lock);
+
+    c_free(key);
+    return ret;
+}
+
+int
+json_schema_registry_add_file(struct json_schema_registry *registry,
+                              const char *path) {
+    size_t len;
+    char *data;
+    int ret;
+
+    data = json_schema_registry_read_file(path, &len);
+    if (!data)
+        return -1;
+
+    ret = json_schema_registry_add(registry, path, data, len);
+
+    c_free(data);
+    return ret;
+}
+
+struct json_schema *
+json_schema_registry_get(struct json_schema_registry *registry,
+                         const char *uri) {
+    struct json_schema_registry_entry *entry;
+    const struct json_schema_document *document;
+    struct json_schema *schema;
+    char *key;
+
+    key = json_schema_id_normalize(uri);
+    schema = NULL;
+
+    pthread_rwlock_rdlock(&registry->lock);
+
+    entry = json_schema_registry_lookup(registry, key);
+    if (entry)
+        schema = json_schema_ref(entry->document.schema);
+
+    pthread_rwlock_unlock(&registry->lock);
+
+    if (!schema) {
+        /* Unknown documents are loaded on demand */
+        pthread_rwlock_wrlock(&registry->lock);
+
+        document = json_schema_registry_find_document(registry, NULL, key);
+        if (document)
+            schema = json_schema_ref(document->schema);
+
+        pthread_rwlock_unlock(&registry->lock);
+    }
+
+    c_free(key);
+    return schema;
+}
+
+const struct json_schema_document *
+json_schema_registry_find_document(struct json_schema_registry *registry,
+                                   const struct json_schema_document *base,
+                                   const char *uri) {
+    struct json_schema_registry_entry *entry;
+    struct json_schema_registry_load *load;
+    size_t len;
+    char *key, *data;
+
+    /* The registry must be locked for writing */
+    key = json_schema_registry_resolve_uri(base ? base->uri : NULL, uri);
+
+    if (base && base->uri && strcmp(key, base->uri) == 0) {
+        c_free(key);
+        return base;
+    }
+
+    entry = json_schema_registry_lookup(registry, key);
+    if (entry) {
+        c_free(key);
+        return &entry->document;
+    }
+
+    for (load = registry->loading; load; load = load->parent) {
+        if (strcmp(load->uri, key) == 0) {
+            c_set_error("circular reference between documents '%s'", key);
+            c_free(key);
+            return NULL;
+        }
+    }
+
+    data = json_schema_registry_read(registry, key, &len);
+    if (!data) {
+        c_free(key);
+        return NULL;
+    }
+
+    if (json_schema_registry_load(registry, key, data, len) == -1) {
+        c_set_error("cannot load schema '%s': %s", key, c_get_error());
+        c_free(data);
+        c_free(key);
+        return NULL;
+    }
+
+    c_free(data);
+
+    entry = json_schema_registry_lookup(registry, key);
+    c_free(key);
+
+    return &entry->document;
+}
+
+static struct json_schema_registry_entry *
+json_schema_registry_lookup(struct json_schema_registry *registry,
+                            const char *uri) {
+    struct json_schema_registry_entry *entry;
+    struct c_hash_table_iterator *it;
+    char *key;
+
+    if (c_hash_table_get(registry->entries, uri, (void **)&entry) == 1)
+        return entry;
+
+    /* Documents can also be designated by the id of their root schema */
+    it = c_hash_table_iterate(registry->entries);
+    while (c_hash_table_iterator_next(it, (void **)&key,
+                                      (void **)&entry) == 1) {
+        const char *id;
+        size_t len;
+
+        id = entry->document.schema->id;
+        if (!id)
+            continue;
+
+        len = strlen(uri);
+        if (strncmp(id, uri, len) == 0
+         && (id[len] == '\0' || (id[len] == '#' && id[len + 1] == '\0'))) {
+            c_hash_table_iterator_delete(it);
+            return entry;
+        }
+    }
+    c_hash_table_iterator_delete(it);
+
+    return NULL;
+}
+
+static int
+json_schema_registry_load(struct json_schema_registry *registry,
+                          const char *uri, const char *data, size_t sz) {
+    struct json_schema_registry_entry *entry;
+    struct json_schema_registry_load load;
+    struct json_schema_document document;
+    uint64_t hash;
+    int ret;
+
+    hash = json_schema_registry_hash(data, sz);
+
+    if (c_hash_table_get(registry->entries, uri, (void **)&entry) != 1)
+        entry = NULL;
+
+    /* Documents which did not change keep their compiled schema */
+    if (entry && entry->hash == hash)
+        return 0;
+
+    load.uri = uri;
+    load.parent = registry->loading;
+    registry->loading = &load;
+
+    ret = json_schema_document_parse(&document, uri, data, sz, registry);
+
+    registry->loading = load.parent;
+
+    if (ret == -1)
+        return -1;
+
+    if (json_schema_compile(document.schema) == -1) {
+        json_schema_document_free(&document);
+        return -1;
+    }
+
+    if (!entry) {
+        entry = c_malloc0(sizeof(struct json_schema_registry_entry));
+
+        entry->uri = c_strdup(uri);
+        entry->hash = hash;
+        entry->document = document;
+
+        c_hash_table_insert(registry->entries, entry->uri, entry);
+        return 1;
+    }
+
+    entry->hash = hash;
+
+    if (json_schema_registry_replace(registry, entry, &document) == -1)
+        return -1;
+
+    return 1;
+}
+
+static int
+json_schema_registry_replace(struct json_schema_registry *registry,
+                             struct json_schema_registry_entry *entry,
+                             struct json_schema_document *document) {
+    struct json_schema_registry_entry *dependent;
+    struct c_hash_table_iterator *it;
+    struct c_ptr_vector *dependents;
+    struct json_schema *schema;
+    char *uri;
+    int ret;
+
+    /* Documents referencing the previous version of the document are
+     * collected before it is released, then resolved again. */
+    schema = entry->document.schema;
+
+    dependents = c_ptr_vector_new();
+
+    it = c_hash_table_iterate(registry->entries);
+    while (c_hash_table_iterator_next(it, (void **)&uri,
+                                      (void **)&dependent) == 1) {
+        struct c_ptr_vector *documents;
+
+        documents = dependent->document.schema->documents;
+        if (!documents)
+            continue;
+
+        for (size_t i = 0; i < c_ptr_vector_length(documents); i++) {
+            if (c_ptr_vector_entry(documents, i) == schema) {
+                c_ptr_vector_append(dependents, dependent);
+                break;
+            }
+        }
+    }
+    c_hash_table_iterator_delete(it);
+
+    json_schema_document_free(&entry->document);
+    entry->document = *document;
+
+    ret = 0;
+
+    for (size_t i = 0; i < c_ptr_vector_length(dependents); i++) {
+        struct json_schema_document ndocument;
+        struct json_value *json;
+
+        dependent = c_ptr_vector_entry(dependents, i);
+        json = dependent->document.json;
+
+        if (json_schema_document_load(&ndocument, dependent->uri, json,
+                                      registry) == -1) {
+            c_set_error("cannot reload schema '%s': %s",
+                        dependent->uri, c_get_error());
+            ret = -1;
+            continue;
+        }
+
+        if (json_schema_compile(ndocument.schema) == -1) {
+            ndocument.json = NULL;
+            json_schema_document_free(&ndocument);
+            ret = -1;
+            continue;
+        }
+
+        /* The new document now owns the JSON value */
+        dependent->document.json = NULL;
+
+        if (json_schema_registry_replace(registry, dependent,
+                                         &ndocument) == -1) {
+            ret = -1;
+        }
+    }
+
+    c_ptr_vector_delete(dependents);
+    return ret;
+}
+
+static char *
+json_schema_registry_read(struct json_schema_registry *registry,
+                          const char *uri, size_t *plen) {
+    const char *path;
+
+    if (registry->loader)
+        return registry->loader(uri, plen, registry->loader_data);
+
+    /* Without a loader, only local files can be loaded */
+    if (strncmp(uri, "file://", 7) == 0) {
+        path = uri + 7;
+    } else if (strstr(uri, "://")) {
+        c_set_error("no loader for '%s'", uri);
+        return NULL;
+    } else {
+        path = uri;
+    }
+
+    return json_schema_registry_read_file(path, plen);
+}
+
+static char *
+json_schema_registry_read_file(const char *path, size_t *plen) {
+    struct c_buffer *buf;
+    char *data;
+    int fd;
+
+    fd = open(path, O_RDONLY);
+    if (fd == -1) {
+        c_set_error("cannot open %s: %s", path, strerror(errno));
+        return NULL;
+    }
+
+    buf = c_buffer_new();
+
+    for (;;) {
+        ssize_t ret;
+
+        ret = c_buffer_read(buf, fd, BUFSIZ);
+        if (ret == -1) {
+            c_set_error("cannot read %s: %s", path, c_get_error());
+            c_buffer_delete(buf);
+            close(fd);
+            return NULL;
+        } else if (ret == 0) {
+            break;
+        }
+    }
+
+    close(fd);
+
+    data = c_buffer_extract_string(buf, plen);
+    c_buffer_delete(buf);
+
+    return data;
+}
+
+static char *
+json_schema_registry_resolve_uri(const char *base, const char *uri) {
+    const char *slash;
+    size_t base_len, len;
+    char *resolved;
+
+    /* Relative uris are resolved against the directory of the base uri */
+    if (!base || uri[0] == '/' || strstr(uri, "://"))
+        return c_strdup(uri);
+
+    slash = strrchr(base, '/');
+    if (!slash)
+        return c_strdup(uri);
+
+    base_len = (size_t)(slash - base) + 1;
+    len = strlen(uri);
+
+    resolved = c_malloc(base_len + len + 1);
+    memcpy(resolved, base, base_len);
+    memcpy(resolved + base_len, uri, len + 1);
+
+    return resolved;
+}
+
+static uint64_t
+json_schema_registry_hash(const char *data, size_t sz) {
+    uint64_t hash;
+
+    /* FNV-1a */
+    hash = 14695981039346656037ULL;
+
+    for (size_t i = 0; i < sz; i++) {
+        hash ^= (uint8_t)data[i];
+        hash *= 1099511628211ULL;
+    }
+
+    return hash;
+}
+
+static void
+json_schema_registry_entry_delete(struct json_schema_registry_entry *entry) {
+    if (!entry)
+        return;
+
+    c_free(entry->uri);
+    json_schema_document_free(&entry->document);
+
+    c_free0(entry, sizeof(struct json_schema_registry_entry));
+}
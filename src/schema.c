@@ -35,20 +35,6 @@ json_schema_parse_validator_type(const struct json_value *);
 static struct json_value *
 json_schema_parse_validator_multiple_of(const struct json_value *);
 
-static bool
-json_schema_value_is_multiple_of_integer(const struct json_value *, int64_t);
-static bool
-json_schema_value_is_multiple_of_real(const struct json_value *, double);
-
-static bool
-json_schema_value_lt_integer(const struct json_value *, int64_t, bool);
-static bool
-json_schema_value_gt_integer(const struct json_value *, int64_t, bool);
-static bool
-json_schema_value_lt_real(const struct json_value *, double, bool);
-static bool
-json_schema_value_gt_real(const struct json_value *, double, bool);
-
 /* Array */
 static int
 json_schema_parse_validator_additional_items(struct json_array_validator *,
@@ -74,9 +60,15 @@ json_schema_parse_validator_dependencies(struct json_object_validator *,
 static struct c_hash_table *
 json_schema_parse_validator_definitions(const struct json_value *);
 
-/* Regex */
-pcre *json_schema_re_compile(const char *);
-int json_schema_re_exec(pcre *, const char *, size_t, bool *);
+/* References */
+typedef int (*json_schema_walk_func)(struct json_schema *, void *);
+
+static int json_schema_walk(struct json_schema *, json_schema_walk_func,
+                            void *);
+static int json_schema_walk_vector(struct c_ptr_vector *,
+                                   json_schema_walk_func, void *);
+static int json_schema_walk_table(struct c_hash_table *,
+                                  json_schema_walk_func, void *);
 
 /* Misc */
 static void json_value_vector_delete(struct c_ptr_vector *);
@@ -116,6 +108,19 @@ json_schema_uri_parse(const char *string, enum json_schema_uri *puri) {
     return -1;
 }
 
+char *
+json_schema_id_normalize(const char *id) {
+    size_t len;
+
+    /* "http://example.com/schema#" and "http://example.com/schema" identify
+     * the same document. */
+    len = strlen(id);
+    if (len > 0 && id[len - 1] == '#')
+        len--;
+
+    return c_strndup(id, len);
+}
+
 /* ------------------------------------------------------------------------
  *  Simple types
  * ------------------------------------------------------------------------ */
@@ -169,35 +174,6 @@ json_schema_simple_type_matches_type(enum json_schema_simple_type stype,
     return false;
 }
 
-/* ------------------------------------------------------------------------
- *  Formats
- * ------------------------------------------------------------------------ */
-int
-json_schema_format_parse(const char *string, enum json_schema_format *pformat) {
-    struct {
-        const char *string;
-        enum json_schema_format format;
-    } formats[] = {
-        {"date-time", JSON_SCHEMA_FORMAT_DATE_TIME},
-        {"email",     JSON_SCHEMA_FORMAT_EMAIL},
-        {"hostname",  JSON_SCHEMA_FORMAT_HOSTNAME},
-        {"ipv4",      JSON_SCHEMA_FORMAT_IPV4},
-        {"ipv6",      JSON_SCHEMA_FORMAT_IPV6},
-        {"uri",       JSON_SCHEMA_FORMAT_URI},
-        {"regex",     JSON_SCHEMA_FORMAT_REGEX},
-    };
-    size_t nb_formats = sizeof(formats) / sizeof(formats[0]);
-
-    for (size_t i = 0; i < nb_formats; i++) {
-        if (strcmp(string, formats[i].string) == 0) {
-            *pformat = formats[i].format;
-            return 0;
-        }
-    }
-
-    return -1;
-}
-
 /* ------------------------------------------------------------------------
  *  Generic validator
  * ------------------------------------------------------------------------ */
@@ -352,138 +328,6 @@ json_schema_parse_validator_multiple_of(const struct json_value *value) {
     return json_value_clone(value);
 }
 
-static bool
-json_schema_value_is_multiple_of_integer(const struct json_value *value,
-                                         int64_t integer) {
-    assert(value->type == JSON_INTEGER || value->type == JSON_REAL);
-
-    if (value->type == JSON_INTEGER) {
-        return ((value->u.integer % integer) == 0);
-    } else if (value->type == JSON_REAL) {
-        if (value->u.real > (double)INT64_MAX
-         || value->u.real < (double)INT64_MIN
-         || trunc(value->u.real) != value->u.real) {
-            return false;
-        }
-
-        return (((int64_t)value->u.real % integer) == 0);
-    }
-
-    return false;
-}
-
-static bool
-json_schema_value_is_multiple_of_real(const struct json_value *value,
-                                      double real) {
-    assert(value->type == JSON_INTEGER || value->type == JSON_REAL);
-
-
-    if (value->type == JSON_INTEGER) {
-        double ratio;
-
-        /* FIXME */
-        ratio = (double)value->u.integer / real;
-        return (trunc(ratio) == ratio);
-    } else if (value->type == JSON_REAL) {
-        double ratio;
-
-        ratio = value->u.real / real;
-        return (trunc(ratio) == ratio);
-    }
-
-    return false;
-}
-
-static bool
-json_schema_value_lt_integer(const struct json_value *value, int64_t integer,
-                             bool exclusive) {
-    assert(value->type == JSON_INTEGER || value->type == JSON_REAL);
-
-    if (value->type == JSON_INTEGER) {
-        if (exclusive) {
-            return value->u.integer < integer;
-        } else {
-            return value->u.integer <= integer;
-        }
-    } else if (value->type == JSON_REAL) {
-        /* FIXME */
-        if (exclusive) {
-            return (int64_t)value->u.real < integer;
-        } else {
-            return (int64_t)value->u.real <= integer;
-        }
-    }
-
-    return false;
-}
-
-static bool
-json_schema_value_gt_integer(const struct json_value *value, int64_t integer,
-                             bool exclusive) {
-    assert(value->type == JSON_INTEGER || value->type == JSON_REAL);
-
-    if (value->type == JSON_INTEGER) {
-        if (exclusive) {
-            return value->u.integer > integer;
-        } else {
-            return value->u.integer >= integer;
-        }
-    } else if (value->type == JSON_REAL) {
-        if (exclusive) {
-            /* FIXME */
-            return (int64_t)value->u.real > integer;
-        } else {
-            return (int64_t)value->u.real >= integer;
-        }
-    }
-
-    return false;
-}
-
-static bool
-json_schema_value_lt_real(const struct json_value *value, double real,
-                          bool exclusive) {
-    assert(value->type == JSON_INTEGER || value->type == JSON_REAL);
-
-    if (value->type == JSON_INTEGER) {
-        if (exclusive) {
-            return (double)value->u.integer < real;
-        } else {
-            return (double)value->u.integer <= real;
-        }
-    } else if (value->type == JSON_REAL) {
-        if (exclusive) {
-            return value->u.real < real;
-        } else {
-            return value->u.real <= real;
-        }
-    }
-
-    return false;
-}
-
-static bool
-json_schema_value_gt_real(const struct json_value *value, double real,
-                          bool exclusive) {
-    assert(value->type == JSON_INTEGER || value->type == JSON_REAL);
-
-    if (value->type == JSON_INTEGER) {
-        if (exclusive) {
-            return (double)value->u.integer > real;
-        } else {
-            return (double)value->u.integer >= real;
-        }
-    } else if (value->type == JSON_REAL) {
-        if (exclusive) {
-            return value->u.real > real;
-        } else {
-            return value->u.real >= real;
-        }
-    }
-
-    return false;
-}
-
 /* ------------------------------------------------------------------------
  *  String validator
  * ------------------------------------------------------------------------ */
@@ -498,7 +342,7 @@ json_string_validator_free(struct json_string_validator *validator) {
         return;
 
     c_free(validator->pattern);
-    pcre_free(validator->pattern_re);
+    json_schema_re_delete(validator->pattern_re);
 
     memset(validator, 0, sizeof(struct json_string_validator));
 }
@@ -892,15 +736,31 @@ json_schema_new(void) {
 
     json_validator_init(&schema->validator);
 
+    schema->refcount = 1;
+
+    return schema;
+}
+
+struct json_schema *
+json_schema_ref(struct json_schema *schema) {
+    __atomic_add_fetch(&schema->refcount, 1, __ATOMIC_RELAXED);
     return schema;
 }
 
 void
 json_schema_delete(struct json_schema *schema) {
+    const struct json_allocator *allocator;
+
     if (!schema)
         return;
 
+    if (__atomic_sub_fetch(&schema->refcount, 1, __ATOMIC_ACQ_REL) > 0)
+        return;
+
+    allocator = json_use_allocator(NULL);
+
     c_free(schema->id);
+    c_free(schema->ref);
 
     c_free(schema->title);
     c_free(schema->description);
@@ -909,7 +769,32 @@ json_schema_delete(struct json_schema *schema) {
 
     json_validator_free(&schema->validator);
 
+    json_schema_program_delete(schema->program);
+
+    if (schema->documents) {
+        for (size_t i = 0; i < c_ptr_vector_length(schema->documents); i++)
+            json_schema_delete(c_ptr_vector_entry(schema->documents, i));
+
+        c_ptr_vector_delete(schema->documents);
+    }
+
     c_free0(schema, sizeof(struct json_schema));
+
+    json_use_allocator(allocator);
+}
+
+void
+json_schema_add_document(struct json_schema *schema,
+                         struct json_schema *document) {
+    if (!schema->documents)
+        schema->documents = c_ptr_vector_new();
+
+    for (size_t i = 0; i < c_ptr_vector_length(schema->documents); i++) {
+        if (c_ptr_vector_entry(schema->documents, i) == document)
+            return;
+    }
+
+    c_ptr_vector_append(schema->documents, json_schema_ref(document));
 }
 
 /* ------------------------------------------------------------------------
@@ -917,673 +802,187 @@ json_schema_delete(struct json_schema *schema) {
  * ------------------------------------------------------------------------ */
 int
 json_schema_validate(struct json_schema *schema, struct json_value *value) {
-    return json_validator_check(&schema->validator, value);
-}
-
-int
-json_validator_check(struct json_validator *validator,
-                     struct json_value *value) {
-    if (json_generic_validator_check(&validator->generic, value) == -1)
+    if (json_schema_compile(schema) == -1)
         return -1;
 
-    switch (value->type) {
-    case JSON_INTEGER:
-    case JSON_REAL:
-        return json_numeric_validator_check(&validator->numeric, value);
-
-    case JSON_STRING:
-        return json_string_validator_check(&validator->string, value);
+    return json_schema_program_check(schema->program, schema->program->root,
+                                     value);
+}
 
-    case JSON_ARRAY:
-        return json_array_validator_check(&validator->array, value);
+int
+json_schema_validate_parallel(struct json_schema *schema,
+                              struct json_value *value,
+                              struct json_schema_pool *pool) {
+    struct json_schema_check check;
 
-    case JSON_OBJECT:
-        return json_object_validator_check(&validator->object, value);
+    if (json_schema_compile(schema) == -1)
+        return -1;
 
-    case JSON_BOOLEAN:
-    case JSON_NULL:
-        return 0;
-    }
+    json_schema_check_init(&check, schema->program,
+                           JSON_SCHEMA_CHECK_FIRST_ERROR);
+    check.pool = pool;
 
-    return 0;
+    return json_schema_check_node(&check, schema->program->root, value);
 }
 
 int
-json_generic_validator_check(struct json_generic_validator *validator,
-                             struct json_value *value) {
-    bool is_valid;
+json_schema_validate_all(struct json_schema *schema,
+                         const struct json_value *value,
+                         struct json_schema_error *errors, size_t max_errors,
+                         size_t *p_nb_errors) {
+    struct json_schema_check check;
+    int ret;
 
-    /* type */
-    if (validator->types) {
-        is_valid = false;
+    *p_nb_errors = 0;
 
-        for (size_t i = 0; i < c_vector_length(validator->types); i++) {
-            enum json_schema_simple_type *stype;
-
-            stype = c_vector_entry(validator->types, i);
-            if (json_schema_simple_type_matches_type(*stype, value->type)) {
-                is_valid = true;
-                break;
-            }
-        }
+    if (json_schema_compile(schema) == -1)
+        return -1;
 
-        if (!is_valid) {
-            c_set_error("value does not match 'type' constraint");
-            return -1;
-        }
-    }
+    json_schema_check_init(&check, schema->program,
+                           JSON_SCHEMA_CHECK_ALL_ERRORS);
+    check.errors = errors;
+    check.max_errors = max_errors;
 
-    /* enum */
-    if (validator->enumeration) {
-        is_valid = false;
+    ret = json_schema_check_node(&check, schema->program->root, value);
 
-        for (size_t i = 0; i < c_ptr_vector_length(validator->enumeration); i++) {
-            struct json_value *evalue;
+    if (check.failed) {
+        json_schema_errors_free(errors, check.nb_errors);
+        return -1;
+    }
 
-            evalue = c_ptr_vector_entry(validator->enumeration, i);
-            if (json_value_equal(evalue, value)) {
-                is_valid = true;
-                break;
-            }
-        }
+    *p_nb_errors = check.nb_errors;
+    return ret;
+}
 
-        if (!is_valid) {
-            c_set_error("value does not match 'enum' constraint");
-            return -1;
-        }
+void
+json_schema_errors_free(struct json_schema_error *errors, size_t nb_errors) {
+    for (size_t i = 0; i < nb_errors; i++) {
+        c_free(errors[i].pointer);
+        c_free(errors[i].schema_path);
     }
+}
 
-    /* allOf */
-    if (validator->all_of) {
-        is_valid = true;
+bool
+json_schema_is_valid(struct json_schema *schema,
+                     const struct json_value *value) {
+    struct json_schema_check check;
 
-        for (size_t i = 0; i < c_ptr_vector_length(validator->all_of); i++) {
-            struct json_schema *sschema;
+    if (json_schema_compile(schema) == -1)
+        return false;
 
-            sschema = c_ptr_vector_entry(validator->all_of, i);
-            if (json_schema_validate(sschema, value) == -1) {
-                is_valid = false;
-                break;
-            }
-        }
+    json_schema_check_init(&check, schema->program, JSON_SCHEMA_CHECK_VALID);
 
-        if (!is_valid) {
-            c_set_error("value does not match 'allOf' constraint");
-            return -1;
-        }
-    }
+    return json_schema_check_node(&check, schema->program->root, value) == 0;
+}
 
-    /* anyOf */
-    if (validator->any_of) {
-        is_valid = false;
+/* ------------------------------------------------------------------------
+ *  Parsing
+ * ------------------------------------------------------------------------ */
+struct json_schema *
+json_schema_parse(const char *data, size_t sz) {
+    struct json_schema_document document;
+    struct json_schema *schema;
 
-        for (size_t i = 0; i < c_ptr_vector_length(validator->any_of); i++) {
-            struct json_schema *sschema;
+    if (json_schema_document_parse(&document, NULL, data, sz, NULL) == -1)
+        return NULL;
 
-            sschema = c_ptr_vector_entry(validator->any_of, i);
-            if (json_schema_validate(sschema, value) == 0) {
-                is_valid = true;
-                break;
-            }
-        }
+    schema = json_schema_ref(document.schema);
+    json_schema_document_free(&document);
 
-        if (!is_valid) {
-            c_set_error("value does not match 'anyOf' constraint");
-            return -1;
-        }
+    if (json_schema_compile(schema) == -1) {
+        json_schema_delete(schema);
+        return NULL;
     }
 
-    /* oneOf */
-    if (validator->one_of) {
-        size_t nb_matches;
-
-        nb_matches = 0;
+    return schema;
+}
 
-        for (size_t i = 0; i < c_ptr_vector_length(validator->one_of); i++) {
-            struct json_schema *sschema;
-            bool is_valid;
+struct json_schema *
+json_schema_parse_string(const char *string) {
+    return json_schema_parse(string, strlen(string));
+}
 
-            sschema = c_ptr_vector_entry(validator->one_of, i);
-            is_valid = (json_schema_validate(sschema, value) == 0);
+struct json_schema *
+json_schema_parse_fd(int fd) {
+    struct json_schema *schema;
+    struct c_buffer *buf;
 
-            if (is_valid)
-                nb_matches++;
-        }
+    buf = c_buffer_new();
 
-        if (nb_matches != 1) {
-            c_set_error("value does not match 'oneOf' constraint");
-            return -1;
-        }
-    }
+    for (;;) {
+        ssize_t ret;
 
-    /* not */
-    if (validator->not) {
-        if (json_schema_validate(validator->not, value) == 0) {
-            c_set_error("value does not match 'not' constraint");
-            return -1;
+        ret = c_buffer_read(buf, fd, BUFSIZ);
+        if (ret == -1) {
+            c_set_error("cannot read file: %s", c_get_error());
+            c_buffer_delete(buf);
+        } else if (ret == 0) {
+            break;
         }
     }
 
-    /* TODO format */
-    if (validator->format) {
-        c_set_error("'format' keyword is not supported");
-        return -1;
+    schema = json_schema_parse(c_buffer_data(buf), c_buffer_length(buf));
+    if (!schema) {
+        c_buffer_delete(buf);
+        return NULL;
     }
 
-    return 0;
+    c_buffer_delete(buf);
+    return schema;
 }
 
-int
-json_numeric_validator_check(struct json_numeric_validator *validator,
-                             struct json_value *value) {
-    /* multipleOf */
-    if (validator->multiple_of) {
-        struct json_value *vvalue;
-        bool is_valid;
-
-        vvalue = validator->multiple_of;
-
-        if (vvalue->type == JSON_INTEGER) {
-            is_valid = json_schema_value_is_multiple_of_integer(value,
-                                                                vvalue->u.integer);
-        } else {
-            is_valid = json_schema_value_is_multiple_of_real(value,
-                                                             vvalue->u.real);
-        }
+struct json_schema *
+json_schema_parse_file(const char *path) {
+    struct json_schema *schema;
+    int fd;
 
-        if (!is_valid) {
-            c_set_error("value does not match 'multipleOf' constraint");
-            return -1;
-        }
+    fd = open(path, O_RDONLY);
+    if (fd == -1) {
+        c_set_error("cannot open %s: %s", path, strerror(errno));
+        return NULL;
     }
 
-    /* minimum/exclusiveMinimum */
-    if (validator->min) {
-        struct json_value *vvalue;
-        bool is_valid;
-
-        vvalue = validator->min;
-
-        if (vvalue->type == JSON_INTEGER) {
-            is_valid = json_schema_value_gt_integer(value, vvalue->u.integer,
-                                                    validator->exclusive_min);
-        } else {
-            is_valid = json_schema_value_gt_real(value, vvalue->u.real,
-                                                 validator->exclusive_min);
-        }
-
-        if (!is_valid) {
-            c_set_error("number too small");
-            return -1;
-        }
+    schema = json_schema_parse_fd(fd);
+    if (!schema) {
+        close(fd);
+        return NULL;
     }
 
-    /* maximum/exclusiveMaximum */
-    if (validator->max) {
-        struct json_value *vvalue;
-        bool is_valid;
+    close(fd);
+    return schema;
+}
 
-        vvalue = validator->max;
+static struct json_schema *
+json_schema_parse_object(const struct json_value *json) {
+    struct json_schema *schema;
+    struct json_validator *validator;
+    struct json_generic_validator *generic_validator;
+    struct json_numeric_validator *numeric_validator;
+    struct json_string_validator *string_validator;
+    struct json_array_validator *array_validator;
+    struct json_object_validator *object_validator;
 
-        if (vvalue->type == JSON_INTEGER) {
-            is_valid = json_schema_value_lt_integer(value, vvalue->u.integer,
-                                                    validator->exclusive_max);
-        } else {
-            is_valid = json_schema_value_lt_real(value, vvalue->u.real,
-                                                 validator->exclusive_max);
-        }
+    schema = json_schema_new();
 
-        if (!is_valid) {
-            c_set_error("number too large");
-            return -1;
-        }
+    if (json->type != JSON_OBJECT) {
+        c_set_error("schema is not a json object");
+        goto error;
     }
 
-    return 0;
-}
-
-int
-json_string_validator_check(struct json_string_validator *validator,
-                            struct json_value *value) {
-    assert(value->type == JSON_STRING);
+    schema->json = json;
 
-    if (validator->has_min_length || validator->has_max_length) {
-        size_t length;
+    validator = &schema->validator;
+    generic_validator = &validator->generic;
+    numeric_validator = &validator->numeric;
+    string_validator = &validator->string;
+    array_validator = &validator->array;
+    object_validator = &validator->object;
 
-        /* FIXME c_utf8_nb_codepoints() stops at the first U+0000 character.
-         * Add a function that counts using a pointer and size. */
-        if (c_utf8_nb_codepoints(value->u.string.ptr, &length) == -1) {
-            c_set_error("invalid string: %s", c_get_error());
-            return -1;
-        }
-
-        /* minLength */
-        if (validator->has_min_length) {
-            if (length < validator->min_length) {
-                c_set_error("string too short");
-                return -1;
-            }
-        }
-
-        /* maxLength */
-        if (validator->has_max_length) {
-            if (length > validator->max_length) {
-                c_set_error("string too long");
-                return -1;
-            }
-        }
-    }
-
-    /* pattern */
-    if (validator->pattern) {
-        bool match;
-
-        if (json_schema_re_exec(validator->pattern_re,
-                                value->u.string.ptr, value->u.string.len,
-                                &match) == -1) {
-            return -1;
-        }
-
-        if (!match) {
-            c_set_error("string does not match pattern");
-            return -1;
-        }
-    }
-
-    return 0;
-}
-
-int
-json_array_validator_check(struct json_array_validator *validator,
-                           struct json_value *value) {
-    size_t nb_elements;
-
-    nb_elements = value->u.array.nb_elements;
-
-    /* minItems */
-    if (validator->has_min_items) {
-        if (nb_elements < validator->min_items) {
-            c_set_error("array contains too few elements");
-            return -1;
-        }
-    }
-
-    /* maxItems */
-    if (validator->has_max_items) {
-        if (nb_elements > validator->max_items) {
-            c_set_error("array contains too many elements");
-            return -1;
-        }
-    }
-
-    /* uniqueItems */
-    if (validator->unique_items) {
-        /* XXX inefficient */
-        for (size_t i = 0; i < nb_elements; i++) {
-            struct json_value *el1;
-
-            el1 = value->u.array.elements[i];
-
-            for (size_t j = 0; j < nb_elements; j++) {
-                struct json_value *el2;
-
-                if (i == j)
-                    continue;
-
-                el2 = value->u.array.elements[j];
-
-                if (json_value_equal(el1, el2)) {
-                    c_set_error("array elements are not unique");
-                    return -1;
-                }
-            }
-        }
-    }
-
-    /* items/additionalItems */
-    if (validator->items) {
-        size_t nb_schemas;
-
-        nb_schemas = c_ptr_vector_length(validator->items);
-
-        if (validator->items_is_array) {
-            for (size_t i = 0; i < value->u.array.nb_elements; i++) {
-                struct json_value *evalue;
-                struct json_schema *eschema;
-
-                evalue = value->u.array.elements[i];
-
-                if (i < nb_schemas) {
-                    eschema = c_ptr_vector_entry(validator->items, i);
-                } else {
-                    if (validator->additional_items_is_schema) {
-                        eschema = validator->additional_items.schema;
-                    } else {
-                        if (!validator->additional_items.boolean) {
-                            c_set_error("array contains additional items");
-                            return -1;
-                        }
-
-                        eschema = NULL;
-                    }
-                }
-
-                if (eschema) {
-                    if (json_schema_validate(eschema, evalue) == -1) {
-                        c_set_error("array element %zu does not match "
-                                    "'%s' constraint: %s", i,
-                                    (i < nb_schemas) ? "items" : "additionalItems",
-                                    c_get_error());
-                        return -1;
-                    }
-                }
-            }
-        } else {
-            struct json_schema *eschema;
-
-            assert(nb_schemas == 1);
-            eschema = c_ptr_vector_entry(validator->items, 0);
-
-            for (size_t i = 0; i < value->u.array.nb_elements; i++) {
-                struct json_value *evalue;
-
-                evalue = value->u.array.elements[i];
-
-                if (json_schema_validate(eschema, evalue) == -1) {
-                    c_set_error("array element %zu does not match 'items' "
-                                "constraint: %s", i, c_get_error());
-                    return -1;
-                }
-            }
-        }
-    }
-
-    return 0;
-}
-
-int
-json_object_validator_check(struct json_object_validator *validator,
-                            struct json_value *value) {
-    size_t nb_members;
-    const char *key;
-
-    assert(value->type == JSON_OBJECT);
-
-    nb_members = value->u.object.nb_members;
-
-    /* minProperties */
-    if (validator->has_min_properties) {
-        if (nb_members < validator->min_properties) {
-            c_set_error("object contains too few members");
-            return -1;
-        }
-    }
-
-    /* maxProperties */
-    if (validator->has_max_properties) {
-        if (nb_members > validator->max_properties) {
-            c_set_error("object contains too many members");
-            return -1;
-        }
-    }
-
-    /* required */
-    if (validator->required) {
-        for (size_t i = 0; i < c_ptr_vector_length(validator->required); i++) {
-            key = c_ptr_vector_entry(validator->required, i);
-
-            if (!json_object_has_member(value, key)) {
-                c_set_error("object does not contain required members");
-                return -1;
-            }
-        }
-    }
-
-    /* properties/additionalProperties/patternProperties */
-    for (size_t i = 0; i < value->u.object.nb_members; i++) {
-        struct json_value *mvalue;
-        struct json_schema *mschema1, *mschema2;
-
-        key = json_object_nth_member(value, i, &mvalue);
-
-        /* properties */
-        mschema1 = NULL;
-        if (validator->properties) {
-            for (size_t j = 0; j < c_vector_length(validator->properties);
-                 j++) {
-                struct json_object_validator_property *vprop;
-
-                vprop = c_vector_entry(validator->properties, j);
-                if (strcmp(key, vprop->string) == 0) {
-                    mschema1 = vprop->schema;
-                    break;
-                }
-            }
-        }
-
-        if (mschema1) {
-            if (json_schema_validate(mschema1, mvalue) == -1) {
-                c_set_error("object member %zu does not match "
-                            "'properties' constraint: %s", i, c_get_error());
-                return -1;
-            }
-        }
-
-        /* patternProperties */
-        mschema2 = NULL;
-        if (validator->pattern_properties) {
-            for (size_t j = 0; j < c_vector_length(validator->pattern_properties);
-                 j++) {
-                struct json_object_validator_pattern *vpattern;
-                bool match;
-
-                vpattern = c_vector_entry(validator->pattern_properties, j);
-
-                if (json_schema_re_exec(vpattern->pattern_re,
-                                        key, strlen(key), &match) == -1) {
-                    return -1;
-                }
-
-                if (match) {
-                    mschema2 = vpattern->schema;
-                    break;
-                }
-            }
-        }
-
-        if (mschema2) {
-            if (json_schema_validate(mschema2, mvalue) == -1) {
-                c_set_error("object member %zu does not match "
-                            "'patternProperties' constraint: %s",
-                            i, c_get_error());
-                return -1;
-            }
-        }
-
-        if (mschema1 || mschema2)
-            continue;
-
-        /* additionalProperties */
-        if (validator->additional_properties_is_schema) {
-            if (json_schema_validate(validator->additional_properties.schema,
-                                     mvalue) == -1) {
-                c_set_error("object member %zu does not match "
-                            "'additionalProperties' constraint: %s",
-                            i, c_get_error());
-                return -1;
-            }
-        } else {
-            if (!validator->additional_properties.boolean) {
-                c_set_error("object contains additional members");
-                return -1;
-            }
-        }
-    }
-
-    /* dependencies */
-    if (validator->schema_dependencies) {
-        struct c_hash_table_iterator *it;
-        struct json_schema *schema;
-
-        it = c_hash_table_iterate(validator->schema_dependencies);
-        while (c_hash_table_iterator_next(it, (void **)&key,
-                                          (void **)&schema) == 1) {
-            if (json_object_has_member(value, key)) {
-                if (json_schema_validate(schema, value) == -1) {
-                    c_set_error("object contains member '%s' but does not match "
-                                "the associated schema dependency", key);
-                    c_hash_table_iterator_delete(it);
-                    return -1;
-                }
-            }
-        }
-        c_hash_table_iterator_delete(it);
-    }
-
-    if (validator->property_dependencies) {
-        struct c_hash_table_iterator *it;
-        struct c_ptr_vector *ptr_vector;
-
-        it = c_hash_table_iterate(validator->property_dependencies);
-        while (c_hash_table_iterator_next(it, (void **)&key,
-                                          (void **)&ptr_vector) == 1) {
-            if (json_object_has_member(value, key)) {
-                for (size_t i = 0; i < c_ptr_vector_length(ptr_vector); i++) {
-                    const char *property;
-
-                    property = c_ptr_vector_entry(ptr_vector, i);
-
-                    if (!json_object_has_member(value, property)) {
-                        c_set_error("object has member '%s' but does not have "
-                                    "member '%s'", key, property);
-                        c_hash_table_iterator_delete(it);
-                        return -1;
-                    }
-                }
-            }
-        }
-        c_hash_table_iterator_delete(it);
-    }
-
-    return 0;
-}
-
-/* ------------------------------------------------------------------------
- *  Parsing
- * ------------------------------------------------------------------------ */
-struct json_schema *
-json_schema_parse(const char *data, size_t sz) {
-    struct json_schema *schema;
-    struct json_value *json;
-    uint32_t flags;
-
-    flags = JSON_PARSE_REJECT_DUPLICATE_KEYS
-          | JSON_PARSE_REJECT_NULL_CHARACTERS;
-
-    json = json_parse(data, sz, flags);
-    if (!json)
-        return NULL;
-
-    if (json->type != JSON_OBJECT) {
-        c_set_error("schema is not a json object");
-        json_value_delete(json);
-        return NULL;
-    }
-
-    schema = json_schema_parse_object(json);
-    if (!schema) {
-        json_value_delete(json);
-        return NULL;
-    }
-
-    json_value_delete(json);
-    return schema;
-}
-
-struct json_schema *
-json_schema_parse_string(const char *string) {
-    return json_schema_parse(string, strlen(string));
-}
-
-struct json_schema *
-json_schema_parse_fd(int fd) {
-    struct json_schema *schema;
-    struct c_buffer *buf;
-
-    buf = c_buffer_new();
-
-    for (;;) {
-        ssize_t ret;
-
-        ret = c_buffer_read(buf, fd, BUFSIZ);
-        if (ret == -1) {
-            c_set_error("cannot read file: %s", c_get_error());
-            c_buffer_delete(buf);
-        } else if (ret == 0) {
-            break;
-        }
-    }
-
-    schema = json_schema_parse(c_buffer_data(buf), c_buffer_length(buf));
-    if (!schema) {
-        c_buffer_delete(buf);
-        return NULL;
-    }
-
-    c_buffer_delete(buf);
-    return schema;
-}
-
-struct json_schema *
-json_schema_parse_file(const char *path) {
-    struct json_schema *schema;
-    int fd;
-
-    fd = open(path, O_RDONLY);
-    if (fd == -1) {
-        c_set_error("cannot open %s: %s", path, strerror(errno));
-        return NULL;
-    }
-
-    schema = json_schema_parse_fd(fd);
-    if (!schema) {
-        close(fd);
-        return NULL;
-    }
-
-    close(fd);
-    return schema;
-}
-
-static struct json_schema *
-json_schema_parse_object(const struct json_value *json) {
-    struct json_schema *schema;
-    struct json_validator *validator;
-    struct json_generic_validator *generic_validator;
-    struct json_numeric_validator *numeric_validator;
-    struct json_string_validator *string_validator;
-    struct json_array_validator *array_validator;
-    struct json_object_validator *object_validator;
-
-    schema = json_schema_new();
-
-    if (json->type != JSON_OBJECT) {
-        c_set_error("schema is not a json object");
-        goto error;
-    }
-
-    validator = &schema->validator;
-    generic_validator = &validator->generic;
-    numeric_validator = &validator->numeric;
-    string_validator = &validator->string;
-    array_validator = &validator->array;
-    object_validator = &validator->object;
-
-#define JSON_CHECK_TYPE(key_, value_, type_)                    \
-    if ((value_)->type != type_) {                              \
-        c_set_error("invalid type for member '%s'", key_);      \
-        goto error;                                             \
-    }
+#define JSON_CHECK_TYPE(key_, value_, type_)                    \
+    if ((value_)->type != type_) {                              \
+        c_set_error("invalid type for member '%s'", key_);      \
+        goto error;                                             \
+    }
 
 #define JSON_CHECK_TYPE2(key_, value_, type1_, type2_)          \
     if ((value_)->type != type1_ && (value_)->type != type2_) { \
@@ -1629,9 +1028,9 @@ json_schema_parse_object(const struct json_value *json) {
         } else if (strcmp(key, "$ref") == 0) {
             JSON_CHECK_TYPE(key, value, JSON_STRING);
 
-            /* TODO */
-            c_set_error("schema references are not supported");
-            goto invalid_member;
+            /* Other members of a reference are ignored for validation; the
+             * reference is resolved once the whole document is read. */
+            schema->ref = c_strndup(value->u.string.ptr, value->u.string.len);
 
         } else if (strcmp(key, "title") == 0) {
             JSON_CHECK_TYPE(key, value, JSON_STRING);
@@ -1679,8 +1078,9 @@ json_schema_parse_object(const struct json_value *json) {
         } else if (strcmp(key, "format") == 0) {
             JSON_CHECK_TYPE(key, value, JSON_STRING);
 
-            if (json_schema_format_parse(value->u.string.ptr,
-                                         &generic_validator->format) == -1) {
+            generic_validator->format =
+                json_schema_format_find(value->u.string.ptr);
+            if (!generic_validator->format) {
                 c_set_error("unknown format '%s'", value->u.string.ptr);
                 goto invalid_member;
             }
@@ -1718,7 +1118,7 @@ json_schema_parse_object(const struct json_value *json) {
 
         } else if (strcmp(key, "pattern") == 0) {
             char *pattern;
-            pcre *re;
+            struct json_schema_re *re;
 
             JSON_CHECK_TYPE(key, value, JSON_STRING);
 
@@ -1871,50 +1271,412 @@ json_schema_parse_schema_array(const struct json_value *value) {
 }
 
 /* ------------------------------------------------------------------------
- *  Regex
+ *  References
  * ------------------------------------------------------------------------ */
-pcre *
-json_schema_re_compile(const char *pattern) {
-    const char *error;
-    int flags, error_offset;
-    pcre *re;
+struct json_schema_resolver {
+    struct json_schema_document *document;
+    struct json_schema_registry *registry;
 
-    flags = PCRE_UTF8 | PCRE_JAVASCRIPT_COMPAT;
+    struct c_ptr_vector *refs; /* schemas with a reference */
+};
 
-    re = pcre_compile(pattern, flags, &error, &error_offset, NULL);
-    if (!re) {
-        c_set_error("cannot compile regex: %s", error);
-        return NULL;
+static int json_schema_resolver_collect(struct json_schema *, void *);
+static struct json_schema *
+json_schema_resolver_find(struct json_schema_resolver *, const char *);
+static const struct json_value *
+json_schema_resolve_pointer(const struct json_value *, const char *);
+
+static int
+json_schema_walk(struct json_schema *schema, json_schema_walk_func func,
+                 void *data) {
+    struct json_validator *validator;
+
+    /* Visit a schema and all the schemas it contains, without following
+     * references. */
+    if (func(schema, data) == -1)
+        return -1;
+
+    validator = &schema->validator;
+
+    /* Generic */
+    if (json_schema_walk_vector(validator->generic.all_of, func, data) == -1
+     || json_schema_walk_vector(validator->generic.any_of, func, data) == -1
+     || json_schema_walk_vector(validator->generic.one_of, func, data) == -1) {
+        return -1;
+    }
+
+    if (validator->generic.not) {
+        if (json_schema_walk(validator->generic.not, func, data) == -1)
+            return -1;
+    }
+
+    /* Array */
+    if (json_schema_walk_vector(validator->array.items, func, data) == -1)
+        return -1;
+
+    if (validator->array.additional_items_is_schema) {
+        if (json_schema_walk(validator->array.additional_items.schema,
+                             func, data) == -1) {
+            return -1;
+        }
+    }
+
+    /* Object */
+    if (validator->object.properties) {
+        struct c_vector *properties;
+
+        properties = validator->object.properties;
+
+        for (size_t i = 0; i < c_vector_length(properties); i++) {
+            struct json_object_validator_property *property;
+
+            property = c_vector_entry(properties, i);
+            if (json_schema_walk(property->schema, func, data) == -1)
+                return -1;
+        }
+    }
+
+    if (validator->object.additional_properties_is_schema) {
+        if (json_schema_walk(validator->object.additional_properties.schema,
+                             func, data) == -1) {
+            return -1;
+        }
+    }
+
+    if (validator->object.pattern_properties) {
+        struct c_vector *patterns;
+
+        patterns = validator->object.pattern_properties;
+
+        for (size_t i = 0; i < c_vector_length(patterns); i++) {
+            struct json_object_validator_pattern *pattern;
+
+            pattern = c_vector_entry(patterns, i);
+            if (json_schema_walk(pattern->schema, func, data) == -1)
+                return -1;
+        }
+    }
+
+    if (json_schema_walk_table(validator->object.schema_dependencies,
+                               func, data) == -1) {
+        return -1;
+    }
+
+    /* Definitions */
+    if (json_schema_walk_table(validator->definitions, func, data) == -1)
+        return -1;
+
+    return 0;
+}
+
+static int
+json_schema_walk_vector(struct c_ptr_vector *vector,
+                        json_schema_walk_func func, void *data) {
+    if (!vector)
+        return 0;
+
+    for (size_t i = 0; i < c_ptr_vector_length(vector); i++) {
+        if (json_schema_walk(c_ptr_vector_entry(vector, i), func, data) == -1)
+            return -1;
+    }
+
+    return 0;
+}
+
+static int
+json_schema_walk_table(struct c_hash_table *table,
+                       json_schema_walk_func func, void *data) {
+    struct c_hash_table_iterator *it;
+    struct json_schema *schema;
+    char *name;
+    int ret;
+
+    if (!table)
+        return 0;
+
+    ret = 0;
+
+    it = c_hash_table_iterate(table);
+    while (c_hash_table_iterator_next(it, (void **)&name,
+                                      (void **)&schema) == 1) {
+        if (json_schema_walk(schema, func, data) == -1) {
+            ret = -1;
+            break;
+        }
     }
+    c_hash_table_iterator_delete(it);
 
-    return re;
+    return ret;
 }
 
 int
-json_schema_re_exec(pcre *re, const char *string, size_t length, bool *pmatch) {
-    int ret, offset, flags;
+json_schema_document_parse(struct json_schema_document *document,
+                           const char *uri, const char *data, size_t sz,
+                           struct json_schema_registry *registry) {
+    const struct json_allocator *allocator;
+    struct json_value *json;
+    uint32_t flags;
+    int ret;
+
+    flags = JSON_PARSE_REJECT_DUPLICATE_KEYS
+          | JSON_PARSE_REJECT_NULL_CHARACTERS;
+
+    allocator = json_use_allocator(NULL);
+
+    ret = -1;
+
+    json = json_parse(data, sz, flags);
+    if (json) {
+        ret = json_schema_document_load(document, uri, json, registry);
+        if (ret == -1)
+            json_value_delete(json);
+    }
 
-    if (length > INT_MAX) {
-        c_set_error("string too long");
+    json_use_allocator(allocator);
+    return ret;
+}
+
+int
+json_schema_document_load(struct json_schema_document *document,
+                          const char *uri, struct json_value *json,
+                          struct json_schema_registry *registry) {
+    const struct json_allocator *allocator;
+    struct json_schema_resolver resolver;
+    size_t nb_refs;
+
+    memset(document, 0, sizeof(struct json_schema_document));
+
+    if (json->type != JSON_OBJECT) {
+        c_set_error("schema is not a json object");
         return -1;
     }
 
-    offset = 0;
-    flags = 0;
+    /* Schemas outlive the scope of thread allocators */
+    allocator = json_use_allocator(NULL);
+    document->schema = json_schema_parse_object(json);
+    json_use_allocator(allocator);
 
-    ret = pcre_exec(re, NULL, string, (int)length, offset, flags, NULL, 0);
-    if (ret < 0) {
-        if (ret == PCRE_ERROR_NOMATCH) {
-            *pmatch = false;
-            return 0;
-        } else {
-            c_set_error("cannot execute regex: %d", ret);
-            return -1;
+    if (!document->schema)
+        return -1;
+
+    document->uri = uri ? c_strdup(uri) : NULL;
+    document->json = json;
+    document->schemas = c_hash_table_new(json_hash_pointer,
+                                         json_equal_pointer);
+    document->ids = c_hash_table_new(c_hash_string, c_equal_string);
+
+    /* References are resolved once, when the schema is parsed, into direct
+     * pointers to the schema they designate. Chains of references are
+     * collapsed so that validation never has to follow more than one. */
+    resolver.document = document;
+    resolver.registry = registry;
+    resolver.refs = c_ptr_vector_new();
+
+    json_schema_walk(document->schema, json_schema_resolver_collect,
+                     &resolver);
+
+    nb_refs = c_ptr_vector_length(resolver.refs);
+
+    for (size_t i = 0; i < nb_refs; i++) {
+        struct json_schema *ref_schema;
+
+        ref_schema = c_ptr_vector_entry(resolver.refs, i);
+
+        ref_schema->ref_target = json_schema_resolver_find(&resolver,
+                                                           ref_schema->ref);
+        if (!ref_schema->ref_target)
+            goto error;
+    }
+
+    for (size_t i = 0; i < nb_refs; i++) {
+        struct json_schema *ref_schema, *target;
+
+        ref_schema = c_ptr_vector_entry(resolver.refs, i);
+
+        target = ref_schema->ref_target;
+        for (size_t n = 0; target->ref; n++) {
+            if (n >= nb_refs) {
+                c_set_error("circular reference '%s'", ref_schema->ref);
+                goto error;
+            }
+
+            target = target->ref_target;
         }
+
+        ref_schema->ref_target = target;
     }
 
-    *pmatch = true;
+    c_ptr_vector_delete(resolver.refs);
     return 0;
+
+error:
+    c_ptr_vector_delete(resolver.refs);
+
+    /* The caller still owns the json value on error */
+    document->json = NULL;
+    json_schema_document_free(document);
+    return -1;
+}
+
+void
+json_schema_document_free(struct json_schema_document *document) {
+    const struct json_allocator *allocator;
+    struct c_hash_table_iterator *it;
+    char *id;
+    void *ptr;
+
+    if (document->ids) {
+        it = c_hash_table_iterate(document->ids);
+        while (c_hash_table_iterator_next(it, (void **)&id, &ptr) == 1)
+            c_free(id);
+        c_hash_table_iterator_delete(it);
+
+        c_hash_table_delete(document->ids);
+    }
+
+    if (document->schemas)
+        c_hash_table_delete(document->schemas);
+
+    allocator = json_use_allocator(NULL);
+    json_value_delete(document->json);
+    json_use_allocator(allocator);
+
+    json_schema_delete(document->schema);
+
+    c_free(document->uri);
+
+    memset(document, 0, sizeof(struct json_schema_document));
+}
+
+static int
+json_schema_resolver_collect(struct json_schema *schema, void *data) {
+    struct json_schema_resolver *resolver;
+    struct json_schema_document *document;
+    void *ptr;
+
+    resolver = data;
+    document = resolver->document;
+
+    if (schema->json) {
+        c_hash_table_insert(document->schemas, (void *)schema->json, schema);
+
+        if (schema->id) {
+            char *id;
+
+            /* The first schema using an id wins */
+            id = json_schema_id_normalize(schema->id);
+
+            if (c_hash_table_get(document->ids, id, &ptr) == 1) {
+                c_free(id);
+            } else {
+                c_hash_table_insert(document->ids, id, (void *)schema->json);
+            }
+        }
+
+        schema->json = NULL;
+    }
+
+    if (schema->ref)
+        c_ptr_vector_append(resolver->refs, schema);
+
+    return 0;
+}
+
+static struct json_schema *
+json_schema_resolver_find(struct json_schema_resolver *resolver,
+                          const char *ref) {
+    const struct json_schema_document *document;
+    const struct json_value *json;
+    const char *fragment;
+    void *ptr;
+
+    document = resolver->document;
+
+    fragment = strchr(ref, '#');
+    if (!fragment)
+        fragment = ref + strlen(ref);
+
+    /* Identifiers are matched as they are written, they are not resolved
+     * against the identifier of enclosing schemas. Other documents are
+     * looked up in the registry, relative to the uri of the document. */
+    if (fragment == ref) {
+        json = document->json;
+    } else {
+        char *uri;
+        int ret;
+
+        uri = c_strndup(ref, (size_t)(fragment - ref));
+        ret = c_hash_table_get(document->ids, uri, &ptr);
+
+        if (ret == 1) {
+            json = ptr;
+        } else if (resolver->registry) {
+            document = json_schema_registry_find_document(resolver->registry,
+                                                          document, uri);
+            if (!document) {
+                c_set_error("cannot resolve reference '%s': %s",
+                            ref, c_get_error());
+                c_free(uri);
+                return NULL;
+            }
+
+            if (document != resolver->document) {
+                json_schema_add_document(resolver->document->schema,
+                                         document->schema);
+            }
+
+            json = document->json;
+        } else {
+            c_set_error("cannot resolve reference '%s'", ref);
+            c_free(uri);
+            return NULL;
+        }
+
+        c_free(uri);
+    }
+
+    if (*fragment == '#')
+        fragment++;
+
+    if (*fragment == '/') {
+        json = json_schema_resolve_pointer(json, fragment);
+        if (!json) {
+            c_set_error("cannot resolve reference '%s'", ref);
+            return NULL;
+        }
+    } else if (*fragment != '\0') {
+        /* A plain name fragment designates the schema whose id is
+         * "#<name>". */
+        if (c_hash_table_get(document->ids, fragment - 1, &ptr) != 1) {
+            c_set_error("cannot resolve reference '%s'", ref);
+            return NULL;
+        }
+
+        json = ptr;
+    }
+
+    if (c_hash_table_get(document->schemas, (void *)json, &ptr) != 1) {
+        c_set_error("reference '%s' does not point to a schema", ref);
+        return NULL;
+    }
+
+    return ptr;
+}
+
+static const struct json_value *
+json_schema_resolve_pointer(const struct json_value *value,
+                            const char *string) {
+    struct json_pointer *pointer;
+
+    /* JSON pointer (RFC 6901) in a URI fragment, percent-encoded */
+    pointer = json_pointer_compile_fragment(string);
+    if (!pointer)
+        return NULL;
+
+    value = json_pointer_get(pointer, value);
+
+    json_pointer_delete(pointer);
+    return value;
 }
 
 /* ------------------------------------------------------------------------
@@ -2021,7 +1783,7 @@ json_object_validator_pattern_vector_delete(struct c_vector *vector) {
         pattern = c_vector_entry(vector, i);
 
         c_free(pattern->pattern);
-        pcre_free(pattern->pattern_re);
+        json_schema_re_delete(pattern->pattern_re);
 
         json_schema_delete(pattern->schema);
     }
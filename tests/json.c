@@ -14,6 +14,11 @@
  * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
  */
 
+#include <errno.h>
+#include <string.h>
+
+#include <unistd.h>
+
 #include "../src/json.h"
 #include "tests.h"
 
@@ -289,6 +294,269 @@ TEST(object_iterators) {
     json_value_delete(value);
 }
 
+TEST(object_key_interning) {
+    struct json_value *value, *copy, *child1, *child2;
+    const char *key1, *key2;
+    char long_key[1024], *string;
+
+    JSONT_PARSE_ARRAY("[{\"a\": 1, \"b\": 2}, {\"b\": 3, \"a\": 4}]", 2,
+                      JSON_PARSE_DEFAULT);
+    child1 = json_array_element(value, 0);
+    child2 = json_array_element(value, 1);
+    key1 = json_object_nth_member(child1, 0, NULL);
+    key2 = json_object_nth_member(child2, 1, NULL);
+    TEST_STRING_EQ(key1, "a");
+    TEST_TRUE(key1 == key2);
+    key1 = json_object_nth_member(child1, 1, NULL);
+    key2 = json_object_nth_member(child2, 0, NULL);
+    TEST_STRING_EQ(key1, "b");
+    TEST_TRUE(key1 == key2);
+
+    copy = json_value_clone(value);
+    key2 = json_object_nth_member(json_array_element(copy, 0), 1, NULL);
+    TEST_TRUE(key1 == key2);
+    json_value_delete(value);
+    JSONT_INTEGER_EQ(json_object_member(json_array_element(copy, 0), "b"), 2);
+    json_value_delete(copy);
+
+    JSONT_PARSE_OBJECT("{\"a\": {\"a\": {\"a\": 1}}}", 1,
+                       JSON_PARSE_REJECT_DUPLICATE_KEYS);
+    json_value_delete(value);
+
+    JSONT_IS_INVALID("{\"a\": 1, \"b\": 2, \"a\": 3}",
+                     JSON_PARSE_REJECT_DUPLICATE_KEYS);
+
+    /* Keys longer than the buffer of the parser */
+    memset(long_key, 'k', sizeof(long_key) - 1);
+    long_key[sizeof(long_key) - 1] = '\0';
+    c_asprintf(&string, "[{\"%s\": 1}, {\"%s\": 2}]", long_key, long_key);
+
+    JSONT_PARSE_ARRAY(string, 2, JSON_PARSE_DEFAULT);
+    key1 = json_object_nth_member(json_array_element(value, 0), 0, NULL);
+    key2 = json_object_nth_member(json_array_element(value, 1), 0, NULL);
+    TEST_STRING_EQ(key1, long_key);
+    TEST_TRUE(key1 == key2);
+    JSONT_INTEGER_EQ(json_object_member(json_array_element(value, 1),
+                                        long_key), 2);
+    json_value_delete(value);
+    c_free(string);
+}
+
+TEST(object_add_member_nocopy) {
+    struct json_value *value;
+    char *key;
+
+    value = json_object_new();
+
+    key = c_strdup("foo");
+    TEST_INT_EQ(json_object_add_member_nocopy(value, key,
+                                              json_integer_new(1)), 0);
+    TEST_PTR_EQ(json_object_nth_member(value, 0, NULL), key);
+    key = c_strndup("barbaz", 3);
+    TEST_INT_EQ(json_object_add_member_nocopy2(value, key, 3,
+                                               json_integer_new(2)), 0);
+
+    TEST_UINT_EQ(json_object_nb_members(value), 2);
+    JSONT_INTEGER_EQ(json_object_member(value, "foo"), 1);
+    JSONT_INTEGER_EQ(json_object_member(value, "bar"), 2);
+
+    json_value_delete(value);
+}
+
+TEST(large_objects) {
+    struct json_value *value, *clone;
+    char key[16];
+
+    value = json_object_new();
+
+    for (int i = 0; i < 200; i++) {
+        snprintf(key, sizeof(key), "k%d", i);
+        json_object_add_member(value, key, json_integer_new(i));
+    }
+
+    TEST_UINT_EQ(json_object_nb_members(value), 200);
+
+    for (int i = 0; i < 200; i++) {
+        snprintf(key, sizeof(key), "k%d", i);
+        JSONT_INTEGER_EQ(json_object_member(value, key), i);
+    }
+    TEST_FALSE(json_object_has_member(value, "k200"));
+
+    /* Members keep their insertion order */
+    TEST_STRING_EQ(json_object_nth_member(value, 0, NULL), "k0");
+    TEST_STRING_EQ(json_object_nth_member(value, 199, NULL), "k199");
+
+    TEST_INT_EQ(json_object_set_member(value, "k42", json_integer_new(-1)), 1);
+    JSONT_INTEGER_EQ(json_object_member(value, "k42"), -1);
+
+    json_object_remove_member(value, "k0");
+    json_object_remove_member(value, "k100");
+    TEST_UINT_EQ(json_object_nb_members(value), 198);
+    TEST_FALSE(json_object_has_member(value, "k0"));
+    TEST_FALSE(json_object_has_member(value, "k100"));
+    JSONT_INTEGER_EQ(json_object_member(value, "k101"), 101);
+    JSONT_INTEGER_EQ(json_object_member(value, "k199"), 199);
+
+    clone = json_value_clone(value);
+    TEST_TRUE(json_value_equal(value, clone));
+    TEST_STRING_EQ(json_object_nth_member(value, 0, NULL), "k1");
+
+    json_object_set_member(clone, "k7", json_integer_new(0));
+    TEST_FALSE(json_value_equal(value, clone));
+
+    json_value_delete(clone);
+    json_value_delete(value);
+}
+
+static bool
+jsont_filter_is_odd(const char *key, struct json_value *value, void *data) {
+    return json_integer_value(value) % 2 == 1;
+}
+
+TEST(clone) {
+    struct json_value *value, *clone, *child;
+
+    JSONT_PARSE("{\"a\": {\"b\": {\"c\": 1}}, \"d\": [[2]]}",
+                JSON_PARSE_DEFAULT);
+
+    /* Clones are deep copies, nested values can be modified directly */
+    clone = json_value_clone(value);
+    TEST_TRUE(json_value_equal(value, clone));
+
+    child = json_object_member(json_object_member(clone, "a"), "b");
+    TEST_INT_EQ(json_object_add_member(child, "x", json_integer_new(42)), 0);
+    child = json_array_element(json_object_member(clone, "d"), 0);
+    TEST_INT_EQ(json_array_add_element(child, json_null_new()), 0);
+
+    child = json_object_member(json_object_member(value, "a"), "b");
+    TEST_UINT_EQ(json_object_nb_members(child), 1);
+    TEST_FALSE(json_object_has_member(child, "x"));
+    child = json_array_element(json_object_member(value, "d"), 0);
+    TEST_UINT_EQ(json_array_nb_elements(child), 1);
+
+    json_value_delete(value);
+    JSONT_INTEGER_EQ(json_object_member(json_object_member(
+                         json_object_member(clone, "a"), "b"), "x"), 42);
+    json_value_delete(clone);
+}
+
+TEST(clone_shared) {
+    struct json_value *value, *clone, *child, *element;
+
+    JSONT_PARSE("{\"a\": {\"b\": [1, 2], \"c\": \"foo\"}, \"d\": [3]}",
+                JSON_PARSE_DEFAULT);
+
+    /* Clones share their members with the original value */
+    clone = json_value_clone_shared(value);
+    TEST_TRUE(clone != value);
+    TEST_TRUE(json_value_equal(value, clone));
+    TEST_PTR_EQ(json_object_member(clone, "a"), json_object_member(value, "a"));
+
+    /* Shared values cannot be modified directly */
+    child = json_object_member(clone, "a");
+    element = json_null_new();
+    TEST_INT_EQ(json_object_add_member(child, "e", element), -1);
+    TEST_INT_EQ(json_object_set_member(child, "c", element), -1);
+    TEST_INT_EQ(json_array_add_element(json_object_member(value, "d"),
+                                       element), -1);
+    json_value_delete(element);
+    TEST_INT_EQ(json_object_remove_member(child, "c"), -1);
+    TEST_UINT_EQ(json_object_remove_members(child, (const char *[]){"c"}, 1),
+                 (size_t)-1);
+    TEST_UINT_EQ(json_object_filter(child, jsont_filter_is_odd, NULL),
+                 (size_t)-1);
+    TEST_PTR_NULL(json_object_member_mutable(child, "b"));
+    TEST_PTR_NULL(json_array_element_mutable(json_object_member(value, "d"),
+                                             0));
+    TEST_UINT_EQ(json_object_nb_members(child), 2);
+
+    /* The original is modified from its root without affecting the clone */
+    TEST_PTR_NOT_NULL(json_object_member_mutable(value, "a"));
+    TEST_INT_EQ(json_object_remove_member(json_object_member(value, "a"),
+                                          "x"), 0);
+    TEST_TRUE(json_value_equal(value, clone));
+
+    /* Only the path to the modified value is copied */
+    child = json_object_member_mutable(clone, "a");
+    TEST_PTR_NOT_NULL(child);
+    TEST_TRUE(child != json_object_member(value, "a"));
+    TEST_PTR_EQ(json_object_member(child, "b"),
+                json_object_member(json_object_member(value, "a"), "b"));
+
+    element = json_object_member_mutable(child, "b");
+    TEST_INT_EQ(json_array_add_element(element, json_integer_new(42)), 0);
+    TEST_INT_EQ(json_object_set_member(child, "c", json_integer_new(1)), 1);
+    TEST_PTR_NULL(json_object_member_mutable(child, "x"));
+
+    element = json_array_element_mutable(json_object_member_mutable(clone,
+                                                                    "d"), 0);
+    JSONT_INTEGER_EQ(element, 3);
+    TEST_PTR_NULL(json_array_element_mutable(json_object_member(clone, "d"),
+                                             1));
+
+    TEST_FALSE(json_value_equal(value, clone));
+    TEST_UINT_EQ(json_array_nb_elements(json_object_member(
+                     json_object_member(value, "a"), "b")), 2);
+    JSONT_STRING_EQ(json_object_member(json_object_member(value, "a"), "c"),
+                    "foo");
+    TEST_UINT_EQ(json_array_nb_elements(json_object_member(
+                     json_object_member(clone, "a"), "b")), 3);
+
+    /* The original can be deleted first */
+    json_value_delete(value);
+    JSONT_INTEGER_EQ(json_object_member(json_object_member(clone, "a"), "c"),
+                     1);
+    json_value_delete(clone);
+
+    /* Arrays and scalars */
+    JSONT_PARSE_ARRAY("[[1], \"foo\"]", 2, JSON_PARSE_DEFAULT);
+    clone = json_value_clone_shared(value);
+    TEST_INT_EQ(json_array_add_element(clone, json_null_new()), 0);
+    TEST_UINT_EQ(json_array_nb_elements(value), 2);
+    TEST_UINT_EQ(json_array_nb_elements(clone), 3);
+    child = json_value_clone_shared(json_array_element(value, 1));
+    JSONT_STRING_EQ(child, "foo");
+    json_value_delete(child);
+    json_value_delete(clone);
+    json_value_delete(value);
+}
+
+TEST(copy) {
+    struct json_value *value, *copy;
+
+    JSONT_PARSE("{\"a\": {\"b\": [1, 2.5], \"c\": \"foo\"}, \"d\": null,"
+                " \"e\": [true, {}, []]}", JSON_PARSE_DEFAULT);
+
+    copy = json_value_copy(value);
+    TEST_TRUE(json_value_equal(value, copy));
+    TEST_TRUE(json_object_member(value, "a") != json_object_member(copy, "a"));
+    TEST_INT_EQ(json_object_add_member(json_object_member(copy, "a"), "f",
+                                       json_integer_new(1)), 0);
+    TEST_FALSE(json_value_equal(value, copy));
+    TEST_FALSE(json_object_has_member(json_object_member(value, "a"), "f"));
+    json_value_delete(copy);
+    json_value_delete(value);
+
+    /* Indexed objects */
+    value = json_object_new();
+    for (int i = 0; i < 100; i++) {
+        char key[16];
+
+        snprintf(key, sizeof(key), "k%d", i);
+        json_object_add_member(value, key, json_integer_new(i));
+    }
+
+    copy = json_value_copy(value);
+    json_value_delete(value);
+    TEST_UINT_EQ(json_object_nb_members(copy), 100);
+    JSONT_INTEGER_EQ(json_object_member(copy, "k0"), 0);
+    JSONT_INTEGER_EQ(json_object_member(copy, "k73"), 73);
+    TEST_PTR_NULL(json_object_member(copy, "k100"));
+    json_object_add_member(copy, "k100", json_integer_new(100));
+    JSONT_INTEGER_EQ(json_object_member(copy, "k100"), 100);
+    json_value_delete(copy);
+}
+
 TEST(object_remove_member) {
     struct json_value *value;
 
@@ -329,10 +597,68 @@ TEST(object_remove_member) {
     TEST_UINT_EQ(json_object_nb_members(value), 2);
     TEST_FALSE(json_object_has_member(value, "b"));
     json_value_delete(value);
+
+    /* Indexed objects */
+    value = json_object_new();
+    for (int i = 0; i < 100; i++) {
+        char key[16];
+
+        snprintf(key, sizeof(key), "k%d", i);
+        json_object_add_member(value, key, json_integer_new(i));
+    }
+
+    json_object_remove_member(value, "k0");
+    json_object_remove_member(value, "k50");
+    json_object_remove_member(value, "k99");
+    json_object_remove_member(value, "k100");
+    TEST_UINT_EQ(json_object_nb_members(value), 97);
+    TEST_STRING_EQ(json_object_nth_member(value, 0, NULL), "k1");
+    TEST_STRING_EQ(json_object_nth_member(value, 49, NULL), "k51");
+    TEST_FALSE(json_object_has_member(value, "k50"));
+    JSONT_INTEGER_EQ(json_object_member(value, "k51"), 51);
+    JSONT_INTEGER_EQ(json_object_member(value, "k98"), 98);
+    json_value_delete(value);
+}
+
+TEST(object_remove_members) {
+    const char *keys[] = {"b", "d", "x", "e"};
+    struct json_value *value;
+
+    JSONT_PARSE("{\"a\": 1, \"b\": 2, \"c\": 3, \"d\": 4, \"e\": 5}",
+                JSON_PARSE_DEFAULT);
+    TEST_UINT_EQ(json_object_remove_members(value, keys, 4), 3);
+    TEST_UINT_EQ(json_object_nb_members(value), 2);
+    TEST_STRING_EQ(json_object_nth_member(value, 0, NULL), "a");
+    TEST_STRING_EQ(json_object_nth_member(value, 1, NULL), "c");
+    TEST_UINT_EQ(json_object_remove_members(value, keys, 4), 0);
+    TEST_UINT_EQ(json_object_remove_members(value, keys, 0), 0);
+    TEST_UINT_EQ(json_object_nb_members(value), 2);
+    json_value_delete(value);
+
+    JSONT_PARSE("{\"a\": 1, \"b\": 2, \"a\": 3}", JSON_PARSE_DEFAULT);
+    TEST_UINT_EQ(json_object_remove_members(value, keys, 1), 1);
+    TEST_UINT_EQ(json_object_nb_members(value), 2);
+    JSONT_INTEGER_EQ(json_object_member(value, "a"), 1);
+    json_value_delete(value);
+}
+
+TEST(object_filter) {
+    struct json_value *value;
+
+    JSONT_PARSE("{\"a\": 1, \"b\": 2, \"c\": 3, \"d\": 4, \"e\": 5}",
+                JSON_PARSE_DEFAULT);
+    TEST_UINT_EQ(json_object_filter(value, jsont_filter_is_odd, NULL), 2);
+    TEST_UINT_EQ(json_object_nb_members(value), 3);
+    TEST_STRING_EQ(json_object_nth_member(value, 0, NULL), "a");
+    TEST_STRING_EQ(json_object_nth_member(value, 1, NULL), "c");
+    TEST_STRING_EQ(json_object_nth_member(value, 2, NULL), "e");
+    TEST_FALSE(json_object_has_member(value, "d"));
+    TEST_UINT_EQ(json_object_filter(value, jsont_filter_is_odd, NULL), 0);
+    json_value_delete(value);
 }
 
 TEST(object_merge) {
-    struct json_value *obj1, *obj2;
+    struct json_value *obj1, *obj2, *clone;
 
     /* merge({}, {}) => {} */
     obj1 = json_object_new();
@@ -374,9 +700,964 @@ TEST(object_merge) {
     JSONT_INTEGER_EQ(json_object_member(obj1, "a"), 1);
     JSONT_INTEGER_EQ(json_object_member(obj1, "b"), 2);
     json_value_delete(obj1);
+
+    /* Merging in a shared object fails */
+    obj1 = json_object_new();
+    json_object_add_member(obj1, "o", json_object_new());
+    clone = json_value_clone_shared(obj1);
+    TEST_INT_EQ(json_object_merge(json_object_member(obj1, "o"), obj2), -1);
+    TEST_UINT_EQ(json_object_nb_members(json_object_member(obj1, "o")), 0);
+    TEST_INT_EQ(json_object_merge(json_object_member_mutable(obj1, "o"),
+                                  obj2), 0);
+    TEST_UINT_EQ(json_object_nb_members(json_object_member(obj1, "o")), 1);
+    TEST_UINT_EQ(json_object_nb_members(json_object_member(clone, "o")), 0);
+    json_value_delete(clone);
+    json_value_delete(obj1);
     json_value_delete(obj2);
 }
 
+TEST(pointer) {
+    struct json_pointer *pointer;
+    struct json_value *value, *clone, *member;
+
+#define JSONT_POINTER_GET(string_, expected_)                          \
+    do {                                                               \
+        struct json_value *expected;                                   \
+                                                                       \
+        pointer = json_pointer_compile(string_);                       \
+        if (!pointer)                                                  \
+            TEST_ABORT("cannot compile pointer: %s", c_get_error());   \
+                                                                       \
+        expected = json_parse_string(expected_, JSON_PARSE_DEFAULT);   \
+        member = json_pointer_get(pointer, value);                     \
+        TEST_PTR_NOT_NULL(member);                                     \
+        TEST_TRUE(json_value_equal(member, expected));                 \
+                                                                       \
+        json_value_delete(expected);                                   \
+        json_pointer_delete(pointer);                                  \
+    } while (0)
+
+#define JSONT_POINTER_MISSING(string_)                                 \
+    do {                                                               \
+        pointer = json_pointer_compile(string_);                       \
+        if (!pointer)                                                  \
+            TEST_ABORT("cannot compile pointer: %s", c_get_error());   \
+                                                                       \
+        TEST_PTR_NULL(json_pointer_get(pointer, value));               \
+        json_pointer_delete(pointer);                                  \
+    } while (0)
+
+    /* RFC 6901 section 5 */
+    JSONT_PARSE("{\"foo\": [\"bar\", \"baz\"], \"\": 0, \"a/b\": 1,"
+                " \"c%d\": 2, \"e^f\": 3, \"g|h\": 4, \"i\\\\j\": 5,"
+                " \"k\\\"l\": 6, \" \": 7, \"m~n\": 8}", JSON_PARSE_DEFAULT);
+
+    pointer = json_pointer_compile("");
+    TEST_UINT_EQ(json_pointer_nb_tokens(pointer), 0);
+    TEST_PTR_EQ(json_pointer_get(pointer, value), value);
+    json_pointer_delete(pointer);
+
+    JSONT_POINTER_GET("/foo", "[\"bar\", \"baz\"]");
+    JSONT_POINTER_GET("/foo/0", "\"bar\"");
+    JSONT_POINTER_GET("/", "0");
+    JSONT_POINTER_GET("/a~1b", "1");
+    JSONT_POINTER_GET("/c%d", "2");
+    JSONT_POINTER_GET("/e^f", "3");
+    JSONT_POINTER_GET("/g|h", "4");
+    JSONT_POINTER_GET("/i\\j", "5");
+    JSONT_POINTER_GET("/k\"l", "6");
+    JSONT_POINTER_GET("/ ", "7");
+    JSONT_POINTER_GET("/m~0n", "8");
+
+    JSONT_POINTER_MISSING("/bar");
+    JSONT_POINTER_MISSING("/foo/2");
+    JSONT_POINTER_MISSING("/foo/-");
+    JSONT_POINTER_MISSING("/foo/01");
+    JSONT_POINTER_MISSING("/foo/x");
+    JSONT_POINTER_MISSING("/foo/0/x");
+    JSONT_POINTER_MISSING("/foo/99999999999999999999999");
+
+    TEST_PTR_NULL(json_pointer_compile("foo"));
+    TEST_PTR_NULL(json_pointer_compile("/a~2"));
+    TEST_PTR_NULL(json_pointer_compile("/a~"));
+
+    json_value_delete(value);
+
+    /* Setting values */
+    JSONT_PARSE("{\"a\": {\"b\": [1, 2]}}", JSON_PARSE_DEFAULT);
+    clone = json_value_clone_shared(value);
+
+    pointer = json_pointer_compile("/a/b/0");
+    TEST_INT_EQ(json_pointer_set(pointer, clone, json_integer_new(3)), 0);
+    json_pointer_delete(pointer);
+
+    pointer = json_pointer_compile("/a/b/-");
+    TEST_INT_EQ(json_pointer_set(pointer, clone, json_integer_new(4)), 0);
+    json_pointer_delete(pointer);
+
+    pointer = json_pointer_compile("/a/c");
+    TEST_INT_EQ(json_pointer_set(pointer, clone, json_integer_new(5)), 0);
+    json_pointer_delete(pointer);
+
+    member = json_null_new();
+    pointer = json_pointer_compile("/a/b/5");
+    TEST_INT_EQ(json_pointer_set(pointer, clone, member), -1);
+    json_pointer_delete(pointer);
+    pointer = json_pointer_compile("/a/b/x");
+    TEST_INT_EQ(json_pointer_set(pointer, clone, member), -1);
+    TEST_STRING_EQ(c_get_error(), "invalid array index 'x'");
+    json_pointer_delete(pointer);
+    pointer = json_pointer_compile("/x/y");
+    TEST_INT_EQ(json_pointer_set(pointer, clone, member), -1);
+    json_pointer_delete(pointer);
+    pointer = json_pointer_compile("");
+    TEST_INT_EQ(json_pointer_set(pointer, clone, member), -1);
+    json_pointer_delete(pointer);
+    json_value_delete(member);
+
+    JSONT_POINTER_GET("/a/b", "[1, 2]");
+    json_value_delete(value);
+
+    value = clone;
+    JSONT_POINTER_GET("", "{\"a\": {\"b\": [3, 2, 4], \"c\": 5}}");
+    json_value_delete(value);
+
+#undef JSONT_POINTER_GET
+#undef JSONT_POINTER_MISSING
+}
+
+TEST(projection) {
+    struct json_projection *projection;
+    struct json_value *values[8];
+    const char *document;
+    char nested[2067];
+
+#define JSONT_PROJECT(string_)                                         \
+    do {                                                               \
+        if (json_parse_project(string_, strlen(string_),               \
+                               JSON_PARSE_DEFAULT, projection,         \
+                               values) == -1) {                        \
+            TEST_ABORT("cannot parse projection: %s", c_get_error());  \
+        }                                                              \
+    } while (0)
+
+#define JSONT_PROJECT_INVALID(string_)                                 \
+    do {                                                               \
+        TEST_INT_EQ(json_parse_project(string_, strlen(string_),       \
+                                       JSON_PARSE_DEFAULT, projection, \
+                                       values), -1);                   \
+        TEST_PTR_NULL(values[0]);                                      \
+    } while (0)
+
+#define JSONT_PROJECTED_EQ(i_, expected_)                              \
+    do {                                                               \
+        struct json_value *expected;                                   \
+                                                                       \
+        expected = json_parse_string(expected_, JSON_PARSE_DEFAULT);   \
+        TEST_PTR_NOT_NULL(values[i_]);                                 \
+        TEST_TRUE(json_value_equal(values[i_], expected));             \
+                                                                       \
+        json_value_delete(expected);                                   \
+        json_value_delete(values[i_]);                                 \
+    } while (0)
+
+    document = "{\"a\": {\"x\": [1, {\"y\": \"}]\\\\\\\"\"}],"
+               " \"b\": [10, 20, 30]},"
+               " \"c\\\"d\": \"e\", \"f\": [{\"g\": null}, {\"g\": true}]}";
+
+    projection = json_projection_new();
+    TEST_INT_EQ(json_projection_add_pointer(projection, "/a/b/1"), 0);
+    TEST_INT_EQ(json_projection_add_path(projection, "$['c\"d']"), 1);
+    TEST_INT_EQ(json_projection_add_path(projection, "$.f[1].g"), 2);
+    TEST_INT_EQ(json_projection_add_pointer(projection, "/missing"), 3);
+    TEST_INT_EQ(json_projection_add_path(projection, "$.a.b[1]"), 0);
+    TEST_UINT_EQ(json_projection_nb_targets(projection), 4);
+
+    JSONT_PROJECT(document);
+    JSONT_PROJECTED_EQ(0, "20");
+    JSONT_PROJECTED_EQ(1, "\"e\"");
+    JSONT_PROJECTED_EQ(2, "true");
+    TEST_PTR_NULL(values[3]);
+
+    json_projection_delete(projection);
+
+    /* Values selected inside a selected value */
+    projection = json_projection_new();
+    TEST_INT_EQ(json_projection_add_pointer(projection, "/a/b/2"), 0);
+    TEST_INT_EQ(json_projection_add_pointer(projection, "/a"), 1);
+    TEST_INT_EQ(json_projection_add_pointer(projection, "/a/x/1/y"), 2);
+
+    JSONT_PROJECT(document);
+    JSONT_PROJECTED_EQ(0, "30");
+    JSONT_PROJECTED_EQ(1, "{\"x\": [1, {\"y\": \"}]\\\\\\\"\"}],"
+                       " \"b\": [10, 20, 30]}");
+    JSONT_PROJECTED_EQ(2, "\"}]\\\\\\\"\"");
+
+    json_projection_delete(projection);
+
+    /* The root value */
+    projection = json_projection_new();
+    TEST_INT_EQ(json_projection_add_path(projection, "$"), 0);
+
+    JSONT_PROJECT("[1, 2]");
+    JSONT_PROJECTED_EQ(0, "[1, 2]");
+
+    json_projection_delete(projection);
+
+    /* Parsing stops once every value has been read */
+    projection = json_projection_new();
+    TEST_INT_EQ(json_projection_add_pointer(projection, "/0"), 0);
+
+    JSONT_PROJECT("[{\"a\": [1, \"]\"]}, 2, {invalid");
+    JSONT_PROJECTED_EQ(0, "{\"a\": [1, \"]\"]}");
+
+    JSONT_PROJECT_INVALID("[[1, \"2], 3]");
+
+    json_projection_delete(projection);
+
+    /* Duplicate keys: only the first member is followed, as with
+     * json_pointer_get(). */
+    projection = json_projection_new();
+    TEST_INT_EQ(json_projection_add_pointer(projection, "/a/b"), 0);
+
+    document = "{\"a\": {\"x\": 1}, \"a\": {\"b\": 2}}";
+    JSONT_PROJECT(document);
+    TEST_PTR_NULL(values[0]);
+
+    JSONT_PROJECT("{\"a\": {\"b\": 1}, \"a\": {\"b\": 2}}");
+    JSONT_PROJECTED_EQ(0, "1");
+
+    TEST_INT_EQ(json_parse_project(document, strlen(document),
+                                   JSON_PARSE_REJECT_DUPLICATE_KEYS,
+                                   projection, values), -1);
+    TEST_PTR_NULL(values[0]);
+
+    document = "{\"x\": 1, \"x\": 3, \"a\": {\"b\": 2}}";
+    TEST_INT_EQ(json_parse_project(document, strlen(document),
+                                   JSON_PARSE_REJECT_DUPLICATE_KEYS,
+                                   projection, values), -1);
+    TEST_PTR_NULL(values[0]);
+
+    json_projection_delete(projection);
+
+        /* Invalid skipped values */
+    projection = json_projection_new();
+    TEST_INT_EQ(json_projection_add_pointer(projection, "/b"), 0);
+
+    JSONT_PROJECT_INVALID("{\"a\": [1, {\"x\": 2}, \"b\": 3");
+    JSONT_PROJECT_INVALID("{\"a\": , \"b\": 3}");
+    JSONT_PROJECT_INVALID("{\"a\": \"\\\"}");
+    JSONT_PROJECT_INVALID("{\"a\": [1}, \"b\": 3}");
+    JSONT_PROJECT_INVALID("{\"a\": {\"x\": 1], \"b\": 3}");
+    JSONT_PROJECT_INVALID("{\"a\": [tru, 1], \"b\": 3}");
+    JSONT_PROJECT_INVALID("{\"a\": [true, 1x], \"b\": 3}");
+    JSONT_PROJECT_INVALID("{\"a\": [1 2], \"b\": 3}");
+    JSONT_PROJECT_INVALID("{\"a\": [1, ], \"b\": 3}");
+    JSONT_PROJECT_INVALID("{\"a\": {1: 2}, \"b\": 3}");
+    JSONT_PROJECT_INVALID("{\"a\": {\"x\" 2}, \"b\": 3}");
+    JSONT_PROJECT_INVALID("{\"a\": [@], \"b\": 3}");
+
+    JSONT_PROJECT("{\"a\": {\"x\": [true, false, null, -1.5e3, {}],"
+                  " \"y\": [[]]}, \"b\": 3}");
+    JSONT_PROJECTED_EQ(0, "3");
+
+    /* Skipped values are subject to the depth limit */
+    memcpy(nested, "{\"a\": ", 6);
+    memset(nested + 6, '[', 1025);
+    memset(nested + 6 + 1025, ']', 1025);
+    memcpy(nested + 6 + 2050, ", \"b\": 3}", 10);
+    nested[6 + 2050 + 10] = '\0';
+    JSONT_PROJECT_INVALID(nested);
+
+    nested[6] = ' ';
+    nested[6 + 2049] = ' ';
+    JSONT_PROJECT(nested);
+    JSONT_PROJECTED_EQ(0, "3");
+
+    json_projection_delete(projection);
+
+    /* Invalid queries */
+    projection = json_projection_new();
+
+    TEST_INT_EQ(json_projection_add_pointer(projection, "a"), -1);
+    TEST_INT_EQ(json_projection_add_pointer(projection, "/a/-"), -1);
+    TEST_INT_EQ(json_projection_add_path(projection, "a"), -1);
+    TEST_INT_EQ(json_projection_add_path(projection, "$.a[*]"), -1);
+    TEST_INT_EQ(json_projection_add_path(projection, "$.*"), -1);
+    TEST_INT_EQ(json_projection_add_path(projection, "$['a"), -1);
+    TEST_UINT_EQ(json_projection_nb_targets(projection), 0);
+
+    json_projection_delete(projection);
+
+#undef JSONT_PROJECT
+#undef JSONT_PROJECT_INVALID
+#undef JSONT_PROJECTED_EQ
+}
+
+TEST(frozen) {
+    struct json_value *value, *thawed;
+    struct json_frozen *frozen, *copy;
+    const struct json_frozen_value *root, *fvalue, *fmember;
+    char key[16];
+
+    JSONT_PARSE("{\"a\": 1, \"b\": [true, null, 2.5, \"foo\"],"
+                " \"c\": {\"a\": \"foo\", \"d\": {}}, \"e\": []}",
+                JSON_PARSE_DEFAULT);
+
+    frozen = json_freeze(value);
+    if (!frozen)
+        TEST_ABORT("cannot freeze value: %s", c_get_error());
+
+    root = json_frozen_root(frozen);
+    TEST_INT_EQ(json_frozen_value_type(root), JSON_OBJECT);
+    TEST_UINT_EQ(json_frozen_object_nb_members(root), 4);
+    TEST_STRING_EQ(json_frozen_object_nth_member(root, 1, &fmember), "b");
+    TEST_INT_EQ(json_frozen_value_type(fmember), JSON_ARRAY);
+
+    fvalue = json_frozen_object_member(root, "a");
+    TEST_INT_EQ(json_frozen_value_type(fvalue), JSON_INTEGER);
+    TEST_INT_EQ(json_frozen_integer_value(fvalue), 1);
+
+    fvalue = json_frozen_object_member(root, "b");
+    TEST_UINT_EQ(json_frozen_array_nb_elements(fvalue), 4);
+    TEST_TRUE(json_frozen_boolean_value(json_frozen_array_element(fvalue, 0)));
+    TEST_INT_EQ(json_frozen_value_type(json_frozen_array_element(fvalue, 1)),
+                JSON_NULL);
+    TEST_TRUE(json_frozen_real_value(json_frozen_array_element(fvalue, 2))
+              == 2.5);
+    TEST_STRING_EQ(json_frozen_string_value(
+                       json_frozen_array_element(fvalue, 3)), "foo");
+    TEST_TRUE(json_frozen_array_element(fvalue, 4) == NULL);
+
+    fvalue = json_frozen_object_member(root, "c");
+    TEST_STRING_EQ(json_frozen_string_value(
+                       json_frozen_object_member(fvalue, "a")), "foo");
+    TEST_UINT_EQ(json_frozen_object_nb_members(
+                     json_frozen_object_member(fvalue, "d")), 0);
+    TEST_FALSE(json_frozen_object_has_member(fvalue, "b"));
+    TEST_FALSE(json_frozen_object_has_member(root, "f"));
+
+    /* Frozen documents do not contain any pointer */
+    copy = json_frozen_clone(frozen);
+    json_frozen_delete(frozen);
+
+    thawed = json_frozen_value_thaw(json_frozen_root(copy));
+    TEST_TRUE(json_value_equal(value, thawed));
+    json_value_delete(thawed);
+
+    json_frozen_delete(copy);
+    json_value_delete(value);
+
+    /* Large objects and duplicate keys */
+    value = json_object_new();
+    for (int i = 0; i < 100; i++) {
+        snprintf(key, sizeof(key), "k%d", i);
+        json_object_add_member(value, key, json_integer_new(i));
+    }
+    json_object_add_member(value, "k10", json_integer_new(-1));
+
+    frozen = json_freeze(value);
+    root = json_frozen_root(frozen);
+
+    for (int i = 0; i < 100; i++) {
+        snprintf(key, sizeof(key), "k%d", i);
+        fvalue = json_frozen_object_member(root, key);
+        TEST_INT_EQ(json_frozen_integer_value(fvalue), i);
+    }
+    TEST_FALSE(json_frozen_object_has_member(root, "k100"));
+
+    json_frozen_delete(frozen);
+    json_value_delete(value);
+}
+
+TEST(binary) {
+    struct json_value *value, *decoded, *array;
+    uint8_t document[16 + 1 + 1026];
+    char *data, *text, *padded;
+    size_t len, text_len;
+
+#define JSONT_BINARY_DOCUMENT(payload_, payload_len_)                  \
+    do {                                                               \
+        memcpy(document, "JSNB\0\0\0\1\0\0\0\0\0\0\0", 15);            \
+        document[15] = (uint8_t)(16 + (payload_len_));                 \
+        memcpy(document + 16, payload_, payload_len_);                 \
+    } while (0)
+
+    JSONT_PARSE("{\"a\": [1, -2.5, \"foo\", true, null, -3, 9223372036854775807,"
+                " -9223372036854775808], \"b\": {\"a\": \"foo\\u0000bar\"},"
+                " \"c\": \"\", \"d\": \"foo\"}", JSON_PARSE_DEFAULT);
+
+    data = json_value_encode_binary(value, &len);
+    if (!data)
+        TEST_ABORT("cannot encode value: %s", c_get_error());
+    TEST_TRUE(memcmp(data, "JSNB", 4) == 0);
+
+    decoded = json_value_decode_binary(data, len);
+    if (!decoded)
+        TEST_ABORT("cannot decode value: %s", c_get_error());
+    TEST_TRUE(json_value_equal(value, decoded));
+    json_value_delete(decoded);
+
+    /* The size in the header delimits the document */
+    padded = c_malloc(len + 3);
+    memcpy(padded, data, len);
+    memcpy(padded + len, "xyz", 3);
+    decoded = json_value_decode_binary(padded, len + 3);
+    TEST_PTR_NOT_NULL(decoded);
+    json_value_delete(decoded);
+    c_free(padded);
+
+    /* Invalid documents */
+    TEST_PTR_NULL(json_value_decode_binary(data, len - 1));
+    TEST_PTR_NULL(json_value_decode_binary(data, 8));
+
+    data[0] ^= 0xff;
+    TEST_PTR_NULL(json_value_decode_binary(data, len));
+    data[0] ^= 0xff;
+
+    c_free(data);
+    json_value_delete(value);
+
+    JSONT_BINARY_DOCUMENT("\x00\x04", 2);
+    TEST_PTR_NULL(json_value_decode_binary(document, 18));
+    JSONT_BINARY_DOCUMENT("\x01\x01" "a" "\x0e\x01\x00", 5);
+    TEST_PTR_NULL(json_value_decode_binary(document, 21));
+    JSONT_BINARY_DOCUMENT("\x00\x00\x00", 3);
+    TEST_PTR_NULL(json_value_decode_binary(document, 19));
+    JSONT_BINARY_DOCUMENT("\x00\x07", 2);
+    TEST_PTR_NULL(json_value_decode_binary(document, 18));
+    JSONT_BINARY_DOCUMENT("\x00\xfd\xff\xff\xff\xff\xff\xff\xff\xff\x7f", 11);
+    TEST_PTR_NULL(json_value_decode_binary(document, 27));
+
+    /* Small values are encoded in a single byte */
+    value = json_integer_new(-3);
+    data = json_value_encode_binary(value, &len);
+    TEST_UINT_EQ(len, 18);
+    decoded = json_value_decode_binary(data, len);
+    JSONT_INTEGER_EQ(decoded, -3);
+    json_value_delete(decoded);
+    c_free(data);
+    json_value_delete(value);
+
+    /* Keys and strings are only stored once */
+    value = json_array_new();
+    for (int i = 0; i < 100; i++) {
+        struct json_value *record;
+
+        record = json_object_new();
+        json_object_add_member(record, "name", json_string_new("record"));
+        json_object_add_member(record, "value", json_integer_new(i));
+        json_array_add_element(value, record);
+    }
+
+    data = json_value_encode_binary(value, &len);
+    text = json_value_format(value, JSON_FORMAT_DEFAULT, &text_len);
+    TEST_TRUE(len * 4 < text_len);
+
+    decoded = json_value_decode_binary(data, len);
+    TEST_TRUE(json_value_equal(value, decoded));
+    TEST_TRUE(json_object_nth_member(json_array_element(decoded, 0), 0, NULL)
+              == json_object_nth_member(json_array_element(decoded, 99), 0,
+                                        NULL));
+    json_value_delete(decoded);
+
+    c_free(text);
+    c_free(data);
+    json_value_delete(value);
+
+    /* Nesting depth */
+    value = json_null_new();
+    for (int i = 0; i < 1024; i++) {
+        array = json_array_new();
+        json_array_add_element(array, value);
+        value = array;
+    }
+
+    data = json_value_encode_binary(value, &len);
+    if (!data)
+        TEST_ABORT("cannot encode value: %s", c_get_error());
+    decoded = json_value_decode_binary(data, len);
+    TEST_PTR_NOT_NULL(decoded);
+    json_value_delete(decoded);
+    c_free(data);
+
+    array = json_array_new();
+    json_array_add_element(array, value);
+    TEST_PTR_NULL(json_value_encode_binary(array, &len));
+    json_value_delete(array);
+
+    memcpy(document, "JSNB\0\0\0\1\0\0\0\0\0\0", 14);
+    document[14] = (uint8_t)(sizeof(document) >> 8);
+    document[15] = (uint8_t)sizeof(document);
+    document[16] = 0x00;
+    memset(document + 17, 0x0d, 1025);
+    document[sizeof(document) - 1] = 0x00;
+    TEST_PTR_NULL(json_value_decode_binary(document, sizeof(document)));
+
+#undef JSONT_BINARY_DOCUMENT
+}
+
+TEST(frozen_open) {
+    struct json_value *value, *decoded, *array;
+    const struct json_frozen *frozen;
+    struct json_frozen *image;
+    char *data, tmp_path[] = "/tmp/libjson-test-XXXXXX";
+    uint64_t tag;
+    size_t len;
+    int fd;
+
+    JSONT_PARSE("{\"a\": [1, -2.5, \"foo\", true, null],"
+                " \"b\": {\"a\": \"foo\\u0000bar\"}, \"c\": \"\"}",
+                JSON_PARSE_DEFAULT);
+
+    image = json_freeze(value);
+    if (!image)
+        TEST_ABORT("cannot freeze value: %s", c_get_error());
+    data = (char *)image;
+    len = json_frozen_size(image);
+
+    frozen = json_frozen_open(data, len, JSON_FROZEN_OPEN_DEFAULT);
+    if (!frozen)
+        TEST_ABORT("cannot open document: %s", c_get_error());
+    TEST_UINT_EQ(json_frozen_object_nb_members(json_frozen_root(frozen)), 3);
+
+    /* Invalid documents */
+    TEST_PTR_NULL(json_frozen_open(data, len - 8, JSON_FROZEN_OPEN_DEFAULT));
+    TEST_PTR_NULL(json_frozen_open(data, 8, JSON_FROZEN_OPEN_DEFAULT));
+
+    data[0] ^= 0xff;
+    TEST_PTR_NULL(json_frozen_open(data, len, JSON_FROZEN_OPEN_DEFAULT));
+    data[0] ^= 0xff;
+
+    /* Mapped files */
+    fd = mkstemp(tmp_path);
+    if (fd == -1)
+        TEST_ABORT("cannot create temporary file: %s", strerror(errno));
+    if (write(fd, data, len) != (ssize_t)len)
+        TEST_ABORT("cannot write temporary file: %s", strerror(errno));
+    close(fd);
+
+    frozen = json_frozen_map_file(tmp_path, JSON_FROZEN_OPEN_DEFAULT);
+    if (!frozen)
+        TEST_ABORT("cannot map file: %s", c_get_error());
+    decoded = json_frozen_value_thaw(json_frozen_root(frozen));
+    TEST_TRUE(json_value_equal(value, decoded));
+    json_value_delete(decoded);
+    json_frozen_unmap(frozen);
+
+    unlink(tmp_path);
+
+    json_frozen_delete(image);
+    json_value_delete(value);
+
+    /* Nesting depth */
+    value = json_null_new();
+    for (int i = 0; i < 1024; i++) {
+        array = json_array_new();
+        json_array_add_element(array, value);
+        value = array;
+    }
+
+    image = json_freeze(value);
+    if (!image)
+        TEST_ABORT("cannot freeze value: %s", c_get_error());
+    data = (char *)image;
+    len = json_frozen_size(image);
+
+    frozen = json_frozen_open(data, len, JSON_FROZEN_OPEN_DEFAULT);
+    if (!frozen)
+        TEST_ABORT("cannot open document: %s", c_get_error());
+
+    /* Replace the innermost null by an empty array */
+    memcpy(&tag, data + len - 8, sizeof(uint64_t));
+    TEST_UINT_EQ(tag, JSON_NULL);
+    tag = JSON_ARRAY;
+    memcpy(data + len - 8, &tag, sizeof(uint64_t));
+
+    TEST_PTR_NULL(json_frozen_open(data, len, JSON_FROZEN_OPEN_DEFAULT));
+    json_frozen_delete(image);
+
+    array = json_array_new();
+    json_array_add_element(array, value);
+    TEST_PTR_NULL(json_freeze(array));
+    json_value_delete(array);
+}
+
+TEST(cbor) {
+    struct json_value *value, *decoded;
+    uint8_t nested[1026];
+    char *data;
+    size_t len;
+
+#define JSONT_CBOR_DECODE(data_, json_)                                \
+    do {                                                               \
+        struct json_value *expected_;                                  \
+                                                                       \
+        value = json_value_decode_cbor(data_, sizeof(data_) - 1);      \
+        if (!value)                                                    \
+            TEST_ABORT("cannot decode cbor: %s", c_get_error());       \
+                                                                       \
+        expected_ = json_parse(json_, strlen(json_), 0);               \
+        TEST_TRUE(json_value_equal(value, expected_));                 \
+                                                                       \
+        json_value_delete(expected_);                                  \
+        json_value_delete(value);                                      \
+    } while (0)
+
+    /* RFC 8949 appendix A */
+    JSONT_CBOR_DECODE("\x00", "0");
+    JSONT_CBOR_DECODE("\x18\x64", "100");
+    JSONT_CBOR_DECODE("\x3a\x00\x0f\x42\x3f", "-1000000");
+    JSONT_CBOR_DECODE("\x3b\x7f\xff\xff\xff\xff\xff\xff\xff",
+                      "-9223372036854775808");
+    JSONT_CBOR_DECODE("\xf9\x3e\x00", "1.5");
+    JSONT_CBOR_DECODE("\xfa\x47\xc3\x50\x00", "100000.0");
+    JSONT_CBOR_DECODE("\xfb\x3f\xf1\x99\x99\x99\x99\x99\x9a", "1.1");
+    JSONT_CBOR_DECODE("\xf4", "false");
+    JSONT_CBOR_DECODE("\xf6", "null");
+    JSONT_CBOR_DECODE("\x64\x49\x45\x54\x46", "\"IETF\"");
+    JSONT_CBOR_DECODE("\x7f\x65\x73\x74\x72\x65\x61\x64\x6d\x69\x6e\x67\xff",
+                      "\"streaming\"");
+    JSONT_CBOR_DECODE("\x83\x01\x82\x02\x03\x82\x04\x05", "[1, [2, 3], [4, 5]]");
+    JSONT_CBOR_DECODE("\x9f\x01\x82\x02\x03\x9f\x04\x05\xff\xff",
+                      "[1, [2, 3], [4, 5]]");
+    JSONT_CBOR_DECODE("\xa2\x61\x61\x01\x61\x62\x82\x02\x03",
+                      "{\"a\": 1, \"b\": [2, 3]}");
+    JSONT_CBOR_DECODE("\xbf\x63\x46\x75\x6e\xf5\x63\x41\x6d\x74\x21\xff",
+                      "{\"Fun\": true, \"Amt\": -2}");
+    JSONT_CBOR_DECODE("\xc1\x1a\x51\x4b\x67\xb0", "1363896240");
+    JSONT_CBOR_DECODE("\x62\xc3\xa9", "\"\xc3\xa9\"");
+
+#undef JSONT_CBOR_DECODE
+
+    /* Invalid items */
+    TEST_TRUE(json_value_decode_cbor("\x1b\x80\x00\x00\x00\x00\x00\x00\x00",
+                                     9) == NULL);
+    TEST_TRUE(json_value_decode_cbor("\x43\x01\x02\x03", 4) == NULL);
+    TEST_TRUE(json_value_decode_cbor("\xa1\x01\x02", 3) == NULL);
+    TEST_TRUE(json_value_decode_cbor("\x82\x01", 2) == NULL);
+    TEST_TRUE(json_value_decode_cbor("\x01\x02", 2) == NULL);
+    TEST_TRUE(json_value_decode_cbor("\xff", 1) == NULL);
+
+    /* Text strings must be valid UTF-8 */
+    TEST_TRUE(json_value_decode_cbor("\x62\xc3\x28", 3) == NULL);
+    TEST_TRUE(json_value_decode_cbor("\x62\xc0\x80", 3) == NULL);
+    TEST_TRUE(json_value_decode_cbor("\x63\xed\xa0\x80", 4) == NULL);
+    TEST_TRUE(json_value_decode_cbor("\x64\xf4\x90\x80\x80", 5) == NULL);
+    TEST_TRUE(json_value_decode_cbor("\x7f\x61\xc3\x61\xa9\xff",
+                                     6) == NULL);
+    TEST_TRUE(json_value_decode_cbor("\xa1\x61\xff\x01", 4) == NULL);
+
+    /* Nesting depth */
+    memset(nested, 0x81, sizeof(nested));
+    nested[1024] = 0x00;
+    value = json_value_decode_cbor(nested, 1025);
+    if (!value)
+        TEST_ABORT("cannot decode cbor: %s", c_get_error());
+    json_value_delete(value);
+
+    nested[1024] = 0x81;
+    TEST_TRUE(json_value_decode_cbor(nested, sizeof(nested)) == NULL);
+
+    /* Round trip */
+    JSONT_PARSE("{\"a\": [1, -1, 255, -256, 65536, -4294967297, 1.5],"
+                " \"b\": {\"c\": \"foo\", \"d\": null, \"e\": false},"
+                " \"f\": \"\", \"g\": []}", JSON_PARSE_DEFAULT);
+
+    data = json_value_encode_cbor(value, &len);
+    decoded = json_value_decode_cbor(data, len);
+    if (!decoded)
+        TEST_ABORT("cannot decode cbor: %s", c_get_error());
+    TEST_TRUE(json_value_equal(value, decoded));
+
+    json_value_delete(decoded);
+    c_free(data);
+    json_value_delete(value);
+}
+
+TEST(msgpack) {
+    struct json_value *value, *decoded;
+    uint8_t nested[1026];
+    char *data;
+    size_t len;
+
+#define JSONT_MSGPACK_DECODE(data_, json_)                             \
+    do {                                                               \
+        struct json_value *expected_;                                  \
+                                                                       \
+        value = json_value_decode_msgpack(data_, sizeof(data_) - 1);   \
+        if (!value)                                                    \
+            TEST_ABORT("cannot decode msgpack: %s", c_get_error());    \
+                                                                       \
+        expected_ = json_parse(json_, strlen(json_), 0);               \
+        TEST_TRUE(json_value_equal(value, expected_));                 \
+                                                                       \
+        json_value_delete(expected_);                                  \
+        json_value_delete(value);                                      \
+    } while (0)
+
+    JSONT_MSGPACK_DECODE("\x7f", "127");
+    JSONT_MSGPACK_DECODE("\xe0", "-32");
+    JSONT_MSGPACK_DECODE("\xcd\x01\x00", "256");
+    JSONT_MSGPACK_DECODE("\xd2\xff\xff\xff\x00", "-256");
+    JSONT_MSGPACK_DECODE("\xca\x3f\xc0\x00\x00", "1.5");
+    JSONT_MSGPACK_DECODE("\xc3", "true");
+    JSONT_MSGPACK_DECODE("\xc0", "null");
+    JSONT_MSGPACK_DECODE("\xa3\x66\x6f\x6f", "\"foo\"");
+    JSONT_MSGPACK_DECODE("\xd9\x03\x66\x6f\x6f", "\"foo\"");
+    JSONT_MSGPACK_DECODE("\x92\x01\x91\x02", "[1, [2]]");
+    JSONT_MSGPACK_DECODE("\xdc\x00\x02\x01\x02", "[1, 2]");
+    JSONT_MSGPACK_DECODE("\x82\xa1\x61\x01\xa1\x62\x80",
+                         "{\"a\": 1, \"b\": {}}");
+
+#undef JSONT_MSGPACK_DECODE
+
+    /* Invalid items */
+    TEST_TRUE(json_value_decode_msgpack("\xc1", 1) == NULL);
+    TEST_TRUE(json_value_decode_msgpack("\xc4\x01\x00", 3) == NULL);
+    TEST_TRUE(json_value_decode_msgpack("\xd4\x01\x00", 3) == NULL);
+    TEST_TRUE(json_value_decode_msgpack("\x81\x01\x02", 3) == NULL);
+    TEST_TRUE(json_value_decode_msgpack("\x92\x01", 2) == NULL);
+    TEST_TRUE(json_value_decode_msgpack("\xa3\x66\x6f", 3) == NULL);
+    TEST_TRUE(json_value_decode_msgpack("\xcf\x80\x00\x00\x00\x00\x00\x00\x00",
+                                        9) == NULL);
+
+    /* Nesting depth */
+    memset(nested, 0x91, sizeof(nested));
+    nested[1024] = 0xc0;
+    value = json_value_decode_msgpack(nested, 1025);
+    if (!value)
+        TEST_ABORT("cannot decode msgpack: %s", c_get_error());
+    json_value_delete(value);
+
+    nested[1024] = 0x91;
+    TEST_TRUE(json_value_decode_msgpack(nested, sizeof(nested)) == NULL);
+
+    /* Round trip */
+    JSONT_PARSE("{\"a\": [1, -1, 255, -256, 65536, -4294967297, 1.5],"
+                " \"b\": {\"c\": \"foo\", \"d\": null, \"e\": false},"
+                " \"f\": \"\", \"g\": []}", JSON_PARSE_DEFAULT);
+
+    data = json_value_encode_msgpack(value, &len);
+    decoded = json_value_decode_msgpack(data, len);
+    if (!decoded)
+        TEST_ABORT("cannot decode msgpack: %s", c_get_error());
+    TEST_TRUE(json_value_equal(value, decoded));
+
+    json_value_delete(decoded);
+    c_free(data);
+    json_value_delete(value);
+}
+
+TEST(decoder) {
+    enum json_decoder_format formats[] = {
+        JSON_DECODER_CBOR,
+        JSON_DECODER_MSGPACK,
+    };
+    struct json_value *value;
+
+    JSONT_PARSE("{\"a\": [1, 2, {\"b\": \"foo\"}], \"c\": []}",
+                JSON_PARSE_DEFAULT);
+
+    for (size_t f = 0; f < sizeof(formats) / sizeof(formats[0]); f++) {
+        struct json_decoder *decoder;
+        struct c_buffer *buf;
+        struct json_value *decoded;
+        const char *data;
+        size_t len;
+        int nb_values;
+
+        /* Three items fed one byte at a time */
+        buf = c_buffer_new();
+
+        for (int i = 0; i < 3; i++) {
+            if (formats[f] == JSON_DECODER_CBOR) {
+                json_value_encode_cbor_to_buffer(value, buf);
+            } else {
+                json_value_encode_msgpack_to_buffer(value, buf);
+            }
+        }
+
+        data = c_buffer_data(buf);
+        len = c_buffer_length(buf);
+
+        decoder = json_decoder_new(formats[f]);
+        nb_values = 0;
+
+        for (size_t i = 0; i < len; i++) {
+            int ret;
+
+            json_decoder_feed(decoder, data + i, 1);
+
+            while ((ret = json_decoder_next(decoder, &decoded)) == 1) {
+                TEST_TRUE(json_value_equal(value, decoded));
+                json_value_delete(decoded);
+                nb_values++;
+            }
+
+            if (ret == -1)
+                TEST_ABORT("cannot decode item: %s", c_get_error());
+        }
+
+        TEST_INT_EQ(nb_values, 3);
+
+        json_decoder_delete(decoder);
+        c_buffer_delete(buf);
+    }
+
+    json_value_delete(value);
+
+    /* Nesting depth */
+    for (size_t f = 0; f < sizeof(formats) / sizeof(formats[0]); f++) {
+        struct json_decoder *decoder;
+        struct json_value *decoded;
+        uint8_t nested[1025];
+
+        memset(nested, (formats[f] == JSON_DECODER_CBOR) ? 0x81 : 0x91,
+               sizeof(nested));
+
+        decoder = json_decoder_new(formats[f]);
+        json_decoder_feed(decoder, nested, sizeof(nested));
+        TEST_INT_EQ(json_decoder_next(decoder, &decoded), -1);
+        json_decoder_delete(decoder);
+    }
+}
+
+struct jsont_allocator_stats {
+    size_t nb_allocs;
+    size_t nb_reallocs;
+    size_t nb_frees;
+};
+
+static void *
+jsont_allocator_alloc(void *data, size_t size) {
+    struct jsont_allocator_stats *stats;
+
+    stats = data;
+    stats->nb_allocs++;
+
+    return malloc(size);
+}
+
+static void *
+jsont_allocator_realloc(void *data, void *ptr, size_t size) {
+    struct jsont_allocator_stats *stats;
+
+    stats = data;
+    if (ptr) {
+        stats->nb_reallocs++;
+    } else {
+        stats->nb_allocs++;
+    }
+
+    return realloc(ptr, size);
+}
+
+static void
+jsont_allocator_free(void *data, void *ptr) {
+    struct jsont_allocator_stats *stats;
+
+    stats = data;
+    stats->nb_frees++;
+
+    free(ptr);
+}
+
+TEST(allocator) {
+    struct jsont_allocator_stats stats;
+    struct json_allocator allocator;
+    const struct json_allocator *previous;
+    struct json_value *value, *copy;
+    struct json_schema *schema;
+    char *cbor;
+    size_t nb_allocs, nb_reallocs, nb_frees, cbor_len;
+
+    memset(&stats, 0, sizeof(struct jsont_allocator_stats));
+
+    allocator.alloc = jsont_allocator_alloc;
+    allocator.realloc = jsont_allocator_realloc;
+    allocator.free = jsont_allocator_free;
+    allocator.data = &stats;
+
+    /* Values created with a thread allocator */
+    previous = json_use_allocator(&allocator);
+    TEST_PTR_NULL(previous);
+
+    JSONT_PARSE("{\"a\": [1, \"foo\", {\"b\": \"bar\"}], \"c\": true}",
+                JSON_PARSE_DEFAULT);
+    TEST_TRUE(stats.nb_allocs > 0);
+
+    json_object_add_member(value, "d", json_string_new_printf("%d", 42));
+    JSONT_STRING_EQ(json_object_member(value, "d"), "42");
+
+    cbor = json_value_encode_cbor(value, &cbor_len);
+    copy = json_value_decode_cbor(cbor, cbor_len);
+    TEST_TRUE(json_value_equal(value, copy));
+    json_value_delete(copy);
+    c_free(cbor);
+
+    /* Schemas always use the default allocator */
+    nb_allocs = stats.nb_allocs;
+    schema = json_schema_parse_string("{\"enum\": [{\"a\": 1}]}");
+    TEST_PTR_NOT_NULL(schema);
+    TEST_UINT_EQ(stats.nb_allocs, nb_allocs);
+
+    json_value_delete(value);
+
+    TEST_PTR_EQ(json_use_allocator(previous), &allocator);
+    json_schema_delete(schema);
+
+    /* Clones made with a thread allocator share nothing with the original */
+    JSONT_PARSE("{\"a\": [1, \"foo\", {\"b\": \"bar\"}], \"c\": true}",
+                JSON_PARSE_DEFAULT);
+
+    json_use_allocator(&allocator);
+    nb_allocs = stats.nb_allocs;
+    copy = json_value_clone(value);
+    TEST_TRUE(stats.nb_allocs > nb_allocs);
+    TEST_TRUE(json_value_equal(value, copy));
+    TEST_TRUE(json_object_nth_member(value, 0, NULL)
+           != json_object_nth_member(copy, 0, NULL));
+    TEST_TRUE(json_object_member(value, "a")
+           != json_object_member(copy, "a"));
+    json_value_delete(copy);
+    json_use_allocator(previous);
+
+    json_value_delete(value);
+
+    /* Values are resized and freed with the allocator which created them,
+     * whatever the allocator selected at the time. */
+    json_use_allocator(&allocator);
+    JSONT_PARSE("[1, {\"a\": \"foo\"}]", JSON_PARSE_DEFAULT);
+    json_use_allocator(previous);
+
+    nb_reallocs = stats.nb_reallocs;
+    for (int i = 0; i < 32; i++)
+        json_array_add_element(value, json_integer_new(i));
+    TEST_TRUE(stats.nb_reallocs > nb_reallocs);
+
+    nb_allocs = stats.nb_allocs;
+    copy = json_value_clone(value);
+    TEST_UINT_EQ(stats.nb_allocs, nb_allocs);
+    TEST_TRUE(json_value_equal(value, copy));
+    TEST_TRUE(json_array_element(value, 1) != json_array_element(copy, 1));
+
+    nb_frees = stats.nb_frees;
+    json_value_delete(copy);
+    TEST_UINT_EQ(stats.nb_frees, nb_frees);
+
+    json_value_delete(value);
+    TEST_UINT_EQ(stats.nb_frees, stats.nb_allocs);
+
+    /* The default allocator is referenced by the values created with it */
+    json_set_allocator(&allocator);
+    value = json_string_new("foo");
+    json_set_allocator(NULL);
+
+    json_value_delete(value);
+    TEST_UINT_EQ(stats.nb_frees, stats.nb_allocs);
+}
+
 TEST(invalid) {
     JSONT_IS_INVALID("", JSON_PARSE_DEFAULT);
 }
@@ -628,8 +1909,25 @@ main(int argc, char **argv) {
     TEST_RUN(suite, null);
     TEST_RUN(suite, objects);
     TEST_RUN(suite, object_iterators);
+    TEST_RUN(suite, object_key_interning);
+    TEST_RUN(suite, object_add_member_nocopy);
+    TEST_RUN(suite, large_objects);
+    TEST_RUN(suite, clone);
+    TEST_RUN(suite, clone_shared);
+    TEST_RUN(suite, copy);
     TEST_RUN(suite, object_remove_member);
+    TEST_RUN(suite, object_remove_members);
+    TEST_RUN(suite, object_filter);
     TEST_RUN(suite, object_merge);
+    TEST_RUN(suite, pointer);
+    TEST_RUN(suite, projection);
+    TEST_RUN(suite, frozen);
+    TEST_RUN(suite, binary);
+    TEST_RUN(suite, frozen_open);
+    TEST_RUN(suite, cbor);
+    TEST_RUN(suite, msgpack);
+    TEST_RUN(suite, decoder);
+    TEST_RUN(suite, allocator);
 
     TEST_RUN(suite, invalid);
     TEST_RUN(suite, invalid_arrays);
@@ -17,10 +17,12 @@
 #include "../src/json.h"
 #include "tests.h"
 
+/* Documents are also validated while being parsed, with and without
+ * building the document, and must give the same result. */
 #define JSONT_SCHEMA_VALID(schema_string_, json_string_)          \
     do {                                                          \
         struct json_schema *schema;                               \
-        struct json_value *value;                                 \
+        struct json_value *value, *parsed_value;                  \
                                                                   \
         schema = json_schema_parse(schema_string_,                \
                                    strlen(schema_string_));       \
@@ -35,6 +37,25 @@
         if (json_schema_validate(schema, value) == -1)            \
             TEST_ABORT("validation failed: %s", c_get_error());   \
                                                                   \
+        if (json_parse_validate(json_string_,                     \
+                                strlen(json_string_),             \
+                                JSON_PARSE_DEFAULT, schema,       \
+                                NULL) == -1) {                    \
+            TEST_ABORT("validation while parsing failed: %s",     \
+                       c_get_error());                            \
+        }                                                         \
+                                                                  \
+        if (json_parse_validate(json_string_,                     \
+                                strlen(json_string_),             \
+                                JSON_PARSE_DEFAULT, schema,       \
+                                &parsed_value) == -1) {           \
+            TEST_ABORT("validation while parsing failed: %s",     \
+                       c_get_error());                            \
+        }                                                         \
+                                                                  \
+        TEST_TRUE(json_value_equal(parsed_value, value));         \
+                                                                  \
+        json_value_delete(parsed_value);                          \
         json_value_delete(value);                                 \
         json_schema_delete(schema);                               \
     } while (0)
@@ -42,7 +63,7 @@
 #define JSONT_SCHEMA_INVALID(schema_string_, json_string_)        \
     do {                                                          \
         struct json_schema *schema;                               \
-        struct json_value *value;                                 \
+        struct json_value *value, *parsed_value;                  \
                                                                   \
         schema = json_schema_parse(schema_string_,                \
                                    strlen(schema_string_));       \
@@ -57,6 +78,23 @@
         if (json_schema_validate(schema, value) == 0)             \
             TEST_ABORT("validation succeeded");                   \
                                                                   \
+        if (json_parse_validate(json_string_,                     \
+                                strlen(json_string_),             \
+                                JSON_PARSE_DEFAULT, schema,       \
+                                NULL) == 0) {                     \
+            TEST_ABORT("validation while parsing succeeded");     \
+        }                                                         \
+                                                                  \
+        parsed_value = NULL;                                      \
+        if (json_parse_validate(json_string_,                     \
+                                strlen(json_string_),             \
+                                JSON_PARSE_DEFAULT, schema,       \
+                                &parsed_value) == 0) {            \
+            TEST_ABORT("validation while parsing succeeded");     \
+        }                                                         \
+                                                                  \
+        TEST_PTR_NULL(parsed_value);                              \
+                                                                  \
         json_value_delete(value);                                 \
         json_schema_delete(schema);                               \
     } while (0)
@@ -80,6 +118,18 @@ TEST(array) {
     JSONT_SCHEMA_VALID("{\"uniqueItems\": true}", "[\"\", {}, true, null]");
     JSONT_SCHEMA_INVALID("{\"uniqueItems\": true}", "[1, 1]");
     JSONT_SCHEMA_INVALID("{\"uniqueItems\": true}", "[\"foo\", \"foo\"]");
+    JSONT_SCHEMA_VALID("{\"uniqueItems\": true}",
+                       "[1, 2, 3, 4, 5, 6, 7, 8, 9, \"1\", 1.5, [1], {\"a\": 1},"
+                       " {\"a\": 2}, {\"b\": 1}, [1, 2], [2, 1], true, false]");
+    JSONT_SCHEMA_INVALID("{\"uniqueItems\": true}",
+                         "[1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 9]");
+    JSONT_SCHEMA_INVALID("{\"uniqueItems\": true}",
+                         "[1, 2, 3, 4, 5, 6, 7, 8, 9, 0.0,"
+                         " [{\"a\": 1, \"b\": [2]}], -0.0]");
+    JSONT_SCHEMA_INVALID("{\"uniqueItems\": true}",
+                         "[1, 2, 3, 4, 5, 6, 7, 8, 9,"
+                         " {\"a\": 1, \"b\": [2, {\"c\": null}]},"
+                         " {\"b\": [2, {\"c\": null}], \"a\": 1}]");
     JSONT_SCHEMA_VALID("{\"uniqueItems\": false}", "[]");
     JSONT_SCHEMA_VALID("{\"uniqueItems\": false}", "[1, 1]");
 
@@ -116,6 +166,43 @@ TEST(array) {
                          "[1,2,3]");
 }
 
+TEST(unique_items) {
+    struct json_schema *schema;
+    struct json_value *value, *element;
+    char *string;
+
+    schema = json_schema_parse_string("{\"uniqueItems\": true}");
+    if (!schema)
+        TEST_ABORT("cannot parse schema: %s", c_get_error());
+
+    /* Validation does not reorder object members */
+    string = "[{\"b\": 1, \"a\": 2}, {\"a\": 2, \"b\": 1}]";
+    value = json_parse(string, strlen(string), JSON_PARSE_DEFAULT);
+    if (!value)
+        TEST_ABORT("cannot parse value: %s", c_get_error());
+
+    TEST_INT_EQ(json_schema_validate(schema, value), -1);
+
+    element = json_array_element(value, 0);
+    TEST_STRING_EQ(json_object_nth_member(element, 0, NULL), "b");
+    TEST_STRING_EQ(json_object_nth_member(element, 1, NULL), "a");
+
+    json_value_delete(value);
+
+    /* Large arrays */
+    value = json_array_new();
+    for (int64_t i = 0; i < 50000; i++)
+        json_array_add_element(value, json_integer_new(i));
+
+    TEST_INT_EQ(json_schema_validate(schema, value), 0);
+
+    json_array_add_element(value, json_integer_new(25000));
+    TEST_INT_EQ(json_schema_validate(schema, value), -1);
+
+    json_value_delete(value);
+    json_schema_delete(schema);
+}
+
 TEST(object) {
     /* minProperties/maxProperties */
     JSONT_SCHEMA_VALID("{\"minProperties\":2, \"maxProperties\":4}",
@@ -137,6 +224,17 @@ TEST(object) {
     JSONT_SCHEMA_INVALID("{\"required\": [\"a\", \"b\"]}",
                          "{\"a\":1, \"c\":3, \"d\":4}");
     JSONT_SCHEMA_INVALID("{\"required\": [\"a\", \"b\"]}", "{}");
+    JSONT_SCHEMA_INVALID("{\"required\": [\"a\", \"b\"]}",
+                         "{\"a\":1, \"a\":2}");
+    JSONT_SCHEMA_VALID("{\"required\": [\"a\", \"b\"],"
+                       " \"properties\": {\"b\": {\"type\": \"integer\"}}}",
+                       "{\"a\":1, \"b\":2}");
+    JSONT_SCHEMA_INVALID("{\"required\": [\"a\", \"b\"],"
+                         " \"properties\": {\"b\": {\"type\": \"integer\"}}}",
+                         "{\"a\":1, \"b\":true}");
+    JSONT_SCHEMA_INVALID("{\"required\": [\"a\"],"
+                         " \"additionalProperties\": false}",
+                         "{\"a\":1}");
 
     /* properties/additionalProperties/patternProperties */
     JSONT_SCHEMA_VALID("{\"properties\": {\"a\": {\"type\": \"integer\"},"
@@ -269,11 +367,99 @@ TEST(generic) {
                                       "{\"type\": \"array\", \"minItems\": 3}]}",
                          "[1]");
 
+    /* Branches discriminated by a member with a single value */
+    JSONT_SCHEMA_VALID("{\"items\": {\"oneOf\": ["
+                       "  {\"type\": \"object\", \"required\": [\"kind\"],"
+                       "   \"properties\": {\"kind\": {\"enum\": [\"a\"]},"
+                       "                    \"a\": {\"type\": \"integer\"}}},"
+                       "  {\"type\": \"object\", \"required\": [\"kind\"],"
+                       "   \"properties\": {\"kind\": {\"enum\": [\"b\"]},"
+                       "                    \"a\": {\"type\": \"string\"}}},"
+                       "  {\"type\": \"string\"}]}}",
+                       "[{\"kind\": \"a\", \"a\": 1},"
+                       " {\"kind\": \"b\", \"a\": \"1\"}, \"c\"]");
+    JSONT_SCHEMA_INVALID("{\"items\": {\"oneOf\": ["
+                         "  {\"type\": \"object\", \"required\": [\"kind\"],"
+                         "   \"properties\": {\"kind\": {\"enum\": [\"a\"]},"
+                         "                    \"a\": {\"type\": \"integer\"}}},"
+                         "  {\"type\": \"object\", \"required\": [\"kind\"],"
+                         "   \"properties\": {\"kind\": {\"enum\": [\"b\"]},"
+                         "                    \"a\": {\"type\": \"string\"}}}]}}",
+                         "[{\"kind\": \"a\", \"a\": \"1\"}]");
+    JSONT_SCHEMA_INVALID("{\"anyOf\": ["
+                         "  {\"type\": \"object\", \"required\": [\"kind\"],"
+                         "   \"properties\": {\"kind\": {\"enum\": [\"a\"]}}},"
+                         "  {\"type\": \"array\"}]}",
+                         "{\"kind\": \"b\"}");
+
+    /* Branches referring to a schema being compiled */
+    JSONT_SCHEMA_VALID("{\"anyOf\": [{\"type\": \"integer\"},"
+                       "            {\"type\": \"array\","
+                       "             \"items\": {\"$ref\": \"#\"}}]}",
+                       "[1, [2, [3]]]");
+    JSONT_SCHEMA_INVALID("{\"anyOf\": [{\"type\": \"integer\"},"
+                         "            {\"type\": \"array\","
+                         "             \"items\": {\"$ref\": \"#\"}}]}",
+                         "[1, [2, [\"3\"]]]");
+
     /* not */
     JSONT_SCHEMA_VALID("{\"not\": {\"type\": \"object\"}}", "[]");
     JSONT_SCHEMA_INVALID("{\"not\": {\"type\": \"object\"}}", "{}");
 
-    /* TODO format */
+    /* format */
+    JSONT_SCHEMA_VALID("{\"format\": \"date-time\"}", "42");
+    JSONT_SCHEMA_VALID("{\"format\": \"date-time\"}",
+                       "\"2015-06-30T23:59:60Z\"");
+    JSONT_SCHEMA_VALID("{\"format\": \"date-time\"}",
+                       "\"2016-02-29t08:30:00.125+02:00\"");
+    JSONT_SCHEMA_INVALID("{\"format\": \"date-time\"}",
+                         "\"2015-02-29T08:30:00Z\"");
+    JSONT_SCHEMA_INVALID("{\"format\": \"date-time\"}",
+                         "\"2015-06-30T24:00:00Z\"");
+    JSONT_SCHEMA_INVALID("{\"format\": \"date-time\"}",
+                         "\"2015-06-30T08:30:00\"");
+    JSONT_SCHEMA_INVALID("{\"format\": \"date-time\"}", "\"2015-06-30\"");
+
+    JSONT_SCHEMA_VALID("{\"format\": \"email\"}", "\"john.doe+tag@example.com\"");
+    JSONT_SCHEMA_VALID("{\"format\": \"email\"}", "\"root@[127.0.0.1]\"");
+    JSONT_SCHEMA_INVALID("{\"format\": \"email\"}", "\"john..doe@example.com\"");
+    JSONT_SCHEMA_INVALID("{\"format\": \"email\"}", "\"john.doe\"");
+    JSONT_SCHEMA_INVALID("{\"format\": \"email\"}", "\"john@-example.com\"");
+
+    JSONT_SCHEMA_VALID("{\"format\": \"hostname\"}", "\"www.example.com\"");
+    JSONT_SCHEMA_VALID("{\"format\": \"hostname\"}", "\"localhost\"");
+    JSONT_SCHEMA_INVALID("{\"format\": \"hostname\"}", "\"example-.com\"");
+    JSONT_SCHEMA_INVALID("{\"format\": \"hostname\"}", "\"www..example.com\"");
+    JSONT_SCHEMA_INVALID("{\"format\": \"hostname\"}", "\"under_score.com\"");
+
+    JSONT_SCHEMA_VALID("{\"format\": \"ipv4\"}", "\"192.168.0.255\"");
+    JSONT_SCHEMA_INVALID("{\"format\": \"ipv4\"}", "\"192.168.0.256\"");
+    JSONT_SCHEMA_INVALID("{\"format\": \"ipv4\"}", "\"192.168.0\"");
+    JSONT_SCHEMA_INVALID("{\"format\": \"ipv4\"}", "\"192.168.00.1\"");
+
+    JSONT_SCHEMA_VALID("{\"format\": \"ipv6\"}", "\"::\"");
+    JSONT_SCHEMA_VALID("{\"format\": \"ipv6\"}", "\"::1\"");
+    JSONT_SCHEMA_VALID("{\"format\": \"ipv6\"}", "\"fe80::1:2\"");
+    JSONT_SCHEMA_VALID("{\"format\": \"ipv6\"}", "\"1:2:3:4:5:6:7:8\"");
+    JSONT_SCHEMA_VALID("{\"format\": \"ipv6\"}", "\"::ffff:10.0.0.1\"");
+    JSONT_SCHEMA_INVALID("{\"format\": \"ipv6\"}", "\"1:2:3:4:5:6:7:8:9\"");
+    JSONT_SCHEMA_INVALID("{\"format\": \"ipv6\"}", "\"1::2::3\"");
+    JSONT_SCHEMA_INVALID("{\"format\": \"ipv6\"}", "\"12345::\"");
+    JSONT_SCHEMA_INVALID("{\"format\": \"ipv6\"}", "\"1:2:3\"");
+
+    JSONT_SCHEMA_VALID("{\"format\": \"uri\"}",
+                       "\"http://example.com/a%20b?c=d#e\"");
+    JSONT_SCHEMA_VALID("{\"format\": \"uri\"}", "\"urn:isbn:0451450523\"");
+    JSONT_SCHEMA_INVALID("{\"format\": \"uri\"}", "\"/relative/path\"");
+    JSONT_SCHEMA_INVALID("{\"format\": \"uri\"}", "\"http://a b\"");
+    JSONT_SCHEMA_INVALID("{\"format\": \"uri\"}", "\"http://a/%2\"");
+
+    JSONT_SCHEMA_VALID("{\"format\": \"regex\"}", "\"^[a-z]+(?:-[0-9]{2,})?$\"");
+    JSONT_SCHEMA_VALID("{\"format\": \"regex\"}", "\"a{,b\"");
+    JSONT_SCHEMA_INVALID("{\"format\": \"regex\"}", "\"(abc\"");
+    JSONT_SCHEMA_INVALID("{\"format\": \"regex\"}", "\"[abc\"");
+    JSONT_SCHEMA_INVALID("{\"format\": \"regex\"}", "\"*a\"");
+    JSONT_SCHEMA_INVALID("{\"format\": \"regex\"}", "\"a{3,1}\"");
 }
 
 TEST(numeric) {
@@ -364,6 +550,544 @@ TEST(string) {
                        "[\"1\", true, \"42\"]");
     JSONT_SCHEMA_INVALID("{\"items\": {\"pattern\": \"^[0-9]+$\"}}",
                          "[\"1\", \"42\", \"foo\"]");
+
+    /* pattern: literals */
+    JSONT_SCHEMA_VALID("{\"items\": {\"pattern\": \"ab\"}}",
+                       "[\"ab\", \"xaby\", \"xab\"]");
+    JSONT_SCHEMA_INVALID("{\"items\": {\"pattern\": \"ab\"}}", "[\"a\"]");
+    JSONT_SCHEMA_VALID("{\"items\": {\"pattern\": \"^SKU-\"}}",
+                       "[\"SKU-\", \"SKU-42\"]");
+    JSONT_SCHEMA_INVALID("{\"items\": {\"pattern\": \"^SKU-\"}}",
+                         "[\"xSKU-42\"]");
+    JSONT_SCHEMA_VALID("{\"items\": {\"pattern\": \"\\\\.json$\"}}",
+                       "[\"a.json\", \"b.json\\n\"]");
+    JSONT_SCHEMA_INVALID("{\"items\": {\"pattern\": \"\\\\.json$\"}}",
+                         "[\"a_json\"]");
+    JSONT_SCHEMA_VALID("{\"items\": {\"pattern\": \"^abc$\"}}",
+                       "[\"abc\", \"abc\\n\"]");
+    JSONT_SCHEMA_INVALID("{\"items\": {\"pattern\": \"^abc$\"}}",
+                         "[\"abcd\"]");
+
+    /* pattern: character classes */
+    JSONT_SCHEMA_VALID("{\"items\": {\"pattern\": \"^[0-9a-f]{8}$\"}}",
+                       "[\"0123abcd\", \"deadbeef\\n\"]");
+    JSONT_SCHEMA_INVALID("{\"items\": {\"pattern\": \"^[0-9a-f]{8}$\"}}",
+                         "[\"0123abc\"]");
+    JSONT_SCHEMA_INVALID("{\"items\": {\"pattern\": \"^[0-9a-f]{8}$\"}}",
+                         "[\"0123abcg\"]");
+    JSONT_SCHEMA_VALID("{\"items\": {\"pattern\": \"^[\\\\w.-]{2,4}$\"}}",
+                       "[\"a_\", \"a-b.\"]");
+    JSONT_SCHEMA_INVALID("{\"items\": {\"pattern\": \"^[\\\\w.-]{2,4}$\"}}",
+                         "[\"a\"]");
+    JSONT_SCHEMA_INVALID("{\"items\": {\"pattern\": \"^[\\\\w.-]{2,4}$\"}}",
+                         "[\"abcde\"]");
+    JSONT_SCHEMA_VALID("{\"items\": {\"pattern\": \"^\\\\d*$\"}}",
+                       "[\"\", \"123\"]");
+    JSONT_SCHEMA_INVALID("{\"items\": {\"pattern\": \"^\\\\d*$\"}}",
+                         "[\"12é\"]");
+}
+
+TEST(program) {
+    struct json_schema *schema;
+    struct json_value *value;
+    struct c_buffer *schema_buf, *value_buf;
+
+    /* Constraints only apply to values of their type */
+    JSONT_SCHEMA_VALID("{\"items\": {\"minimum\": 3, \"minLength\": 2,"
+                       "           \"minItems\": 1}}",
+                       "[\"ab\", 4, [1], {}, null]");
+    JSONT_SCHEMA_VALID("{\"type\": \"string\", \"minItems\": 3}", "\"a\"");
+    JSONT_SCHEMA_INVALID("{\"type\": [\"string\", \"null\"],"
+                         " \"minLength\": 2}",
+                         "\"a\"");
+
+    /* Nested lists of sub-schemas */
+    JSONT_SCHEMA_VALID("{\"items\": [{\"anyOf\": [{\"type\": \"null\"},"
+                                                "{\"type\": \"integer\"}]},"
+                       "           {\"allOf\": [{\"type\": \"string\"},"
+                                               "{\"maxLength\": 3}]}],"
+                       " \"additionalItems\": {\"oneOf\": [{\"minimum\": 0},"
+                                                          "{\"maximum\": -10}]}}",
+                       "[null, \"abc\", 1, -20]");
+    JSONT_SCHEMA_INVALID("{\"items\": [{\"anyOf\": [{\"type\": \"null\"},"
+                                                  "{\"type\": \"integer\"}]},"
+                         "           {\"allOf\": [{\"type\": \"string\"},"
+                                                 "{\"maxLength\": 3}]}],"
+                         " \"additionalItems\": {\"oneOf\": [{\"minimum\": 0},"
+                                                            "{\"maximum\": -10}]}}",
+                         "[null, \"abc\", 1, -5]");
+    JSONT_SCHEMA_INVALID("{\"properties\": {\"a\": {\"properties\":"
+                                             "{\"b\": {\"enum\": [1, 2]}}}}}",
+                         "{\"a\": {\"b\": 3}}");
+
+    /* Large member tables */
+    schema_buf = c_buffer_new();
+    value_buf = c_buffer_new();
+
+    c_buffer_add_string(schema_buf, "{\"required\": [");
+    c_buffer_add_string(value_buf, "{");
+    for (int i = 0; i < 300; i++) {
+        c_buffer_add_printf(schema_buf, "%s\"k%d\"", i > 0 ? "," : "", i);
+        c_buffer_add_printf(value_buf, "%s\"k%d\": %d",
+                            i > 0 ? "," : "", i, i);
+    }
+    c_buffer_add_string(schema_buf, "]}");
+    c_buffer_add_string(value_buf, "}");
+
+    schema = json_schema_parse(c_buffer_data(schema_buf),
+                               c_buffer_length(schema_buf));
+    if (!schema)
+        TEST_ABORT("cannot parse schema: %s", c_get_error());
+
+    value = json_parse(c_buffer_data(value_buf),
+                       c_buffer_length(value_buf), JSON_PARSE_DEFAULT);
+    if (!value)
+        TEST_ABORT("cannot parse value: %s", c_get_error());
+
+    TEST_INT_EQ(json_schema_validate(schema, value), 0);
+
+    json_object_remove_member(value, "k299");
+    TEST_INT_EQ(json_schema_validate(schema, value), -1);
+
+    json_value_delete(value);
+    json_schema_delete(schema);
+
+    c_buffer_delete(schema_buf);
+    c_buffer_delete(value_buf);
+
+    /* Compiling a schema twice is a no-op */
+    schema = json_schema_parse_string("{\"type\": \"integer\"}");
+    if (!schema)
+        TEST_ABORT("cannot parse schema: %s", c_get_error());
+
+    TEST_INT_EQ(json_schema_compile(schema), 0);
+
+    value = json_integer_new(42);
+    TEST_INT_EQ(json_schema_validate(schema, value), 0);
+    json_value_delete(value);
+
+    value = json_null_new();
+    TEST_INT_EQ(json_schema_validate(schema, value), -1);
+    json_value_delete(value);
+
+    json_schema_delete(schema);
+}
+
+TEST(parse_validate) {
+    struct json_schema *schema;
+    struct json_value *value;
+    const char *schema_string, *string;
+
+    schema_string = "{\"type\": \"object\","
+                    " \"required\": [\"id\"],"
+                    " \"additionalProperties\": false,"
+                    " \"properties\": {"
+                    "   \"id\": {\"type\": \"integer\"},"
+                    "   \"tags\": {\"type\": \"array\", \"maxItems\": 2,"
+                    "              \"items\": {\"type\": \"string\"}}}}";
+
+    schema = json_schema_parse_string(schema_string);
+    if (!schema)
+        TEST_ABORT("cannot parse schema: %s", c_get_error());
+
+    /* Valid documents */
+    string = "{\"id\": 1, \"tags\": [\"a\", \"b\"]}";
+    TEST_INT_EQ(json_parse_validate(string, strlen(string),
+                                    JSON_PARSE_DEFAULT, schema, NULL), 0);
+
+    value = NULL;
+    TEST_INT_EQ(json_parse_validate(string, strlen(string),
+                                    JSON_PARSE_DEFAULT, schema, &value), 0);
+    TEST_INT_EQ(json_value_type(value), JSON_OBJECT);
+    TEST_UINT_EQ(json_object_nb_members(value), 2);
+    json_value_delete(value);
+
+    /* Invalid documents are rejected before the end of the data, even if
+     * the rest is not well-formed. */
+    string = "[";
+    TEST_INT_EQ(json_parse_validate(string, strlen(string),
+                                    JSON_PARSE_DEFAULT, schema, NULL), -1);
+    TEST_STRING_EQ(c_get_error(), "value does not match 'type' constraint");
+
+    string = "{\"id\": 1, \"name\": ";
+    TEST_INT_EQ(json_parse_validate(string, strlen(string),
+                                    JSON_PARSE_DEFAULT, schema, NULL), -1);
+    TEST_STRING_EQ(c_get_error(), "object contains additional members");
+
+    string = "{\"tags\": [\"a\", \"b\", \"c\"";
+    TEST_INT_EQ(json_parse_validate(string, strlen(string),
+                                    JSON_PARSE_DEFAULT, schema, NULL), -1);
+    TEST_STRING_EQ(c_get_error(), "object member 0 does not match "
+                   "'properties' constraint: array contains too many "
+                   "elements");
+
+    /* Syntax errors are reported as such */
+    string = "{\"id\": 1,, }";
+    TEST_INT_EQ(json_parse_validate(string, strlen(string),
+                                    JSON_PARSE_DEFAULT, schema, NULL), -1);
+    TEST_STRING_EQ(c_get_error(), "key in object member is not a string");
+
+    /* Required members are checked at the end of the object */
+    string = "{\"tags\": []}";
+    TEST_INT_EQ(json_parse_validate(string, strlen(string),
+                                    JSON_PARSE_DEFAULT, schema, NULL), -1);
+    TEST_STRING_EQ(c_get_error(), "object does not contain required members");
+
+    /* Parse options still apply */
+    string = "{\"id\": 1, \"id\": 2}";
+    TEST_INT_EQ(json_parse_validate(string, strlen(string),
+                                    JSON_PARSE_REJECT_DUPLICATE_KEYS, schema,
+                                    NULL), -1);
+    TEST_STRING_EQ(c_get_error(), "duplicate object key");
+
+    string = "{\"id\": 1, \"tags\": [\"a\"]}";
+    TEST_INT_EQ(json_parse_validate(string, strlen(string),
+                                    JSON_PARSE_REJECT_DUPLICATE_KEYS, schema,
+                                    NULL), 0);
+
+    json_schema_delete(schema);
+}
+
+static bool
+jsont_format_is_even(const char *string, size_t len, void *data) {
+    return len % 2 == 0;
+}
+
+TEST(format) {
+    struct json_schema *schema;
+
+    TEST_PTR_NULL(json_schema_parse_string("{\"format\": \"even\"}"));
+
+    TEST_INT_EQ(json_schema_format_register("even", jsont_format_is_even,
+                                            NULL), 0);
+    TEST_INT_EQ(json_schema_format_register("even", jsont_format_is_even,
+                                            NULL), -1);
+    TEST_INT_EQ(json_schema_format_register("ipv4", jsont_format_is_even,
+                                            NULL), -1);
+
+    JSONT_SCHEMA_VALID("{\"format\": \"even\"}", "\"ab\"");
+    JSONT_SCHEMA_INVALID("{\"format\": \"even\"}", "\"abc\"");
+
+    schema = json_schema_parse_string("{\"format\": \"even\"}");
+    TEST_PTR_NOT_NULL(schema);
+    json_schema_delete(schema);
+}
+
+TEST(parallel) {
+    struct json_schema_pool *pool;
+    struct json_schema *schema;
+    struct json_value *value, *object;
+    char *error;
+
+    pool = json_schema_pool_new(4);
+    if (!pool)
+        TEST_ABORT("cannot create pool: %s", c_get_error());
+
+    schema = json_schema_parse_string("{\"items\": {\"allOf\": ["
+                                      "  {\"type\": \"object\"},"
+                                      "  {\"additionalProperties\":"
+                                      "     {\"type\": \"integer\"}}]}}");
+    if (!schema)
+        TEST_ABORT("cannot parse schema: %s", c_get_error());
+
+    value = json_array_new();
+    for (int i = 0; i < 2000; i++) {
+        object = json_object_new();
+        for (int j = 0; j < 300; j++) {
+            char key[32];
+
+            snprintf(key, sizeof(key), "m%d", j);
+            json_object_add_member(object, key, json_integer_new(i + j));
+        }
+
+        json_array_add_element(value, object);
+    }
+
+    TEST_INT_EQ(json_schema_validate_parallel(schema, value, pool), 0);
+
+    /* The first error is reported whatever the order of the checks */
+    json_object_set_member(json_array_element(value, 1500), "m250",
+                           json_string_new("foo"));
+    json_object_set_member(json_array_element(value, 1200), "m270",
+                           json_null_new());
+    json_object_set_member(json_array_element(value, 1200), "m10",
+                           json_null_new());
+
+    TEST_INT_EQ(json_schema_validate(schema, value), -1);
+    error = c_strdup(c_get_error());
+
+    for (int i = 0; i < 10; i++) {
+        TEST_INT_EQ(json_schema_validate_parallel(schema, value, pool), -1);
+        TEST_STRING_EQ(c_get_error(), error);
+    }
+
+    c_free(error);
+    json_value_delete(value);
+    json_schema_delete(schema);
+    json_schema_pool_delete(pool);
+}
+
+TEST(ref) {
+    const char *schema_string;
+
+    /* Definitions */
+    schema_string = "{\"definitions\": {"
+                    "   \"positive\": {\"type\": \"integer\", \"minimum\": 1}},"
+                    " \"properties\": {"
+                    "   \"a\": {\"$ref\": \"#/definitions/positive\"},"
+                    "   \"b\": {\"$ref\": \"#/definitions/positive\"}}}";
+    JSONT_SCHEMA_VALID(schema_string, "{\"a\": 1, \"b\": 2}");
+    JSONT_SCHEMA_INVALID(schema_string, "{\"a\": 1, \"b\": 0}");
+    JSONT_SCHEMA_INVALID(schema_string, "{\"a\": \"1\"}");
+
+    /* Recursive schemas */
+    schema_string = "{\"type\": \"object\","
+                    " \"required\": [\"value\"],"
+                    " \"properties\": {"
+                    "   \"value\": {\"type\": \"integer\"},"
+                    "   \"children\": {\"type\": \"array\","
+                    "                  \"items\": {\"$ref\": \"#\"}}}}";
+    JSONT_SCHEMA_VALID(schema_string, "{\"value\": 1}");
+    JSONT_SCHEMA_VALID(schema_string,
+                       "{\"value\": 1, \"children\": ["
+                       "  {\"value\": 2, \"children\": [{\"value\": 3}]},"
+                       "  {\"value\": 4}]}");
+    JSONT_SCHEMA_INVALID(schema_string,
+                         "{\"value\": 1, \"children\": ["
+                         "  {\"value\": 2, \"children\": [{\"value\": \"3\"}]}]}");
+    JSONT_SCHEMA_INVALID(schema_string,
+                         "{\"value\": 1, \"children\": [{\"children\": []}]}");
+
+    /* Chains of references and identifiers */
+    schema_string = "{\"definitions\": {"
+                    "   \"a\": {\"$ref\": \"#/definitions/b\"},"
+                    "   \"b\": {\"id\": \"#string\", \"type\": \"string\"}},"
+                    " \"items\": [{\"$ref\": \"#/definitions/a\"},"
+                    "             {\"$ref\": \"#string\"}]}";
+    JSONT_SCHEMA_VALID(schema_string, "[\"a\", \"b\"]");
+    JSONT_SCHEMA_INVALID(schema_string, "[\"a\", 2]");
+    JSONT_SCHEMA_INVALID(schema_string, "[1]");
+
+    /* Escaped pointers */
+    schema_string = "{\"definitions\": {\"a/b~c d\": {\"type\": \"null\"}},"
+                    " \"items\": {\"$ref\": \"#/definitions/a~1b~0c%20d\"}}";
+    JSONT_SCHEMA_VALID(schema_string, "[null]");
+    JSONT_SCHEMA_INVALID(schema_string, "[true]");
+
+    /* Invalid references */
+    TEST_PTR_NULL(json_schema_parse_string("{\"$ref\": \"#\"}"));
+    TEST_STRING_EQ(c_get_error(), "circular reference '#'");
+
+    TEST_PTR_NULL(json_schema_parse_string(
+        "{\"definitions\": {\"a\": {\"$ref\": \"#/definitions/b\"},"
+        "                   \"b\": {\"$ref\": \"#/definitions/a\"}}}"));
+
+    TEST_PTR_NULL(json_schema_parse_string(
+        "{\"items\": {\"$ref\": \"#/definitions/foo\"}}"));
+    TEST_STRING_EQ(c_get_error(),
+                   "cannot resolve reference '#/definitions/foo'");
+
+    TEST_PTR_NULL(json_schema_parse_string(
+        "{\"items\": {\"$ref\": \"http://example.com/schema#\"}}"));
+
+    TEST_PTR_NULL(json_schema_parse_string(
+        "{\"definitions\": {}, \"items\": {\"$ref\": \"#/definitions\"}}"));
+    TEST_STRING_EQ(c_get_error(),
+                   "reference '#/definitions' does not point to a schema");
+}
+
+TEST(all_errors) {
+    struct json_schema_error errors[8];
+    struct json_schema *schema;
+    struct json_value *value;
+    size_t nb_errors;
+
+    schema = json_schema_parse_string(
+        "{\"type\": \"object\","
+        " \"required\": [\"id\", \"name\"],"
+        " \"additionalProperties\": false,"
+        " \"properties\": {"
+        "   \"id\": {\"type\": \"integer\", \"minimum\": 1},"
+        "   \"name\": {\"type\": \"string\"},"
+        "   \"a/b\": {\"type\": \"string\", \"maxLength\": 2},"
+        "   \"tags\": {\"items\": {\"type\": \"string\"}}}}");
+    if (!schema)
+        TEST_ABORT("cannot parse schema: %s", c_get_error());
+
+    value = json_parse_string("{\"id\": 0, \"a/b\": \"foo\","
+                              " \"tags\": [\"a\", 2, \"c\", null],"
+                              " \"x\": true}", JSON_PARSE_DEFAULT);
+    if (!value)
+        TEST_ABORT("cannot parse value: %s", c_get_error());
+
+    TEST_INT_EQ(json_schema_validate_all(schema, value, errors, 8,
+                                         &nb_errors), -1);
+    TEST_UINT_EQ(nb_errors, 6);
+
+    TEST_INT_EQ(errors[0].code, JSON_SCHEMA_ERROR_MINIMUM);
+    TEST_STRING_EQ(errors[0].pointer, "/id");
+    TEST_STRING_EQ(errors[0].schema_path, "/properties/id/minimum");
+
+    TEST_INT_EQ(errors[1].code, JSON_SCHEMA_ERROR_MAX_LENGTH);
+    TEST_STRING_EQ(errors[1].pointer, "/a~1b");
+    TEST_STRING_EQ(errors[1].schema_path, "/properties/a~1b/maxLength");
+
+    TEST_INT_EQ(errors[2].code, JSON_SCHEMA_ERROR_TYPE);
+    TEST_STRING_EQ(errors[2].pointer, "/tags/1");
+    TEST_STRING_EQ(errors[2].schema_path, "/properties/tags/items/type");
+
+    TEST_STRING_EQ(errors[3].pointer, "/tags/3");
+
+    TEST_INT_EQ(errors[4].code, JSON_SCHEMA_ERROR_ADDITIONAL_PROPERTIES);
+    TEST_STRING_EQ(errors[4].pointer, "/x");
+    TEST_STRING_EQ(errors[4].schema_path, "/additionalProperties");
+
+    TEST_INT_EQ(errors[5].code, JSON_SCHEMA_ERROR_REQUIRED);
+    TEST_STRING_EQ(errors[5].pointer, "");
+    TEST_STRING_EQ(errors[5].schema_path, "/required/1");
+
+    json_schema_errors_free(errors, nb_errors);
+
+    /* The error budget stops validation */
+    TEST_INT_EQ(json_schema_validate_all(schema, value, errors, 2,
+                                         &nb_errors), -1);
+    TEST_UINT_EQ(nb_errors, 2);
+    TEST_STRING_EQ(errors[1].pointer, "/a~1b");
+    json_schema_errors_free(errors, nb_errors);
+
+    TEST_FALSE(json_schema_is_valid(schema, value));
+    json_value_delete(value);
+
+    value = json_parse_string("{\"id\": 1, \"name\": \"foo\"}",
+                              JSON_PARSE_DEFAULT);
+    TEST_INT_EQ(json_schema_validate_all(schema, value, errors, 8,
+                                         &nb_errors), 0);
+    TEST_UINT_EQ(nb_errors, 0);
+    TEST_TRUE(json_schema_is_valid(schema, value));
+    json_value_delete(value);
+
+    json_schema_delete(schema);
+
+    /* Failed branches of anyOf are not reported */
+    schema = json_schema_parse_string(
+        "{\"items\": {\"anyOf\": [{\"type\": \"integer\"},"
+        "                         {\"type\": \"string\"}]}}");
+    value = json_parse_string("[1, \"a\", true]", JSON_PARSE_DEFAULT);
+
+    TEST_INT_EQ(json_schema_validate_all(schema, value, errors, 8,
+                                         &nb_errors), -1);
+    TEST_UINT_EQ(nb_errors, 1);
+    TEST_INT_EQ(errors[0].code, JSON_SCHEMA_ERROR_ANY_OF);
+    TEST_STRING_EQ(errors[0].pointer, "/2");
+    TEST_STRING_EQ(errors[0].schema_path, "/items/anyOf");
+    json_schema_errors_free(errors, nb_errors);
+
+    json_value_delete(value);
+    json_schema_delete(schema);
+}
+
+static char *
+jsont_schema_loader(const char *uri, size_t *plen, void *data) {
+    const char **documents;
+
+    documents = data;
+
+    for (size_t i = 0; documents[i]; i += 2) {
+        if (strcmp(documents[i], uri) == 0) {
+            *plen = strlen(documents[i + 1]);
+            return c_strdup(documents[i + 1]);
+        }
+    }
+
+    c_set_error("unknown document");
+    return NULL;
+}
+
+TEST(registry) {
+    struct json_schema_registry *registry;
+    struct json_schema *schema, *schema2;
+    struct json_value *value;
+    const char *string;
+    const char *documents[] = {
+        "http://example.com/common.json",
+        "{\"definitions\": {\"id\": {\"type\": \"integer\"}}}",
+        "http://example.com/a.json",
+        "{\"$ref\": \"b.json\"}",
+        "http://example.com/b.json",
+        "{\"items\": {\"$ref\": \"a.json\"}}",
+        NULL,
+    };
+
+    registry = json_schema_registry_new();
+    json_schema_registry_set_loader(registry, jsont_schema_loader, documents);
+
+    /* References to other documents */
+    string = "{\"properties\": {\"id\": {\"$ref\": "
+             "  \"common.json#/definitions/id\"}}}";
+    TEST_INT_EQ(json_schema_registry_add(registry,
+                                         "http://example.com/user.json",
+                                         string, strlen(string)), 1);
+
+    schema = json_schema_registry_get(registry,
+                                      "http://example.com/user.json#");
+    TEST_PTR_NOT_NULL(schema);
+
+    value = json_parse_string("{\"id\": 1}", JSON_PARSE_DEFAULT);
+    TEST_INT_EQ(json_schema_validate(schema, value), 0);
+    json_value_delete(value);
+
+    value = json_parse_string("{\"id\": \"1\"}", JSON_PARSE_DEFAULT);
+    TEST_INT_EQ(json_schema_validate(schema, value), -1);
+    json_value_delete(value);
+
+    /* Documents which did not change are kept */
+    TEST_INT_EQ(json_schema_registry_add(registry,
+                                         "http://example.com/user.json",
+                                         string, strlen(string)), 0);
+
+    schema2 = json_schema_registry_get(registry,
+                                       "http://example.com/user.json");
+    TEST_PTR_EQ(schema2, schema);
+    json_schema_delete(schema2);
+
+    /* Documents referencing a document which changed are resolved again;
+     * schemas obtained before stay valid. */
+    string = "{\"definitions\": {\"id\": {\"type\": \"string\"}}}";
+    TEST_INT_EQ(json_schema_registry_add(registry,
+                                         "http://example.com/common.json",
+                                         string, strlen(string)), 1);
+
+    schema2 = json_schema_registry_get(registry,
+                                       "http://example.com/user.json");
+    TEST_PTR_NOT_NULL(schema2);
+    TEST_TRUE(schema2 != schema);
+
+    value = json_parse_string("{\"id\": \"1\"}", JSON_PARSE_DEFAULT);
+    TEST_INT_EQ(json_schema_validate(schema, value), -1);
+    TEST_INT_EQ(json_schema_validate(schema2, value), 0);
+    json_value_delete(value);
+
+    json_schema_delete(schema2);
+    json_schema_delete(schema);
+
+    /* Documents designated by the id of their root schema */
+    string = "{\"id\": \"http://example.com/schemas/name#\","
+             " \"type\": \"string\"}";
+    TEST_INT_EQ(json_schema_registry_add(registry, "name.json",
+                                         string, strlen(string)), 1);
+
+    schema = json_schema_registry_get(registry,
+                                      "http://example.com/schemas/name");
+    TEST_PTR_NOT_NULL(schema);
+    json_schema_delete(schema);
+
+    /* Errors */
+    TEST_PTR_NULL(json_schema_registry_get(registry,
+                                           "http://example.com/c.json"));
+    TEST_PTR_NULL(json_schema_registry_get(registry,
+                                           "http://example.com/a.json"));
+
+    json_schema_registry_delete(registry);
 }
 
 #undef JSONT_SCHEMA_VALID
@@ -380,10 +1104,18 @@ main(int argc, char **argv) {
 
     TEST_RUN(suite, empty);
     TEST_RUN(suite, array);
+    TEST_RUN(suite, unique_items);
     TEST_RUN(suite, object);
     TEST_RUN(suite, generic);
     TEST_RUN(suite, numeric);
     TEST_RUN(suite, string);
+    TEST_RUN(suite, program);
+    TEST_RUN(suite, parse_validate);
+    TEST_RUN(suite, format);
+    TEST_RUN(suite, parallel);
+    TEST_RUN(suite, ref);
+    TEST_RUN(suite, all_errors);
+    TEST_RUN(suite, registry);
 
     test_suite_print_results_and_exit(suite);
 }